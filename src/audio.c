@@ -30,6 +30,22 @@ static struct controllable audio_initializing_controllable;
 
 #define AUDIO_SLEEP_US 200000
 
+#define AUDIO_STREAM_FRAMES (1 << 17)	//Ring length. Around 3 s at usual rates.
+#define AUDIO_STREAM_CHUNK_FRAMES 4096
+#define AUDIO_STREAM_PREFILL_FRAMES (AUDIO_STREAM_FRAMES - AUDIO_STREAM_CHUNK_FRAMES)	//The whole ring.
+#define AUDIO_STREAM_SLEEP_US 10000
+
+//Single producer and single consumer ring protected by the audio mutex. The producer is the task thread and the consumer is the audio callback.
+struct audio_stream
+{
+  guint8 *data;
+  guint frame_size;
+  guint64 read;
+  guint64 write;
+  gboolean finished;
+  gboolean underrun;		//Any underrun inserts silence in the signal so the stream is not valid anymore.
+};
+
 void audio_init_int ();
 void audio_destroy_int ();
 const gchar *audio_name ();
@@ -99,6 +115,65 @@ audio_is_stopped ()
   return s == AUDIO_STATUS_STOPPED;
 }
 
+//Returns TRUE when the playback must stop.
+//The stream is stereo and already in the playback format, so there is no selection, looping nor mono mixing.
+
+static gboolean
+audio_write_stream_to_output (void *buffer, gint frames)
+{
+  guint8 *src, *dst = buffer;
+  guint64 available;
+  struct audio_stream *stream = audio.stream;
+
+  memset (buffer, 0, frames * stream->frame_size);
+
+  if (audio.status == AUDIO_STATUS_PREPARING_PLAYBACK)
+    {
+      audio.status = AUDIO_STATUS_PLAYING;
+      return FALSE;
+    }
+
+  if (audio.status == AUDIO_STATUS_STOPPING_PLAYBACK)
+    {
+      return TRUE;
+    }
+
+  available = stream->write - stream->read;
+  if (!available)
+    {
+      if (!stream->finished && !stream->underrun)
+	{
+	  debug_print (1, "Stream underrun");
+	  stream->underrun = TRUE;
+	}
+      return stream->finished || stream->underrun;
+    }
+
+  debug_print (2, "Writing %d stream frames...", frames);
+
+  for (gint i = 0; i < frames && stream->read < stream->write; i++)
+    {
+      src = &stream->data[(stream->read % AUDIO_STREAM_FRAMES) *
+			  stream->frame_size];
+      if (audio.float_mode)
+	{
+	  audio_copy_sample_f32 ((gfloat *) dst, (gfloat *) src);
+	  audio_copy_sample_f32 ((gfloat *) dst + 1, (gfloat *) src + 1);
+	}
+      else
+	{
+	  audio_copy_sample_s16 ((gint16 *) dst, (gint16 *) src);
+	  audio_copy_sample_s16 ((gint16 *) dst + 1, (gint16 *) src + 1);
+	}
+      dst += stream->frame_size;
+      stream->read++;
+    }
+
+  audio.pos = stream->read;
+
+  return FALSE;
+}
+
 void
 audio_write_to_output (void *buffer, gint frames)
 {
@@ -113,6 +188,12 @@ audio_write_to_output (void *buffer, gint frames)
 
   sample_info = audio.sample.info;
 
+  if (audio.stream)
+    {
+      stopping = audio_write_stream_to_output (buffer, frames);
+      goto end;
+    }
+
   if (!sample_info)
     {
       goto end;
@@ -259,7 +340,7 @@ audio_write_to_output (void *buffer, gint frames)
     }
 
 end:
-  if (!sample_info || stopping)
+  if ((!sample_info && !audio.stream) || stopping)
     {
       audio.release_frames += frames;
       if (audio.cursor_notifier)
@@ -620,6 +701,124 @@ audio_set_play_and_wait (struct idata *sample, struct task_control *control)
     }
 }
 
+static void
+audio_stream_push (struct audio_stream *stream, guint8 *data, guint frames)
+{
+  guint pos, len;
+
+  g_mutex_lock (&audio.control.controllable.mutex);
+  pos = stream->write % AUDIO_STREAM_FRAMES;
+  len = MIN (frames, AUDIO_STREAM_FRAMES - pos);
+  memcpy (&stream->data[pos * stream->frame_size], data,
+	  len * stream->frame_size);
+  memcpy (stream->data, &data[len * stream->frame_size],
+	  (frames - len) * stream->frame_size);
+  stream->write += frames;
+  if (!frames)
+    {
+      stream->finished = TRUE;
+    }
+  g_mutex_unlock (&audio.control.controllable.mutex);
+}
+
+//Frames are pulled from the reader as there is room in the ring, so memory is bounded regardless of the stream length.
+//Playback starts when the ring is full and the ring keeps filling while playing. This gives the reader around 3 s of margin to recover from a slow period.
+//As the stream might carry data, an underrun stops the playback and is an error.
+
+gint
+audio_set_play_stream_and_wait (audio_stream_reader reader, void *data,
+				guint64 frames, struct task_control *control)
+{
+  gint n, err = 0;
+  guint8 *chunk;
+  guint64 space, pos, written;
+  gboolean active = TRUE, started = FALSE, finished = FALSE, underrun;
+  struct audio_stream *stream;
+
+  audio_reset_sample ();
+
+  stream = g_malloc (sizeof (struct audio_stream));
+  stream->frame_size = FRAME_SIZE (AUDIO_CHANNELS,
+				   sample_get_internal_format ());
+  stream->data = g_malloc (AUDIO_STREAM_FRAMES * stream->frame_size);
+  stream->read = 0;
+  stream->write = 0;
+  stream->finished = FALSE;
+  stream->underrun = FALSE;
+  chunk = g_malloc (AUDIO_STREAM_CHUNK_FRAMES * stream->frame_size);
+
+  g_mutex_lock (&audio.control.controllable.mutex);
+  audio.stream = stream;
+  audio.control.callback = NULL;
+  audio.sel_start = -1;
+  audio.sel_end = -1;
+  g_mutex_unlock (&audio.control.controllable.mutex);
+
+  while (active)
+    {
+      if (started && audio_is_stopped ())
+	{
+	  break;
+	}
+
+      g_mutex_lock (&audio.control.controllable.mutex);
+      written = stream->write;
+      space = AUDIO_STREAM_FRAMES - (stream->write - stream->read);
+      pos = stream->read;
+      g_mutex_unlock (&audio.control.controllable.mutex);
+
+      if (!started && (finished || written >= AUDIO_STREAM_PREFILL_FRAMES))
+	{
+	  debug_print (1, "Starting stream playback...");
+	  audio_start_playback (NULL);
+	  started = TRUE;
+	}
+
+      if (!finished && space >= AUDIO_STREAM_CHUNK_FRAMES)
+	{
+	  n = reader (data, chunk, AUDIO_STREAM_CHUNK_FRAMES);
+	  if (n < 0)
+	    {
+	      error_print ("Error while reading stream");
+	      err = n;
+	      break;
+	    }
+	  audio_stream_push (stream, chunk, n);
+	  finished = !n;
+	}
+      else
+	{
+	  usleep (AUDIO_STREAM_SLEEP_US);
+	}
+
+      //This is also checked while filling the ring as the reader might not be much faster than real time.
+      if (control)
+	{
+	  task_control_set_progress (control, pos / (gdouble) frames);
+	  active = controllable_is_active (&control->controllable);
+	}
+    }
+
+  //Without the stream and the sample, the audio callback stops the playback.
+  g_mutex_lock (&audio.control.controllable.mutex);
+  audio.stream = NULL;
+  underrun = stream->underrun;
+  pos = stream->read;
+  g_mutex_unlock (&audio.control.controllable.mutex);
+
+  if (underrun && !err)
+    {
+      error_print ("Stream underrun at frame %" PRIu64, pos);
+      err = -EIO;
+    }
+
+  g_free (stream->data);
+  g_free (stream);
+  g_free (chunk);
+
+  return err;
+}
+
 void
 audio_record_and_wait (guint32 options, struct task_control *control)
 {
@@ -59,6 +59,12 @@ enum audio_status
   AUDIO_STATUS_STOPPED
 };
 
+//Writes up to the given frames in the playback format and returns the frames written. 0 means the end of the stream and negative values are errors.
+typedef gint (*audio_stream_reader) (void *data, guint8 * buffer,
+				     guint frames);
+
+struct audio_stream;
+
 struct audio
 {
 // PulseAudio or RtAudio backend
@@ -79,6 +85,7 @@ struct audio
   gboolean float_mode;
   guint32 rate;
   struct idata sample;
+  struct audio_stream *stream;	//If set, playback is pulled from this instead of the sample.
   struct sample_info sample_info_src;
   gboolean loop;
   guint32 pos;
@@ -139,6 +146,10 @@ void audio_init_and_wait ();
 void audio_set_play_and_wait (struct idata *sample,
 			      struct task_control *control);
 
+gint audio_set_play_stream_and_wait (audio_stream_reader reader, void *data,
+				     guint64 frames,
+				     struct task_control *control);
+
 void audio_record_and_wait (guint32 options, struct task_control *control);
 
 #endif
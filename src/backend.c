@@ -18,14 +18,19 @@
  *   along with Elektroid. If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <sys/stat.h>
 #include "backend.h"
 #include "local.h"
 #include "sample.h"
 #include "preferences.h"
 #include "utils.h"
 
-// This can be allocated statically as the only function that uses it is synchronized.
-static guint8 tmp_buffer[BE_MAX_BUFF_SIZE];
+#define BE_PACING_FILE "/pacing.json"
+#define BE_PACING_KEY_REST_TIME "restTime"
+#define BE_PACING_KEY_LATENCY "latency"
+#define BE_CONNECTORS_FILE "/connectors.json"
+#define BE_CONNECTORS_KEY_CONNECTOR "connector"
+#define BE_CONNECTORS_KEY_FILESYSTEMS "filesystems"
 
 struct connector *system_connector = NULL;
 GSList *connectors = NULL;
@@ -85,6 +90,8 @@ sysex_transfer_init (struct sysex_transfer *sysex_transfer, gint timeout,
   sysex_transfer->timeout = timeout;
   sysex_transfer->time = 0;
   sysex_transfer->batch = batch;
+  sysex_transfer->dry_run = FALSE;
+  sysex_transfer->probe = FALSE;
   sysex_transfer->raw = data;
   sysex_transfer->err = 0;
 }
@@ -192,12 +199,14 @@ backend_midi_handshake (struct backend *backend)
 
   if (rx_msg->data[4] == 2)
     {
-      if (rx_msg->len == 15 || rx_msg->len == 17)
+      //Some devices, like the Eventide pedals, append additional data after the version. These use 1 byte company IDs.
+      if (rx_msg->len == 15 || rx_msg->len == 17 ||
+	  (rx_msg->len > 17 && rx_msg->data[5]))
 	{
-	  offset = rx_msg->len - 15;
+	  offset = rx_msg->len == 17 ? 2 : 0;
 	  memset (backend->midi_info.company, 0, BE_COMPANY_LEN);
 	  memcpy (backend->midi_info.company, &rx_msg->data[5],
-		  rx_msg->len == 15 ? 1 : BE_COMPANY_LEN);
+		  offset ? BE_COMPANY_LEN : 1);
 	  memcpy (backend->midi_info.family, &rx_msg->data[6 + offset],
 		  BE_FAMILY_LEN);
 	  memcpy (backend->midi_info.model, &rx_msg->data[8 + offset],
@@ -236,13 +245,198 @@ backend_midi_handshake (struct backend *backend)
   usleep (BE_REST_TIME_US);
 }
 
+gint
+backend_capture_start (struct backend *backend, const gchar *path)
+{
+  guint8 version = BE_CAPTURE_VERSION;
+
+  backend->capture = fopen (path, "wb");
+  if (!backend->capture)
+    {
+      error_print ("Error while opening capture file %s", path);
+      return -errno;
+    }
+
+  debug_print (1, "Capturing SysEx messages into %s...", path);
+
+  backend->capture_start = g_get_monotonic_time ();
+  fwrite (BE_CAPTURE_MAGIC, 1, strlen (BE_CAPTURE_MAGIC), backend->capture);
+  fwrite (&version, 1, 1, backend->capture);
+
+  return 0;
+}
+
+void
+backend_capture_stop (struct backend *backend)
+{
+  g_mutex_lock (&backend->capture_mutex);
+  if (backend->capture)
+    {
+      debug_print (1, "Stopping SysEx capture...");
+      fclose (backend->capture);
+      backend->capture = NULL;
+    }
+  g_mutex_unlock (&backend->capture_mutex);
+}
+
+static void
+backend_capture_write (struct backend *backend, enum backend_capture_dir dir,
+		       const guint8 *data, guint len)
+{
+  guint8 d = dir;
+  guint64 time;
+  guint32 l;
+
+  g_mutex_lock (&backend->capture_mutex);
+  if (backend->capture)
+    {
+      time = GUINT64_TO_LE (g_get_monotonic_time () -
+			    backend->capture_start);
+      l = GUINT32_TO_LE (len);
+      fwrite (&d, 1, 1, backend->capture);
+      fwrite (&time, sizeof (guint64), 1, backend->capture);
+      fwrite (&l, sizeof (guint32), 1, backend->capture);
+      fwrite (data, 1, len, backend->capture);
+    }
+  g_mutex_unlock (&backend->capture_mutex);
+}
+
+//Transmitted buffers might contain several SysEx messages, so they are recorded one by one.
+
+static void
+backend_capture_write_tx (struct backend *backend, const guint8 *data,
+			  guint len)
+{
+  const guint8 *end = data + len;
+  const guint8 *msg_end;
+
+  if (!backend->capture)
+    {
+      return;
+    }
+
+  while (data < end && (msg_end = memchr (data, 0xf7, end - data)))
+    {
+      backend_capture_write (backend, BE_CAPTURE_TX, data,
+			     msg_end - data + 1);
+      data = msg_end + 1;
+    }
+}
+
+void
+backend_capture_record_free (gpointer data)
+{
+  struct backend_capture_record *record = data;
+  free_msg (record->data);
+  g_free (record);
+}
+
+gint
+backend_capture_load (const gchar *path, GSList **records)
+{
+  gint err;
+  guint8 *data, *end;
+  guint64 time;
+  guint32 len;
+  struct idata idata;
+  struct backend_capture_record *record;
+  guint header_len = strlen (BE_CAPTURE_MAGIC) + 1;
+
+  *records = NULL;
+
+  err = file_load (path, &idata, NULL);
+  if (err)
+    {
+      error_print ("Error while loading capture file %s", path);
+      return err;
+    }
+
+  data = idata.content->data;
+  end = data + idata.content->len;
+
+  if (idata.content->len < header_len ||
+      memcmp (data, BE_CAPTURE_MAGIC, header_len - 1) ||
+      data[header_len - 1] != BE_CAPTURE_VERSION)
+    {
+      error_print ("Invalid capture file %s", path);
+      idata_clear (&idata);
+      return -EINVAL;
+    }
+
+  data += header_len;
+
+  while (data < end)
+    {
+      if (end - data < 13)
+	{
+	  err = -EINVAL;
+	  break;
+	}
+
+      memcpy (&time, data + 1, sizeof (guint64));
+      memcpy (&len, data + 9, sizeof (guint32));
+      len = GUINT32_FROM_LE (len);
+
+      if (end - data - 13 < len)
+	{
+	  err = -EINVAL;
+	  break;
+	}
+
+      record = g_malloc (sizeof (struct backend_capture_record));
+      record->dir = *data == BE_CAPTURE_TX ? BE_CAPTURE_TX : BE_CAPTURE_RX;
+      record->time = GUINT64_FROM_LE (time);
+      record->data = g_byte_array_sized_new (len);
+      g_byte_array_append (record->data, data + 13, len);
+      *records = g_slist_prepend (*records, record);
+
+      data += 13 + len;
+    }
+
+  idata_clear (&idata);
+
+  *records = g_slist_reverse (*records);
+
+  if (err)
+    {
+      error_print ("Truncated capture file %s", path);
+    }
+
+  debug_print (1, "%d records loaded from capture file %s",
+	       g_slist_length (*records), path);
+
+  return err;
+}
+
 //Not synchronized
 
 gint
 backend_tx_sysex (struct backend *backend, struct sysex_transfer *transfer,
 		  struct controllable *controllable)
 {
-  return backend_tx_sysex_int (backend, transfer, controllable);
+  guint msgs = 0;
+  guint8 *data = transfer->raw->data;
+  guint8 *end = data + transfer->raw->len;
+  gint err = backend_tx_sysex_int (backend, transfer, controllable);
+
+  if (!err)
+    {
+      while ((data = memchr (data, 0xf7, end - data)))
+	{
+	  msgs++;
+	  data++;
+	}
+
+      g_mutex_lock (&backend->stats_mutex);
+      backend->stats.tx_msgs += msgs;
+      backend->stats.tx_bytes += transfer->raw->len;
+      g_mutex_unlock (&backend->stats_mutex);
+
+      backend_capture_write_tx (backend, transfer->raw->data,
+				transfer->raw->len);
+    }
+
+  return err;
 }
 
 //Synchronized
@@ -278,6 +472,424 @@ backend_rx (struct backend *backend, gint timeout,
   return sysex_transfer_steal (&transfer);
 }
 
+void
+backend_stats_reset (struct backend *backend)
+{
+  g_mutex_lock (&backend->stats_mutex);
+  memset (&backend->stats, 0, sizeof (struct backend_stats));
+  g_mutex_unlock (&backend->stats_mutex);
+}
+
+void
+backend_stats_get (struct backend *backend, struct backend_stats *stats)
+{
+  g_mutex_lock (&backend->stats_mutex);
+  *stats = backend->stats;
+  g_mutex_unlock (&backend->stats_mutex);
+}
+
+void
+backend_stats_add_retry (struct backend *backend)
+{
+  g_mutex_lock (&backend->stats_mutex);
+  backend->stats.retries++;
+  g_mutex_unlock (&backend->stats_mutex);
+}
+
+static void
+backend_stats_add_latency (struct backend *backend, gint64 latency)
+{
+  guint bucket;
+  gint64 ms = latency / G_TIME_SPAN_MILLISECOND;
+
+  bucket = ms ? g_bit_storage (ms) : 0;
+  if (bucket >= BE_STATS_LATENCY_BUCKETS)
+    {
+      bucket = BE_STATS_LATENCY_BUCKETS - 1;
+    }
+
+  g_mutex_lock (&backend->stats_mutex);
+  backend->stats.latency[bucket]++;
+  backend->stats.latency_sum += latency;
+  g_mutex_unlock (&backend->stats_mutex);
+}
+
+static void
+backend_stats_add_timeout (struct backend *backend)
+{
+  g_mutex_lock (&backend->stats_mutex);
+  backend->stats.timeouts++;
+  g_mutex_unlock (&backend->stats_mutex);
+}
+
+gint64
+backend_stats_get_latency_mean (struct backend_stats *stats)
+{
+  guint count = 0;
+
+  for (guint i = 0; i < BE_STATS_LATENCY_BUCKETS; i++)
+    {
+      count += stats->latency[i];
+    }
+
+  return count ? stats->latency_sum / count : 0;
+}
+
+//Returns the upper bound in ms of the bucket the percentile falls into or -1 if there are no latencies.
+//As the last bucket has no upper bound, its lower bound is returned.
+
+gint
+backend_stats_get_latency_percentile (struct backend_stats *stats,
+				      guint percentile)
+{
+  guint count = 0, acc = 0;
+
+  for (guint i = 0; i < BE_STATS_LATENCY_BUCKETS; i++)
+    {
+      count += stats->latency[i];
+    }
+
+  if (!count)
+    {
+      return -1;
+    }
+
+  for (guint i = 0; i < BE_STATS_LATENCY_BUCKETS - 1; i++)
+    {
+      acc += stats->latency[i];
+      if (acc * 100 >= count * percentile)
+	{
+	  return 1 << i;
+	}
+    }
+
+  return 1 << (BE_STATS_LATENCY_BUCKETS - 2);
+}
+
+gchar *
+backend_stats_get_summary (struct backend_stats *stats)
+{
+  GString *summary = g_string_new (NULL);
+
+  g_string_append_printf (summary, "Sent: %u messages, %" PRIu64 " B\n",
+			  stats->tx_msgs, stats->tx_bytes);
+  g_string_append_printf (summary,
+			  "Received: %u messages, %" PRIu64 " B\n",
+			  stats->rx_msgs, stats->rx_bytes);
+  g_string_append_printf (summary, "Timeouts: %u; retries: %u; NAKs: %u\n",
+			  stats->timeouts, stats->retries, stats->naks);
+  g_string_append_printf (summary,
+			  "Waiting for the device: %.3f s; resting: %.3f s\n",
+			  stats->wait_time / (gdouble) G_TIME_SPAN_SECOND,
+			  stats->rest_time / (gdouble) G_TIME_SPAN_SECOND);
+  g_string_append (summary, "Latency:");
+  for (guint i = 0; i < BE_STATS_LATENCY_BUCKETS; i++)
+    {
+      if (!stats->latency[i])
+	{
+	  continue;
+	}
+      if (i == BE_STATS_LATENCY_BUCKETS - 1)
+	{
+	  g_string_append_printf (summary, " >= %d ms: %u;", 1 << (i - 1),
+				  stats->latency[i]);
+	}
+      else
+	{
+	  g_string_append_printf (summary, " < %d ms: %u;", 1 << i,
+				  stats->latency[i]);
+	}
+    }
+
+  return g_string_free (summary, FALSE);
+}
+
+static gchar *
+backend_pacing_get_key (struct backend *backend)
+{
+  return g_strdup_printf ("%s:%s", backend->conn_name, backend->name);
+}
+
+static void
+backend_pacing_reset (struct backend *backend)
+{
+  g_mutex_lock (&backend->pacing.mutex);
+  backend->pacing.rest_time = 0;
+  backend->pacing.default_rest_time = 0;
+  backend->pacing.min_rest_time = 0;
+  backend->pacing.max_rest_time = 0;
+  backend->pacing.latency = 0;
+  g_mutex_unlock (&backend->pacing.mutex);
+}
+
+//Connectors call this during the handshake with the rest time they would otherwise use between consecutive messages.
+
+void
+backend_pacing_init (struct backend *backend, gint rest_time)
+{
+  backend_pacing_init_with_min (backend, rest_time,
+				rest_time / BE_PACING_MIN_DIV);
+}
+
+//Used when the device needs a minimum gap regardless of how fast it answers.
+
+void
+backend_pacing_init_with_min (struct backend *backend, gint rest_time,
+			      gint min_rest_time)
+{
+  g_mutex_lock (&backend->pacing.mutex);
+  backend->pacing.rest_time = rest_time;
+  backend->pacing.default_rest_time = rest_time;
+  backend->pacing.min_rest_time = min_rest_time;
+  backend->pacing.max_rest_time = rest_time * BE_PACING_MAX_MUL;
+  backend->pacing.latency = 0;
+  g_mutex_unlock (&backend->pacing.mutex);
+}
+
+static void
+backend_pacing_increase (struct backend_pacing *pacing)
+{
+  pacing->rest_time *= 2;
+  if (pacing->rest_time > pacing->max_rest_time)
+    {
+      pacing->rest_time = pacing->max_rest_time;
+    }
+  if (pacing->rest_time < pacing->min_rest_time)
+    {
+      pacing->rest_time = pacing->min_rest_time;
+    }
+}
+
+//Reports an error detected by the connector (NAKs, unexpected statuses...) so that the gap grows.
+
+void
+backend_pacing_report (struct backend *backend, gint err)
+{
+  struct backend_pacing *pacing = &backend->pacing;
+
+  if (!err)
+    {
+      return;
+    }
+
+  if (err == -EBADMSG)
+    {
+      g_mutex_lock (&backend->stats_mutex);
+      backend->stats.naks++;
+      g_mutex_unlock (&backend->stats_mutex);
+    }
+
+  g_mutex_lock (&pacing->mutex);
+  if (pacing->default_rest_time)
+    {
+      backend_pacing_increase (pacing);
+      debug_print (2, "Increasing rest time to %d us...", pacing->rest_time);
+    }
+  g_mutex_unlock (&pacing->mutex);
+}
+
+static void
+backend_pacing_update (struct backend *backend, gint err, gint64 latency)
+{
+  struct backend_pacing *pacing = &backend->pacing;
+
+  if (err == -ECANCELED)
+    {
+      return;
+    }
+
+  g_mutex_lock (&pacing->mutex);
+
+  if (!pacing->default_rest_time)
+    {
+      goto end;
+    }
+
+  if (err)
+    {
+      backend_pacing_increase (pacing);
+      debug_print (2, "Increasing rest time to %d us...", pacing->rest_time);
+      goto end;
+    }
+
+  if (!pacing->latency)
+    {
+      pacing->latency = latency;
+    }
+
+  if (latency <= pacing->latency * BE_PACING_LATENCY_FACTOR)
+    {
+      pacing->rest_time -= pacing->default_rest_time / BE_PACING_STEPS;
+      if (pacing->rest_time < pacing->min_rest_time)
+	{
+	  pacing->rest_time = pacing->min_rest_time;
+	}
+    }
+
+  pacing->latency = (pacing->latency * 7 + latency) / 8;
+
+end:
+  g_mutex_unlock (&pacing->mutex);
+}
+
+void
+backend_pacing_rest (struct backend *backend)
+{
+  backend_pacing_rest_min (backend, 0);
+}
+
+//Used when an operation needs a fixed gap even if the pacing has learnt a lower one.
+
+void
+backend_pacing_rest_min (struct backend *backend, gint min_rest_time)
+{
+  gint rest_time;
+
+  g_mutex_lock (&backend->pacing.mutex);
+  rest_time = MAX (backend->pacing.rest_time, min_rest_time);
+  g_mutex_unlock (&backend->pacing.mutex);
+
+  if (rest_time)
+    {
+      usleep (rest_time);
+
+      g_mutex_lock (&backend->stats_mutex);
+      backend->stats.rest_time += rest_time;
+      g_mutex_unlock (&backend->stats_mutex);
+    }
+}
+
+//Returns a node holding an object even if the file can not be loaded.
+
+static JsonNode *
+backend_load_json_object (const gchar *file)
+{
+  GError *error;
+  JsonNode *root;
+  JsonParser *parser = json_parser_new ();
+  gchar *filename = get_user_dir (file);
+
+  error = NULL;
+  json_parser_load_from_file (parser, filename, &error);
+  if (error)
+    {
+      debug_print (1, "Error wile loading `%s': %s", filename,
+		   error->message);
+      g_error_free (error);
+    }
+
+  if (!error && JSON_NODE_HOLDS_OBJECT (json_parser_get_root (parser)))
+    {
+      root = json_node_copy (json_parser_get_root (parser));
+    }
+  else
+    {
+      root = json_node_new (JSON_NODE_OBJECT);
+      json_node_take_object (root, json_object_new ());
+    }
+
+  g_object_unref (parser);
+  g_free (filename);
+
+  return root;
+}
+
+static void
+backend_save_json_object (const gchar *file, JsonNode *root)
+{
+  gchar *dir, *filename, *json;
+  JsonGenerator *gen;
+
+  dir = get_user_dir (CONF_DIR);
+  if (g_mkdir_with_parents (dir, S_IFDIR | S_IRWXU | S_IRGRP | S_IXGRP |
+			    S_IROTH | S_IXOTH))
+    {
+      error_print ("Error wile creating directory `%s'", dir);
+      g_free (dir);
+      return;
+    }
+  g_free (dir);
+
+  filename = get_user_dir (file);
+
+  debug_print (1, "Saving '%s'...", filename);
+
+  gen = json_generator_new ();
+  json_generator_set_root (gen, root);
+  json_generator_set_pretty (gen, TRUE);
+  json = json_generator_to_data (gen, NULL);
+
+  file_save_data (filename, (guint8 *) json, strlen (json));
+
+  g_free (json);
+  g_object_unref (gen);
+  g_free (filename);
+}
+
+static void
+backend_pacing_load (struct backend *backend)
+{
+  gchar *key;
+  JsonObject *profiles, *profile;
+  gint64 rest_time, latency;
+  struct backend_pacing *pacing = &backend->pacing;
+  JsonNode *root = backend_load_json_object (CONF_DIR BE_PACING_FILE);
+
+  key = backend_pacing_get_key (backend);
+  profiles = json_node_get_object (root);
+
+  if (!json_object_has_member (profiles, key))
+    {
+      debug_print (1, "No pacing profile for '%s'", key);
+      goto end;
+    }
+
+  profile = json_object_get_object_member (profiles, key);
+  rest_time = json_object_get_int_member (profile, BE_PACING_KEY_REST_TIME);
+  latency = json_object_get_int_member (profile, BE_PACING_KEY_LATENCY);
+
+  g_mutex_lock (&pacing->mutex);
+  if (rest_time >= pacing->min_rest_time
+      && rest_time <= pacing->max_rest_time)
+    {
+      pacing->rest_time = rest_time;
+      pacing->latency = latency;
+      debug_print (1, "Using rest time of %d us for '%s'...",
+		   pacing->rest_time, key);
+    }
+  g_mutex_unlock (&pacing->mutex);
+
+end:
+  g_free (key);
+  json_node_free (root);
+}
+
+static void
+backend_pacing_save (struct backend *backend)
+{
+  gchar *key;
+  JsonObject *profile;
+  struct backend_pacing *pacing = &backend->pacing;
+  //Profiles from other devices are kept.
+  JsonNode *root = backend_load_json_object (CONF_DIR BE_PACING_FILE);
+
+  profile = json_object_new ();
+  g_mutex_lock (&pacing->mutex);
+  json_object_set_int_member (profile, BE_PACING_KEY_REST_TIME,
+			      pacing->rest_time);
+  json_object_set_int_member (profile, BE_PACING_KEY_LATENCY,
+			      pacing->latency);
+  g_mutex_unlock (&pacing->mutex);
+
+  key = backend_pacing_get_key (backend);
+  json_object_set_object_member (json_node_get_object (root), key, profile);
+  debug_print (1, "Saving pacing profile for '%s'...", key);
+  backend_save_json_object (CONF_DIR BE_PACING_FILE, root);
+
+  g_free (key);
+  json_node_free (root);
+}
+
 //Synchronized
 
 gint
@@ -285,8 +897,12 @@ backend_tx_and_rx_sysex_transfer (struct backend *backend,
 				  struct sysex_transfer *transfer,
 				  struct controllable *controllable)
 {
+  gint64 start, latency;
+
   g_mutex_lock (&backend->mutex);
 
+  start = g_get_monotonic_time ();
+
   if (transfer->raw)
     {
       backend_tx_sysex (backend, transfer, controllable);
@@ -298,6 +914,24 @@ backend_tx_and_rx_sysex_transfer (struct backend *backend,
       backend_rx_sysex (backend, transfer, controllable);
     }
 
+  latency = g_get_monotonic_time () - start;
+  if (transfer->probe && transfer->err == -ETIMEDOUT)
+    {
+      debug_print (2, "No response to probe");
+    }
+  else
+    {
+      backend_pacing_update (backend, transfer->err, latency);
+      if (!transfer->err)
+	{
+	  backend_stats_add_latency (backend, latency);
+	}
+      else if (transfer->err == -ETIMEDOUT)
+	{
+	  backend_stats_add_timeout (backend);
+	}
+    }
+
   g_mutex_unlock (&backend->mutex);
 
   return transfer->err;
@@ -317,6 +951,216 @@ backend_tx_and_rx_sysex (struct backend *backend, GByteArray *tx_msg,
   return sysex_transfer_steal (&transfer);
 }
 
+//Like backend_tx_and_rx_sysex but for requests that might not be answered. A timeout is not taken as an error by the pacing.
+
+GByteArray *
+backend_tx_and_probe_sysex (struct backend *backend, GByteArray *tx_msg,
+			    gint timeout)
+{
+  struct sysex_transfer transfer;
+  gint t = timeout == -1 ? BE_SYSEX_TIMEOUT_MS : timeout;
+  sysex_transfer_init_tx_and_rx (&transfer, t, tx_msg);
+  transfer.probe = TRUE;
+  backend_tx_and_rx_sysex_transfer (backend, &transfer, NULL);
+  return sysex_transfer_steal (&transfer);
+}
+
+//Synchronized until backend_pipeline_clear is called.
+//A timeout of -1 means the default timeout.
+
+void
+backend_pipeline_init (struct backend_pipeline *pipeline,
+		       struct backend *backend, guint window, gint timeout,
+		       t_sysex_matcher matcher, void *data)
+{
+  pipeline->backend = backend;
+  pipeline->window = window ? window : 1;
+  pipeline->timeout = timeout == -1 ? BE_SYSEX_TIMEOUT_MS : timeout;
+  pipeline->matcher = matcher;
+  pipeline->data = data;
+  pipeline->outstanding = NULL;
+
+  debug_print (2, "Starting pipeline (window %d)...", pipeline->window);
+
+  g_mutex_lock (&backend->mutex);
+}
+
+static void
+backend_request_finish (struct backend_pipeline *pipeline,
+			struct backend_request *request, gint err)
+{
+  gint64 start;
+
+  request->err = err;
+  request->done = TRUE;
+  pipeline->outstanding = g_slist_remove (pipeline->outstanding, request);
+
+  if (!err)
+    {
+      start = request->deadline -
+	pipeline->timeout * G_TIME_SPAN_MILLISECOND;
+      backend_stats_add_latency (pipeline->backend,
+				 g_get_monotonic_time () - start);
+    }
+  else if (err == -ETIMEDOUT)
+    {
+      backend_stats_add_timeout (pipeline->backend);
+    }
+}
+
+static void
+backend_pipeline_fail (struct backend_pipeline *pipeline, gint err)
+{
+  while (pipeline->outstanding)
+    {
+      backend_request_finish (pipeline, pipeline->outstanding->data, err);
+    }
+}
+
+//Receives one message and assigns it to the matching outstanding request.
+//The oldest outstanding request times out if nothing arrives before its deadline.
+
+static gint
+backend_pipeline_rx (struct backend_pipeline *pipeline,
+		     struct controllable *controllable)
+{
+  gint err;
+  gint64 remaining;
+  GByteArray *reply;
+  struct sysex_transfer transfer;
+  struct backend_request *oldest = pipeline->outstanding->data;
+
+  remaining = (oldest->deadline - g_get_monotonic_time ()) /
+    G_TIME_SPAN_MILLISECOND;
+  if (remaining <= 0)
+    {
+      debug_print (1, "Pipelined request timeout");
+      backend_request_finish (pipeline, oldest, -ETIMEDOUT);
+      return 0;
+    }
+
+  sysex_transfer_init_rx (&transfer, remaining, FALSE);
+  err = backend_rx_sysex (pipeline->backend, &transfer, controllable);
+  if (err == -ETIMEDOUT)
+    {
+      return 0;
+    }
+  if (err)
+    {
+      return err;
+    }
+
+  reply = sysex_transfer_steal (&transfer);
+  for (GSList * e = pipeline->outstanding; e; e = e->next)
+    {
+      struct backend_request *request = e->data;
+      if (pipeline->matcher (request->tx_msg, reply, pipeline->data))
+	{
+	  request->rx_msg = reply;
+	  backend_request_finish (pipeline, request, 0);
+	  return 0;
+	}
+    }
+
+  debug_print (1, "Discarding unexpected reply...");
+  free_msg (reply);
+
+  return 0;
+}
+
+//The pipeline takes the ownership of tx_msg. If the window is full, this waits for a request to finish before sending.
+//Errors are reported by backend_pipeline_wait.
+
+struct backend_request *
+backend_pipeline_tx (struct backend_pipeline *pipeline, GByteArray *tx_msg,
+		     struct controllable *controllable)
+{
+  gint err;
+  struct sysex_transfer transfer;
+  struct backend_request *request =
+    g_malloc (sizeof (struct backend_request));
+
+  request->tx_msg = tx_msg;
+  request->rx_msg = NULL;
+  request->err = 0;
+  request->done = FALSE;
+
+  while (g_slist_length (pipeline->outstanding) >= pipeline->window)
+    {
+      err = backend_pipeline_rx (pipeline, controllable);
+      if (err)
+	{
+	  backend_pipeline_fail (pipeline, err);
+	  request->err = err;
+	  request->done = TRUE;
+	  return request;
+	}
+    }
+
+  sysex_transfer_init_tx (&transfer, tx_msg);
+  err = backend_tx_sysex (pipeline->backend, &transfer, controllable);
+  if (err)
+    {
+      request->err = err;
+      request->done = TRUE;
+      return request;
+    }
+
+  request->deadline = g_get_monotonic_time () +
+    pipeline->timeout * G_TIME_SPAN_MILLISECOND;
+  pipeline->outstanding = g_slist_append (pipeline->outstanding, request);
+
+  return request;
+}
+
+gint
+backend_pipeline_wait (struct backend_pipeline *pipeline,
+		       struct backend_request *request,
+		       struct controllable *controllable)
+{
+  gint err;
+
+  while (!request->done)
+    {
+      err = backend_pipeline_rx (pipeline, controllable);
+      if (err)
+	{
+	  backend_pipeline_fail (pipeline, err);
+	}
+    }
+
+  return request->err;
+}
+
+//Outstanding requests are canceled but not freed.
+
+void
+backend_pipeline_clear (struct backend_pipeline *pipeline)
+{
+  backend_pipeline_fail (pipeline, -ECANCELED);
+  g_mutex_unlock (&pipeline->backend->mutex);
+  debug_print (2, "Pipeline finished");
+}
+
+GByteArray *
+backend_request_steal (struct backend_request *request)
+{
+  GByteArray *rx_msg = request->rx_msg;
+  request->rx_msg = NULL;
+  return rx_msg;
+}
+
+void
+backend_request_free (struct backend_request *request)
+{
+  free_msg (request->tx_msg);
+  if (request->rx_msg)
+    {
+      free_msg (request->rx_msg);
+    }
+  g_free (request);
+}
+
 void
 backend_destroy_data (struct backend *backend)
 {
@@ -406,12 +1250,18 @@ backend_init_midi (struct backend *backend, const gchar *id)
   debug_print (1, "Initializing backend (%s) to '%s'...",
 	       backend_name (), id);
   backend->type = BE_TYPE_MIDI;
+  const gchar *capture = g_getenv (BE_CAPTURE_ENV);
   gint err = backend_init_int (backend, id);
   if (!err)
     {
       g_mutex_lock (&backend->mutex);
       backend_rx_drain (backend);
       g_mutex_unlock (&backend->mutex);
+
+      if (capture)
+	{
+	  backend_capture_start (backend, capture);
+	}
     }
 
   if (preferences_get_boolean (PREF_KEY_STOP_DEVICE_WHEN_CONNECTING))
@@ -419,86 +1269,318 @@ backend_init_midi (struct backend *backend, const gchar *id)
       debug_print (1, "Stopping device...");
       if (backend_tx_raw (backend, (guint8 *) "\xfc", 1) < 0)
 	{
-	  error_print ("Error while stopping device");
+	  error_print ("Error while stopping device");
+	}
+      usleep (BE_REST_TIME_US);
+    }
+
+  return err;
+}
+
+void
+backend_destroy (struct backend *backend)
+{
+  debug_print (1, "Destroying backend...");
+
+  if (backend->pacing.default_rest_time)
+    {
+      backend_pacing_save (backend);
+    }
+  backend_pacing_reset (backend);
+
+  if (backend->destroy_data)
+    {
+      backend->destroy_data (backend);
+    }
+
+  if (backend->type == BE_TYPE_MIDI)
+    {
+      backend_capture_stop (backend);
+      backend_destroy_int (backend);
+    }
+
+  backend->upgrade_os = NULL;
+  backend->get_storage_stats = NULL;
+  backend->destroy_data = NULL;
+  backend->type = BE_TYPE_NONE;
+  g_slist_free (backend->fs_ops);
+}
+
+gboolean
+backend_check (struct backend *backend)
+{
+  switch (backend->type)
+    {
+    case BE_TYPE_MIDI:
+      return backend_check_int (backend);
+    case BE_TYPE_SYSTEM:
+    case BE_TYPE_NO_MIDI:
+      return TRUE;
+    default:
+      return FALSE;
+    }
+}
+
+void
+backend_rx_ring_init (struct backend *backend)
+{
+  g_mutex_init (&backend->rx_mutex);
+  g_cond_init (&backend->rx_cond);
+  backend->rx_ring = g_malloc (BE_DEV_RING_BUF_LEN);
+  backend->rx_ring_start = 0;
+  backend->rx_ring_len = 0;
+  backend->rx_msg = NULL;
+  backend->rx_ready = FALSE;
+  backend->rx_running = TRUE;
+  backend->rx_err = 0;
+}
+
+//After this, the producer (thread or callback) must be stopped before freeing the ring.
+
+void
+backend_rx_ring_stop (struct backend *backend)
+{
+  g_mutex_lock (&backend->rx_mutex);
+  backend->rx_running = FALSE;
+  g_cond_broadcast (&backend->rx_cond);
+  g_mutex_unlock (&backend->rx_mutex);
+}
+
+void
+backend_rx_ring_free (struct backend *backend)
+{
+  if (!backend->rx_ring)
+    {
+      return;
+    }
+
+  if (backend->rx_msg)
+    {
+      free_msg (backend->rx_msg);
+      backend->rx_msg = NULL;
+    }
+  g_free (backend->rx_ring);
+  backend->rx_ring = NULL;
+  g_cond_clear (&backend->rx_cond);
+  g_mutex_clear (&backend->rx_mutex);
+}
+
+static void
+backend_rx_ring_reset (struct backend *backend)
+{
+  if (!backend->rx_ring)
+    {
+      return;
+    }
+
+  g_mutex_lock (&backend->rx_mutex);
+  backend->rx_ring_start = 0;
+  backend->rx_ring_len = 0;
+  backend->rx_ready = FALSE;
+  if (backend->rx_msg)
+    {
+      free_msg (backend->rx_msg);
+      backend->rx_msg = NULL;
+    }
+  g_cond_broadcast (&backend->rx_cond);
+  g_mutex_unlock (&backend->rx_mutex);
+}
+
+//This is called from the receiving thread or the input callback and blocks while the ring is full.
+//Readers are only woken up when a SysEx message ends or the ring is half full.
+
+void
+backend_rx_ring_push (struct backend *backend, const guint8 *data, guint len)
+{
+  guint pos, chunk;
+
+  g_mutex_lock (&backend->rx_mutex);
+
+  while (len)
+    {
+      while (backend->rx_running && backend->rx_ring_len == BE_DEV_RING_BUF_LEN)
+	{
+	  g_cond_wait (&backend->rx_cond, &backend->rx_mutex);
+	}
+
+      if (!backend->rx_running)
+	{
+	  break;
+	}
+
+      pos = (backend->rx_ring_start + backend->rx_ring_len) %
+	BE_DEV_RING_BUF_LEN;
+      chunk = MIN (len, BE_DEV_RING_BUF_LEN - backend->rx_ring_len);
+      chunk = MIN (chunk, BE_DEV_RING_BUF_LEN - pos);
+
+      memcpy (&backend->rx_ring[pos], data, chunk);
+      backend->rx_ring_len += chunk;
+
+      if (memchr (data, 0xf7, chunk)
+	  || backend->rx_ring_len >= BE_DEV_RING_BUF_LEN / 2)
+	{
+	  backend->rx_ready = TRUE;
+	  g_cond_broadcast (&backend->rx_cond);
 	}
-      usleep (BE_REST_TIME_US);
+
+      data += chunk;
+      len -= chunk;
     }
 
-  return err;
+  g_mutex_unlock (&backend->rx_mutex);
 }
 
 void
-backend_destroy (struct backend *backend)
+backend_rx_ring_set_error (struct backend *backend, gint err)
 {
-  debug_print (1, "Destroying backend...");
+  g_mutex_lock (&backend->rx_mutex);
+  backend->rx_err = err;
+  g_cond_broadcast (&backend->rx_cond);
+  g_mutex_unlock (&backend->rx_mutex);
+}
 
-  if (backend->destroy_data)
-    {
-      backend->destroy_data (backend);
-    }
+//Status bytes other than SysEx start and end must be removed from the messages.
+//As SysEx data bytes never have the MSB set, 8 bytes are checked at a time and only the words with some MSB set are inspected byte by byte.
 
-  if (backend->type == BE_TYPE_MIDI)
+static const guint8 *
+backend_rx_find_non_sysex_status (const guint8 *data, const guint8 *end)
+{
+  guint64 word;
+
+  while (data < end)
     {
-      backend_destroy_int (backend);
+      if (end - data >= sizeof (guint64))
+	{
+	  memcpy (&word, data, sizeof (guint64));
+	  if (!(word & 0x8080808080808080ULL))
+	    {
+	      data += sizeof (guint64);
+	      continue;
+	    }
+	}
+
+      if ((*data & 0xf0) == 0xf0 && *data != 0xf0 && *data != 0xf7)
+	{
+	  return data;
+	}
+      data++;
     }
 
-  backend->upgrade_os = NULL;
-  backend->get_storage_stats = NULL;
-  backend->destroy_data = NULL;
-  backend->type = BE_TYPE_NONE;
-  g_slist_free (backend->fs_ops);
+  return end;
 }
 
-gboolean
-backend_check (struct backend *backend)
+static void
+backend_rx_append_filtered (GByteArray *msg, const guint8 *data, guint len)
 {
-  switch (backend->type)
+  const guint8 *next;
+  const guint8 *end = data + len;
+
+  while (data < end)
     {
-    case BE_TYPE_MIDI:
-      return backend_check_int (backend);
-    case BE_TYPE_SYSTEM:
-    case BE_TYPE_NO_MIDI:
-      return TRUE;
-    default:
-      return FALSE;
+      next = backend_rx_find_non_sysex_status (data, end);
+      g_byte_array_append (msg, data, next - data);
+      if (next < end)
+	{
+	  debug_print (4, "Skipping non SysEx data in message: %02x", *next);
+	  next++;
+	}
+      data = next;
     }
 }
 
-static guint8 *
-backend_get_sysex_start (guint8 *tmp, ssize_t *size)
+static void
+backend_rx_ring_consume (struct backend *backend, guint len)
+{
+  backend->rx_ring_start = (backend->rx_ring_start + len) %
+    BE_DEV_RING_BUF_LEN;
+  backend->rx_ring_len -= len;
+}
+
+//Access to this function must be synchronized with the rx_mutex.
+//Every byte in the ring is looked at once. Everything until an 0xf0 is discarded and the following bytes are moved into the message being built until an 0xf7 is found.
+//The complete message is handed out without further copies and the caller owns it.
+
+GByteArray *
+backend_rx_ring_next_msg (struct backend *backend)
 {
-  guint i, total = *size;
-  guint8 *msg_start;
+  guint8 *seg, *b;
+  guint seg_len, len;
+  GByteArray *msg = NULL;
 
-  //Everything is skipped until a 0xf0 is found. This includes every RT MIDI message.
-  msg_start = tmp;
-  for (i = 0; i < total; i++, msg_start++, (*size)--)
+  while (backend->rx_ring_len && !msg)
     {
-      if (*msg_start == 0xf0)
+      seg = &backend->rx_ring[backend->rx_ring_start];
+      seg_len = MIN (backend->rx_ring_len,
+		     BE_DEV_RING_BUF_LEN - backend->rx_ring_start);
+
+      if (!backend->rx_msg)
 	{
-	  break;
+	  b = memchr (seg, 0xf0, seg_len);
+	  len = b ? b - seg : seg_len;
+	  if (len && debug_level >= 4)
+	    {
+	      gchar *text = debug_get_hex_data (debug_level, seg, len);
+	      debug_print (4, "Skipping non SysEx data (%d): %s", len, text);
+	      g_free (text);
+	    }
+	  backend_rx_ring_consume (backend, len);
+	  if (!b)
+	    {
+	      continue;
+	    }
+	  seg = b;
+	  seg_len -= len;
+	}
+
+      b = memchr (seg, 0xf7, seg_len);
+      len = b ? b - seg + 1 : seg_len;
+
+      if (!backend->rx_msg)
+	{
+	  backend->rx_msg = g_byte_array_sized_new (b ? len :
+						    BE_INT_BUFF_SIZE);
+	}
+      backend_rx_append_filtered (backend->rx_msg, seg, len);
+      backend_rx_ring_consume (backend, len);
+
+      if (b)
+	{
+	  msg = backend->rx_msg;
+	  backend->rx_msg = NULL;
+
+	  //Filter empty message
+	  if (msg->len == 2)
+	    {
+	      debug_print (4, "Removing empty message...");
+	      free_msg (msg);
+	      msg = NULL;
+	    }
 	}
     }
 
-  if (debug_level >= 4)
+  if (!backend->rx_ring_len)
     {
-      gchar *text = debug_get_hex_data (debug_level, tmp, i);
-      debug_print (4, "Skipping non SysEx data (%d): %s", i, text);
-      g_free (text);
+      backend->rx_ready = FALSE;
     }
+  g_cond_broadcast (&backend->rx_cond);
 
-  return msg_start;
+  return msg;
 }
 
-static ssize_t
-backend_rx_raw_loop (struct backend *backend, struct sysex_transfer *transfer,
-		     struct controllable *controllable)
+//Waits until a complete message is available, the transfer times out or it is canceled.
+//In batch mode, the timeout only applies once the first message has been received.
+
+static gint
+backend_rx_ring_wait_msg (struct backend *backend,
+			  struct sysex_transfer *transfer,
+			  struct controllable *controllable, GByteArray **msg)
 {
-  gchar *text;
-  ssize_t rx_len;
-  guint8 *msg_start;
+  gint err;
+  gint64 start;
+  gboolean timed = !transfer->batch ||
+    transfer->status == SYSEX_TRANSFER_STATUS_RECEIVING;
 
-  if (!backend->inputp)
+  if (!backend->rx_ring)
     {
       error_print ("Input port is NULL");
       return -ENOTCONN;
@@ -506,91 +1588,65 @@ backend_rx_raw_loop (struct backend *backend, struct sysex_transfer *transfer,
 
   debug_print (4, "Reading data...");
 
+  g_mutex_lock (&backend->rx_mutex);
+
   while (1)
     {
       if (!CONTROLLABLE_IS_NULL_OR_ACTIVE (controllable))
 	{
-	  return -ECANCELED;
+	  err = -ECANCELED;
+	  break;
 	}
 
-      debug_print (6, "Checking timeout (%d ms, %d ms, %s mode)...",
-		   transfer->time, transfer->timeout,
-		   transfer->batch ? "batch" : "single");
-      if (((transfer->batch &&
-	    transfer->status == SYSEX_TRANSFER_STATUS_RECEIVING)
-	   || !transfer->batch) && transfer->timeout > -1
-	  && transfer->time >= transfer->timeout)
+      *msg = backend_rx_ring_next_msg (backend);
+      if (*msg)
 	{
-	  debug_print (1, "Timeout (%d)", transfer->timeout);
-	  gchar *text =
-	    debug_get_hex_data (debug_level, backend->buffer->data,
-				backend->buffer->len);
-	  debug_print (4, "Internal buffer data (%u): %s",
-		       backend->buffer->len, text);
-	  g_free (text);
-	  return -ETIMEDOUT;
+	  err = 0;
+	  break;
 	}
 
-      rx_len = backend_rx_raw (backend, tmp_buffer, BE_MAX_BUFF_SIZE);
-      if (rx_len < 0)
+      if (backend->rx_err)
 	{
-	  return rx_len;
+	  err = backend->rx_err;
+	  break;
 	}
-      if (rx_len == 0)
+
+      debug_print (6, "Checking timeout (%d ms, %d ms, %s mode)...",
+		   transfer->time, transfer->timeout,
+		   transfer->batch ? "batch" : "single");
+      if (timed && transfer->timeout > -1
+	  && transfer->time >= transfer->timeout)
 	{
-	  if ((transfer->batch &&
-	       transfer->status == SYSEX_TRANSFER_STATUS_RECEIVING)
-	      || !transfer->batch)
+	  debug_print (1, "Timeout (%d)", transfer->timeout);
+	  if (backend->rx_msg && debug_level >= 4)
 	    {
-	      transfer->time += BE_POLL_TIMEOUT_MS;
+	      gchar *text = debug_get_hex_data (debug_level,
+						backend->rx_msg->data,
+						backend->rx_msg->len);
+	      debug_print (4, "Incomplete message data (%u): %s",
+			   backend->rx_msg->len, text);
+	      g_free (text);
 	    }
-	  continue;
-	}
-
-      if (debug_level >= 4)
-	{
-	  gchar *text = debug_get_hex_data (debug_level, tmp_buffer, rx_len);
-	  debug_print (4, "Read data (%zd): %s", rx_len, text);
-	  g_free (text);
-	}
-
-      if (backend->buffer->len)
-	{
-	  msg_start = tmp_buffer;
-	}
-      else
-	{
-	  msg_start = backend_get_sysex_start (tmp_buffer, &rx_len);
+	  err = -ETIMEDOUT;
+	  break;
 	}
 
-      if (rx_len == 0)
+      start = g_get_monotonic_time ();
+      if (!backend->rx_ready)
 	{
-	  transfer->time += BE_POLL_TIMEOUT_MS;
-	  continue;
+	  g_cond_wait_until (&backend->rx_cond, &backend->rx_mutex,
+			     start +
+			     BE_POLL_TIMEOUT_MS * G_TIME_SPAN_MILLISECOND);
 	}
-
-      if (rx_len > 0)
+      if (timed)
 	{
-	  guint8 *v = msg_start;
-	  for (guint i = 0; i < rx_len; i++, v++)
-	    {
-	      if (*v == 0xf0 || *v == 0xf7 || (*v & 0xf0) != 0xf0)
-		{
-		  g_byte_array_append (backend->buffer, v, 1);
-		}
-	    }
-	  if (debug_level >= 3)
-	    {
-	      text = debug_get_hex_data (debug_level, msg_start, rx_len);
-	      debug_print (3, "Queued data (%zu): %s", rx_len, text);
-	      g_free (text);
-	    }
-	  break;
+	  transfer->time += (g_get_monotonic_time () - start + 999) / 1000;
 	}
     }
 
+  g_mutex_unlock (&backend->rx_mutex);
 
-  return backend->buffer->len;
+  return err;
 }
 
 //Access to this function must be synchronized.
@@ -599,128 +1655,82 @@ gint
 backend_rx_sysex (struct backend *backend, struct sysex_transfer *transfer,
 		  struct controllable *controllable)
 {
-  gint next_check, len, i;
-  guint8 *b;
-  ssize_t rx_len;
+  gint err;
+  GByteArray *msg;
+  gint64 start = g_get_monotonic_time ();
 
   transfer->err = 0;
   transfer->time = 0;
-  transfer->raw = g_byte_array_sized_new (BE_INT_BUFF_SIZE);
+  transfer->raw = NULL;
   sysex_transfer_set_status (transfer, controllable,
 			     SYSEX_TRANSFER_STATUS_WAITING);
 
-  next_check = 0;
   while (1)
     {
-      if (backend->buffer->len == next_check)
+      if (transfer->batch)
 	{
-	  debug_print (4, "Reading from MIDI device...");
-	  if (transfer->batch)
-	    {
-	      transfer->time = 0;
-	    }
-	  rx_len = backend_rx_raw_loop (backend, transfer, controllable);
+	  transfer->time = 0;
+	}
 
-	  if (rx_len == -ENODATA || rx_len == -ETIMEDOUT
-	      || rx_len == -ECANCELED)
-	    {
-	      if (transfer->batch)
-		{
-		  break;
-		}
-	      else
-		{
-		  transfer->err = rx_len;
-		  goto end;
-		}
-	    }
-	  else if (rx_len < 0)
+      err = backend_rx_ring_wait_msg (backend, transfer, controllable, &msg);
+      if (err == -ENODATA || err == -ETIMEDOUT || err == -ECANCELED)
+	{
+	  if (!transfer->batch)
 	    {
-	      transfer->err = -EIO;
-	      goto end;
+	      transfer->err = err;
 	    }
+	  break;
 	}
-      else
+      else if (err < 0)
 	{
-	  debug_print (4, "Reading from internal buffer...");
+	  transfer->err = -EIO;
+	  break;
 	}
 
       sysex_transfer_set_status (transfer, controllable,
 				 SYSEX_TRANSFER_STATUS_RECEIVING);
-      len = -1;
-      b = backend->buffer->data + next_check;
-      for (; next_check < backend->buffer->len; next_check++, b++)
-	{
-	  if (*b == 0xf7)
-	    {
-	      next_check++;
-	      len = next_check;
-	      break;
-	    }
-	}
-
-      //We filter out any SysEx message not suitable.
 
-      if (len > 0)
+      if (debug_level >= 4)
 	{
-	  //Filter out everything until an 0xf0 is found.
-	  b = backend->buffer->data;
-	  for (i = 0; i < len && *b != 0xf0; i++, b++);
-	  if (i > 0 && debug_level >= 4)
-	    {
-	      gchar *text = debug_get_hex_data (debug_level,
-						backend->buffer->data, i);
-	      debug_print (4, "Skipping non SysEx data in buffer (%d): %s",
-			   i, text);
-	      g_free (text);
-	    }
-	  debug_print (3, "Copying %d bytes...", len - i);
-	  g_byte_array_append (transfer->raw, b, len - i);
-
-	  g_byte_array_remove_range (backend->buffer, 0, len);
+	  gchar *text = debug_get_hex_data (debug_level, msg->data, msg->len);
+	  debug_print (4, "Queued data (%d): %s", msg->len, text);
+	  g_free (text);
+	}
 
-	  transfer->err = 0;
-	  next_check = 0;
+      g_mutex_lock (&backend->stats_mutex);
+      backend->stats.rx_msgs++;
+      backend->stats.rx_bytes += msg->len;
+      g_mutex_unlock (&backend->stats_mutex);
 
-	  //Filter empty message
-	  if (transfer->raw->len == 2
-	      && !memcmp (transfer->raw->data, "\xf0\xf7", 2))
-	    {
-	      debug_print (4, "Removing empty message...");
-	      g_byte_array_remove_range (transfer->raw, 0, 2);
-	      continue;
-	    }
+      backend_capture_write (backend, BE_CAPTURE_RX, msg->data, msg->len);
 
-	  if (debug_level >= 4)
-	    {
-	      gchar *text =
-		debug_get_hex_data (debug_level, transfer->raw->data,
-				    transfer->raw->len);
-	      debug_print (4, "Queued data (%d): %s",
-			   transfer->raw->len, text);
-	      g_free (text);
-	    }
+      if (transfer->raw)
+	{
+	  g_byte_array_append (transfer->raw, msg->data, msg->len);
+	  free_msg (msg);
 	}
       else
 	{
-	  debug_print (4, "No message in the queue. Continuing...");
+	  transfer->raw = msg;
 	}
 
-      if (transfer->raw->len && !transfer->batch)
+      if (!transfer->batch)
 	{
 	  break;
 	}
     }
 
-end:
-  if (!transfer->raw->len)
+  if (!transfer->err && !transfer->raw)
     {
       transfer->err = -ETIMEDOUT;
     }
   if (transfer->err)
     {
-      free_msg (transfer->raw);
-      transfer->raw = NULL;
+      if (transfer->raw)
+	{
+	  free_msg (transfer->raw);
+	  transfer->raw = NULL;
+	}
     }
   else
     {
@@ -732,9 +1742,12 @@ end:
 		       transfer->raw->len, text);
 	  g_free (text);
 	}
-
     }
 
+  g_mutex_lock (&backend->stats_mutex);
+  backend->stats.wait_time += g_get_monotonic_time () - start;
+  g_mutex_unlock (&backend->stats_mutex);
+
   sysex_transfer_set_status (transfer, controllable,
 			     SYSEX_TRANSFER_STATUS_FINISHED);
 
@@ -751,8 +1764,8 @@ backend_rx_drain (struct backend *backend)
   sysex_transfer_init_rx (&transfer, 1000, FALSE);
 
   debug_print (2, "Draining buffers...");
-  backend->buffer->len = 0;
   backend_rx_drain_int (backend);
+  backend_rx_ring_reset (backend);
   while (!backend_rx_sysex (backend, &transfer, NULL))
     {
       sysex_transfer_clear (&transfer);
@@ -826,6 +1839,148 @@ backend_get_devices ()
   return devices;
 }
 
+//Connectors claiming more bytes of the identity go first.
+
+static gint
+backend_connector_compare_score (gconstpointer a, gconstpointer b,
+				 gpointer data)
+{
+  const struct backend_midi_info *midi_info = data;
+  return connector_get_midi_id_score (b, midi_info) -
+    connector_get_midi_id_score (a, midi_info);
+}
+
+//The device is identified by the port name and the identity reply, which is stored in the backend name just after the MIDI handshake.
+
+static gchar *
+backend_connector_cache_get_key (struct backend *backend,
+				 struct backend_device *device)
+{
+  return g_strdup_printf ("%s:%s", device->name, backend->name);
+}
+
+static const struct connector *
+backend_connector_cache_get (const gchar *key)
+{
+  const gchar *name;
+  JsonObject *entry;
+  const struct connector *connector = NULL;
+  JsonNode *root = backend_load_json_object (CONF_DIR BE_CONNECTORS_FILE);
+  JsonObject *entries = json_node_get_object (root);
+
+  if (json_object_has_member (entries, key))
+    {
+      entry = json_object_get_object_member (entries, key);
+      name = json_object_has_member (entry, BE_CONNECTORS_KEY_CONNECTOR) ?
+	json_object_get_string_member (entry,
+				       BE_CONNECTORS_KEY_CONNECTOR) : NULL;
+      for (GSList *l = connectors; l; l = l->next)
+	{
+	  const struct connector *c = l->data;
+	  if (name && !strcmp (c->name, name))
+	    {
+	      debug_print (1, "Cached connector for '%s': %s", key, name);
+	      connector = c;
+	      break;
+	    }
+	}
+    }
+
+  json_node_free (root);
+
+  return connector;
+}
+
+static gboolean
+backend_connector_cache_entry_equals (JsonObject *entry,
+				      struct backend *backend)
+{
+  GSList *l;
+  guint i;
+  const gchar *name;
+  JsonArray *filesystems;
+
+  if (!json_object_has_member (entry, BE_CONNECTORS_KEY_CONNECTOR) ||
+      !json_object_has_member (entry, BE_CONNECTORS_KEY_FILESYSTEMS))
+    {
+      return FALSE;
+    }
+
+  name = json_object_get_string_member (entry, BE_CONNECTORS_KEY_CONNECTOR);
+  if (!name || strcmp (name, backend->conn_name))
+    {
+      return FALSE;
+    }
+
+  filesystems = json_object_get_array_member (entry,
+					      BE_CONNECTORS_KEY_FILESYSTEMS);
+  if (!filesystems)
+    {
+      return FALSE;
+    }
+
+  for (l = backend->fs_ops, i = 0; l; l = l->next, i++)
+    {
+      const struct fs_operations *ops = l->data;
+      if (i >= json_array_get_length (filesystems) ||
+	  strcmp (ops->name, json_array_get_string_element (filesystems, i)))
+	{
+	  return FALSE;
+	}
+    }
+
+  return i == json_array_get_length (filesystems);
+}
+
+//If backend is NULL, the entry is removed.
+
+static void
+backend_connector_cache_set (const gchar *key, struct backend *backend)
+{
+  JsonObject *entry;
+  JsonArray *filesystems;
+  JsonNode *root = backend_load_json_object (CONF_DIR BE_CONNECTORS_FILE);
+  JsonObject *entries = json_node_get_object (root);
+
+  if (!backend)
+    {
+      if (json_object_has_member (entries, key))
+	{
+	  debug_print (1, "Invalidating cached connector for '%s'...", key);
+	  json_object_remove_member (entries, key);
+	  backend_save_json_object (CONF_DIR BE_CONNECTORS_FILE, root);
+	}
+      goto end;
+    }
+
+  if (json_object_has_member (entries, key) &&
+      backend_connector_cache_entry_equals (json_object_get_object_member
+					    (entries, key), backend))
+    {
+      goto end;
+    }
+
+  entry = json_object_new ();
+  json_object_set_string_member (entry, BE_CONNECTORS_KEY_CONNECTOR,
+				 backend->conn_name);
+  filesystems = json_array_new ();
+  for (GSList *l = backend->fs_ops; l; l = l->next)
+    {
+      const struct fs_operations *ops = l->data;
+      json_array_add_string_element (filesystems, ops->name);
+    }
+  json_object_set_array_member (entry, BE_CONNECTORS_KEY_FILESYSTEMS,
+				filesystems);
+  json_object_set_object_member (entries, key, entry);
+
+  debug_print (1, "Caching connector %s for '%s'...", backend->conn_name,
+	       key);
+  backend_save_json_object (CONF_DIR BE_CONNECTORS_FILE, root);
+
+end:
+  json_node_free (root);
+}
+
 // A handshake function might return these values:
 // 0, the device matches the connector.
 // -ENODEV, the device does not match the connector but we can continue with the next connector.
@@ -838,9 +1993,14 @@ backend_init_connector (struct backend *backend,
 			struct controllable *controllable)
 {
   gint err;
-  GSList *list = NULL, *iterator;
+  gboolean identified;
+  gchar *key = NULL;
+  const struct connector *cached = NULL;
+  GSList *list = NULL, *matched = NULL, *iterator;
   GSList *c;
 
+  backend_pacing_reset (backend);
+
   if (device->type == BE_TYPE_SYSTEM)
     {
       backend->conn_name = system_connector->name;
@@ -877,11 +2037,47 @@ backend_init_connector (struct backend *backend,
       return err;
     }
 
+  if (!CONTROLLABLE_IS_NULL_OR_ACTIVE (controllable))
+    {
+      err = -ECANCELED;
+      goto end;
+    }
+
+  //The name is only set if there was a valid identity reply.
+  identified = FALSE;
+  if (!conn_name)
+    {
+      backend_midi_handshake (backend);
+      identified = backend->name[0] != 0;
+      //Without an identity reply, the port name alone can not tell apart the devices connected to it.
+      if (identified)
+	{
+	  key = backend_connector_cache_get_key (backend, device);
+	  cached = backend_connector_cache_get (key);
+	}
+    }
+
   c = connectors;
   while (c)
     {
       struct connector *connector = c->data;
-      if (connector->regex)
+      gint score = identified ?
+	connector_get_midi_id_score (connector, &backend->midi_info) : 0;
+      if (score < 0)
+	{
+	  debug_print (1, "Skipping %s connector as the identity differs",
+		       connector->name);
+	}
+      else if (score > 0)
+	{
+	  debug_print (1, "Connector %s claims the device identity",
+		       connector->name);
+	  matched = g_slist_insert_sorted_with_data (matched,
+						     (void *) connector,
+						     backend_connector_compare_score,
+						     &backend->midi_info);
+	}
+      else if (connector->regex)
 	{
 	  GRegex *regex = g_regex_new (connector->regex, G_REGEX_CASELESS,
 				       0, NULL);
@@ -904,15 +2100,14 @@ backend_init_connector (struct backend *backend,
       c = c->next;
     }
 
-  if (!CONTROLLABLE_IS_NULL_OR_ACTIVE (controllable))
-    {
-      err = -ECANCELED;
-      goto end;
-    }
+  list = g_slist_concat (matched, list);
 
-  if (!conn_name)
+  //A returning device only needs the handshake of its previous connector.
+  //The handshake itself can not be skipped as it is what builds the connector state (device description, filesystems and pacing) and it verifies that the firmware still offers the cached filesystems.
+  if (cached && g_slist_find (list, cached))
     {
-      backend_midi_handshake (backend);
+      list = g_slist_remove (list, cached);
+      list = g_slist_prepend (list, (void *) cached);
     }
 
   err = -ENODEV;
@@ -949,6 +2144,11 @@ backend_init_connector (struct backend *backend,
       else
 	{
 	  err = c->handshake (backend);
+	  if (err && key && c == cached)
+	    {
+	      backend_connector_cache_set (key, NULL);
+	    }
+
 	  if (err && err != -ENODEV)
 	    {
 	      goto end;
@@ -958,6 +2158,10 @@ backend_init_connector (struct backend *backend,
 	    {
 	      debug_print (1, "Using %s connector...", c->name);
 	      backend->conn_name = c->name;
+	      if (key)
+		{
+		  backend_connector_cache_set (key, backend);
+		}
 	      goto end;
 	    }
 	}
@@ -966,10 +2170,15 @@ backend_init_connector (struct backend *backend,
   error_print ("No device recognized");
 
 end:
+  g_free (key);
   g_slist_free (list);
   if (err)
     {
       backend_destroy (backend);
     }
+  else if (backend->pacing.default_rest_time)
+    {
+      backend_pacing_load (backend);
+    }
   return err;
 }
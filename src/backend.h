@@ -20,7 +20,9 @@
 
 #include "utils.h"
 
-#if defined(ELEKTROID_RTMIDI)
+#if defined(ELEKTROID_LOOPBACK)
+#include <fcntl.h>
+#elif defined(ELEKTROID_RTMIDI)
 #include <fcntl.h>
 #include <rtmidi_c.h>
 #else
@@ -32,17 +34,27 @@
 
 #define BE_MAX_MIDI_PROGRAMS 128
 
-#define BE_POLL_TIMEOUT_MS 20
+#define BE_POLL_TIMEOUT_MS 20	//Only used to check for cancellation and to stop the receiving thread. Incoming SysEx messages wake up the readers immediately.
 #define BE_MAX_TX_LEN KI	//With a higher value than 4 KB, functions behave erratically.
-#define BE_INT_BUFF_SIZE (128 * KI)	//Used as the default size for the GByteArray buffer.
+#define BE_INT_BUFF_SIZE (128 * KI)	//Used as the default size for the messages being received.
 #define BE_DEV_RING_BUF_LEN (256 * KI)
 //This size is required by RtMidi as it needs enough space for a message. Therefore, this must be the maximum size of all the possible messages.
 #define BE_MAX_BUFF_SIZE MI
 
 #define BE_REST_TIME_US 50000
+#define BE_PACING_MIN_DIV 10	//The inter-message gap never goes below the connector default divided by this.
+#define BE_PACING_MAX_MUL 8	//The inter-message gap never goes above the connector default multiplied by this.
+#define BE_PACING_STEPS 32	//Additive decrease step as a fraction of the connector default.
+#define BE_PACING_LATENCY_FACTOR 2	//Replies slower than the average latency multiplied by this do not decrease the gap.
 #define BE_SYSEX_TIMEOUT_MS 5000
 #define BE_SYSEX_TIMEOUT_GUESS_MS 1000	//When the request is not implemented, 5 s is too much.
 
+#define BE_CAPTURE_ENV "ELEKTROID_CAPTURE"	//When set, the SysEx messages of the session are recorded into this file.
+#define BE_CAPTURE_MAGIC "ELKCAP"
+#define BE_CAPTURE_VERSION 1
+
+#define BE_STATS_LATENCY_BUCKETS 12	//Bucket i counts latencies under 2^i ms. The last one counts the remaining ones.
+
 #define BE_COMPANY_LEN 3
 #define BE_FAMILY_LEN 2
 #define BE_MODEL_LEN 2
@@ -103,17 +115,66 @@ struct sysex_transfer
   gint timeout;			//Measured in ms. -1 is infinite.
   gint time;
   gboolean batch;
+  gboolean dry_run;		//Only used by upgrade_os. The data is validated and nothing is sent.
+  gboolean probe;		//No response is a valid outcome, so timeouts are neither counted nor used for pacing.
   GByteArray *raw;
   gint err;
 };
 
+//Adaptive inter-message gap (AIMD). The gap decreases additively after every timely reply and doubles after every timeout or error reported by the connector.
+struct backend_pacing
+{
+  GMutex mutex;
+  gint rest_time;		//Current gap in us. 0 means no pacing.
+  gint default_rest_time;
+  gint min_rest_time;
+  gint max_rest_time;
+  gint64 latency;		//Average reply latency in us.
+};
+
+//Counters accumulated since the last call to backend_stats_reset. Times are measured in us.
+struct backend_stats
+{
+  guint64 tx_bytes;
+  guint64 rx_bytes;
+  guint tx_msgs;
+  guint rx_msgs;
+  guint retries;
+  guint naks;
+  guint timeouts;
+  gint64 rest_time;
+  gint64 wait_time;
+  guint latency[BE_STATS_LATENCY_BUCKETS];
+  gint64 latency_sum;
+};
+
+enum backend_capture_dir
+{
+  BE_CAPTURE_TX,
+  BE_CAPTURE_RX
+};
+
+//Capture files start with the magic string and the version byte. Every record has the direction byte, the time in us since the capture start as a 64 bits little endian value, the length as a 32 bits little endian value and the message.
+struct backend_capture_record
+{
+  enum backend_capture_dir dir;
+  gint64 time;
+  GByteArray *data;
+};
+
 typedef gint (*t_sysex_transfer) (struct backend *, struct sysex_transfer *,
 				  struct controllable * controllable);
 
+//Returns TRUE if the reply answers the request.
+typedef gboolean (*t_sysex_matcher) (GByteArray * request, GByteArray * reply,
+				     void *data);
+
 struct backend
 {
-// ALSA or RtMidi backend
-#if defined(ELEKTROID_RTMIDI)
+// Loopback, ALSA or RtMidi backend
+#if defined(ELEKTROID_LOOPBACK)
+  struct loopback_device *device;
+#elif defined(ELEKTROID_RTMIDI)
   struct RtMidiWrapper *inputp;
   struct RtMidiWrapper *outputp;
 #else
@@ -121,14 +182,30 @@ struct backend
   snd_rawmidi_t *outputp;
   gint npfds;
   struct pollfd *pfds;
+  GThread *rx_thread;
 #endif
-  GByteArray *buffer;
+  //Ring buffer filled by the receiving thread (ALSA), the input callback (RtMidi) or the device thread (loopback).
+  GMutex rx_mutex;
+  GCond rx_cond;
+  guint8 *rx_ring;
+  guint rx_ring_start;
+  guint rx_ring_len;
+  GByteArray *rx_msg;		//SysEx message being framed.
+  gboolean rx_ready;		//Set when a SysEx end is available or the ring is getting full.
+  gboolean rx_running;
+  gint rx_err;
   enum backend_type type;
   struct backend_midi_info midi_info;
   gchar name[LABEL_MAX];
   gchar version[LABEL_MAX];
   gchar description[LABEL_MAX];
   GMutex mutex;
+  struct backend_pacing pacing;
+  GMutex stats_mutex;
+  struct backend_stats stats;
+  GMutex capture_mutex;
+  FILE *capture;		//NULL when not capturing.
+  gint64 capture_start;
   //This must be filled by the concrete connector.
   const gchar *conn_name;
   GSList *fs_ops;
@@ -138,6 +215,28 @@ struct backend
   t_get_storage_stats get_storage_stats;	//This function is a device function, not a filesystem function. Several filesystems might share the same memory.
 };
 
+//A request sent through a pipeline. It owns both messages and must be waited for before being freed.
+struct backend_request
+{
+  GByteArray *tx_msg;
+  GByteArray *rx_msg;
+  gint64 deadline;		//Monotonic time in us.
+  gint err;
+  gboolean done;
+};
+
+//Several requests can be in flight at the same time. Replies are assigned to the oldest outstanding request the matcher accepts.
+//The backend is locked for the lifetime of the pipeline.
+struct backend_pipeline
+{
+  struct backend *backend;
+  guint window;			//Maximum number of outstanding requests.
+  gint timeout;
+  t_sysex_matcher matcher;
+  void *data;
+  GSList *outstanding;
+};
+
 struct backend_device
 {
   enum backend_type type;
@@ -149,7 +248,18 @@ gint backend_init (struct backend *, struct backend_device *);
 
 void backend_destroy (struct backend *);
 
-ssize_t backend_rx_raw (struct backend *, guint8 *, guint);
+void backend_rx_ring_init (struct backend *backend);
+
+void backend_rx_ring_stop (struct backend *backend);
+
+void backend_rx_ring_free (struct backend *backend);
+
+void backend_rx_ring_push (struct backend *backend, const guint8 * data,
+			   guint len);
+
+void backend_rx_ring_set_error (struct backend *backend, gint err);
+
+GByteArray *backend_rx_ring_next_msg (struct backend *backend);
 
 ssize_t backend_tx_raw (struct backend *, guint8 *, guint);
 
@@ -172,6 +282,61 @@ gint backend_tx_and_rx_sysex_transfer (struct backend *backend,
 
 GByteArray *backend_tx_and_rx_sysex (struct backend *, GByteArray *, gint);
 
+GByteArray *backend_tx_and_probe_sysex (struct backend *, GByteArray *, gint);
+
+void backend_pipeline_init (struct backend_pipeline *pipeline,
+			    struct backend *backend, guint window,
+			    gint timeout, t_sysex_matcher matcher,
+			    void *data);
+
+struct backend_request *backend_pipeline_tx (struct backend_pipeline
+					     *pipeline, GByteArray * tx_msg,
+					     struct controllable
+					     *controllable);
+
+gint backend_pipeline_wait (struct backend_pipeline *pipeline,
+			    struct backend_request *request,
+			    struct controllable *controllable);
+
+void backend_pipeline_clear (struct backend_pipeline *pipeline);
+
+GByteArray *backend_request_steal (struct backend_request *request);
+
+void backend_request_free (struct backend_request *request);
+
+void backend_pacing_init (struct backend *backend, gint rest_time);
+
+void backend_pacing_init_with_min (struct backend *backend, gint rest_time,
+				   gint min_rest_time);
+
+void backend_pacing_report (struct backend *backend, gint err);
+
+void backend_pacing_rest (struct backend *backend);
+
+void backend_pacing_rest_min (struct backend *backend, gint min_rest_time);
+
+void backend_stats_reset (struct backend *backend);
+
+void backend_stats_get (struct backend *backend,
+			struct backend_stats *stats);
+
+void backend_stats_add_retry (struct backend *backend);
+
+gchar *backend_stats_get_summary (struct backend_stats *stats);
+
+gint64 backend_stats_get_latency_mean (struct backend_stats *stats);
+
+gint backend_stats_get_latency_percentile (struct backend_stats *stats,
+					   guint percentile);
+
+gint backend_capture_start (struct backend *backend, const gchar * path);
+
+void backend_capture_stop (struct backend *backend);
+
+gint backend_capture_load (const gchar * path, GSList ** records);
+
+void backend_capture_record_free (gpointer record);
+
 void backend_rx_drain (struct backend *);
 
 gboolean backend_check (struct backend *);
@@ -22,6 +22,7 @@
 
 #define BE_DEVICE_NAME "hw:%d,%d"
 #define BE_DEVICE_NAME_SUB "hw:%d,%d,%d"
+#define BE_RX_THREAD_BUFF_SIZE (4 * KI)
 
 void
 sysex_transfer_set_status (struct sysex_transfer *sysex_transfer,
@@ -33,6 +34,14 @@ backend_destroy_int (struct backend *backend)
 {
   gint err;
 
+  if (backend->rx_thread)
+    {
+      backend_rx_ring_stop (backend);
+      g_thread_join (backend->rx_thread);
+      backend->rx_thread = NULL;
+    }
+  backend_rx_ring_free (backend);
+
   if (backend->inputp)
     {
       err = snd_rawmidi_close (backend->inputp);
@@ -55,12 +64,6 @@ backend_destroy_int (struct backend *backend)
       backend->outputp = NULL;
     }
 
-  if (backend->buffer)
-    {
-      g_free (backend->buffer);
-      backend->buffer = NULL;
-    }
-
   if (backend->pfds)
     {
       g_free (backend->pfds);
@@ -68,6 +71,93 @@ backend_destroy_int (struct backend *backend)
     }
 }
 
+// The data is read as soon as it is available and pushed into the ring buffer.
+// The poll timeout is only used to check if the thread needs to stop.
+
+static gpointer
+backend_rx_runner (gpointer data)
+{
+  gint err;
+  ssize_t rx_len;
+  unsigned short revents;
+  struct backend *backend = data;
+  guint8 buffer[BE_RX_THREAD_BUFF_SIZE];
+
+  debug_print (1, "Starting receiving thread...");
+
+  while (1)
+    {
+      g_mutex_lock (&backend->rx_mutex);
+      gboolean running = backend->rx_running;
+      g_mutex_unlock (&backend->rx_mutex);
+
+      if (!running)
+	{
+	  break;
+	}
+
+      err = poll (backend->pfds, backend->npfds, BE_POLL_TIMEOUT_MS);
+      if (err == 0)
+	{
+	  continue;
+	}
+
+      if (err < 0)
+	{
+	  if (errno == EINTR)
+	    {
+	      continue;
+	    }
+	  error_print ("Error while polling. %s.", g_strerror (errno));
+	  backend_rx_ring_set_error (backend, -errno);
+	  break;
+	}
+
+      if ((err = snd_rawmidi_poll_descriptors_revents (backend->inputp,
+						       backend->pfds,
+						       backend->npfds,
+						       &revents)) < 0)
+	{
+	  error_print ("Error while getting poll events. %s.",
+		       snd_strerror (err));
+	  backend_rx_ring_set_error (backend, err);
+	  break;
+	}
+
+      if (revents & (POLLERR | POLLHUP))
+	{
+	  backend_rx_ring_set_error (backend, -ENODATA);
+	  break;
+	}
+
+      if (!(revents & POLLIN))
+	{
+	  continue;
+	}
+
+      rx_len = snd_rawmidi_read (backend->inputp, buffer,
+				 BE_RX_THREAD_BUFF_SIZE);
+      if (rx_len == -EAGAIN || rx_len == 0)
+	{
+	  continue;
+	}
+
+      if (rx_len < 0)
+	{
+	  error_print ("Error while reading from device: %s",
+		       snd_strerror (rx_len));
+	  backend_rx_ring_set_error (backend, rx_len);
+	  break;
+	}
+
+      backend_rx_ring_push (backend, buffer, rx_len);
+    }
+
+  debug_print (1, "Stopping receiving thread...");
+
+  return NULL;
+}
+
 gint
 backend_init_int (struct backend *backend, const gchar *id)
 {
@@ -77,8 +167,7 @@ backend_init_int (struct backend *backend, const gchar *id)
   backend->inputp = NULL;
   backend->outputp = NULL;
   backend->pfds = NULL;
-
-  backend->buffer = g_byte_array_sized_new (BE_INT_BUFF_SIZE);
+  backend->rx_thread = NULL;
 
   if ((err = snd_rawmidi_open (&backend->inputp, &backend->outputp, id,
 			       SND_RAWMIDI_NONBLOCK | SND_RAWMIDI_SYNC)) < 0)
@@ -129,13 +218,17 @@ backend_init_int (struct backend *backend, const gchar *id)
       goto cleanup_params;
     }
 
+  snd_rawmidi_params_free (params);
+
+  backend_rx_ring_init (backend);
+  backend->rx_thread = g_thread_new ("rx_thread", backend_rx_runner, backend);
+
   return 0;
 
 cleanup_params:
   snd_rawmidi_params_free (params);
 cleanup:
   backend_destroy (backend);
-  g_free (backend->buffer);
   return err;
 }
 
@@ -221,65 +314,6 @@ backend_rx_drain_int (struct backend *backend)
   snd_rawmidi_drain (backend->inputp);
 }
 
-ssize_t
-backend_rx_raw (struct backend *backend, guint8 *buffer, guint len)
-{
-  gint err;
-  ssize_t rx_len;
-  unsigned short revents;
-
-  debug_print (6, "Polling...");
-  err = poll (backend->pfds, backend->npfds, BE_POLL_TIMEOUT_MS);
-  if (err == 0)
-    {
-      return 0;
-    }
-
-  if (err < 0)
-    {
-      error_print ("Error while polling. %s.", g_strerror (errno));
-      if (errno == EINTR)
-	{
-	  return -ECANCELED;
-	}
-      return err;
-    }
-
-  if ((err = snd_rawmidi_poll_descriptors_revents (backend->inputp,
-						   backend->pfds,
-						   backend->npfds,
-						   &revents)) < 0)
-    {
-      error_print ("Error while getting poll events. %s.",
-		   snd_strerror (err));
-      return err;
-    }
-
-  if (revents & (POLLERR | POLLHUP))
-    {
-      return -ENODATA;
-    }
-
-  if (!(revents & POLLIN))
-    {
-      return 0;
-    }
-
-  rx_len = snd_rawmidi_read (backend->inputp, buffer, len);
-  if (rx_len == -EAGAIN)
-    {
-      return 0;
-    }
-
-  if (rx_len < 0)
-    {
-      error_print ("Error while reading from device: %s",
-		   snd_strerror (rx_len));
-    }
-
-  return rx_len;
-}
-
 gboolean
 backend_check_int (struct backend *backend)
 {
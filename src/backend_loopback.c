@@ -0,0 +1,436 @@
+/*
+ *   backend_loopback.c
+ *   Copyright (C) 2026 David García Goñi <dagargo@gmail.com>
+ *
+ *   This file is part of Elektroid.
+ *
+ *   Elektroid is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   Elektroid is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with Elektroid. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <glib/gstdio.h>
+#include "backend.h"
+#include "loopback/loopback.h"
+
+// This backend does not use any MIDI port. Every device is an in-process model running in its own thread.
+// Messages are delivered to the model after the configured latency and both directions are throttled to the configured bandwidth.
+// The models only implement known protocol behaviour. Anything else, like unconfirmed requests or faulty devices, is configured with a script whose rules are checked before the model.
+
+static const struct loopback_model *LOOPBACK_MODELS[] = {
+  &LOOPBACK_MODEL_ELEKTRON,
+  &LOOPBACK_MODEL_SDS,
+  &LOOPBACK_MODEL_MICROFREAK,
+  &LOOPBACK_MODEL_REPLAY,
+  &LOOPBACK_MODEL_SCRIPT,
+  NULL
+};
+
+struct loopback_device
+{
+  struct backend *backend;
+  const struct loopback_model *model;
+  gpointer state;
+  GSList *rules;
+  GAsyncQueue *queue;
+  GThread *thread;
+  gint64 latency;		//Measured in us.
+  guint64 bandwidth;		//Measured in B/s. 0 means unlimited.
+};
+
+//A message without data stops the device thread.
+struct loopback_msg
+{
+  GByteArray *data;
+  gint64 time;			//Monotonic time in us when the message was completely sent.
+};
+
+void
+sysex_transfer_set_status (struct sysex_transfer *sysex_transfer,
+			   struct controllable *controllable,
+			   enum sysex_transfer_status status);
+
+static gint64
+loopback_get_env_value (const gchar *name)
+{
+  const gchar *value = g_getenv (name);
+  return value ? g_ascii_strtoll (value, NULL, 10) : 0;
+}
+
+static void
+loopback_device_wait_until (gint64 time)
+{
+  gint64 diff = time - g_get_monotonic_time ();
+  if (diff > 0)
+    {
+      g_usleep (diff);
+    }
+}
+
+static void
+loopback_device_wait_wire (struct loopback_device *device, guint len)
+{
+  if (device->bandwidth)
+    {
+      g_usleep (len * G_USEC_PER_SEC / device->bandwidth);
+    }
+}
+
+static gboolean
+loopback_is_identity_request (const GByteArray *msg)
+{
+  return msg->len == 6 && msg->data[1] == 0x7e && msg->data[3] == 6 &&
+    msg->data[4] == 1;
+}
+
+void
+loopback_device_reply (struct loopback_device *device, GByteArray *msg)
+{
+  if (debug_level >= 2)
+    {
+      gchar *text = debug_get_hex_msg (msg);
+      debug_print (2, "Loopback device message sent (%d): %s", msg->len,
+		   text);
+      g_free (text);
+    }
+
+  loopback_device_wait_wire (device, msg->len);
+  backend_rx_ring_push (device->backend, msg->data, msg->len);
+  free_msg (msg);
+}
+
+static gpointer
+loopback_device_runner (gpointer data)
+{
+  GByteArray *reply;
+  struct loopback_msg *msg;
+  struct loopback_device *device = data;
+
+  debug_print (1, "Starting loopback device thread...");
+
+  while (1)
+    {
+      msg = g_async_queue_pop (device->queue);
+      if (!msg->data)
+	{
+	  g_free (msg);
+	  break;
+	}
+
+      loopback_device_wait_until (msg->time + device->latency);
+
+      if (loopback_script_handle (device, device->rules, msg->data))
+	{
+	  debug_print (2, "Request handled by the script");
+	}
+      else if (device->model->identity &&
+	  loopback_is_identity_request (msg->data))
+	{
+	  reply = g_byte_array_sized_new (device->model->identity_len);
+	  g_byte_array_append (reply, device->model->identity,
+			       device->model->identity_len);
+	  loopback_device_reply (device, reply);
+	}
+      else
+	{
+	  device->model->handle (device, device->state, msg->data);
+	}
+
+      free_msg (msg->data);
+      g_free (msg);
+    }
+
+  debug_print (1, "Stopping loopback device thread...");
+
+  return NULL;
+}
+
+//Only SysEx messages reach the model. Everything else is discarded as a real device would ignore it.
+
+static void
+loopback_device_tx (struct loopback_device *device, const guint8 *data,
+		    guint len)
+{
+  struct loopback_msg *msg;
+  GByteArray *sysex = NULL;
+
+  loopback_device_wait_wire (device, len);
+
+  for (guint i = 0; i < len; i++)
+    {
+      if (data[i] == 0xf0)
+	{
+	  if (sysex)
+	    {
+	      free_msg (sysex);
+	    }
+	  sysex = g_byte_array_new ();
+	}
+
+      if (!sysex || data[i] >= 0xf8)
+	{
+	  continue;
+	}
+
+      g_byte_array_append (sysex, &data[i], 1);
+
+      if (data[i] == 0xf7)
+	{
+	  msg = g_malloc (sizeof (struct loopback_msg));
+	  msg->data = sysex;
+	  msg->time = g_get_monotonic_time ();
+	  g_async_queue_push (device->queue, msg);
+	  sysex = NULL;
+	}
+    }
+
+  if (sysex)
+    {
+      free_msg (sysex);
+    }
+}
+
+void
+backend_destroy_int (struct backend *backend)
+{
+  struct loopback_msg *msg;
+  struct loopback_device *device = backend->device;
+
+  if (device)
+    {
+      //The thread might be waiting for room in a full ring.
+      backend_rx_ring_stop (backend);
+
+      msg = g_malloc (sizeof (struct loopback_msg));
+      msg->data = NULL;
+      g_async_queue_push (device->queue, msg);
+      g_thread_join (device->thread);
+
+      device->model->free (device->state);
+      loopback_script_free (device->rules);
+      g_async_queue_unref (device->queue);
+      g_free (device);
+      backend->device = NULL;
+    }
+  backend_rx_ring_free (backend);
+}
+
+gint
+backend_init_int (struct backend *backend, const gchar *id)
+{
+  gchar *dir, *script;
+  const gchar *env_dir, *env_script;
+  struct loopback_device *device;
+  const struct loopback_model **model = LOOPBACK_MODELS;
+
+  backend->device = NULL;
+
+  while (*model)
+    {
+      if (!strcmp ((*model)->name, id))
+	{
+	  break;
+	}
+      model++;
+    }
+
+  if (!*model)
+    {
+      error_print ("Loopback device '%s' not found", id);
+      return -ENODEV;
+    }
+
+  env_dir = g_getenv (LOOPBACK_ENV_DIR);
+  if (env_dir)
+    {
+      dir = g_build_filename (env_dir, (*model)->name, NULL);
+    }
+  else
+    {
+      gchar *root = get_user_dir (CONF_DIR LOOPBACK_DIR);
+      dir = g_build_filename (root, (*model)->name, NULL);
+      g_free (root);
+    }
+
+  if (g_mkdir_with_parents (dir, 0755))
+    {
+      error_print ("Error while creating directory %s", dir);
+      g_free (dir);
+      return -errno;
+    }
+
+  device = g_malloc (sizeof (struct loopback_device));
+  device->backend = backend;
+  device->model = *model;
+  device->latency = loopback_get_env_value (LOOPBACK_ENV_LATENCY);
+  device->bandwidth = loopback_get_env_value (LOOPBACK_ENV_BANDWIDTH);
+  device->state = device->model->init (dir);
+  device->queue = g_async_queue_new ();
+
+  env_script = g_getenv (LOOPBACK_ENV_SCRIPT);
+  if (env_script)
+    {
+      script = g_strdup (env_script);
+    }
+  else
+    {
+      script = g_build_filename (dir, LOOPBACK_SCRIPT_FILE, NULL);
+    }
+  device->rules = loopback_script_load (script);
+  g_free (script);
+
+  debug_print (1, "Loopback device state in %s (latency: %" PRId64
+	       " us; bandwidth: %" PRIu64 " B/s)", dir, device->latency,
+	       device->bandwidth);
+  g_free (dir);
+
+  backend_rx_ring_init (backend);
+  backend->device = device;
+  device->thread = g_thread_new ("loopback_device", loopback_device_runner,
+				 device);
+
+  return 0;
+}
+
+ssize_t
+backend_tx_raw (struct backend *backend, guint8 *data, guint len)
+{
+  if (!backend->device)
+    {
+      error_print ("Loopback device is NULL");
+      return -ENOTCONN;
+    }
+
+  loopback_device_tx (backend->device, data, len);
+
+  return len;
+}
+
+gint
+backend_tx_sysex_int (struct backend *backend,
+		      struct sysex_transfer *transfer,
+		      struct controllable *controllable)
+{
+  ssize_t tx_len;
+
+  transfer->err = 0;
+  sysex_transfer_set_status (transfer, controllable,
+			     SYSEX_TRANSFER_STATUS_SENDING);
+
+  tx_len = backend_tx_raw (backend, transfer->raw->data, transfer->raw->len);
+  if (tx_len < 0)
+    {
+      transfer->err = tx_len;
+    }
+
+  if (!transfer->err && debug_level >= 2)
+    {
+      gchar *text = debug_get_hex_data (debug_level, transfer->raw->data,
+					transfer->raw->len);
+      debug_print (2, "Raw message sent (%d): %s", transfer->raw->len, text);
+      g_free (text);
+    }
+
+  sysex_transfer_set_status (transfer, controllable,
+			     SYSEX_TRANSFER_STATUS_FINISHED);
+
+  return transfer->err;
+}
+
+//The ring buffer is reset by the caller and there is nothing else to drain.
+
+void
+backend_rx_drain_int (struct backend *backend)
+{
+}
+
+gboolean
+backend_check_int (struct backend *backend)
+{
+  return backend->device != NULL;
+}
+
+void
+backend_fill_devices_array (GArray *devices)
+{
+  struct backend_device *backend_device;
+  const struct loopback_model **model = LOOPBACK_MODELS;
+
+  while (*model)
+    {
+      backend_device = g_malloc (sizeof (struct backend_device));
+      backend_device->type = BE_TYPE_MIDI;
+      snprintf (backend_device->id, LABEL_MAX, "%s", (*model)->name);
+      snprintf (backend_device->name, LABEL_MAX, "%s",
+		(*model)->device_name);
+      g_array_append_vals (devices, backend_device, 1);
+      g_free (backend_device);
+      model++;
+    }
+}
+
+const gchar *
+backend_strerror (struct backend *backend, gint err)
+{
+  return g_strerror (err < 0 ? -err : err);
+}
+
+const gchar *
+backend_name ()
+{
+  return "Loopback";
+}
+
+GByteArray *
+loopback_file_load (const gchar *path)
+{
+  gchar *data;
+  gsize len;
+
+  if (!g_file_get_contents (path, &data, &len, NULL))
+    {
+      return NULL;
+    }
+
+  return g_byte_array_new_take ((guint8 *) data, len);
+}
+
+gint
+loopback_file_save (const gchar *path, GByteArray *content)
+{
+  return file_save_data (path, content->data, content->len);
+}
+
+//Returns the sorted entry names of a directory.
+
+GSList *
+loopback_dir_list (const gchar *path)
+{
+  GDir *dir;
+  const gchar *name;
+  GSList *names = NULL;
+
+  dir = g_dir_open (path, 0, NULL);
+  if (!dir)
+    {
+      return NULL;
+    }
+
+  while ((name = g_dir_read_name (dir)))
+    {
+      names = g_slist_insert_sorted (names, g_strdup (name),
+				     (GCompareFunc) g_strcmp0);
+    }
+  g_dir_close (dir);
+
+  return names;
+}
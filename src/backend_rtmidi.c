@@ -21,8 +21,6 @@
 #include <rtmidi_c.h>
 #include "backend.h"
 
-#define RTMIDI_TMP_BUFF_SIZE 1024
-
 #if defined(__linux__)
 #define ELEKTROID_RTMIDI_API RTMIDI_API_LINUX_ALSA
 #define FIRST_OUTPUT_PORT 1	//Skip Midi Through
@@ -46,6 +44,8 @@ backend_destroy_int (struct backend *backend)
 {
   if (backend->inputp)
     {
+      backend_rx_ring_stop (backend);
+      rtmidi_in_cancel_callback (backend->inputp);
       rtmidi_close_port (backend->inputp);
       rtmidi_in_free (backend->inputp);
       backend->inputp = NULL;
@@ -56,11 +56,17 @@ backend_destroy_int (struct backend *backend)
       rtmidi_in_free (backend->outputp);
       backend->outputp = NULL;
     }
-  if (backend->buffer)
-    {
-      g_free (backend->buffer);
-      backend->buffer = NULL;
-    }
+  backend_rx_ring_free (backend);
+}
+
+// RtMidi calls this from its own thread with complete messages, SysEx included.
+
+static void
+backend_rx_callback (double timestamp, const unsigned char *message,
+		     size_t size, void *data)
+{
+  struct backend *backend = data;
+  backend_rx_ring_push (backend, message, size);
 }
 
 gint
@@ -81,7 +87,6 @@ backend_init_int (struct backend *backend, const gchar *id)
 
   backend->inputp = NULL;
   backend->outputp = NULL;
-  backend->buffer = NULL;
 
   if (!(inputp = rtmidi_in_create_default ()))
     {
@@ -129,12 +134,13 @@ backend_init_int (struct backend *backend, const gchar *id)
 						  PACKAGE_NAME,
 						  BE_INT_BUFF_SIZE);
 	      rtmidi_in_ignore_types (backend->inputp, false, true, true);
+	      backend_rx_ring_init (backend);
+	      rtmidi_in_set_callback (backend->inputp, backend_rx_callback,
+				      backend);
 	      rtmidi_open_port (backend->inputp, i, PACKAGE_NAME);
 	      backend->outputp =
 		rtmidi_out_create (ELEKTROID_RTMIDI_API, PACKAGE_NAME);
 	      rtmidi_open_port (backend->outputp, j, PACKAGE_NAME);
-
-	      backend->buffer = g_byte_array_sized_new (BE_INT_BUFF_SIZE);
 	      goto cleanup_output;
 	    }
 	}
@@ -194,41 +200,11 @@ backend_tx_raw (struct backend *backend, guint8 *data, guint len)
   return transfer.err ? transfer.err : len;
 }
 
+//The ring buffer is reset by the caller and the callback API leaves nothing else to drain.
+
 void
 backend_rx_drain_int (struct backend *backend)
 {
-  guint8 tmp[RTMIDI_TMP_BUFF_SIZE];
-  while (1)
-    {
-      size_t size = RTMIDI_TMP_BUFF_SIZE;
-      //The size is not important here. As long as there are no more data.
-      rtmidi_in_get_message (backend->inputp, tmp, &size);
-      if (size == 0)
-	{
-	  break;
-	}
-    }
-}
-
-// rtmidi_in_get_message requires enough space in the buffer to store the message.
-// As this is unknown, quite a large buffer needs to be allocated for this.
-
-ssize_t
-backend_rx_raw (struct backend *backend, guint8 *buffer, guint s)
-{
-  size_t size = s;
-  rtmidi_in_get_message (backend->inputp, buffer, &size);
-  if (!backend->inputp->ok)
-    {
-      return -EIO;
-    }
-
-  if (!size)
-    {
-      usleep (BE_POLL_TIMEOUT_MS * 1000);
-    }
-
-  return size;
 }
 
 gboolean
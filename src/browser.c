@@ -1107,9 +1107,345 @@ browser_load_dir_runner_show_spinner_and_lock_browser (gpointer data)
   return FALSE;
 }
 
+//Item info loading
+//Some filesystems need additional requests per item to fill the info column. These are done in the background once the directory has been listed.
+//Only the visible rows are loaded and the results are shown in batches. The rows that become visible after scrolling are loaded then.
+//Stopping the loading does not block the main thread. Workers are tagged with a generation and they stop before the next request once it changes, while their pending results are dropped. They are joined from the main loop when they finish.
+
+struct browser_item_info
+{
+  GtkTreeRowReference *reference;
+  gchar *name;
+  gint32 id;
+  gint64 size;
+  gchar *info;
+  gboolean renamed;
+};
+
+struct browser_item_info_batch
+{
+  struct browser *browser;
+  guint generation;
+  GSList *items;
+};
+
+//The directory and the filesystem are kept as the browser ones might change before the thread is stopped.
+struct browser_item_info_data
+{
+  struct browser *browser;
+  guint generation;
+  const struct fs_operations *fs_ops;
+  gchar *dir;
+  GSList *items;
+};
+
+struct browser_item_info_worker
+{
+  struct browser *browser;
+  GThread *thread;
+};
+
+static void
+browser_item_info_free (gpointer data)
+{
+  struct browser_item_info *item_info = data;
+  gtk_tree_row_reference_free (item_info->reference);
+  g_free (item_info->name);
+  g_free (item_info->info);
+  g_free (item_info);
+}
+
+static gboolean
+browser_item_info_set_batch (gpointer data)
+{
+  GtkTreeIter iter;
+  GtkTreePath *path;
+  struct browser_item_info_batch *batch = data;
+  GtkTreeModel *model = gtk_tree_view_get_model (batch->browser->view);
+  //The generation is only changed in the main thread.
+  gboolean stale = batch->generation != batch->browser->item_info_generation;
+
+  for (GSList *e = batch->items; e; e = e->next)
+    {
+      struct browser_item_info *item_info = e->data;
+
+      if (stale || (!item_info->info && !item_info->renamed) ||
+	  !gtk_tree_row_reference_valid (item_info->reference))
+	{
+	  continue;
+	}
+
+      path = gtk_tree_row_reference_get_path (item_info->reference);
+      if (gtk_tree_model_get_iter (model, &iter, path))
+	{
+	  if (item_info->info)
+	    {
+	      gtk_list_store_set (GTK_LIST_STORE (model), &iter,
+				  BROWSER_LIST_STORE_INFO_FIELD,
+				  item_info->info, -1);
+	    }
+	  if (item_info->renamed)
+	    {
+	      gtk_list_store_set (GTK_LIST_STORE (model), &iter,
+				  BROWSER_LIST_STORE_NAME_FIELD,
+				  item_info->name, -1);
+	    }
+	}
+      gtk_tree_path_free (path);
+    }
+
+  g_slist_free_full (batch->items, browser_item_info_free);
+  g_free (batch);
+
+  return G_SOURCE_REMOVE;
+}
+
+static gboolean
+browser_item_info_join (gpointer data)
+{
+  struct browser_item_info_worker *worker = data;
+
+  g_thread_join (worker->thread);
+  worker->browser->item_info_workers--;
+  g_free (worker);
+
+  return G_SOURCE_REMOVE;
+}
+
+static gboolean
+browser_item_info_is_current (struct browser_item_info_data *info_data)
+{
+  gboolean current;
+  struct browser *browser = info_data->browser;
+
+  g_mutex_lock (&browser->mutex);
+  current = info_data->generation == browser->item_info_generation;
+  g_mutex_unlock (&browser->mutex);
+
+  return current;
+}
+
+static gpointer
+browser_item_info_runner (gpointer data)
+{
+  gint err;
+  guint len;
+  struct item item;
+  gboolean loading = TRUE;
+  struct browser_item_info_worker *worker;
+  struct browser_item_info_data *info_data = data;
+  struct browser *browser = info_data->browser;
+  struct browser_item_info *item_info;
+  struct browser_item_info_batch *batch;
+  GSList *items = info_data->items;
+
+  debug_print (1, "Loading item info in %s...", info_data->dir);
+
+  while (items)
+    {
+      batch = g_malloc (sizeof (struct browser_item_info_batch));
+      batch->browser = browser;
+      batch->generation = info_data->generation;
+      batch->items = NULL;
+
+      for (len = 0; items && len < BROWSER_ITEM_INFO_BATCH_LEN; len++)
+	{
+	  item_info = items->data;
+	  items = g_slist_delete_link (items, items);
+	  batch->items = g_slist_prepend (batch->items, item_info);
+
+	  loading = loading && browser_item_info_is_current (info_data);
+	  if (!loading)
+	    {
+	      continue;
+	    }
+
+	  item.type = ITEM_TYPE_FILE;
+	  snprintf (item.name, ITEM_NAME_MAX, "%s", item_info->name);
+	  item.id = item_info->id;
+	  item.size = item_info->size;
+	  item.object_info[0] = 0;
+
+	  err = info_data->fs_ops->get_item_info (browser->backend,
+						  info_data->dir, &item);
+	  if (err)
+	    {
+	      continue;
+	    }
+
+	  if (*item.object_info)
+	    {
+	      item_info->info = g_strdup (item.object_info);
+	    }
+
+	  //Some filesystems also set the name as it might be slow to get.
+	  if (strcmp (item.name, item_info->name))
+	    {
+	      g_free (item_info->name);
+	      item_info->name = g_strdup (item.name);
+	      item_info->renamed = TRUE;
+	    }
+	}
+
+      //The rows are freed in the main thread even if the loading was canceled.
+      g_idle_add (browser_item_info_set_batch, batch);
+    }
+
+  debug_print (1, "Item info %s", loading ? "loaded" : "loading stopped");
+
+  g_free (info_data->dir);
+  g_free (info_data);
+
+  worker = g_malloc (sizeof (struct browser_item_info_worker));
+  worker->browser = browser;
+  worker->thread = g_thread_self ();
+  g_idle_add (browser_item_info_join, worker);
+
+  return NULL;
+}
+
+//This only signals the workers so it does not block.
+
+void
+browser_stop_item_info (struct browser *browser)
+{
+  g_mutex_lock (&browser->mutex);
+  browser->item_info_generation++;
+  g_mutex_unlock (&browser->mutex);
+}
+
+//This must be called before the backend is no longer usable by the workers.
+
+void
+browser_wait_item_info (struct browser *browser)
+{
+  browser_stop_item_info (browser);
+  while (browser->item_info_workers)
+    {
+      gtk_main_iteration ();
+    }
+}
+
+static void
+browser_start_item_info (struct browser *browser)
+{
+  gint32 id;
+  gint64 size;
+  gchar *name, *info;
+  GtkTreeIter iter;
+  GtkTreePath *path;
+  enum item_type type;
+  GtkTreePath *start, *end;
+  GSList *items = NULL;
+  GtkTreeModel *model = gtk_tree_view_get_model (browser->view);
+  struct browser_item_info *item_info;
+  struct browser_item_info_data *info_data;
+
+  if (!browser->fs_ops || !browser->fs_ops->get_item_info)
+    {
+      return;
+    }
+
+  //Before the first layout there is no visible range. The rows are loaded later when the adjustment changes.
+  if (!gtk_tree_view_get_visible_range (browser->view, &start, &end))
+    {
+      return;
+    }
+
+  path = gtk_tree_path_copy (start);
+  while (gtk_tree_path_compare (path, end) <= 0 &&
+	 gtk_tree_model_get_iter (model, &iter, path))
+    {
+      gtk_tree_model_get (model, &iter, BROWSER_LIST_STORE_NAME_FIELD, &name,
+			  BROWSER_LIST_STORE_ID_FIELD, &id,
+			  BROWSER_LIST_STORE_SIZE_FIELD, &size,
+			  BROWSER_LIST_STORE_TYPE_FIELD, &type,
+			  BROWSER_LIST_STORE_INFO_FIELD, &info, -1);
+
+      if (type == ITEM_TYPE_FILE && (!info || !*info))
+	{
+	  item_info = g_malloc (sizeof (struct browser_item_info));
+	  item_info->reference = gtk_tree_row_reference_new (model, path);
+	  item_info->name = name;
+	  item_info->id = id;
+	  item_info->size = size;
+	  item_info->info = NULL;
+	  item_info->renamed = FALSE;
+	  name = NULL;
+
+	  items = g_slist_prepend (items, item_info);
+	}
+
+      g_free (name);
+      g_free (info);
+      gtk_tree_path_next (path);
+    }
+
+  gtk_tree_path_free (path);
+  gtk_tree_path_free (start);
+  gtk_tree_path_free (end);
+
+  if (!items)
+    {
+      return;
+    }
+
+  //A worker loading rows that are no longer visible is not needed anymore.
+  browser_stop_item_info (browser);
+
+  info_data = g_malloc (sizeof (struct browser_item_info_data));
+  info_data->browser = browser;
+  info_data->generation = browser->item_info_generation;
+  info_data->fs_ops = browser->fs_ops;
+  info_data->dir = g_strdup (browser->dir);
+  info_data->items = g_slist_reverse (items);
+
+  browser->item_info_workers++;
+  //The worker is joined from the main loop when it finishes.
+  g_thread_new ("browser_item_info_thread", browser_item_info_runner,
+		info_data);
+}
+
+static gboolean
+browser_item_info_scroll_timeout (gpointer data)
+{
+  gboolean loading;
+  struct browser *browser = data;
+
+  browser->item_info_timeout_id = 0;
+
+  g_mutex_lock (&browser->mutex);
+  loading = browser->loading;
+  g_mutex_unlock (&browser->mutex);
+
+  if (!loading && !browser->search_mode)
+    {
+      browser_start_item_info (browser);
+    }
+
+  return G_SOURCE_REMOVE;
+}
+
+//The loading waits until the scrolling stops so that rows that are only visible for a moment are not loaded.
+
+static void
+browser_item_info_scrolled (GtkAdjustment *adjustment, gpointer data)
+{
+  struct browser *browser = data;
+
+  if (browser->item_info_timeout_id)
+    {
+      g_source_remove (browser->item_info_timeout_id);
+    }
+  browser->item_info_timeout_id =
+    g_timeout_add (BROWSER_ITEM_INFO_SCROLL_MS,
+		   browser_item_info_scroll_timeout, browser);
+}
+
 static void
 browser_wait (struct browser *browser)
 {
+  browser_stop_item_info (browser);
   while (browser->thread)
     {
       g_thread_join (browser->thread);
@@ -1195,6 +1531,10 @@ browser_load_dir_runner_update_ui (gpointer data)
       debug_print (1, "Processing pending requests...");
       browser_load_dir (browser);
     }
+  else if (!browser->search_mode)
+    {
+      browser_start_item_info (browser);
+    }
 
   return FALSE;
 }
@@ -1594,6 +1934,7 @@ browser_load_dir (gpointer data)
     }
   g_mutex_unlock (&browser->mutex);
 
+  browser_stop_item_info (browser);
   browser_clear (browser);
 
   if (!browser->fs_ops || !browser->fs_ops->readdir)
@@ -1606,6 +1947,90 @@ browser_load_dir (gpointer data)
   return FALSE;
 }
 
+struct browser_update_item_data
+{
+  struct browser_add_dentry_item_data *add_data;
+  gchar *dir;
+};
+
+//The row with the same name is replaced. As the model is sorted, the row is shown at the same position.
+
+static gboolean
+browser_update_item_runner (gpointer data)
+{
+  gchar *name;
+  gboolean loading, found;
+  GtkTreeIter iter;
+  struct browser_update_item_data *update_data = data;
+  struct browser_add_dentry_item_data *add_data = update_data->add_data;
+  struct browser *browser = add_data->browser;
+  GtkTreeModel *model = gtk_tree_view_get_model (browser->view);
+
+  g_mutex_lock (&browser->mutex);
+  loading = browser->loading;
+  g_mutex_unlock (&browser->mutex);
+
+  //If the directory is being loaded or has changed, the item will be in the listing anyway.
+  if (loading || browser->search_mode || !browser->dir ||
+      strcmp (browser->dir, update_data->dir))
+    {
+      item_sample_info_clear (&add_data->item, browser);
+      g_free (add_data->rel_path);
+      g_free (add_data);
+      goto end;
+    }
+
+  found = gtk_tree_model_get_iter_first (model, &iter);
+  while (found)
+    {
+      gtk_tree_model_get (model, &iter, BROWSER_LIST_STORE_NAME_FIELD, &name,
+			  -1);
+      if (!strcmp (name, add_data->rel_path))
+	{
+	  g_free (name);
+	  gtk_list_store_remove (GTK_LIST_STORE (model), &iter);
+	  break;
+	}
+      g_free (name);
+      found = gtk_tree_model_iter_next (model, &iter);
+    }
+
+  debug_print (1, "%s item %s in %s...", found ? "Updating" : "Adding",
+	       add_data->rel_path, update_data->dir);
+
+  browser_add_dentry_item (add_data);
+
+end:
+  g_free (update_data->dir);
+  g_free (update_data);
+  return G_SOURCE_REMOVE;
+}
+
+//This inserts or updates an item in the current directory without listing it again. As it reads the browser state, it must be called from the main thread.
+//The item is copied and its tags are referenced.
+
+void
+browser_update_item (struct browser *browser, const gchar *dir,
+		     struct item *item)
+{
+  struct browser_update_item_data *data;
+  struct browser_add_dentry_item_data *add_data;
+
+  add_data = g_malloc (sizeof (struct browser_add_dentry_item_data));
+  add_data->browser = browser;
+  memcpy (&add_data->item, item, sizeof (struct item));
+  item_sample_info_ref_tags (item, browser);
+  add_data->icon = item->type == ITEM_TYPE_DIR ? DIR_ICON :
+    browser_get_icon (browser);
+  add_data->rel_path = strdup (item->name);
+
+  data = g_malloc (sizeof (struct browser_update_item_data));
+  data->add_data = add_data;
+  data->dir = strdup (dir);
+
+  g_idle_add (browser_update_item_runner, data);
+}
+
 gboolean
 browser_load_dir_if_needed (gpointer data)
 {
@@ -2418,6 +2843,13 @@ browser_destroy (struct browser *browser)
       gtk_main_iteration_do (TRUE);
     }
 
+  if (browser->item_info_timeout_id)
+    {
+      g_source_remove (browser->item_info_timeout_id);
+      browser->item_info_timeout_id = 0;
+    }
+  browser_wait_item_info (browser);
+
   notifier_destroy (browser->notifier);
   g_slist_free (browser->sensitive_widgets);
   g_hash_table_destroy (browser->folder_size_cache);
@@ -2730,6 +3162,12 @@ browser_init (struct browser *browser)
 		    browser);
   g_signal_connect (browser->view, "row-activated",
 		    G_CALLBACK (browser_item_activated), browser);
+  g_signal_connect (gtk_scrollable_get_vadjustment
+		    (GTK_SCROLLABLE (browser->view)), "value-changed",
+		    G_CALLBACK (browser_item_info_scrolled), browser);
+  g_signal_connect (gtk_scrollable_get_vadjustment
+		    (GTK_SCROLLABLE (browser->view)), "changed",
+		    G_CALLBACK (browser_item_info_scrolled), browser);
   g_signal_connect (browser->up_button, "clicked",
 		    G_CALLBACK (browser_go_up), browser);
   g_signal_connect (browser->add_dir_button, "clicked",
@@ -2774,6 +3212,8 @@ browser_init (struct browser *browser)
 		     GDK_ACTION_COPY | GDK_ACTION_MOVE);
 
   browser->reload_item_in_editor = TRUE;
+  browser->item_info_generation = 0;
+  browser->item_info_workers = 0;
   browser->folder_size_cache =
     g_hash_table_new_full (g_str_hash, g_str_equal, g_free, g_free);
   notifier_init (&browser->notifier, browser);
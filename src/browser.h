@@ -29,6 +29,9 @@
 
 #define SIZE_LABEL_LEN 16
 
+#define BROWSER_ITEM_INFO_BATCH_LEN 8
+#define BROWSER_ITEM_INFO_SCROLL_MS 250
+
 //Common columns
 #define BROWSER_LIST_STORE_ICON_FIELD 0
 #define BROWSER_LIST_STORE_NAME_FIELD 1	//This is the value returned by the funciton se in the get_item_key member in struct fs_operations. It's the filename.
@@ -100,6 +103,10 @@ struct browser
   gboolean dirty;
   gboolean search_mode;
   struct browser_search_options search_options;
+  //Item info loading members
+  guint item_info_generation;	//Incremented every time the loading is stopped. Workers and results of an older generation are stale.
+  guint item_info_workers;
+  guint item_info_timeout_id;	//Pending loading after scrolling.
   gint64 last_selected_index;	//This needs space for gint and -1
   gboolean selection_active;
   //Menu
@@ -161,6 +168,9 @@ gboolean browser_load_dir (gpointer);
 
 gboolean browser_load_dir_if_needed (gpointer);
 
+void browser_update_item (struct browser *browser, const gchar * dir,
+			  struct item *item);
+
 void browser_update_fs_options (struct browser *);
 
 void browser_reset (struct browser *);
@@ -169,6 +179,10 @@ void browser_close_search (GtkSearchEntry *, gpointer);
 
 void browser_cancel (struct browser *browser);
 
+void browser_stop_item_info (struct browser *browser);
+
+void browser_wait_item_info (struct browser *browser);
+
 gboolean browser_no_progress_needed (struct browser *browser);
 
 void browser_init_all (GtkBuilder *);
@@ -88,3 +88,43 @@ item_set_object_info (struct item *item, const gchar *format, ...)
   vsnprintf (item->object_info, ITEM_OBJECT_INFO_MAX, format, args);
   va_end (args);
 }
+
+static gint
+connector_get_midi_id_field_score (const guint8 *id, guint len,
+				   const gchar *field)
+{
+  if (!len)
+    {
+      return 0;
+    }
+  return memcmp (id, field, len) ? -1 : len;
+}
+
+gint
+connector_get_midi_id_score (const struct connector *connector,
+			     const struct backend_midi_info *midi_info)
+{
+  gint company, family, model;
+  const struct connector_midi_id *midi_id = connector->midi_id;
+
+  if (!midi_id)
+    {
+      return 0;
+    }
+
+  company = connector_get_midi_id_field_score (midi_id->company,
+					       midi_id->company_len,
+					       midi_info->company);
+  family = connector_get_midi_id_field_score (midi_id->family,
+					      midi_id->family_len,
+					      midi_info->family);
+  model = connector_get_midi_id_field_score (midi_id->model,
+					     midi_id->model_len,
+					     midi_info->model);
+  if (company < 0 || family < 0 || model < 0)
+    {
+      return -1;
+    }
+
+  return company + family + model;
+}
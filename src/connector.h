@@ -122,6 +122,20 @@ typedef void (*fs_select_item) (struct backend *, const gchar *,
 
 typedef gboolean (*fs_file_exists) (struct backend *, const gchar *);
 
+typedef gint (*fs_get_item_info) (struct backend *, const gchar *,
+				  struct item *);
+
+struct fs_upload_batch_item
+{
+  gchar *path;			//Upload path as returned by get_upload_path.
+  struct idata idata;
+  gint err;			//Status of this upload. Set by upload_batch.
+};
+
+//The list contains struct fs_upload_batch_item. The return value is only used for errors affecting the whole batch.
+typedef gint (*fs_upload_batch) (struct backend *, GSList *,
+				 struct task_control *);
+
 // All the function members that return gint should return 0 if no error and a negative number in case of error.
 // errno values are recommended as will provide the user with a meaningful message. In particular,
 // ENOSYS could be used when a particular device does not support a feature that other devices implementing the same filesystem do.
@@ -149,6 +163,7 @@ struct fs_operations
   fs_src_dst_func swap;
   fs_remote_file_op download;	//Donload a resource from the filesystem to memory.
   fs_remote_file_op upload;	//Upload a resource from memory to the filesystem.
+  fs_upload_batch upload_batch;	//Optionally used to upload several resources at once when this is faster than uploading them one by one.
   fs_remote_file_op save;	//Write a file from memory to the OS storage. Typically used after download.
   fs_remote_file_op load;	//Load a file from the OS storage into memory. Typically used before upload.
   fs_get_item_slot get_slot;	//Optionally used by slot filesystems to show a custom slot name column such `A01` or `[P-01]`. Needs FS_OPTION_SHOW_SLOT_COLUMN.
@@ -156,6 +171,7 @@ struct fs_operations
   fs_get_path get_upload_path;
   fs_get_path get_download_path;
   fs_select_item select_item;
+  fs_get_item_info get_item_info;	//Optionally used to fill the object info or the name of an item in a directory after it has been listed. This allows listings to skip slow requests. The object info needs FS_OPTION_SHOW_INFO_COLUMN to be shown.
 };
 
 enum fs_options
@@ -186,6 +202,17 @@ enum fs_options
 
 typedef gint (*connector_handshake) (struct backend * backend);
 
+//MIDI identity claimed by a connector. Only the first len bytes of every field are compared. A field with len 0 matches anything.
+struct connector_midi_id
+{
+  const guint8 *company;
+  guint company_len;
+  const guint8 *family;
+  guint family_len;
+  const guint8 *model;
+  guint model_len;
+};
+
 struct connector
 {
   const gchar *name;		// This needs to be unique among all the connectors. Using spaces is discouraged and hyphen is the suggested replacement.
@@ -195,6 +222,8 @@ struct connector
   const gchar *device_name;	//Only used for non MIDI devices when a virtual device is created.
   //If the backend device name matches this regex, the handshake will be run before than the connectors that didn't match.
   const gchar *regex;
+  //If the MIDI identity reply matches this, the handshake will be run before any other. If it does not match, the handshake will not be run at all.
+  const struct connector_midi_id *midi_id;
 };
 
 enum connector_options
@@ -229,4 +258,11 @@ void item_set_name (struct item *item, const gchar * format, ...);
 
 void item_set_object_info (struct item *item, const gchar * format, ...);
 
+/**
+ * Returns how well the MIDI identity of a device matches the one claimed by a connector.
+ * @return The amount of matching bytes, 0 if the connector claims no identity or -1 if it does not match.
+ */
+gint connector_get_midi_id_score (const struct connector *connector,
+				  const struct backend_midi_info *midi_info);
+
 #endif
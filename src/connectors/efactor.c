@@ -48,6 +48,7 @@
 #define EFACTOR_READ_DIR_TIMEOUT_MS 30000	//20 s is not enough with RtMidi.
 
 #define EFACTOR_WRITE_SLEEP_TIME_S 3
+#define EFACTOR_REST_TIME_US 1000000	//Time needed by the internal relays after a preset dump.
 
 #define EFACTOR_PEDAL_NAME(data) (data->type == EFACTOR_FACTOR ? EFACTOR_FACTOR_NAME_PREFIX : EFACTOR_H9_NAME_PREFIX)
 
@@ -161,7 +162,7 @@ efactor_read_dir (struct backend *backend, struct item_iterator *iter,
     {
       //Reading from the device switches off and on the internal relays.
       //In case we call this function again just after calling it, we give the device some time to do it.
-      sleep (1);
+      backend_pacing_rest (backend);
     }
 
   tx_msg = efactor_new_op_msg (EFACTOR_OP_PRESETS_WANT);
@@ -244,7 +245,7 @@ efactor_download (struct backend *backend, const gchar *path,
 
   idata_init (preset, output, strdup (name), NULL, NULL);
 
-  sleep (1);
+  backend_pacing_rest (backend);
 
   return err;
 }
@@ -364,7 +365,7 @@ efactor_rename (struct backend *backend, const gchar *src, const gchar *dst)
   g_free (sanitized);
   g_strfreev (lines);
 
-  rx_msg = backend_tx_and_rx_sysex (backend, preset, 100);	//There must be no response.
+  rx_msg = backend_tx_and_probe_sysex (backend, preset, 100);	//There must be no response.
   if (rx_msg)
     {
       err = -EIO;
@@ -552,12 +553,26 @@ efactor_handshake (struct backend *backend)
 
   snprintf (backend->name, LABEL_MAX, "%s", EFACTOR_PEDAL_NAME (data));
 
+  //The relays need this time at least, no matter how fast the device answers.
+  backend_pacing_init_with_min (backend, EFACTOR_REST_TIME_US,
+				EFACTOR_REST_TIME_US);
+
   return 0;
 }
 
+static const struct connector_midi_id EFACTOR_MIDI_ID = {
+  .company = EVENTIDE_ID,
+  .company_len = sizeof (EVENTIDE_ID),
+  .family = FAMILY_ID,
+  .family_len = sizeof (FAMILY_ID),
+  .model = MODEL_ID,
+  .model_len = sizeof (MODEL_ID)
+};
+
 const struct connector CONNECTOR_EFACTOR = {
   .handshake = efactor_handshake,
   .name = "efactor",
   .options = CONNECTOR_OPTION_CUSTOM_HANDSHAKE,
-  .regex = ".*Factor Pedal.*"
+  .regex = ".*Factor Pedal.*",
+  .midi_id = &EFACTOR_MIDI_ID
 };
@@ -25,6 +25,7 @@
 #include "common.h"
 #include "elektron.h"
 #include "elektron_pkg.h"
+#include "elektron_cache.h"
 #include "sample_ops.h"
 #include "../config.h"
 
@@ -36,6 +37,7 @@
 #define DEV_TAG_STORAGE "storage"
 
 #define RAM_OP_DEF_DIR "/incoming"
+#define RAM_SETTLE_TIME_US 1000000	//Time needed for the loaded RAM slots to be available.
 
 static const gchar *FS_TYPE_NAMES[] = { "+Drive", "RAM", NULL };
 
@@ -43,7 +45,9 @@ static const gchar *FS_RAW_ANY_EXTS[] = { "raw", NULL };
 static const gchar *FS_DATA_ANY_EXTS[] = { "data", NULL };
 
 #define DATA_TRANSF_BLOCK_BYTES 0x2000
+#define ELEKTRON_BLK_MAX_RETRIES 3
 #define OS_TRANSF_BLOCK_BYTES 0x800
+#define OS_TRANSF_BLOCK_BYTES_MAX 0x2000	//Tried first if PREF_KEY_ELEKTRON_OS_BIG_BLOCKS is set. Devices rejecting it fall back to OS_TRANSF_BLOCK_BYTES.
 #define MAX_ZIP_SIZE (128 * 1024 * 1024)
 
 #define FS_DATA_PRJ_PREFIX "/projects"
@@ -52,6 +56,8 @@ static const gchar *FS_DATA_ANY_EXTS[] = { "data", NULL };
 #define FS_DATA_SAMPLES_PREFIX "/samples"
 #define FS_SMPLRW_START_POS 5
 #define FS_DATA_START_POS 18
+#define FS_DATA_LIST_PAGE_LEN 128
+#define FS_DATA_LIST_PREFETCH_PAGES 2
 #define FS_RAM_SLOTS_START_POS 5
 #define FS_SAMPLES_SIZE_POS_W 21
 #define FS_SAMPLES_LAST_FRAME_POS_W 33
@@ -61,6 +67,7 @@ static const gchar *FS_DATA_ANY_EXTS[] = { "data", NULL };
 #define ELEKTRON_DATA_SAMPLE_MAX_LEN 16
 
 #define ELEKTRON_SAMPLE_INFO_PAD_I32_LEN 10
+#define ELEKTRON_SAMPLE_HASH_BUF_LEN 1024
 #define ELEKTRON_LOOP_TYPE_FWD 0
 #define ELEKTRON_LOOP_TYPE_NO 0x7f
 
@@ -112,6 +119,7 @@ struct elektron_iterator_data
   gint32 max_slots;
   struct backend *backend;
   gboolean load_metadata;
+  struct elektron_list_pager *pager;	//NULL if the whole listing is in msg.
 };
 
 struct __attribute__((packed)) elektron_data_header
@@ -161,6 +169,11 @@ typedef GByteArray *(*elektron_msg_write_blk_func) (guint, GByteArray *,
 
 typedef void (*elektron_copy_array) (GByteArray *, GByteArray *);
 
+//Returns NULL after the last block.
+typedef GByteArray *(*elektron_blk_msg_func) (guint, void *);
+
+typedef gint (*elektron_blk_reply_func) (guint, GByteArray *, void *);
+
 typedef gint (*elektron_path_func) (struct backend *, const gchar *);
 
 typedef gint (*elektron_src_dst_func) (struct backend *, const gchar *,
@@ -195,6 +208,9 @@ static gint elektron_upload_raw_pst_pkg (struct backend *, const gchar *,
 					 struct idata *,
 					 struct task_control *);
 
+static GByteArray *elektron_list_pager_next (struct elektron_list_pager *);
+static void elektron_list_pager_free (struct elektron_list_pager *);
+
 static gboolean elektron_sample_file_exists (struct backend *, const gchar *);
 static gboolean elektron_raw_file_exists (struct backend *, const gchar *);
 const gchar **elektron_get_dev_exts (struct backend *,
@@ -322,6 +338,10 @@ static void
 elektron_free_iterator_data (void *iter_data)
 {
   struct elektron_iterator_data *data = iter_data;
+  if (data->pager)
+    {
+      elektron_list_pager_free (data->pager);
+    }
   free_msg (data->msg);
   g_free (data);
 }
@@ -366,6 +386,58 @@ elektron_get_msg_string (const GByteArray *msg)
   return (gchar *) & msg->data[6];
 }
 
+static inline gint64
+elektron_get_sample_paths_key (guint32 hash, guint32 size)
+{
+  return ((gint64) hash << 32) | size;
+}
+
+static void
+elektron_set_cached_sample_path (struct backend *backend, guint32 hash,
+				 guint32 size, const gchar *path_cp1252)
+{
+  struct elektron_data *data = backend->data;
+  gint64 *key = g_malloc (sizeof (gint64));
+
+  *key = elektron_get_sample_paths_key (hash, size);
+
+  g_mutex_lock (&data->sample_paths_mutex);
+  g_hash_table_insert (data->sample_paths, key, g_strdup (path_cp1252));
+  g_mutex_unlock (&data->sample_paths_mutex);
+}
+
+//Any sample filesystem change might make a path point to a different sample so everything is invalidated.
+
+static void
+elektron_clear_cached_sample_paths (struct backend *backend)
+{
+  struct elektron_data *data = backend->data;
+
+  g_mutex_lock (&data->sample_paths_mutex);
+  g_hash_table_remove_all (data->sample_paths);
+  g_mutex_unlock (&data->sample_paths_mutex);
+}
+
+//Returns TRUE if the sample is known. In that case, the path is NULL if the sample is not in the device.
+
+static gboolean
+elektron_get_cached_sample_path (struct backend *backend, guint32 hash,
+				 guint32 size, gchar **path_cp1252)
+{
+  gboolean found;
+  gpointer value;
+  struct elektron_data *data = backend->data;
+  gint64 key = elektron_get_sample_paths_key (hash, size);
+
+  g_mutex_lock (&data->sample_paths_mutex);
+  found = g_hash_table_lookup_extended (data->sample_paths, &key, NULL,
+					&value);
+  *path_cp1252 = found ? g_strdup (value) : NULL;
+  g_mutex_unlock (&data->sample_paths_mutex);
+
+  return found;
+}
+
 static gint
 elektron_next_smplrw_entry (struct item_iterator *iter)
 {
@@ -401,6 +473,18 @@ elektron_next_smplrw_entry (struct item_iterator *iter)
 	}
       data->pos += strlen (name_cp1252) + 1;
 
+      //Every listed sample saves a hash to path request later.
+      if (data->mode == ITER_MODE_SAMPLE && iter->item.type == ITEM_TYPE_FILE)
+	{
+	  gchar *dir_cp1252 = elektron_get_cp1252 (iter->dir);
+	  gchar *path_cp1252 = path_chain (PATH_INTERNAL, dir_cp1252,
+					   name_cp1252);
+	  elektron_set_cached_sample_path (data->backend, data->hash,
+					   iter->item.size, path_cp1252);
+	  g_free (dir_cp1252);
+	  g_free (path_cp1252);
+	}
+
       iter->item.id = -1;
       sample_info_init (&iter->item.sample_info);
 
@@ -423,6 +507,7 @@ elektron_init_iterator (struct backend *backend, struct item_iterator *iter,
   data->max_slots = max_slots;
   data->backend = backend;
   data->load_metadata = TRUE;
+  data->pager = NULL;
 
   item_iterator_init (iter, dir, data, next, elektron_free_iterator_data);
   iter->item.id = 0;		//This is needed to point to the next item id
@@ -644,6 +729,27 @@ elektron_new_msg_list (const gchar *path, int32_t start_index,
   return msg;
 }
 
+static void
+elektron_init_sample_header (struct elektron_sample_header
+			     *elektron_sample_header, guint bytes,
+			     struct sample_info *sample_info)
+{
+  //See comment in elektron_sample_header struct.
+  guint8 loop_type = sample_info->loop_type ? ELEKTRON_LOOP_TYPE_NO :
+    ELEKTRON_LOOP_TYPE_FWD;
+  elektron_sample_header->type = 0;
+  elektron_sample_header->stereo = sample_info->channels - 1;
+  memset (&elektron_sample_header->rsvd0, 0, 2);
+  elektron_sample_header->size = g_htonl (bytes);
+  elektron_sample_header->rate = g_htonl (ELEKTRON_SAMPLE_RATE);
+  elektron_sample_header->loop_start = g_htonl (sample_info->loop_start);
+  elektron_sample_header->loop_end = g_htonl (sample_info->loop_end);
+  elektron_sample_header->loop_type = loop_type;
+  memset (&elektron_sample_header->rsvd1, 0, 3);
+  memset (&elektron_sample_header->padding, 0,
+	  sizeof (guint32) * ELEKTRON_SAMPLE_INFO_PAD_I32_LEN);
+}
+
 static GByteArray *
 elektron_new_msg_write_sample_blk (guint id, GByteArray *sample,
 				   guint *total, guint seq, void *data)
@@ -667,21 +773,8 @@ elektron_new_msg_write_sample_blk (guint id, GByteArray *sample,
 
   if (seq == 0)
     {
-      //See comment in elektron_sample_header struct.
-      guint8 loop_type = sample_info->loop_type ? ELEKTRON_LOOP_TYPE_NO :
-	ELEKTRON_LOOP_TYPE_FWD;
-      elektron_sample_header.type = 0;
-      elektron_sample_header.stereo = sample_info->channels - 1;
-      memset (&elektron_sample_header.rsvd0, 0, 2);
-      elektron_sample_header.size = g_htonl (sample->len);
-      elektron_sample_header.rate = g_htonl (ELEKTRON_SAMPLE_RATE);
-      elektron_sample_header.loop_start = g_htonl (sample_info->loop_start);
-      elektron_sample_header.loop_end = g_htonl (sample_info->loop_end);
-      elektron_sample_header.loop_type = loop_type;
-      memset (&elektron_sample_header.rsvd1, 0, 3);
-      memset (&elektron_sample_header.padding, 0,
-	      sizeof (guint32) * ELEKTRON_SAMPLE_INFO_PAD_I32_LEN);
-
+      elektron_init_sample_header (&elektron_sample_header, sample->len,
+				   sample_info);
       g_byte_array_append (msg, (guchar *) & elektron_sample_header,
 			   sizeof (struct elektron_sample_header));
 
@@ -826,19 +919,26 @@ elektron_raw_to_msg (GByteArray *sysex)
   return msg;
 }
 
+static void
+elektron_set_msg_seq (struct backend *backend, const GByteArray *msg)
+{
+  guint16 aux;
+  struct elektron_data *data = backend->data;
+
+  aux = g_htons (data->seq);
+  memcpy (msg->data, &aux, sizeof (guint16));
+  data->seq++;
+}
+
 static gint
 elektron_tx (struct backend *backend, const GByteArray *msg,
 	     struct controllable *controllable)
 {
   gint res;
-  guint16 aux;
   gchar *text;
   struct sysex_transfer transfer;
-  struct elektron_data *data = backend->data;
 
-  aux = g_htons (data->seq);
-  memcpy (msg->data, &aux, sizeof (guint16));
-  data->seq++;
+  elektron_set_msg_seq (backend, msg);
 
   sysex_transfer_init_tx (&transfer, elektron_msg_to_raw (msg));
 
@@ -965,6 +1065,324 @@ elektron_tx_and_rx (struct backend *backend, GByteArray *tx_msg,
   return elektron_tx_and_rx_timeout (backend, tx_msg, -1, controllable);
 }
 
+//If enabled, data listings are requested in pages. The first one is requested synchronously and the rest are requested by a thread that keeps a few pages ahead of the iterator.
+//As every page is a regular request, other requests can be done while iterating.
+//As the meaning of the page fields has not been confirmed in every device, this is disabled by default and the whole listing is requested at once.
+
+struct elektron_list_pager
+{
+  struct backend *backend;
+  gchar *path;
+  guint32 start;
+  GThread *thread;
+  GMutex mutex;
+  GCond cond;
+  GQueue pages;
+  gboolean done;
+  gboolean stop;
+};
+
+static inline guint32
+elektron_get_list_msg_u32 (const GByteArray *msg, guint pos)
+{
+  guint32 v;
+  memcpy (&v, &msg->data[pos], sizeof (guint32));
+  return g_ntohl (v);
+}
+
+//Returns the start of the next page or 0 if this is the last one.
+//An empty page does not end the listing while the total count is not reached. As the page start always moves forward, this ends.
+
+guint32
+elektron_get_list_msg_next_start (const GByteArray *msg)
+{
+  guint32 start, end, total, next;
+
+  if (msg->len < FS_DATA_START_POS)
+    {
+      return 0;
+    }
+
+  start = elektron_get_list_msg_u32 (msg, 6);
+  end = elektron_get_list_msg_u32 (msg, 10);
+  total = elektron_get_list_msg_u32 (msg, 14);
+
+  //Devices not honoring the page boundaries reply with the whole listing, which ends here too.
+  next = end > start ? end : start + FS_DATA_LIST_PAGE_LEN;
+  return next < total ? next : 0;
+}
+
+static gpointer
+elektron_list_pager_runner (gpointer data)
+{
+  gboolean stop;
+  GByteArray *tx_msg, *rx_msg;
+  struct elektron_list_pager *pager = data;
+
+  while (pager->start)
+    {
+      g_mutex_lock (&pager->mutex);
+      while (!pager->stop &&
+	     g_queue_get_length (&pager->pages) >=
+	     FS_DATA_LIST_PREFETCH_PAGES)
+	{
+	  g_cond_wait (&pager->cond, &pager->mutex);
+	}
+      stop = pager->stop;
+      g_mutex_unlock (&pager->mutex);
+
+      if (stop)
+	{
+	  break;
+	}
+
+      debug_print (2, "Requesting %s listing page from %d...", pager->path,
+		   pager->start);
+
+      tx_msg = elektron_new_msg_list (pager->path, pager->start,
+				      pager->start + FS_DATA_LIST_PAGE_LEN,
+				      FALSE);
+      rx_msg = elektron_tx_and_rx (pager->backend, tx_msg, NULL);
+      if (!rx_msg)
+	{
+	  error_print ("Error while listing %s. Listing is incomplete.",
+		       pager->path);
+	  break;
+	}
+
+      if (!elektron_get_msg_status (rx_msg))
+	{
+	  free_msg (rx_msg);
+	  break;
+	}
+
+      pager->start = elektron_get_list_msg_next_start (rx_msg);
+
+      g_mutex_lock (&pager->mutex);
+      g_queue_push_tail (&pager->pages, rx_msg);
+      g_cond_signal (&pager->cond);
+      g_mutex_unlock (&pager->mutex);
+    }
+
+  g_mutex_lock (&pager->mutex);
+  pager->done = TRUE;
+  g_cond_signal (&pager->cond);
+  g_mutex_unlock (&pager->mutex);
+
+  return NULL;
+}
+
+static struct elektron_list_pager *
+elektron_list_pager_new (struct backend *backend, const gchar *path,
+			 guint32 start)
+{
+  struct elektron_list_pager *pager =
+    g_malloc (sizeof (struct elektron_list_pager));
+
+  pager->backend = backend;
+  pager->path = g_strdup (path);
+  pager->start = start;
+  pager->done = FALSE;
+  pager->stop = FALSE;
+  g_queue_init (&pager->pages);
+  g_mutex_init (&pager->mutex);
+  g_cond_init (&pager->cond);
+  pager->thread = g_thread_new ("elektron_list_pager",
+				elektron_list_pager_runner, pager);
+
+  return pager;
+}
+
+//Returns the next page or NULL if there are no more pages.
+
+static GByteArray *
+elektron_list_pager_next (struct elektron_list_pager *pager)
+{
+  GByteArray *msg;
+
+  g_mutex_lock (&pager->mutex);
+  while (!pager->done && g_queue_is_empty (&pager->pages))
+    {
+      g_cond_wait (&pager->cond, &pager->mutex);
+    }
+  msg = g_queue_pop_head (&pager->pages);
+  g_cond_signal (&pager->cond);
+  g_mutex_unlock (&pager->mutex);
+
+  return msg;
+}
+
+static void
+elektron_list_pager_free (struct elektron_list_pager *pager)
+{
+  g_mutex_lock (&pager->mutex);
+  pager->stop = TRUE;
+  g_cond_signal (&pager->cond);
+  g_mutex_unlock (&pager->mutex);
+
+  g_thread_join (pager->thread);
+
+  g_queue_clear_full (&pager->pages, (GDestroyNotify) free_msg);
+  g_mutex_clear (&pager->mutex);
+  g_cond_clear (&pager->cond);
+  g_free (pager->path);
+  g_free (pager);
+}
+
+//Decodes one of the first 7 bytes of the payload of a raw message.
+
+static guint8
+elektron_get_raw_msg_byte (const GByteArray *raw, guint pos)
+{
+  const guint8 *payload = &raw->data[sizeof (MSG_HEADER)];
+  return payload[pos + 1] | (payload[0] & (0x40 >> pos) ? 0x80 : 0);
+}
+
+static gboolean
+elektron_blk_matcher (GByteArray *request, GByteArray *reply, void *data)
+{
+  if (reply->len < 12 || memcmp (reply->data, MSG_HEADER, sizeof (MSG_HEADER)))
+    {
+      return FALSE;
+    }
+
+  //The reply includes the request sequence.
+  return elektron_get_raw_msg_byte (request, 0) ==
+    elektron_get_raw_msg_byte (reply, 2) &&
+    elektron_get_raw_msg_byte (request, 1) ==
+    elektron_get_raw_msg_byte (reply, 3);
+}
+
+static gboolean
+elektron_blk_is_retryable (gint err)
+{
+  return err == -EIO || err == -ETIMEDOUT || err == -EBADMSG;
+}
+
+//Sends the blocks of a transfer keeping up to a window of requests in flight. Replies are matched by sequence and processed in order.
+//After an error, the outstanding requests are discarded and the blocks are sent again from the failed one. As some firmwares might not cope with several requests in flight, the window falls back to 1 for the rest of the transfer.
+//The window is restored if the transfer succeeds so that a transient error does not slow down the rest of the session.
+
+gint
+elektron_tx_and_rx_blks (struct backend *backend,
+			 elektron_blk_msg_func new_msg_blk,
+			 elektron_blk_reply_func process_reply, void *data,
+			 struct controllable *controllable)
+{
+  gint err = 0;
+  guint8 type;
+  guint next_tx = 0, next_rx = 0, retries = 0, window;
+  gboolean last = FALSE;
+  GByteArray *tx_msg, *rx_msg;
+  GQueue outstanding = G_QUEUE_INIT;
+  struct backend_request *request;
+  struct backend_pipeline pipeline;
+  struct elektron_data *elektron_data = backend->data;
+
+  window = elektron_data->window;
+  backend_pipeline_init (&pipeline, backend, window, -1,
+			 elektron_blk_matcher, NULL);
+
+  while (controllable_is_active (controllable))
+    {
+      while (!last && next_tx - next_rx < pipeline.window)
+	{
+	  tx_msg = new_msg_blk (next_tx, data);
+	  if (!tx_msg)
+	    {
+	      last = TRUE;
+	      break;
+	    }
+	  elektron_set_msg_seq (backend, tx_msg);
+	  request = backend_pipeline_tx (&pipeline,
+					 elektron_msg_to_raw (tx_msg),
+					 controllable);
+	  free_msg (tx_msg);
+	  g_queue_push_tail (&outstanding, request);
+	  next_tx++;
+	}
+
+      request = g_queue_pop_head (&outstanding);
+      if (!request)
+	{
+	  break;
+	}
+
+      err = backend_pipeline_wait (&pipeline, request,
+				   controllable);
+      if (!err)
+	{
+	  type = elektron_get_raw_msg_byte (request->tx_msg, 4) | 0x80;
+	  rx_msg = elektron_raw_to_msg (request->rx_msg);
+	  if (rx_msg && rx_msg->len > 5 && rx_msg->data[4] == type)
+	    {
+	      err = process_reply (next_rx, rx_msg, data);
+	    }
+	  else
+	    {
+	      error_print ("Illegal message type in response");
+	      err = -EIO;
+	    }
+	  if (rx_msg)
+	    {
+	      free_msg (rx_msg);
+	    }
+	}
+      backend_request_free (request);
+
+      if (!err)
+	{
+	  next_rx++;
+	  retries = 0;
+	  if (pipeline.window == 1)
+	    {
+	      backend_pacing_rest_min (backend, elektron_data->blk_rest_time);
+	    }
+	  continue;
+	}
+
+      backend_pacing_report (backend, err);
+
+      if (!elektron_blk_is_retryable (err) ||
+	  retries == ELEKTRON_BLK_MAX_RETRIES)
+	{
+	  break;
+	}
+
+      retries++;
+      debug_print (1, "Sending block %d again (retry %d)...", next_rx,
+		   retries);
+
+      while ((request = g_queue_pop_head (&outstanding)))
+	{
+	  backend_pipeline_wait (&pipeline, request, controllable);
+	  backend_request_free (request);
+	}
+
+      if (pipeline.window > 1)
+	{
+	  error_print ("Error in block transfer. Disabling pipelining...");
+	  pipeline.window = 1;
+	  elektron_data->window = 1;
+	}
+
+      next_tx = next_rx;
+      last = FALSE;
+      err = 0;
+    }
+
+  backend_pipeline_clear (&pipeline);
+  g_queue_clear_full (&outstanding, (GDestroyNotify) backend_request_free);
+
+  if (!err && pipeline.window != window)
+    {
+      debug_print (1, "Block transfer finished. Enabling pipelining again...");
+      elektron_data->window = window;
+    }
+
+  return err;
+}
+
 static enum item_type
 elektron_get_path_type (struct backend *backend, const gchar *path,
 			fs_init_iter_func init_iter)
@@ -1010,7 +1428,7 @@ elektron_read_common_dir (struct backend *backend,
   GByteArray *tx_msg, *rx_msg = NULL;
   gboolean is_file = file_exists (backend, dir);
 
-  usleep (BE_REST_TIME_US);
+  backend_pacing_rest (backend);
 
   if (is_file)
     {
@@ -1105,6 +1523,7 @@ static gint
 elektron_rename_sample_file (struct backend *backend, const gchar *src,
 			     const gchar *dst)
 {
+  elektron_clear_cached_sample_paths (backend);
   return elektron_src_dst_common (backend, src, dst,
 				  FS_SAMPLE_RENAME_FILE_REQUEST,
 				  sizeof (FS_SAMPLE_RENAME_FILE_REQUEST));
@@ -1204,6 +1623,7 @@ elektron_path_common (struct backend *backend, const gchar *path,
 static gint
 elektron_delete_sample (struct backend *backend, const gchar *path)
 {
+  elektron_clear_cached_sample_paths (backend);
   return elektron_path_common (backend, path,
 			       FS_SAMPLE_DELETE_FILE_REQUEST,
 			       sizeof (FS_SAMPLE_DELETE_FILE_REQUEST));
@@ -1370,6 +1790,66 @@ elektron_delete_raw_item (struct backend *backend, const gchar *path)
 				      elektron_delete_raw);
 }
 
+struct elektron_upload_smplrw_data
+{
+  guint32 id;
+  struct idata *smplrw;
+  elektron_msg_write_blk_func new_msg_write_blk;
+  GArray *offsets;		//Start of every block already built.
+  guint transferred;
+  struct task_control *control;
+};
+
+static GByteArray *
+elektron_upload_smplrw_blk (guint blk, void *data)
+{
+  struct elektron_upload_smplrw_data *upload_data = data;
+  GByteArray *input = upload_data->smplrw->content;
+
+  //Blocks are built again after an error.
+  if (blk < upload_data->offsets->len)
+    {
+      upload_data->transferred = g_array_index (upload_data->offsets, guint,
+						blk);
+    }
+  else
+    {
+      g_array_append_val (upload_data->offsets, upload_data->transferred);
+    }
+
+  if (upload_data->transferred >= input->len)
+    {
+      return NULL;
+    }
+
+  return upload_data->new_msg_write_blk (upload_data->id, input,
+					 &upload_data->transferred, blk,
+					 upload_data->smplrw->info);
+}
+
+static gint
+elektron_upload_smplrw_reply (guint blk, GByteArray *rx_msg, void *data)
+{
+  guint end;
+  struct elektron_upload_smplrw_data *upload_data = data;
+  GByteArray *input = upload_data->smplrw->content;
+
+  //Response: x, x, x, x, 0xc2, [0 (error), 1 (success)]...
+  //As before pipelining, this is only reported. Sending the block again would not change the status.
+  if (!elektron_get_msg_status (rx_msg))
+    {
+      error_print ("Unexpected status");
+    }
+
+  end = blk + 1 < upload_data->offsets->len ?
+    g_array_index (upload_data->offsets, guint, blk + 1) :
+    upload_data->transferred;
+  task_control_set_progress (upload_data->control,
+			     end / (double) input->len);
+
+  return 0;
+}
+
 static gint
 elektron_upload_smplrw (struct backend *backend, const gchar *path,
 			struct idata *smplrw, struct task_control *control,
@@ -1379,12 +1859,9 @@ elektron_upload_smplrw (struct backend *backend, const gchar *path,
 {
   GByteArray *tx_msg;
   GByteArray *rx_msg;
-  guint transferred;
-  guint32 id;
-  int i;
-  gboolean active;
   gint res = 0;
   GByteArray *input = smplrw->content;
+  struct elektron_upload_smplrw_data upload_data;
 
   //If the file already exists the device makes no difference between creating a new file and creating an already existent file.
   //Also, the new file would be discarded if an upload is not completed.
@@ -1397,7 +1874,7 @@ elektron_upload_smplrw (struct backend *backend, const gchar *path,
     }
 
   //Response: x, x, x, x, 0xc0, [0 (error), 1 (success)], id, frames
-  res = elektron_get_smplrw_info_from_msg (rx_msg, &id, NULL);
+  res = elektron_get_smplrw_info_from_msg (rx_msg, &upload_data.id, NULL);
   if (res)
     {
       error_print ("%s (%s)", backend_strerror (backend, res),
@@ -1407,39 +1884,26 @@ elektron_upload_smplrw (struct backend *backend, const gchar *path,
     }
   free_msg (rx_msg);
 
-  transferred = 0;
-  i = 0;
-
-  active = controllable_is_active (&control->controllable);
+  upload_data.smplrw = smplrw;
+  upload_data.new_msg_write_blk = new_msg_write_blk;
+  upload_data.offsets = g_array_new (FALSE, FALSE, sizeof (guint));
+  upload_data.transferred = 0;
+  upload_data.control = control;
 
-  while (transferred < input->len && active)
+  res = elektron_tx_and_rx_blks (backend, elektron_upload_smplrw_blk,
+				 elektron_upload_smplrw_reply, &upload_data,
+				 &control->controllable);
+  g_array_free (upload_data.offsets, TRUE);
+  if (res)
     {
-      tx_msg = new_msg_write_blk (id, input, &transferred, i, smplrw->info);
-      rx_msg = elektron_tx_and_rx (backend, tx_msg, &control->controllable);
-      if (!rx_msg)
-	{
-	  return -EIO;
-	}
-      //Response: x, x, x, x, 0xc2, [0 (error), 1 (success)]...
-      if (!elektron_get_msg_status (rx_msg))
-	{
-	  error_print ("Unexpected status");
-	}
-      free_msg (rx_msg);
-      i++;
-
-      task_control_set_progress (control, transferred / (double) input->len);
-
-      active = controllable_is_active (&control->controllable);
-
-      usleep (BE_REST_TIME_US);
+      return res;
     }
 
-  debug_print (2, "%d bytes sent", transferred);
+  debug_print (2, "%d bytes sent", upload_data.transferred);
 
-  if (active)
+  if (controllable_is_active (&control->controllable))
     {
-      tx_msg = new_msg_close_write (id, transferred);
+      tx_msg = new_msg_close_write (upload_data.id, upload_data.transferred);
       rx_msg = elektron_tx_and_rx (backend, tx_msg, &control->controllable);
       if (!rx_msg)
 	{
@@ -1456,11 +1920,83 @@ elektron_upload_smplrw (struct backend *backend, const gchar *path,
   return res;
 }
 
-gint
-elektron_upload_sample_part (struct backend *backend, const gchar *path,
-			     struct idata *sample,
-			     struct task_control *control)
+static guint32
+elektron_crc (guint8 *data, guint32 len)
+{
+  return crc32 (0xffffffff, data, len);
+}
+
+//The hash is computed over the file as it is stored in the device, which is the header followed by the big endian frames, with the same CRC used in the other transfers.
+//This has not been verified against hashes computed by a device, so the lookups using it are disabled by default.
+
+void
+elektron_get_sample_hash_size (struct idata *sample, guint32 *hash,
+			       guint32 *size)
+{
+  guint i, j, len;
+  guint16 *frame;
+  guint16 buf[ELEKTRON_SAMPLE_HASH_BUF_LEN];
+  struct elektron_sample_header elektron_sample_header;
+  GByteArray *content = sample->content;
+
+  elektron_init_sample_header (&elektron_sample_header, content->len,
+			       sample->info);
+  *hash = elektron_crc ((guint8 *) & elektron_sample_header,
+			sizeof (struct elektron_sample_header));
+
+  frame = (guint16 *) content->data;
+  len = content->len / sizeof (guint16);
+  for (i = 0; i < len; i += j)
+    {
+      for (j = 0; j < ELEKTRON_SAMPLE_HASH_BUF_LEN && i + j < len; j++)
+	{
+	  buf[j] = g_htons (frame[i + j]);
+	}
+      *hash = crc32 (*hash, (guint8 *) buf, j * sizeof (guint16));
+    }
+
+  *size = sizeof (struct elektron_sample_header) + content->len;
+}
+
+//Returns the path of a sample identical to the given one or NULL if there is none.
+
+static gchar *
+elektron_get_sample_path_from_sample (struct backend *backend,
+				      struct idata *sample)
+{
+  gchar *path_cp1252, *path;
+  guint32 hash, size;
+
+  if (!preferences_get_boolean (PREF_KEY_ELEKTRON_SAMPLE_LOOKUP))
+    {
+      return NULL;
+    }
+
+  elektron_get_sample_hash_size (sample, &hash, &size);
+
+  path_cp1252 = elektron_get_sample_path_from_hash_size (backend, hash, size);
+  if (!path_cp1252)
+    {
+      debug_print (1, "Sample (hash: 0x%08x; size: %d) not found in device",
+		   hash, size);
+      return NULL;
+    }
+
+  path = elektron_name_to_utf8 (path_cp1252);
+  g_free (path_cp1252);
+
+  debug_print (1, "Sample (hash: 0x%08x; size: %d) found in device at %s",
+	       hash, size, path);
+
+  return path;
+}
+
+gint
+elektron_upload_sample_part (struct backend *backend, const gchar *path,
+			     struct idata *sample,
+			     struct task_control *control)
 {
+  elektron_clear_cached_sample_paths (backend);
   return elektron_upload_smplrw (backend, path, sample, control,
 				 elektron_new_msg_open_sample_write,
 				 elektron_new_msg_write_sample_blk,
@@ -1471,8 +2007,23 @@ static gint
 elektron_upload_sample (struct backend *backend, const gchar *path,
 			struct idata *sample, struct task_control *control)
 {
+  gboolean found;
+  gchar *existing_path;
+
   control->parts = 1;
   control->part = 0;
+
+  //There is no sample copy request so an identical sample is only useful if it is already in the destination.
+  existing_path = elektron_get_sample_path_from_sample (backend, sample);
+  found = existing_path && !strcmp (existing_path, path);
+  g_free (existing_path);
+  if (found)
+    {
+      debug_print (1, "Sample already in %s. Skipping upload...", path);
+      task_control_set_progress (control, 1.0);
+      return 0;
+    }
+
   return elektron_upload_sample_part (backend, path, sample, control);
 }
 
@@ -1523,26 +2074,78 @@ elektron_copy_raw_data (GByteArray *input, GByteArray *output)
   g_byte_array_append (output, input->data, input->len);
 }
 
-static gint
-elektron_download_smplrw (struct backend *backend, const gchar *path,
-			  struct idata *smplrw, struct task_control *control,
-			  elektron_msg_path_func new_msg_open_read,
-			  guint read_offset,
-			  elektron_msg_read_blk_func new_msg_read_blk,
-			  elektron_msg_id_func new_msg_close_read,
-			  elektron_copy_array copy_array)
+//The whole device file, including the sample header, is stored in the array so that it can be cached as it is.
+
+struct elektron_download_smplrw_data
 {
-  struct sample_info *sample_info = NULL;
-  struct elektron_sample_header *elektron_sample_header;
-  GByteArray *tx_msg, *rx_msg;
-  GByteArray *array, *output;
   guint32 id;
   guint frames;
-  guint next_block_start;
-  guint req_size;
-  guint offset;
-  gboolean active;
+  elektron_msg_read_blk_func new_msg_read_blk;
+  GByteArray *array;
+  struct task_control *control;
+};
+
+static guint
+elektron_download_smplrw_get_blk_size (struct elektron_download_smplrw_data
+				       *download_data, guint start)
+{
+  guint remaining = download_data->frames - start;
+  return remaining > DATA_TRANSF_BLOCK_BYTES ? DATA_TRANSF_BLOCK_BYTES :
+    remaining;
+}
+
+static GByteArray *
+elektron_download_smplrw_blk (guint blk, void *data)
+{
+  struct elektron_download_smplrw_data *download_data = data;
+  guint start = blk * DATA_TRANSF_BLOCK_BYTES;
+
+  if (start >= download_data->frames)
+    {
+      return NULL;
+    }
+
+  return download_data->new_msg_read_blk (download_data->id, start,
+					  elektron_download_smplrw_get_blk_size
+					  (download_data, start));
+}
+
+static gint
+elektron_download_smplrw_reply (guint blk, GByteArray *rx_msg, void *data)
+{
+  struct elektron_download_smplrw_data *download_data = data;
+  guint start = blk * DATA_TRANSF_BLOCK_BYTES;
+  guint req_size = elektron_download_smplrw_get_blk_size (download_data,
+							   start);
+
+  if (rx_msg->len < FS_SAMPLES_PAD_RES + req_size)
+    {
+      error_print ("Unexpected block length");
+      return -EIO;
+    }
+
+  g_byte_array_append (download_data->array,
+		       &rx_msg->data[FS_SAMPLES_PAD_RES], req_size);
+
+  task_control_set_progress (download_data->control,
+			     (start + req_size) /
+			     (double) download_data->frames);
+
+  return 0;
+}
+
+static gint
+elektron_download_smplrw_transfer (struct backend *backend,
+				   const gchar *path, GByteArray *array,
+				   struct task_control *control,
+				   elektron_msg_path_func new_msg_open_read,
+				   elektron_msg_read_blk_func
+				   new_msg_read_blk,
+				   elektron_msg_id_func new_msg_close_read)
+{
+  GByteArray *tx_msg, *rx_msg;
   gint res;
+  struct elektron_download_smplrw_data download_data;
 
   tx_msg = new_msg_open_read (path);
   rx_msg = elektron_tx_and_rx (backend, tx_msg, &control->controllable);
@@ -1550,7 +2153,8 @@ elektron_download_smplrw (struct backend *backend, const gchar *path,
     {
       return -EIO;
     }
-  res = elektron_get_smplrw_info_from_msg (rx_msg, &id, &frames);
+  res = elektron_get_smplrw_info_from_msg (rx_msg, &download_data.id,
+					   &download_data.frames);
   if (res)
     {
       error_print ("%s (%s)", backend_strerror (backend, res),
@@ -1560,95 +2164,182 @@ elektron_download_smplrw (struct backend *backend, const gchar *path,
     }
   free_msg (rx_msg);
 
-  debug_print (2, "%d frames to download", frames);
+  debug_print (2, "%d frames to download", download_data.frames);
 
-  active = controllable_is_active (&control->controllable);
+  download_data.new_msg_read_blk = new_msg_read_blk;
+  download_data.array = array;
+  download_data.control = control;
 
-  output = g_byte_array_new ();
-  array = g_byte_array_new ();
-  res = 0;
-  next_block_start = 0;
-  offset = read_offset;
-  while (next_block_start < frames && active)
-    {
-      req_size =
-	frames - next_block_start >
-	DATA_TRANSF_BLOCK_BYTES ? DATA_TRANSF_BLOCK_BYTES : frames -
-	next_block_start;
-      tx_msg = new_msg_read_blk (id, next_block_start, req_size);
-      rx_msg = elektron_tx_and_rx (backend, tx_msg, &control->controllable);
-      if (!rx_msg)
-	{
-	  res = -EIO;
-	  goto cleanup;
-	}
-      g_byte_array_append (array, &rx_msg->data[FS_SAMPLES_PAD_RES + offset],
-			   req_size - offset);
+  res = elektron_tx_and_rx_blks (backend, elektron_download_smplrw_blk,
+				 elektron_download_smplrw_reply,
+				 &download_data, &control->controllable);
+  if (res)
+    {
+      return res;
+    }
 
-      next_block_start += req_size;
-      //Only in the first iteration. It has no effect for the raw filesystem (M:C) as offset is 0.
-      if (offset)
-	{
-	  offset = 0;
-	  elektron_sample_header =
-	    (struct elektron_sample_header *)
-	    &rx_msg->data[FS_SAMPLES_PAD_RES];
-	  sample_info = sample_info_new (FALSE);
-	  sample_info->frames = frames;
-	  sample_info->loop_start =
-	    g_ntohl (elektron_sample_header->loop_start);
-	  sample_info->loop_end = g_ntohl (elektron_sample_header->loop_end);
-	  sample_info->loop_type = elektron_sample_header->loop_type;
-	  sample_info->rate = g_ntohl (elektron_sample_header->rate);	//In the case of the RAW filesystem is not used and it is harmless.
-	  sample_info->format = SF_FORMAT_WAV | SF_FORMAT_PCM_16;
-	  sample_info->channels = elektron_sample_header->stereo + 1;
-	  debug_print (2, "Loop start at %d, loop end at %d",
-		       sample_info->loop_start, sample_info->loop_end);
-	}
+  debug_print (2, "%d bytes received", array->len);
 
-      free_msg (rx_msg);
+  if (!controllable_is_active (&control->controllable))
+    {
+      res = -1;
+    }
 
-      task_control_set_progress (control, next_block_start / (double) frames);
+  tx_msg = new_msg_close_read (download_data.id);
+  rx_msg = elektron_tx_and_rx (backend, tx_msg, &control->controllable);
+  if (!rx_msg)
+    {
+      return -EIO;
+    }
+  //Response: x, x, x, x, 0xb1, 00 00 00 0a 00 01 65 de (sample id and received bytes)
+  free_msg (rx_msg);
 
-      active = controllable_is_active (&control->controllable);
+  return res;
+}
 
-      usleep (BE_REST_TIME_US);
+//Only samples have a header. It has no effect for the raw filesystem (M:C) as offset is 0.
+
+static gint
+elektron_get_smplrw_from_file (GByteArray *array, guint read_offset,
+			       elektron_copy_array copy_array,
+			       GByteArray *output,
+			       struct sample_info **sample_info)
+{
+  struct elektron_sample_header *elektron_sample_header;
+
+  *sample_info = NULL;
+
+  if (array->len < read_offset)
+    {
+      error_print ("Unexpected file length");
+      return -EIO;
+    }
+
+  if (read_offset)
+    {
+      elektron_sample_header = (struct elektron_sample_header *) array->data;
+      *sample_info = sample_info_new (FALSE);
+      (*sample_info)->frames = array->len;
+      (*sample_info)->loop_start =
+	g_ntohl (elektron_sample_header->loop_start);
+      (*sample_info)->loop_end = g_ntohl (elektron_sample_header->loop_end);
+      (*sample_info)->loop_type = elektron_sample_header->loop_type;
+      (*sample_info)->rate = g_ntohl (elektron_sample_header->rate);
+      (*sample_info)->format = SF_FORMAT_WAV | SF_FORMAT_PCM_16;
+      (*sample_info)->channels = elektron_sample_header->stereo + 1;
+      debug_print (2, "Loop start at %d, loop end at %d",
+		   (*sample_info)->loop_start, (*sample_info)->loop_end);
+      g_byte_array_remove_range (array, 0, read_offset);
     }
 
-  debug_print (2, "%d bytes received", next_block_start);
+  copy_array (array, output);
 
-  if (active)
+  return 0;
+}
+
+//Directory listings are the only way to get the hash of a file.
+//The directory is listed for every download as the file might have been replaced in the device since the last listing and cached files are only checked by size.
+
+static gint
+elektron_get_smplrw_hash_size (struct backend *backend, const gchar *path,
+			       fs_init_iter_func init_iter, guint32 *hash,
+			       guint32 *size)
+{
+  gint err;
+  gchar *dir, *name;
+  struct item_iterator iter;
+  struct elektron_iterator_data *data;
+
+  dir = g_path_get_dirname (path);
+  name = g_path_get_basename (path);
+
+  err = init_iter (backend, &iter, dir, NULL);
+  if (err)
     {
-      copy_array (array, output);
+      goto end;
     }
-  else
+
+  err = -ENOENT;
+  while (!item_iterator_next (&iter))
     {
-      res = -1;
+      if (iter.item.type == ITEM_TYPE_FILE && !strcmp (iter.item.name, name))
+	{
+	  data = iter.data;
+	  *hash = data->hash;
+	  *size = iter.item.size;
+	  err = 0;
+	  break;
+	}
     }
 
-  tx_msg = new_msg_close_read (id);
-  rx_msg = elektron_tx_and_rx (backend, tx_msg, &control->controllable);
-  if (!rx_msg)
+  item_iterator_free (&iter);
+
+end:
+  g_free (dir);
+  g_free (name);
+  return err;
+}
+
+static gint
+elektron_download_smplrw (struct backend *backend, const gchar *path,
+			  struct idata *smplrw, struct task_control *control,
+			  fs_init_iter_func init_iter, const gchar *list_path,
+			  elektron_msg_path_func new_msg_open_read,
+			  guint read_offset,
+			  elektron_msg_read_blk_func new_msg_read_blk,
+			  elektron_msg_id_func new_msg_close_read,
+			  elektron_copy_array copy_array)
+{
+  gint res;
+  guint64 limit;
+  gboolean cacheable;
+  guint32 hash, size;
+  GByteArray *array, *output;
+  struct sample_info *sample_info;
+
+  limit = preferences_get_int (PREF_KEY_ELEKTRON_CACHE_SIZE) * (guint64) MI;
+  cacheable = limit && !elektron_get_smplrw_hash_size (backend, list_path,
+						       init_iter, &hash,
+						       &size);
+
+  array = cacheable ? elektron_cache_get (hash, size) : NULL;
+  if (array)
     {
-      res = -EIO;
-      goto cleanup;
+      task_control_set_progress (control, 1.0);
     }
-  //Response: x, x, x, x, 0xb1, 00 00 00 0a 00 01 65 de (sample id and received bytes)
-  free_msg (rx_msg);
+  else
+    {
+      array = g_byte_array_new ();
+      res = elektron_download_smplrw_transfer (backend, path, array, control,
+					       new_msg_open_read,
+					       new_msg_read_blk,
+					       new_msg_close_read);
+      if (res)
+	{
+	  free_msg (array);
+	  return res;
+	}
 
-cleanup:
+      if (cacheable)
+	{
+	  elektron_cache_put (hash, size, array, limit);
+	}
+    }
+
+  output = g_byte_array_new ();
+  res = elektron_get_smplrw_from_file (array, read_offset, copy_array,
+				       output, &sample_info);
   free_msg (array);
   if (res)
     {
       g_byte_array_free (output, TRUE);
-      g_free (sample_info);
-    }
-  else
-    {
-      idata_init (smplrw, output, g_path_get_basename (path), sample_info,
-		  sample_info_free);
+      return res;
     }
-  return res;
+
+  idata_init (smplrw, output, g_path_get_basename (path), sample_info,
+	      sample_info_free);
+
+  return 0;
 }
 
 gint
@@ -1657,6 +2348,7 @@ elektron_download_sample_part (struct backend *backend, const gchar *path,
 			       struct task_control *control)
 {
   return elektron_download_smplrw (backend, path, sample, control,
+				   elektron_read_samples_dir, path,
 				   elektron_new_msg_open_sample_read,
 				   sizeof (struct elektron_sample_header),
 				   elektron_new_msg_read_sample_blk,
@@ -1680,6 +2372,7 @@ elektron_download_raw (struct backend *backend, const gchar *path,
   gint ret;
   gchar *path_with_ext = elektron_add_ext_to_mc_snd (path);
   ret = elektron_download_smplrw (backend, path_with_ext, file, control,
+				  elektron_read_raw_dir, path,
 				  elektron_new_msg_open_raw_read,
 				  0, elektron_new_msg_read_raw_blk,
 				  elektron_new_msg_close_raw_read,
@@ -1699,117 +2392,261 @@ elektron_new_msg_upgrade_os_start (guint size)
   return msg;
 }
 
-static guint32
-elektron_crc (guint8 *data, guint32 len)
-{
-  return crc32 (0xffffffff, data, len);
-}
-
 static GByteArray *
-elektron_new_msg_upgrade_os_write (GByteArray *os_data, gint *offset)
+elektron_new_msg_upgrade_os_write (GByteArray *os_data, guint offset,
+				   guint len)
 {
   GByteArray *msg = elektron_new_msg (OS_UPGRADE_WRITE_RESPONSE,
 				      sizeof (OS_UPGRADE_WRITE_RESPONSE));
-  guint len;
   guint32 crc;
   guint32 aux32;
 
-  if (*offset + OS_TRANSF_BLOCK_BYTES < os_data->len)
-    {
-      len = OS_TRANSF_BLOCK_BYTES;
-    }
-  else
-    {
-      len = os_data->len - *offset;
-    }
-
-  crc = elektron_crc (&os_data->data[*offset], len);
+  crc = elektron_crc (&os_data->data[offset], len);
 
-  debug_print (2, "CRC: %0x", crc);
+  debug_print (3, "CRC: %0x", crc);
 
   aux32 = g_htonl (crc);
   memcpy (&msg->data[5], &aux32, sizeof (guint32));
   aux32 = g_htonl (len);
   memcpy (&msg->data[9], &aux32, sizeof (guint32));
-  aux32 = g_htonl (*offset);
+  aux32 = g_htonl (offset);
   memcpy (&msg->data[13], &aux32, sizeof (guint32));
 
-  g_byte_array_append (msg, &os_data->data[*offset], len);
-
-  *offset = *offset + len;
+  g_byte_array_append (msg, &os_data->data[offset], len);
 
   return msg;
 }
 
+//OS images are SysEx files. Anything else is rejected before the device enters upgrade mode.
+
 static gint
-elektron_upgrade_os (struct backend *backend, struct sysex_transfer *transfer,
-		     struct controllable *controllable)
+elektron_upgrade_os_validate (GByteArray *os_data)
+{
+  gboolean in_msg = FALSE;
+
+  if (!os_data->len || os_data->len > G_MAXINT32)
+    {
+      error_print ("Invalid OS image size %d", os_data->len);
+      return -EINVAL;
+    }
+
+  for (guint i = 0; i < os_data->len; i++)
+    {
+      guint8 b = os_data->data[i];
+      if (b == 0xf0 && !in_msg)
+	{
+	  in_msg = TRUE;
+	}
+      else if (b == 0xf7 && in_msg)
+	{
+	  in_msg = FALSE;
+	}
+      else if (b & 0x80 || !in_msg)
+	{
+	  error_print ("Invalid OS image. Unexpected byte 0x%02x at %d", b,
+		       i);
+	  return -EINVAL;
+	}
+    }
+
+  if (in_msg)
+    {
+      error_print ("Invalid OS image. Last message is incomplete");
+      return -EINVAL;
+    }
+
+  return 0;
+}
+
+struct elektron_upgrade_os_data
+{
+  GByteArray *os_data;
+  guint blk_len;
+  GPtrArray *blks;		//Every block is built before sending anything.
+  guint acked;			//Bytes acknowledged by the device.
+  gboolean finished;
+};
+
+static void
+elektron_upgrade_os_build_blks (struct elektron_upgrade_os_data *upgrade_data,
+				guint blk_len)
+{
+  guint len;
+
+  if (upgrade_data->blks)
+    {
+      g_ptr_array_free (upgrade_data->blks, TRUE);
+    }
+
+  upgrade_data->blk_len = blk_len;
+  upgrade_data->blks = g_ptr_array_new_with_free_func ((GDestroyNotify)
+						       free_msg);
+  upgrade_data->acked = 0;
+  upgrade_data->finished = FALSE;
+
+  for (guint offset = 0; offset < upgrade_data->os_data->len; offset += len)
+    {
+      len = MIN (blk_len, upgrade_data->os_data->len - offset);
+      g_ptr_array_add (upgrade_data->blks,
+		       elektron_new_msg_upgrade_os_write
+		       (upgrade_data->os_data, offset, len));
+    }
+
+  debug_print (1, "%d OS blocks of %d B built", upgrade_data->blks->len,
+	       blk_len);
+}
+
+static GByteArray *
+elektron_upgrade_os_blk (guint blk, void *data)
+{
+  GByteArray *msg, *tx_msg;
+  struct elektron_upgrade_os_data *upgrade_data = data;
+
+  if (upgrade_data->finished || blk >= upgrade_data->blks->len)
+    {
+      return NULL;
+    }
+
+  //The engine consumes the message so a copy is needed in case of resending it.
+  msg = g_ptr_array_index (upgrade_data->blks, blk);
+  tx_msg = g_byte_array_sized_new (msg->len);
+  g_byte_array_append (tx_msg, msg->data, msg->len);
+
+  return tx_msg;
+}
+
+static gint
+elektron_upgrade_os_reply (guint blk, GByteArray *rx_msg, void *data)
+{
+  guint8 op;
+  struct elektron_upgrade_os_data *upgrade_data = data;
+
+  //Response: x, x, x, x, 0xd1, int32, [0..3]...
+  if (rx_msg->len < 10)
+    {
+      error_print ("Unexpected OS upgrade response length %d", rx_msg->len);
+      return -EIO;
+    }
+
+  op = rx_msg->data[9];
+  if (op > 1)
+    {
+      error_print ("Error while upgrading at offset %d (%s)",
+		   upgrade_data->acked, elektron_get_msg_string (rx_msg));
+      return -EINVAL;
+    }
+
+  upgrade_data->acked = MIN ((blk + 1) * upgrade_data->blk_len,
+			     upgrade_data->os_data->len);
+  upgrade_data->finished = op == 1;
+
+  debug_print (2, "OS upgrade: %d/%d B acknowledged", upgrade_data->acked,
+	       upgrade_data->os_data->len);
+
+  return 0;
+}
+
+static gint
+elektron_upgrade_os_start (struct backend *backend, guint size,
+			   struct controllable *controllable)
 {
-  GByteArray *tx_msg;
-  GByteArray *rx_msg;
   gint8 op;
-  gint offset;
-  gint res = 0;
+  GByteArray *tx_msg, *rx_msg;
 
-  tx_msg = elektron_new_msg_upgrade_os_start (transfer->raw->len);
+  tx_msg = elektron_new_msg_upgrade_os_start (size);
   rx_msg = elektron_tx_and_rx (backend, tx_msg, controllable);
-
   if (!rx_msg)
     {
-      res = -EIO;
-      goto end;
+      return -EIO;
     }
+
   //Response: x, x, x, x, 0xd0, [0 (ok), 1 (error)]...
   op = elektron_get_msg_status (rx_msg);
   if (op)
     {
-      res = -EIO;
-      error_print ("%s (%s)", backend_strerror (backend, res),
+      error_print ("%s (%s)", backend_strerror (backend, -EIO),
 		   elektron_get_msg_string (rx_msg));
       free_msg (rx_msg);
-      goto end;
+      return -EIO;
     }
 
   free_msg (rx_msg);
+  return 0;
+}
+
+//Blocks are sent through the block engine so they are resent from the last acknowledged one after a transient error. Every block is built before the start message.
+//Blocks are sent one at a time with a rest of at least BE_REST_TIME_US after each one as the device writes them to the flash memory.
+//If the bigger blocks are enabled and the device fails with them, the upgrade is started again from the start message with the default ones.
+
+static gint
+elektron_upgrade_os (struct backend *backend, struct sysex_transfer *transfer,
+		     struct controllable *controllable)
+{
+  gint res;
+  guint window, blk_len;
+  struct elektron_upgrade_os_data upgrade_data;
+  struct elektron_data *data = backend->data;
 
-  offset = 0;
-  while (offset < transfer->raw->len)
+  res = elektron_upgrade_os_validate (transfer->raw);
+  if (res)
     {
-      tx_msg = elektron_new_msg_upgrade_os_write (transfer->raw, &offset);
-      rx_msg = elektron_tx_and_rx (backend, tx_msg, controllable);
+      return res;
+    }
 
-      if (!rx_msg)
-	{
-	  res = -EIO;
-	  break;
-	}
-      //Response: x, x, x, x, 0xd1, int32, [0..3]...
-      op = rx_msg->data[9];
-      if (op == 1)
+  upgrade_data.os_data = transfer->raw;
+  upgrade_data.blks = NULL;
+  blk_len = preferences_get_boolean (PREF_KEY_ELEKTRON_OS_BIG_BLOCKS) ?
+    OS_TRANSF_BLOCK_BYTES_MAX : OS_TRANSF_BLOCK_BYTES;
+  elektron_upgrade_os_build_blks (&upgrade_data, blk_len);
+
+  if (transfer->dry_run)
+    {
+      debug_print (1, "OS image validated (%d B). Dry run. Skipping...",
+		   transfer->raw->len);
+      goto end;
+    }
+
+  window = data->window;
+  data->window = 1;
+  data->blk_rest_time = BE_REST_TIME_US;
+
+  while (1)
+    {
+      res = elektron_upgrade_os_start (backend, transfer->raw->len,
+				       controllable);
+      if (res)
 	{
 	  break;
 	}
-      else if (op > 1)
+
+      res = elektron_tx_and_rx_blks (backend, elektron_upgrade_os_blk,
+				     elektron_upgrade_os_reply,
+				     &upgrade_data, controllable);
+      if (!res || upgrade_data.blk_len == OS_TRANSF_BLOCK_BYTES ||
+	  !controllable_is_active (controllable))
 	{
-	  res = -EIO;
-	  error_print ("%s (%s)", backend_strerror (backend, res),
-		       elektron_get_msg_string (rx_msg));
-	  free_msg (rx_msg);
 	  break;
 	}
 
-      free_msg (rx_msg);
+      debug_print (1,
+		   "Error while upgrading with %d B blocks at offset %d. Starting again with %d B blocks...",
+		   upgrade_data.blk_len, upgrade_data.acked,
+		   OS_TRANSF_BLOCK_BYTES);
+      elektron_upgrade_os_build_blks (&upgrade_data, OS_TRANSF_BLOCK_BYTES);
+    }
 
-      usleep (BE_REST_TIME_US);
+  data->window = window;
+  data->blk_rest_time = 0;
 
-      if (!controllable_is_active (controllable))
-	{
-	  res = -ECANCELED;
-	  goto end;
-	}
+  //The block engine does not report cancellations.
+  if (!res && !upgrade_data.finished &&
+      upgrade_data.acked < transfer->raw->len)
+    {
+      res = -ECANCELED;
     }
 
 end:
+  g_ptr_array_free (upgrade_data.blks, TRUE);
   return res;
 }
 
@@ -1860,6 +2697,173 @@ elektron_get_storage_stats (struct backend *backend, guint8 type,
   return res ? res : type << 1 < data->dev_desc.storage;
 }
 
+//Tags read while the cache is invalidated would be stale so every entry is tagged with the generation at the time its metadata was requested.
+
+struct elektron_snd_tags
+{
+  gint64 size;
+  gchar *tags;
+  guint generation;
+};
+
+static void
+elektron_snd_tags_free (gpointer data)
+{
+  struct elektron_snd_tags *snd_tags = data;
+  g_free (snd_tags->tags);
+  g_free (snd_tags);
+}
+
+static guint
+elektron_get_snd_tags_generation (struct backend *backend)
+{
+  guint generation;
+  struct elektron_data *data = backend->data;
+
+  g_mutex_lock (&data->snd_tags_mutex);
+  generation = data->snd_tags_generation;
+  g_mutex_unlock (&data->snd_tags_mutex);
+
+  return generation;
+}
+
+static void
+elektron_set_cached_snd_tags (struct backend *backend, const gchar *key,
+			      gint64 size, const gchar *tags,
+			      guint generation)
+{
+  struct elektron_data *data = backend->data;
+  struct elektron_snd_tags *snd_tags;
+
+  g_mutex_lock (&data->snd_tags_mutex);
+  if (generation == data->snd_tags_generation)
+    {
+      snd_tags = g_malloc (sizeof (struct elektron_snd_tags));
+      snd_tags->size = size;
+      snd_tags->tags = g_strdup (tags);
+      snd_tags->generation = generation;
+      g_hash_table_insert (data->snd_tags, g_strdup (key), snd_tags);
+    }
+  else
+    {
+      debug_print (2, "Dropping stale tags for %s", key);
+    }
+  g_mutex_unlock (&data->snd_tags_mutex);
+}
+
+//Any data filesystem change might modify the metadata of a sound without changing its size so everything is invalidated.
+
+static void
+elektron_clear_cached_snd_tags (struct backend *backend)
+{
+  struct elektron_data *data = backend->data;
+
+  g_mutex_lock (&data->snd_tags_mutex);
+  g_hash_table_remove_all (data->snd_tags);
+  data->snd_tags_generation++;
+  g_mutex_unlock (&data->snd_tags_mutex);
+}
+
+//Returns TRUE if the item tags are known. Sounds without metadata are cached with NULL tags.
+
+static gboolean
+elektron_get_cached_snd_tags (struct backend *backend, const gchar *dir,
+			      struct item *item, gboolean has_metadata)
+{
+  gchar key[PATH_MAX];
+  gboolean found = FALSE;
+  struct elektron_snd_tags *snd_tags;
+  struct elektron_data *data = backend->data;
+
+  snprintf (key, PATH_MAX, "%s/%d", dir, item->id);
+
+  if (!has_metadata)
+    {
+      elektron_set_cached_snd_tags (backend, key, item->size, NULL,
+				    elektron_get_snd_tags_generation
+				    (backend));
+      return TRUE;
+    }
+
+  g_mutex_lock (&data->snd_tags_mutex);
+  snd_tags = g_hash_table_lookup (data->snd_tags, key);
+  if (snd_tags)
+    {
+      if (snd_tags->size == item->size &&
+	  snd_tags->generation == data->snd_tags_generation)
+	{
+	  found = TRUE;
+	  if (snd_tags->tags)
+	    {
+	      item_set_object_info (item, "tags=%s", snd_tags->tags);
+	    }
+	}
+      else
+	{
+	  g_hash_table_remove (data->snd_tags, key);
+	}
+    }
+  g_mutex_unlock (&data->snd_tags_mutex);
+
+  return found;
+}
+
+static gint
+elektron_get_snd_item_info (struct backend *backend, const gchar *dir,
+			    struct item *item)
+{
+  gint err;
+  gchar *s;
+  GString *info;
+  GSList *tags, *e;
+  guint generation;
+  struct idata output;
+  struct task_control control;
+  gchar metadata_path[PATH_MAX];
+
+  if (item->type != ITEM_TYPE_FILE ||
+      !preferences_get_boolean (PREF_KEY_ELEKTRON_LOAD_SOUND_TAGS) ||
+      elektron_get_cached_snd_tags (backend, dir, item, TRUE))
+    {
+      return 0;
+    }
+
+  controllable_init (&control.controllable);
+  control.callback = NULL;
+
+  generation = elektron_get_snd_tags_generation (backend);
+
+  snprintf (metadata_path, PATH_MAX, "%s/%d/%s", dir, item->id,
+	    FS_DATA_METADATA_FILE);
+  debug_print (2, "Reading metadata from %s...", metadata_path);
+  err = elektron_download_data_snd (backend, metadata_path, &output,
+				    &control);
+  controllable_clear (&control.controllable);
+  if (err)
+    {
+      return err;
+    }
+
+  info = g_string_new (NULL);
+  tags = elektron_pkg_get_tags_from_snd_metadata (output.content);
+  for (e = tags; e; e = e->next)
+    {
+      const gchar *separator = e == tags ? "" : ELEKTROID_TOKEN_SEPARATOR;
+      g_string_append_printf (info, "%s%s", separator, (gchar *) e->data);
+    }
+  g_slist_free_full (tags, g_free);
+  idata_clear (&output);
+
+  s = g_string_free (info, FALSE);
+  item_set_object_info (item, "tags=%s", s);
+  snprintf (metadata_path, PATH_MAX, "%s/%d", dir, item->id);
+  elektron_set_cached_snd_tags (backend, metadata_path, item->size, s,
+				generation);
+  g_free (s);
+
+  return 0;
+}
+
 static gint
 elektron_next_data_entry (struct item_iterator *iter)
 {
@@ -1871,6 +2875,17 @@ elektron_next_data_entry (struct item_iterator *iter)
   guint32 id;
   struct elektron_iterator_data *data = iter->data;
 
+  if (data->pos == data->msg->len && data->pager)
+    {
+      GByteArray *page = elektron_list_pager_next (data->pager);
+      if (page)
+	{
+	  free_msg (data->msg);
+	  data->msg = page;
+	  data->pos = FS_DATA_START_POS;
+	}
+    }
+
   if (data->pos == data->msg->len)
     {
       //A data directory only contains either files or directories.
@@ -1938,49 +2953,12 @@ elektron_next_data_entry (struct item_iterator *iter)
       data->pos++;
 
       iter->item.object_info[0] = 0;
-      if (data->load_metadata && data->has_metadata &&
-	  data->mode == ITER_MODE_DATA_SND &&
+      if (data->load_metadata && data->mode == ITER_MODE_DATA_SND &&
 	  preferences_get_boolean (PREF_KEY_ELEKTRON_LOAD_SOUND_TAGS))
 	{
-	  gchar metadata_path[PATH_MAX];
-	  struct idata output;
-	  struct task_control control;
-
-	  controllable_init (&control.controllable);
-	  control.callback = NULL;
-
-	  snprintf (metadata_path, PATH_MAX, "%s/%d/%s", iter->dir,
-		    iter->item.id, FS_DATA_METADATA_FILE);
-	  debug_print (2, "Reading metadata from %s...", metadata_path);
-	  if (!elektron_download_data_snd (data->backend, metadata_path,
-					   &output, &control))
-	    {
-	      gchar *s;
-	      gboolean first = TRUE;
-	      GString *info = g_string_new (NULL);
-	      GSList *tags =
-		elektron_pkg_get_tags_from_snd_metadata (output.content);
-	      GSList *e = tags;
-
-	      while (e)
-		{
-		  gchar *tag = (gchar *) e->data;
-		  const gchar *separator =
-		    first ? "" : ELEKTROID_TOKEN_SEPARATOR;
-		  g_string_append_printf (info, "%s%s", separator, tag);
-		  first = FALSE;
-		  e = e->next;
-		}
-
-	      s = g_string_free (info, FALSE);
-	      item_set_object_info (&iter->item, "tags=%s", s);
-	      g_free (s);
-	      g_slist_free_full (tags, g_free);
-
-	      idata_clear (&output);
-	    }
-
-	  controllable_clear (&control.controllable);
+	  //Only cached tags are set here. The rest are loaded later by get_item_info.
+	  elektron_get_cached_snd_tags (data->backend, iter->dir,
+					&iter->item, data->has_metadata);
 	}
 
       break;
@@ -2030,28 +3008,46 @@ elektron_read_data_dir_prefix (struct backend *backend,
 			       guint32 start_pos, gint32 max_slots)
 {
   int res;
+  guint32 next_start;
   GByteArray *tx_msg;
   GByteArray *rx_msg;
+  struct elektron_iterator_data *data;
+  gboolean pages = preferences_get_boolean (PREF_KEY_ELEKTRON_LIST_PAGES);
   gchar *dir_w_prefix = elektron_add_prefix_to_path (dir, prefix);
 
-  tx_msg = elektron_new_msg_list (dir_w_prefix, 0, 0, 1);
-  g_free (dir_w_prefix);
+  tx_msg = pages ? elektron_new_msg_list (dir_w_prefix, 0,
+					  FS_DATA_LIST_PAGE_LEN, FALSE) :
+    elektron_new_msg_list (dir_w_prefix, 0, 0, TRUE);
   rx_msg = elektron_tx_and_rx (backend, tx_msg, NULL);
   if (!rx_msg)
     {
+      g_free (dir_w_prefix);
       return -EIO;
     }
 
   res = elektron_get_msg_status (rx_msg);
   if (!res)
     {
+      g_free (dir_w_prefix);
       free_msg (rx_msg);
       return -ENOTDIR;
     }
 
-  return elektron_init_iterator (backend, iter, dir, rx_msg,
-				 elektron_next_data_entry, mode, start_pos,
-				 max_slots);
+  next_start = pages ? elektron_get_list_msg_next_start (rx_msg) : 0;
+
+  res = elektron_init_iterator (backend, iter, dir, rx_msg,
+				elektron_next_data_entry, mode, start_pos,
+				max_slots);
+  if (!res && next_start)
+    {
+      data = iter->data;
+      data->pager = elektron_list_pager_new (backend, dir_w_prefix,
+					     next_start);
+    }
+
+  g_free (dir_w_prefix);
+
+  return res;
 }
 
 static gint
@@ -2124,6 +3120,8 @@ elektron_dst_src_data_prefix_common (struct backend *backend,
   g_free (src_w_prefix);
   g_free (dst_w_prefix);
 
+  elektron_clear_cached_snd_tags (backend);
+
   return res;
 }
 
@@ -2234,6 +3232,8 @@ elektron_path_data_prefix_common (struct backend *backend,
   res = elektron_path_common (backend, path_w_prefix, op_data, len);
   g_free (path_w_prefix);
 
+  elektron_clear_cached_snd_tags (backend);
+
   return res;
 }
 
@@ -2540,7 +3540,7 @@ elektron_download_data_prefix (struct backend *backend, const gchar *path,
       return -EIO;
     }
 
-  usleep (BE_REST_TIME_US);
+  backend_pacing_rest (backend);
 
   content = g_byte_array_sized_new (4 * MI);
 
@@ -2615,7 +3615,7 @@ elektron_download_data_prefix (struct backend *backend, const gchar *path,
 
       active = controllable_is_active (&control->controllable);
 
-      usleep (BE_REST_TIME_US);
+      backend_pacing_rest (backend);
     }
 
   if (active)
@@ -2965,34 +3965,133 @@ elektron_get_download_path (struct backend *backend,
   // 0:/soundbanks/A/1
   // 0:/soundbanks/A/1/.metadata
 
-  if (strcmp (ext, FS_DATA_METADATA_EXT))
-    {
-      src_fpath = strdup (src_path);
-      md_ext = "";
-    }
-  else
+  if (strcmp (ext, FS_DATA_METADATA_EXT))
+    {
+      src_fpath = strdup (src_path);
+      md_ext = "";
+    }
+  else
+    {
+      src_fpath = g_path_get_dirname (src_path);
+      md_ext = FS_DATA_METADATA_FILE;
+    }
+
+  name = elektron_get_download_name (backend, ops, src_fpath);
+  g_free (src_fpath);
+  if (name)
+    {
+      GString *filename = g_string_new (NULL);
+      const gchar *dl_ext = ops->get_exts (backend, ops)[0];
+      g_string_append_printf (filename, "%s.%s%s", name, dl_ext, md_ext);
+      path = path_chain (PATH_SYSTEM, dst_dir, filename->str);
+      g_free (name);
+      g_string_free (filename, TRUE);
+    }
+  else
+    {
+      path = NULL;
+    }
+
+  return path;
+}
+
+//Blocks never span two items as every item is sent as a separate set of partial requests.
+
+struct elektron_upload_data_blk
+{
+  GByteArray *content;
+  guint32 offset;
+  guint32 len;
+  guint32 sent;			//Accumulated bytes after this block is sent.
+};
+
+struct elektron_upload_data_list_data
+{
+  guint32 jid;
+  GArray *blks;
+  guint32 full_content_size;
+  struct task_control *control;
+};
+
+static GByteArray *
+elektron_upload_data_list_blk (guint blk, void *data)
+{
+  GByteArray *tx_msg;
+  guint32 aux32, jidbe;
+  struct elektron_upload_data_blk *upload_blk;
+  struct elektron_upload_data_list_data *upload_data = data;
+
+  if (blk >= upload_data->blks->len)
+    {
+      return NULL;
+    }
+
+  upload_blk = &g_array_index (upload_data->blks,
+			       struct elektron_upload_data_blk, blk);
+
+  tx_msg = elektron_new_msg (DATA_WRITE_PARTIAL_REQUEST,
+			     sizeof (DATA_WRITE_PARTIAL_REQUEST));
+  jidbe = g_htonl (upload_data->jid);
+  g_byte_array_append (tx_msg, (guint8 *) & jidbe, sizeof (guint32));
+  aux32 = g_htonl (blk);
+  g_byte_array_append (tx_msg, (guint8 *) & aux32, sizeof (guint32));
+
+  aux32 = g_htonl (elektron_crc (&upload_blk->content->data
+				 [upload_blk->offset], upload_blk->len));
+  g_byte_array_append (tx_msg, (guint8 *) & aux32, sizeof (guint32));
+
+  aux32 = g_htonl (upload_blk->len);
+  g_byte_array_append (tx_msg, (guint8 *) & aux32, sizeof (guint32));
+
+  g_byte_array_append (tx_msg, &upload_blk->content->data[upload_blk->offset],
+		       upload_blk->len);
+
+  return tx_msg;
+}
+
+static gint
+elektron_upload_data_list_reply (guint blk, GByteArray *rx_msg, void *data)
+{
+  gint err;
+  guint32 *data32, r_jid, r_seq, total;
+  struct elektron_upload_data_blk *upload_blk;
+  struct elektron_upload_data_list_data *upload_data = data;
+
+  if (!elektron_get_msg_status (rx_msg))
     {
-      src_fpath = g_path_get_dirname (src_path);
-      md_ext = FS_DATA_METADATA_FILE;
+      err = -EPERM;
+      error_print ("%s (%s)", g_strerror (-err),
+		   elektron_get_msg_string (rx_msg));
+      return err;
     }
 
-  name = elektron_get_download_name (backend, ops, src_fpath);
-  g_free (src_fpath);
-  if (name)
-    {
-      GString *filename = g_string_new (NULL);
-      const gchar *dl_ext = ops->get_exts (backend, ops)[0];
-      g_string_append_printf (filename, "%s.%s%s", name, dl_ext, md_ext);
-      path = path_chain (PATH_SYSTEM, dst_dir, filename->str);
-      g_free (name);
-      g_string_free (filename, TRUE);
-    }
-  else
+  upload_blk = &g_array_index (upload_data->blks,
+			       struct elektron_upload_data_blk, blk);
+
+  data32 = (guint32 *) & rx_msg->data[6];
+  r_jid = g_ntohl (*data32);
+
+  data32 = (guint32 *) & rx_msg->data[10];
+  r_seq = g_ntohl (*data32);
+
+  data32 = (guint32 *) & rx_msg->data[14];
+  total = g_ntohl (*data32);
+
+  debug_print (1, "Write datum info: job id: %d; seq: %d; total: %d",
+	       r_jid, r_seq, total);
+
+  if (total != upload_blk->sent)
     {
-      path = NULL;
+      error_print
+	("Actual upload bytes (%d) differs from expected ones (%d)",
+	 total, upload_blk->sent);
     }
 
-  return path;
+  task_control_set_progress (upload_data->control,
+			     upload_blk->sent /
+			     (gdouble) upload_data->full_content_size);
+
+  return 0;
 }
 
 static gint
@@ -3000,15 +4099,14 @@ elektron_upload_data_list_prefix (struct backend *backend, const gchar *path,
 				  GSList *list, struct task_control *control,
 				  const gchar *prefix)
 {
-  gint err;
+  gint err, close_err;
   guint id;
   GSList *iter;
-  gboolean active;
   struct idata *data;
   gchar *path_w_prefix;
-  GByteArray *rx_msg, *tx_msg, *content;
-  guint32 seq, jid, jidbe, crc, len, r_jid, r_seq, offset, *data32,
-    aux32, total, full_content_size, full_content_sent;
+  GByteArray *content;
+  struct elektron_upload_data_blk upload_blk;
+  struct elektron_upload_data_list_data upload_data;
 
   err = common_slot_get_id_from_path (path, &id);
   if (err)
@@ -3016,123 +4114,59 @@ elektron_upload_data_list_prefix (struct backend *backend, const gchar *path,
       return err;
     }
 
-  full_content_size = 0;
+  upload_data.blks = g_array_new (FALSE, FALSE,
+				  sizeof (struct elektron_upload_data_blk));
+  upload_data.control = control;
+
+  upload_blk.sent = 0;
   for (iter = list; iter != NULL; iter = iter->next)
     {
       data = iter->data;
       content = data->content;
-      full_content_size += content->len;
+      upload_blk.content = content;
+      for (guint32 offset = 0; offset < content->len;
+	   offset += upload_blk.len)
+	{
+	  upload_blk.offset = offset;
+	  upload_blk.len = content->len - offset > DATA_TRANSF_BLOCK_BYTES ?
+	    DATA_TRANSF_BLOCK_BYTES : content->len - offset;
+	  upload_blk.sent += upload_blk.len;
+	  g_array_append_val (upload_data.blks, upload_blk);
+	}
     }
+  upload_data.full_content_size = upload_blk.sent;
+
+  elektron_clear_cached_snd_tags (backend);
 
   path_w_prefix = elektron_add_prefix_to_path (path, prefix);
-  err = elektron_open_datum (backend, path_w_prefix, &jid, O_WRONLY,
-			     full_content_size);
+  err = elektron_open_datum (backend, path_w_prefix, &upload_data.jid,
+			     O_WRONLY, upload_data.full_content_size);
   g_free (path_w_prefix);
   if (err)
     {
       goto end;
     }
 
-  usleep (BE_REST_TIME_US);
+  backend_pacing_rest (backend);
 
-  jidbe = g_htonl (jid);
+  err = elektron_tx_and_rx_blks (backend, elektron_upload_data_list_blk,
+				 elektron_upload_data_list_reply,
+				 &upload_data, &control->controllable);
 
-  seq = 0;
-  full_content_sent = 0;
-  for (iter = list; iter != NULL; iter = iter->next)
+  if (!err)
     {
-      data = iter->data;
-      content = data->content;
-
-      offset = 0;
-
-      active = controllable_is_active (&control->controllable);
-
-      while (offset < content->len && active)
-	{
-	  tx_msg = elektron_new_msg (DATA_WRITE_PARTIAL_REQUEST,
-				     sizeof (DATA_WRITE_PARTIAL_REQUEST));
-	  g_byte_array_append (tx_msg, (guint8 *) & jidbe, sizeof (guint32));
-	  aux32 = g_htonl (seq);
-	  g_byte_array_append (tx_msg, (guint8 *) & aux32, sizeof (guint32));
-
-	  if (offset + DATA_TRANSF_BLOCK_BYTES < content->len)
-	    {
-	      len = DATA_TRANSF_BLOCK_BYTES;
-	    }
-	  else
-	    {
-	      len = content->len - offset;
-	    }
-
-	  crc = elektron_crc (&content->data[offset], len);
-	  aux32 = g_htonl (crc);
-	  g_byte_array_append (tx_msg, (guint8 *) & aux32, sizeof (guint32));
-
-	  aux32 = g_htonl (len);
-	  g_byte_array_append (tx_msg, (guint8 *) & aux32, sizeof (guint32));
-
-	  g_byte_array_append (tx_msg, &content->data[offset], len);
-
-	  rx_msg = elektron_tx_and_rx (backend, tx_msg,
-				       &control->controllable);
-	  if (!rx_msg)
-	    {
-	      err = -EIO;
-	      goto end;
-	    }
-
-	  usleep (BE_REST_TIME_US);
-
-	  if (!elektron_get_msg_status (rx_msg))
-	    {
-	      err = -EPERM;
-	      error_print ("%s (%s)", backend_strerror (backend, err),
-			   elektron_get_msg_string (rx_msg));
-	      free_msg (rx_msg);
-	      break;
-	    }
-
-	  data32 = (guint32 *) & rx_msg->data[6];
-	  r_jid = g_ntohl (*data32);
-
-	  data32 = (guint32 *) & rx_msg->data[10];
-	  r_seq = g_ntohl (*data32);
-
-	  data32 = (guint32 *) & rx_msg->data[14];
-	  total = g_ntohl (*data32);
-
-	  free_msg (rx_msg);
-
-	  debug_print (1,
-		       "Write datum info: job id: %d; seq: %d; total: %d",
-		       r_jid, r_seq, total);
-
-	  seq++;
-	  offset += len;
-	  full_content_sent += len;
-
-	  if (total != full_content_sent)
-	    {
-	      error_print
-		("Actual upload bytes (%d) differs from expected ones (%d)",
-		 total, full_content_sent);
-	    }
-
-	  gdouble progress = full_content_sent / (gdouble) full_content_size;
-	  task_control_set_progress (control, progress);
-
-	  active = controllable_is_active (&control->controllable);
-	}
-
-      debug_print (2, "Partial request with %d bytes sent", offset);
+      debug_print (2, "%d bytes sent", upload_data.full_content_size);
     }
 
-  debug_print (2, "%d bytes sent", full_content_sent);
-
-  err = elektron_close_datum (backend, jid, O_WRONLY, full_content_size);
+  close_err = elektron_close_datum (backend, upload_data.jid, O_WRONLY,
+				    upload_data.full_content_size);
+  if (!err)
+    {
+      err = close_err;
+    }
 
 end:
+  g_array_free (upload_data.blks, TRUE);
   return err;
 }
 
@@ -3309,12 +4343,12 @@ elektron_sample_load (struct backend *backend, const gchar *path,
 			     ELEKTRON_SAMPLE_RATE, SF_FORMAT_PCM_16, FALSE);
 }
 
-gchar *
-elektron_get_sample_path_from_hash_size (struct backend *backend,
-					 guint32 hash, guint32 size)
+static gint
+elektron_request_sample_path_from_hash_size (struct backend *backend,
+					     guint32 hash, guint32 size,
+					     gchar **path)
 {
   guint32 aux32;
-  gchar *path;
   GByteArray *rx_msg, *tx_msg =
     elektron_new_msg (FS_SAMPLE_GET_FILE_INFO_FROM_HASH_AND_SIZE_REQUEST,
 		      sizeof
@@ -3328,18 +4362,42 @@ elektron_get_sample_path_from_hash_size (struct backend *backend,
   rx_msg = elektron_tx_and_rx (backend, tx_msg, NULL);
   if (!rx_msg)
     {
-      return NULL;
+      return -EIO;
     }
 
   if (elektron_get_msg_status (rx_msg))
     {
-      path = strdup ((gchar *) & rx_msg->data[14]);
+      *path = strdup ((gchar *) & rx_msg->data[14]);
     }
   else
     {
-      path = NULL;
+      *path = NULL;
     }
   g_byte_array_free (rx_msg, TRUE);
+  return 0;
+}
+
+//Paths are kept for the whole session and invalidated on any sample filesystem change made from here.
+
+gchar *
+elektron_get_sample_path_from_hash_size (struct backend *backend,
+					 guint32 hash, guint32 size)
+{
+  gchar *path;
+
+  if (elektron_get_cached_sample_path (backend, hash, size, &path))
+    {
+      return path;
+    }
+
+  if (elektron_request_sample_path_from_hash_size (backend, hash, size,
+						   &path))
+    {
+      return NULL;
+    }
+
+  elektron_set_cached_sample_path (backend, hash, size, path);
+
   return path;
 }
 
@@ -3396,6 +4454,7 @@ elektron_ram_slot_next_entry (struct item_iterator *iter)
 	  elektron_item_set_name (&iter->item, path_cp1252);
 	  iter->item.size = size;
 	  iter->item.type = ITEM_TYPE_FILE;
+	  g_free (path_cp1252);
 	}
       else
 	{
@@ -3464,7 +4523,7 @@ elektron_ram_clear_sample (struct backend *backend, const gchar *path)
       return -EIO;
     }
 
-  usleep (BE_REST_TIME_US);
+  backend_pacing_rest (backend);
 
   return 0;
 }
@@ -3504,7 +4563,7 @@ elektron_ram_download_sample (struct backend *backend,
 
   item_iterator_free (&iter);
 
-  usleep (BE_REST_TIME_US);
+  backend_pacing_rest (backend);
 
   if (sample_path[0] == 0)
     {
@@ -3535,9 +4594,8 @@ elektron_ram_get_download_path (struct backend *backend,
 }
 
 static gint
-elektron_ram_set_sample (struct backend *backend,
-			 const gchar *path, guint16 ram_slot,
-			 guint8 track, struct task_control *control)
+elektron_ram_load_slot (struct backend *backend, const gchar *path,
+			guint16 ram_slot, guint8 track)
 {
   GByteArray *tx_msg, *rx_msg;
   guint16 ram_slot_be = GUINT16_TO_BE (ram_slot);
@@ -3562,37 +4620,81 @@ elektron_ram_set_sample (struct backend *backend,
 
   free_msg (rx_msg);
 
-  // It takes a while for the result to be available
-  usleep (500000);
+  return 0;
+}
+
+// It takes a while for the result to be available. This is the same for a single slot or for several slots loaded in a row.
+static void
+elektron_ram_settle (struct task_control *control)
+{
+  usleep (RAM_SETTLE_TIME_US / 2);
   task_control_set_progress (control, 0.5);
-  usleep (500000);
+  usleep (RAM_SETTLE_TIME_US / 2);
   task_control_set_progress (control, 1.0);
+}
+
+static gint
+elektron_ram_set_sample (struct backend *backend,
+			 const gchar *path, guint16 ram_slot,
+			 guint8 track, struct task_control *control)
+{
+  gint err = elektron_ram_load_slot (backend, path, ram_slot, track);
+  if (err)
+    {
+      return err;
+    }
+
+  elektron_ram_settle (control);
 
   return 0;
 }
 
+//Any identical sample in the device can be loaded so there is no need to upload it.
+static gint
+elektron_ram_get_sample_path (struct backend *backend, struct idata *sample,
+			      struct task_control *control,
+			      gchar **sample_path)
+{
+  gint err;
+
+  *sample_path = elektron_get_sample_path_from_sample (backend, sample);
+  if (*sample_path)
+    {
+      return 0;
+    }
+
+  *sample_path = path_chain (PATH_SYSTEM, RAM_OP_DEF_DIR, sample->name);
+  err = elektron_upload_sample_part (backend, *sample_path, sample, control);
+  if (err)
+    {
+      g_free (*sample_path);
+      *sample_path = NULL;
+    }
+
+  return err;
+}
+
 static gint
 elektron_ram_track_upload (struct backend *backend, guint16 ram_slot,
 			   guint8 track, struct idata *sample,
 			   struct task_control *control)
 {
   gint err;
-  gchar *upload_path;
+  gchar *sample_path;
 
-  upload_path = path_chain (PATH_SYSTEM, RAM_OP_DEF_DIR, sample->name);
-  err = elektron_upload_sample_part (backend, upload_path, sample, control);
+  err = elektron_ram_get_sample_path (backend, sample, control,
+				      &sample_path);
   if (err)
     {
-      goto end;
+      return err;
     }
 
   control->part++;
 
-  err = elektron_ram_set_sample (backend, upload_path, ram_slot,
+  err = elektron_ram_set_sample (backend, sample_path, ram_slot,
 				 track, control);
 
-end:
-  g_free (upload_path);
+  g_free (sample_path);
   return err;
 }
 
@@ -3761,6 +4863,160 @@ elektron_ram_get_free_slot (struct backend *backend)
   return free_slot;
 }
 
+static gint
+elektron_ram_get_free_slots (struct backend *backend, GSList **free_slots)
+{
+  gint err;
+  struct item_iterator iter;
+
+  *free_slots = NULL;
+
+  err = elektron_ram_read_dir (backend, &iter, "/", NULL);
+  if (err)
+    {
+      return err;
+    }
+
+  while (!item_iterator_next (&iter))
+    {
+      if (iter.item.size == -1 && iter.item.id >= 1)
+	{
+	  *free_slots = g_slist_prepend (*free_slots,
+					 GINT_TO_POINTER (iter.item.id));
+	}
+    }
+
+  item_iterator_free (&iter);
+
+  *free_slots = g_slist_reverse (*free_slots);
+
+  return 0;
+}
+
+struct elektron_ram_assignment
+{
+  struct fs_upload_batch_item *item;
+  gchar *sample_path;
+  guint16 ram_slot;
+  guint8 track;
+};
+
+static void
+elektron_ram_assignment_free (gpointer data)
+{
+  struct elektron_ram_assignment *assignment = data;
+  g_free (assignment->sample_path);
+  g_free (assignment);
+}
+
+//Every missing sample is uploaded first. Then, all the slots are loaded in a row so that there is only one settle wait.
+//When loading into tracks, the samples go to the free RAM slots in order.
+
+static gint
+elektron_ram_upload_batch_common (struct backend *backend, GSList *items,
+				  struct task_control *control,
+				  gboolean to_tracks)
+{
+  gint err;
+  guint id;
+  gchar *sample_path;
+  GSList *free_slots = NULL, *assignments = NULL;
+  struct elektron_ram_assignment *assignment;
+
+  if (to_tracks)
+    {
+      err = elektron_ram_get_free_slots (backend, &free_slots);
+      if (err)
+	{
+	  return err;
+	}
+    }
+
+  control->parts = g_slist_length (items) + 1;
+  control->part = 0;
+
+  for (GSList * e = items; e; e = e->next, control->part++)
+    {
+      struct fs_upload_batch_item *item = e->data;
+
+      if (!controllable_is_active (&control->controllable))
+	{
+	  item->err = -ECANCELED;
+	  continue;
+	}
+
+      item->err = common_slot_get_id_from_path (item->path, &id);
+      if (item->err)
+	{
+	  continue;
+	}
+
+      if (to_tracks && !free_slots)
+	{
+	  item->err = -ENOMEM;
+	  continue;
+	}
+
+      item->err = elektron_ram_get_sample_path (backend, &item->idata,
+						control, &sample_path);
+      if (item->err)
+	{
+	  continue;
+	}
+
+      assignment = g_malloc (sizeof (struct elektron_ram_assignment));
+      assignment->item = item;
+      assignment->sample_path = sample_path;
+      if (to_tracks)
+	{
+	  assignment->ram_slot = GPOINTER_TO_INT (free_slots->data);
+	  assignment->track = id;
+	  free_slots = g_slist_delete_link (free_slots, free_slots);
+	}
+      else
+	{
+	  assignment->ram_slot = id;
+	  assignment->track = 0xff;	// This ignores the track and loads to RAM only.
+	}
+      assignments = g_slist_append (assignments, assignment);
+    }
+
+  for (GSList * e = assignments; e; e = e->next)
+    {
+      assignment = e->data;
+      debug_print (1, "Loading %s into RAM slot %d...",
+		   assignment->sample_path, assignment->ram_slot);
+      assignment->item->err = elektron_ram_load_slot (backend,
+						      assignment->sample_path,
+						      assignment->ram_slot,
+						      assignment->track);
+    }
+
+  if (assignments)
+    {
+      elektron_ram_settle (control);
+    }
+
+  g_slist_free_full (assignments, elektron_ram_assignment_free);
+  g_slist_free (free_slots);
+
+  return 0;
+}
+
+static gint
+elektron_ram_upload_batch (struct backend *backend, GSList *items,
+			   struct task_control *control)
+{
+  return elektron_ram_upload_batch_common (backend, items, control, FALSE);
+}
+
+static gint
+elektron_digitakt_track_upload_batch (struct backend *backend, GSList *items,
+				      struct task_control *control)
+{
+  return elektron_ram_upload_batch_common (backend, items, control, TRUE);
+}
+
 static gint
 elektron_digitakt_track_upload_sample_int (struct backend *backend,
 					   const gchar *path,
@@ -4011,7 +5267,8 @@ static const struct fs_operations FS_DATA_SND_OPERATIONS = {
   .save = common_file_save,
   .get_exts = elektron_get_dev_exts,
   .get_upload_path = common_slot_get_upload_path,
-  .get_download_path = elektron_get_download_path
+  .get_download_path = elektron_get_download_path,
+  .get_item_info = elektron_get_snd_item_info
 };
 
 static const struct fs_operations FS_DATA_PST_OPERATIONS = {
@@ -4060,7 +5317,8 @@ static const struct fs_operations FS_DATA_TAKT_II_PST_OPERATIONS = {
   .save = common_file_save,
   .get_exts = elektron_get_dev_exts,
   .get_upload_path = common_slot_get_upload_path,
-  .get_download_path = elektron_get_download_path
+  .get_download_path = elektron_get_download_path,
+  .get_item_info = elektron_get_snd_item_info
 };
 
 static const struct fs_operations FS_DATA_SAMPLES_OPERATIONS = {
@@ -4104,6 +5362,7 @@ static const struct fs_operations FS_DIGITAKT_RAM_OPERATIONS = {
   .delete = elektron_ram_clear_sample,
   .download = elektron_ram_download_sample,
   .upload = elektron_ram_upload_sample,
+  .upload_batch = elektron_ram_upload_batch,
   .load = elektron_sample_load,
   .save = elektron_sample_save,
   .get_exts = sample_get_sample_extensions,
@@ -4123,6 +5382,7 @@ static const struct fs_operations FS_DIGITAKT_TRACK_OPERATIONS = {
   .readdir = elektron_digitakt_track_read_dir,
   .print_item = common_print_item,
   .upload = elektron_digitakt_track_upload_sample,
+  .upload_batch = elektron_digitakt_track_upload_batch,
   .load = elektron_sample_load,
   .get_exts = sample_get_sample_extensions,
   .get_upload_path = common_slot_get_upload_path
@@ -4358,6 +5618,18 @@ cleanup_parser:
     {
       data->dev_desc.id = -1;
     }
+  else
+    {
+      data->snd_tags = g_hash_table_new_full (g_str_hash, g_str_equal,
+					      g_free,
+					      elektron_snd_tags_free);
+      g_mutex_init (&data->snd_tags_mutex);
+      data->snd_tags_generation = 0;
+      data->sample_paths = g_hash_table_new_full (g_int64_hash,
+						  g_int64_equal, g_free,
+						  g_free);
+      g_mutex_init (&data->sample_paths_mutex);
+    }
   return err;
 }
 
@@ -4386,6 +5658,8 @@ elektron_ping (struct backend *backend)
   struct elektron_data *data = g_malloc (sizeof (struct elektron_data));
 
   data->seq = 0;
+  data->window = preferences_get_int (PREF_KEY_ELEKTRON_TRANSFER_WINDOW);
+  data->blk_rest_time = 0;
   backend->data = data;
 
   tx_msg = elektron_new_msg (PING_REQUEST, sizeof (PING_REQUEST));
@@ -4426,6 +5700,11 @@ elektron_destroy_data (struct backend *backend)
       fs_desc++;
     }
 
+  g_hash_table_destroy (data->snd_tags);
+  g_mutex_clear (&data->snd_tags_mutex);
+  g_hash_table_destroy (data->sample_paths);
+  g_mutex_clear (&data->sample_paths_mutex);
+
   g_free (backend->data);
   backend->data = NULL;
 }
@@ -4465,9 +5744,8 @@ elektron_handshake (struct backend *backend)
   rx_msg = elektron_tx_and_rx (backend, tx_msg, NULL);
   if (!rx_msg)
     {
-      backend->data = NULL;
       g_free (overbridge_name);
-      g_free (data);
+      elektron_destroy_data (backend);
       return -ENODEV;
     }
   snprintf (backend->version, LABEL_MAX, "%s", (gchar *) & rx_msg->data[10]);
@@ -4498,6 +5776,8 @@ elektron_handshake (struct backend *backend)
   backend->get_storage_stats =
     data->dev_desc.storage ? elektron_get_storage_stats : NULL;
 
+  backend_pacing_init (backend, BE_REST_TIME_US);
+
   return 0;
 }
 
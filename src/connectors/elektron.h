@@ -32,6 +32,12 @@
 #define ELEKTRON_AH_FX_ID 32
 
 #define PREF_KEY_ELEKTRON_LOAD_SOUND_TAGS "elektronLoadSoundTags"
+#define PREF_KEY_ELEKTRON_TRANSFER_WINDOW "elektronTransferWindow"
+#define PREF_KEY_ELEKTRON_CACHE_SIZE "elektronCacheSize"	//MiB. 0 disables the download cache.
+#define PREF_KEY_ELEKTRON_SAMPLE_STORE "elektronSampleStore"	//Directory for package samples. Empty disables it.
+#define PREF_KEY_ELEKTRON_SAMPLE_LOOKUP "elektronSampleLookup"	//Look for samples already in the device before uploading them. Experimental.
+#define PREF_KEY_ELEKTRON_LIST_PAGES "elektronListPages"	//Request data listings in pages. Experimental.
+#define PREF_KEY_ELEKTRON_OS_BIG_BLOCKS "elektronOsBigBlocks"	//Try bigger blocks first during OS upgrades. Experimental.
 
 enum elektron_fs
 {
@@ -0,0 +1,179 @@
+/*
+ *   elektron_cache.c
+ *   Copyright (C) 2026 David García Goñi <dagargo@gmail.com>
+ *
+ *   This file is part of Elektroid.
+ *
+ *   Elektroid is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   Elektroid is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with Elektroid. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <glib/gstdio.h>
+#include "elektron_cache.h"
+#include "utils.h"
+
+struct elektron_cache_entry
+{
+  gchar *path;
+  gint64 mtime;
+  guint64 size;
+};
+
+static GMutex mutex;
+
+static gchar *
+elektron_cache_get_path (guint32 hash, guint32 size)
+{
+  gchar name[LABEL_MAX];
+  gchar *dir = get_user_dir (CONF_DIR ELEKTRON_CACHE_DIR);
+  gchar *path;
+
+  snprintf (name, LABEL_MAX, "%08x-%u", hash, size);
+  path = path_chain (PATH_SYSTEM, dir, name);
+  g_free (dir);
+
+  return path;
+}
+
+static void
+elektron_cache_entry_free (gpointer data)
+{
+  struct elektron_cache_entry *entry = data;
+  g_free (entry->path);
+  g_free (entry);
+}
+
+static gint
+elektron_cache_entry_compare (gconstpointer a, gconstpointer b)
+{
+  const struct elektron_cache_entry *ea = a;
+  const struct elektron_cache_entry *eb = b;
+  return ea->mtime < eb->mtime ? -1 : ea->mtime > eb->mtime;
+}
+
+//The modification time is used as the last access time as it is always available.
+
+static void
+elektron_cache_evict (guint64 limit)
+{
+  GDir *dir;
+  GStatBuf buf;
+  const gchar *name;
+  guint64 total = 0;
+  GSList *entries = NULL;
+  struct elektron_cache_entry *entry;
+  gchar *dir_path = get_user_dir (CONF_DIR ELEKTRON_CACHE_DIR);
+
+  dir = g_dir_open (dir_path, 0, NULL);
+  if (!dir)
+    {
+      g_free (dir_path);
+      return;
+    }
+
+  while ((name = g_dir_read_name (dir)))
+    {
+      gchar *path = path_chain (PATH_SYSTEM, dir_path, name);
+      if (g_stat (path, &buf) || !S_ISREG (buf.st_mode))
+	{
+	  g_free (path);
+	  continue;
+	}
+      entry = g_malloc (sizeof (struct elektron_cache_entry));
+      entry->path = path;
+      entry->mtime = buf.st_mtime;
+      entry->size = buf.st_size;
+      entries = g_slist_prepend (entries, entry);
+      total += entry->size;
+    }
+  g_dir_close (dir);
+  g_free (dir_path);
+
+  entries = g_slist_sort (entries, elektron_cache_entry_compare);
+
+  for (GSList *e = entries; e && total > limit; e = e->next)
+    {
+      entry = e->data;
+      debug_print (1, "Removing %s from cache...", entry->path);
+      if (!g_unlink (entry->path))
+	{
+	  total -= entry->size;
+	}
+    }
+
+  g_slist_free_full (entries, elektron_cache_entry_free);
+}
+
+GByteArray *
+elektron_cache_get (guint32 hash, guint32 size)
+{
+  gchar *data;
+  gsize len;
+  GByteArray *content = NULL;
+  gchar *path = elektron_cache_get_path (hash, size);
+
+  g_mutex_lock (&mutex);
+
+  if (g_file_get_contents (path, &data, &len, NULL))
+    {
+      if (len == size)
+	{
+	  debug_print (1, "Cache hit for %s", path);
+	  content = g_byte_array_new_take ((guint8 *) data, len);
+	  g_utime (path, NULL);
+	}
+      else
+	{
+	  error_print ("Invalid cache file %s. Removing...", path);
+	  g_free (data);
+	  g_unlink (path);
+	}
+    }
+
+  g_mutex_unlock (&mutex);
+
+  g_free (path);
+  return content;
+}
+
+void
+elektron_cache_put (guint32 hash, guint32 size, GByteArray *content,
+		    guint64 limit)
+{
+  gchar *dir, *path;
+
+  if (content->len != size || size > limit)
+    {
+      return;
+    }
+
+  dir = get_user_dir (CONF_DIR ELEKTRON_CACHE_DIR);
+  path = elektron_cache_get_path (hash, size);
+
+  g_mutex_lock (&mutex);
+
+  if (g_mkdir_with_parents (dir, 0755))
+    {
+      error_print ("Error while creating directory %s", dir);
+    }
+  else if (!file_save_data (path, content->data, content->len))
+    {
+      debug_print (1, "%s added to cache", path);
+      elektron_cache_evict (limit);
+    }
+
+  g_mutex_unlock (&mutex);
+
+  g_free (path);
+  g_free (dir);
+}
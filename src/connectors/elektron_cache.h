@@ -0,0 +1,36 @@
+/*
+ *   elektron_cache.h
+ *   Copyright (C) 2026 David García Goñi <dagargo@gmail.com>
+ *
+ *   This file is part of Elektroid.
+ *
+ *   Elektroid is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   Elektroid is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with Elektroid. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <glib.h>
+
+#ifndef ELEKTRON_CACHE_H
+#define ELEKTRON_CACHE_H
+
+#define ELEKTRON_CACHE_DIR "/cache/elektron"
+
+//Files downloaded from the sample and raw filesystems are stored as they are in the device, keyed by the hash and size the device reports.
+//The least recently used files are removed when the cache grows over the limit. A limit of 0 disables the cache.
+
+GByteArray *elektron_cache_get (guint32 hash, guint32 size);
+
+void elektron_cache_put (guint32 hash, guint32 size, GByteArray * content,
+			 guint64 limit);
+
+#endif
@@ -20,11 +20,13 @@
 
 #include <stdio.h>
 #include <unistd.h>
+#include <glib/gstdio.h>
 #include <json-glib/json-glib.h>
 #include "elektron_pkg.h"
 #include "utils.h"
 #include "sample.h"
 #include "elektron.h"
+#include "preferences.h"
 
 #define PKG_TAG_FORMAT_VERSION "FormatVersion"
 #define PKG_TAG_PRODUCT_TYPE "ProductType"
@@ -48,9 +50,11 @@
 
 #define METADATA_TAG_SAMPLE_REFS "sound_tags"
 
-#define MAX_PACKAGE_LEN (512 * 1024 * 1024)
 #define MAX_MANIFEST_LEN (128 * 1024)
 #define MANIFEST_FILENAME "manifest.json"
+#define PKG_TMP_DIR_TEMPLATE "elektroid-pkg-XXXXXX"
+#define PKG_TMP_ZIP_FILENAME "package.zip"
+#define PKG_STORE_FILENAME_FORMAT "%08x-%u.wav"
 
 static GSList *
 elektron_pkg_get_tags_from_snd_metadata_int (JsonReader *reader)
@@ -134,38 +138,60 @@ cleanup_parser:
   return tags;
 }
 
+//Resources are written to temporary files as they arrive and the zip reads them when it is closed.
+//Thus, only the resource being added is in memory. The manifest is kept as it is rewritten at the end.
+
 static gint
 elektron_pkg_add_resource (struct elektron_pkg *pkg,
 			   struct elektron_pkg_resource *pkg_resource,
 			   gboolean new)
 {
-  zip_source_t *sample_source;
+  gint err;
+  gchar *path;
+  gchar name[LABEL_MAX];
+  zip_source_t *source;
   zip_int64_t index;
-  zip_error_t zerror;
 
   debug_print (1, "Adding file %s to zip (%d B)...", pkg_resource->path,
 	       pkg_resource->data->len);
-  sample_source = zip_source_buffer_create (pkg_resource->data->data,
-					    pkg_resource->data->len, 0,
-					    &zerror);
-  if (!sample_source)
+
+  snprintf (name, LABEL_MAX, "%d", pkg->tmp_files);
+  pkg->tmp_files++;
+  path = g_build_filename (pkg->tmp_dir, name, NULL);
+  err = file_save_data (path, pkg_resource->data->data,
+			pkg_resource->data->len);
+  if (err)
+    {
+      error_print ("Error while writing %s", path);
+      g_free (path);
+      return -1;
+    }
+
+  source = zip_source_file (pkg->zip, path, 0, -1);
+  g_free (path);
+  if (!source)
     {
       error_print ("Error while creating file source: %s",
-		   zip_error_strerror (&zerror));
-      zip_error_fini (&zerror);
+		   zip_error_strerror (zip_get_error (pkg->zip)));
       return -1;
     }
 
-  index = zip_file_add (pkg->zip, pkg_resource->path, sample_source,
+  index = zip_file_add (pkg->zip, pkg_resource->path, source,
 			ZIP_FL_OVERWRITE | ZIP_FL_ENC_UTF_8);
   if (index < 0)
     {
       error_print ("Error while adding file: %s",
 		   zip_error_strerror (zip_get_error (pkg->zip)));
-      zip_source_free (sample_source);
+      zip_source_free (source);
       return -1;
     }
 
+  if (pkg_resource != pkg->manifest)
+    {
+      g_byte_array_free (pkg_resource->data, TRUE);
+      pkg_resource->data = NULL;
+    }
+
   if (new)
     {
       pkg->resources = g_list_append (pkg->resources, pkg_resource);
@@ -174,6 +200,29 @@ elektron_pkg_add_resource (struct elektron_pkg *pkg,
   return 0;
 }
 
+static void
+elektron_pkg_remove_tmp_dir (struct elektron_pkg *pkg)
+{
+  GDir *dir;
+  gchar *path;
+  const gchar *name;
+
+  dir = g_dir_open (pkg->tmp_dir, 0, NULL);
+  if (dir)
+    {
+      while ((name = g_dir_read_name (dir)))
+	{
+	  path = g_build_filename (pkg->tmp_dir, name, NULL);
+	  g_unlink (path);
+	  g_free (path);
+	}
+      g_dir_close (dir);
+    }
+
+  g_rmdir (pkg->tmp_dir);
+  g_free (pkg->tmp_dir);
+  pkg->tmp_dir = NULL;
+}
 
 gint
 elektron_pkg_begin (struct elektron_pkg *pkg, gchar *name,
@@ -181,41 +230,44 @@ elektron_pkg_begin (struct elektron_pkg *pkg, gchar *name,
 		    const struct elektron_dev_desc *dev_desc,
 		    enum elektron_pkg_type type)
 {
+  gint err;
+  gchar *zip_path;
+  GError *error = NULL;
   zip_error_t zerror;
+
   pkg->resources = NULL;
-  pkg->buff = g_malloc (MAX_PACKAGE_LEN);
   pkg->name = name;
   pkg->fw_version = strdup (fw_version);
   pkg->dev_desc = dev_desc;
   pkg->type = type;
+  pkg->zip_source = NULL;
+  pkg->tmp_files = 0;
 
-  debug_print (1, "Creating zip buffer...");
-
-  zip_error_init (&zerror);
-  pkg->zip_source = zip_source_buffer_create (pkg->buff, MAX_PACKAGE_LEN, 0,
-					      &zerror);
-  if (!pkg->zip_source)
+  pkg->tmp_dir = g_dir_make_tmp (PKG_TMP_DIR_TEMPLATE, &error);
+  if (!pkg->tmp_dir)
     {
-      error_print ("Error while creating zip source: %s",
-		   zip_error_strerror (&zerror));
-      zip_error_fini (&zerror);
-      g_free (pkg->buff);
+      error_print ("Error while creating temporary directory: %s",
+		   error->message);
+      g_clear_error (&error);
+      g_free (pkg->fw_version);
       return -1;
     }
 
-  pkg->zip = zip_open_from_source (pkg->zip_source, ZIP_TRUNCATE, &zerror);
+  zip_path = g_build_filename (pkg->tmp_dir, PKG_TMP_ZIP_FILENAME, NULL);
+  debug_print (1, "Creating zip %s...", zip_path);
+  pkg->zip = zip_open (zip_path, ZIP_CREATE | ZIP_TRUNCATE, &err);
+  g_free (zip_path);
   if (!pkg->zip)
     {
-      error_print ("Error while creating in memory zip: %s",
+      zip_error_init_with_code (&zerror, err);
+      error_print ("Error while creating zip: %s",
 		   zip_error_strerror (&zerror));
       zip_error_fini (&zerror);
-      zip_source_free (pkg->zip_source);
-      g_free (pkg->buff);
+      elektron_pkg_remove_tmp_dir (pkg);
+      g_free (pkg->fw_version);
       return -1;
     }
 
-  zip_source_keep (pkg->zip_source);
-
   pkg->manifest = g_malloc (sizeof (struct elektron_pkg_resource));
   pkg->manifest->type = PKG_RES_TYPE_MANIFEST;
   pkg->manifest->data = g_byte_array_sized_new (MAX_MANIFEST_LEN);	//We need this because we can not resize later.
@@ -364,12 +416,14 @@ elektron_pkg_add_manifest (struct elektron_pkg *pkg)
   return 0;
 }
 
+//The package is read back into memory only once as the download operation must return its content.
+
 gint
 elektron_pkg_end (struct elektron_pkg *pkg, struct idata *out)
 {
   int ret = 0;
-  zip_stat_t zstat;
-  GByteArray *content;
+  gsize len;
+  gchar *zip_path, *content;
 
   ret = elektron_pkg_add_manifest (pkg);
   if (ret)
@@ -378,24 +432,28 @@ elektron_pkg_end (struct elektron_pkg *pkg, struct idata *out)
       return ret;
     }
 
-  debug_print (1, "Writing zip to buffer...");
+  debug_print (1, "Writing zip...");
   if (zip_close (pkg->zip))
     {
-      error_print ("Error while creating in memory zip: %s",
+      error_print ("Error while creating zip: %s",
 		   zip_error_strerror (zip_get_error (pkg->zip)));
       return -1;
     }
+  pkg->zip = NULL;
 
-  zip_source_stat (pkg->zip_source, &zstat);
-  debug_print (1, "%" PRIu64 " B written to package", zstat.comp_size);
+  zip_path = g_build_filename (pkg->tmp_dir, PKG_TMP_ZIP_FILENAME, NULL);
+  if (!g_file_get_contents (zip_path, &content, &len, NULL))
+    {
+      error_print ("Error while reading %s", zip_path);
+      g_free (zip_path);
+      return -1;
+    }
+  g_free (zip_path);
 
-  zip_source_open (pkg->zip_source);
-  content = g_byte_array_sized_new (zstat.comp_size);
-  content->len = zstat.comp_size;
-  zip_source_read (pkg->zip_source, content->data, zstat.comp_size);
-  zip_source_close (pkg->zip_source);
+  debug_print (1, "%zu B written to package", len);
 
-  idata_init (out, content, NULL, NULL, NULL);
+  idata_init (out, g_byte_array_new_take ((guint8 *) content, len), NULL,
+	      NULL, NULL);
 
   return 0;
 }
@@ -404,15 +462,26 @@ void
 elektron_pkg_free_elektron_pkg_resource (gpointer data)
 {
   struct elektron_pkg_resource *pkg_resource = data;
-  g_byte_array_free (pkg_resource->data, TRUE);
+  if (pkg_resource->data)
+    {
+      g_byte_array_free (pkg_resource->data, TRUE);
+    }
+  g_free (pkg_resource->path);
   g_free (pkg_resource);
 }
 
 void
 elektron_pkg_destroy (struct elektron_pkg *pkg)
 {
+  if (pkg->tmp_dir)
+    {
+      if (pkg->zip)
+	{
+	  zip_discard (pkg->zip);
+	}
+      elektron_pkg_remove_tmp_dir (pkg);
+    }
   zip_source_free (pkg->zip_source);
-  g_free (pkg->buff);
   g_free (pkg->name);
   g_free (pkg->fw_version);
   g_list_free_full (pkg->resources, elektron_pkg_free_elektron_pkg_resource);
@@ -473,7 +542,7 @@ elektron_pkg_open (struct elektron_pkg *pkg, struct idata *idata,
 
   pkg->resources = NULL;
   pkg->resources = g_list_append (pkg->resources, pkg->manifest);
-  pkg->buff = NULL;
+  pkg->tmp_dir = NULL;
   pkg->name = NULL;
   pkg->fw_version = NULL;
   pkg->dev_desc = dev_desc;
@@ -499,6 +568,41 @@ elektron_pkg_get_max_sample_slots (struct backend *backend)
   return data->dev_desc.id == ELEKTRON_DIGITAKT_II_ID ? 1023 : 127;
 }
 
+//When the sample store is set, package samples are kept there, named by hash and size, instead of inside the packages.
+//This avoids downloading and storing the same sample for every package that uses it but the packages are no longer self-contained.
+
+static gchar *
+elektron_pkg_get_store_path (guint32 hash, guint32 size)
+{
+  gchar name[LABEL_MAX];
+  const gchar *store = preferences_get_string (PREF_KEY_ELEKTRON_SAMPLE_STORE);
+
+  if (!store || !*store)
+    {
+      return NULL;
+    }
+
+  snprintf (name, LABEL_MAX, PKG_STORE_FILENAME_FORMAT, hash, size);
+  return g_build_filename (store, name, NULL);
+}
+
+static gint
+elektron_pkg_save_to_store (const gchar *store_path, struct idata *file)
+{
+  gint err;
+  gchar *dir = g_path_get_dirname (store_path);
+
+  err = g_mkdir_with_parents (dir, 0755);
+  g_free (dir);
+  if (err)
+    {
+      error_print ("Error while creating sample store directory");
+      return -errno;
+    }
+
+  return file_save_data (store_path, file->content->data, file->content->len);
+}
+
 gint
 elektron_pkg_receive_pkg_resources (struct elektron_pkg *pkg,
 				    const gchar *payload_path,
@@ -512,7 +616,8 @@ elektron_pkg_receive_pkg_resources (struct elektron_pkg *pkg,
   JsonReader *reader;
   gint64 hash, size;
   GError *error = NULL;
-  gchar *sample_path, *metadata_path;
+  gboolean in_store;
+  gchar *sample_path, *metadata_path, *store_path;
   struct elektron_pkg_resource *pkg_resource;
   GString *elektron_pkg_resource_path;
   struct idata metadata_file, payload_file, sample_file, file;
@@ -641,43 +746,79 @@ elektron_pkg_receive_pkg_resources (struct elektron_pkg *pkg,
 
       debug_print (1, "Hash: %" PRIu64 "; size: %" PRIu64 "; path: %s",
 		   hash, size, sample_path);
-      debug_print (1, "Getting sample %s...", sample_path);
 
-      if (elektron_download_sample_part (backend, sample_path, &sample_file,
-					 control))
+      store_path = elektron_pkg_get_store_path (hash, size);
+      in_store = store_path && g_file_test (store_path, G_FILE_TEST_EXISTS);
+
+      if (in_store)
 	{
-	  g_free (sample_path);
-	  error_print ("Error while downloading sample. Continuing...");
-	  continue;
+	  debug_print (1, "Sample found in store at %s", store_path);
 	}
-
-      ret = sample_get_memfile_from_sample (&sample_file, &file, control,
-					    SF_FORMAT_WAV | SF_FORMAT_PCM_16);
-      if (ret)
+      else
 	{
-	  error_print
-	    ("Error while converting sample to wave file. Continuing...");
-	  g_free (sample_path);
-	  continue;
+	  debug_print (1, "Getting sample %s...", sample_path);
+
+	  if (elektron_download_sample_part (backend, sample_path,
+					     &sample_file, control))
+	    {
+	      g_free (sample_path);
+	      g_free (store_path);
+	      error_print ("Error while downloading sample. Continuing...");
+	      continue;
+	    }
+
+	  ret = sample_get_memfile_from_sample (&sample_file, &file, control,
+						SF_FORMAT_WAV |
+						SF_FORMAT_PCM_16);
+	  idata_clear (&sample_file);
+	  if (ret)
+	    {
+	      error_print
+		("Error while converting sample to wave file. Continuing...");
+	      g_free (sample_path);
+	      g_free (store_path);
+	      continue;
+	    }
 	}
 
       pkg_resource = g_malloc (sizeof (struct elektron_pkg_resource));
       pkg_resource->type = PKG_RES_TYPE_SAMPLE;
-      pkg_resource->data = idata_steal (&file);
+      pkg_resource->data = NULL;
       pkg_resource->hash = hash;
       pkg_resource->size = size;
       elektron_pkg_resource_path = g_string_new (NULL);
       g_string_append_printf (elektron_pkg_resource_path, "%s%s.wav",
 			      PKG_TAG_SAMPLES, sample_path);
       pkg_resource->path = g_string_free (elektron_pkg_resource_path, FALSE);
+      g_free (sample_path);
+
+      if (store_path)
+	{
+	  if (!in_store)
+	    {
+	      ret = elektron_pkg_save_to_store (store_path, &file);
+	      idata_clear (&file);
+	      if (ret)
+		{
+		  error_print ("Error while saving sample to store");
+		  elektron_pkg_free_elektron_pkg_resource (pkg_resource);
+		  g_free (store_path);
+		  continue;
+		}
+	    }
+	  g_free (store_path);
+	  //Only the manifest entry is added.
+	  pkg->resources = g_list_append (pkg->resources, pkg_resource);
+	  continue;
+	}
+
+      pkg_resource->data = idata_steal (&file);
       if (elektron_pkg_add_resource (pkg, pkg_resource, TRUE))
 	{
 	  elektron_pkg_free_elektron_pkg_resource (pkg_resource);
 	  error_print ("Error while packaging sample");
 	  continue;
 	}
-
-      idata_clear (&sample_file);
     }
 
 cleanup_reader:
@@ -716,8 +857,10 @@ elektron_pkg_send_pkg_resources (struct elektron_pkg *pkg,
 				 fs_remote_file_op upload_data)
 {
   gint elements, i, ret = 0;
-  const gchar *file_type, *sample_path;
-  gchar *dev_sample_path;
+  gsize store_len;
+  guint32 sample_hash, sample_size;
+  const gchar *file_type, *sample_path, *hash;
+  gchar *dev_sample_path, *store_path, *store_content;
   gint64 product_type;
   JsonParser *parser;
   JsonReader *reader;
@@ -892,17 +1035,49 @@ elektron_pkg_send_pkg_resources (struct elektron_pkg *pkg,
       json_reader_read_member (reader, PKG_TAG_FILE_NAME);
       sample_path = json_reader_get_string_value (reader);
       json_reader_end_element (reader);
+      json_reader_read_member (reader, PKG_TAG_FILE_SIZE);
+      sample_size = json_reader_get_int_value (reader);
+      json_reader_end_element (reader);
+      json_reader_read_member (reader, PKG_TAG_HASH);
+      hash = json_reader_get_string_value (reader);
+      sample_hash = hash ? strtoul (hash, NULL, 10) : 0;
+      json_reader_end_element (reader);
       json_reader_end_element (reader);
 
       debug_print (2, "Uploading %s...", sample_path);
 
       if (zip_stat (pkg->zip, sample_path, ZIP_FL_ENC_STRICT, &zstat))
 	{
-	  error_print ("Error while loading '%s': %s",
-		       MANIFEST_FILENAME, zip_error_strerror (&zerror));
-	  zip_error_fini (&zerror);
-	  ret = -1;
-	  continue;
+	  //Packages created with the sample store enabled do not include the samples.
+	  store_path = elektron_pkg_get_store_path (sample_hash, sample_size);
+	  if (!store_path ||
+	      !g_file_get_contents (store_path, &store_content, &store_len,
+				    NULL))
+	    {
+	      zip_error_init_with_code (&zerror,
+					zip_error_code_zip (zip_get_error
+							    (pkg->zip)));
+	      error_print ("Error while loading '%s': %s",
+			   sample_path, zip_error_strerror (&zerror));
+	      zip_error_fini (&zerror);
+	      g_free (store_path);
+	      ret = -1;
+	      continue;
+	    }
+	  debug_print (2, "Loading %s from store...", sample_path);
+	  g_free (store_path);
+	  g_byte_array_free (sample_file.content, TRUE);
+	  sample_file.content = g_byte_array_new_take ((guint8 *)
+						       store_content,
+						       store_len);
+	}
+      else
+	{
+	  g_byte_array_set_size (sample_file.content, zstat.size);
+	  zip_file = zip_fopen (pkg->zip, sample_path, 0);
+	  zip_fread (zip_file, sample_file.content->data, zstat.size);
+	  sample_file.content->len = zstat.size;
+	  zip_fclose (zip_file);
 	}
 
       //We remove the "Samples" at the beggining of the full zip path...
@@ -911,12 +1086,6 @@ elektron_pkg_send_pkg_resources (struct elektron_pkg *pkg,
       filename_remove_ext (dev_sample_path);
       sample_file.name = g_path_get_basename (dev_sample_path);
 
-      g_byte_array_set_size (sample_file.content, zstat.size);
-      zip_file = zip_fopen (pkg->zip, sample_path, 0);
-      zip_fread (zip_file, sample_file.content->data, zstat.size);
-      sample_file.content->len = zstat.size;
-      zip_fclose (zip_file);
-
       if (sample_load_from_memfile (&sample_file, &sample, control,
 				    &sample_load_opts, &sample_info_src))
 	{
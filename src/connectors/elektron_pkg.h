@@ -79,7 +79,14 @@ struct elektron_dev_desc
 struct elektron_data
 {
   guint16 seq;
+  guint window;			//Block requests in flight during transfers.
+  gint blk_rest_time;		//Minimum rest in us between blocks when the window is 1.
   struct elektron_dev_desc dev_desc;
+  GHashTable *snd_tags;		//Sound tags by path. An entry is only valid while the sound size does not change.
+  GMutex snd_tags_mutex;
+  guint snd_tags_generation;	//Incremented every time the sound tags are invalidated.
+  GHashTable *sample_paths;	//Sample paths in CP1252 by hash and size. A NULL path means that the sample is not in the device.
+  GMutex sample_paths_mutex;
 };
 
 struct elektron_pkg
@@ -88,7 +95,8 @@ struct elektron_pkg
   enum elektron_pkg_type type;
   gchar *fw_version;
   const struct elektron_dev_desc *dev_desc;
-  gchar *buff;
+  gchar *tmp_dir;		//Only used when creating packages. Resources are written here as they arrive.
+  guint tmp_files;
   zip_source_t *zip_source;
   zip_t *zip;
   GList *resources;
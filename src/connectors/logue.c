@@ -1069,7 +1069,7 @@ logue_upload (struct backend *backend, const gchar *path,
 
   free_msg (rx_msg);
 
-  usleep (LOGUE_REST_TIME_US);
+  backend_pacing_rest (backend);
 
 end:
   return err;
@@ -1470,7 +1470,7 @@ logue_download (struct backend *backend, const gchar *path,
       idata_clear (&sysex);
     }
 
-  usleep (LOGUE_REST_TIME_US);
+  backend_pacing_rest (backend);
 
   return err;
 }
@@ -1686,12 +1686,20 @@ logue_handshake (struct backend *backend)
 	       &FS_LOGUE_DELFX_OPERATIONS, &FS_LOGUE_REVFX_OPERATIONS, NULL);
   snprintf (backend->name, LABEL_MAX, "KORG %s", name);
 
+  backend_pacing_init (backend, LOGUE_REST_TIME_US);
+
   return err;
 }
 
+static const struct connector_midi_id LOGUE_MIDI_ID = {
+  .company = KORG_ID,
+  .company_len = sizeof (KORG_ID)
+};
+
 const struct connector CONNECTOR_LOGUE = {
   .name = "logue",
   .handshake = logue_handshake,
   .options = 0,
-  .regex = ".*(prologue|minilogue xd|NTS-1).*KBD/KNOB"
+  .regex = ".*(prologue|minilogue xd|NTS-1).*KBD/KNOB",
+  .midi_id = &LOGUE_MIDI_ID
 };
@@ -616,9 +616,19 @@ microbrute_set_parameter (struct backend *backend,
   return err;
 }
 
+static const struct connector_midi_id MICROBRUTE_MIDI_ID = {
+  .company = ARTURIA_ID,
+  .company_len = sizeof (ARTURIA_ID),
+  .family = FAMILY_ID,
+  .family_len = sizeof (FAMILY_ID),
+  .model = MODEL_ID,
+  .model_len = sizeof (MODEL_ID)
+};
+
 const struct connector CONNECTOR_MICROBRUTE = {
   .name = MICROBRUTE_NAME,
   .handshake = microbrute_handshake,
   .options = 0,
-  .regex = ".*MicroBrute.*"
+  .regex = ".*MicroBrute.*",
+  .midi_id = &MICROBRUTE_MIDI_ID
 };
@@ -259,9 +259,19 @@ padkontrol_handshake (struct backend *backend)
   return 0;
 }
 
+static const struct connector_midi_id PADKONTROL_MIDI_ID = {
+  .company = KORG_ID,
+  .company_len = sizeof (KORG_ID),
+  .family = FAMILY_ID,
+  .family_len = sizeof (FAMILY_ID),
+  .model = MODEL_ID,
+  .model_len = sizeof (MODEL_ID)
+};
+
 const struct connector CONNECTOR_PADKONTROL = {
   .name = "padkontrol",
   .handshake = padkontrol_handshake,
   .options = 0,
-  .regex = ".*padKONTROL.*"
+  .regex = ".*padKONTROL.*",
+  .midi_id = &PADKONTROL_MIDI_ID
 };
@@ -486,9 +486,19 @@ phatty_handshake (struct backend *backend)
   return 0;
 }
 
+static const struct connector_midi_id PHATTY_MIDI_ID = {
+  .company = MOOG_ID,
+  .company_len = sizeof (MOOG_ID),
+  .family = FAMILY_ID,
+  .family_len = sizeof (FAMILY_ID),
+  .model = MODEL_ID,
+  .model_len = sizeof (MODEL_ID)
+};
+
 const struct connector CONNECTOR_PHATTY = {
   .name = "phatty",
   .handshake = phatty_handshake,
   .options = 0,
-  .regex = ".*Phatty.*"
+  .regex = ".*Phatty.*",
+  .midi_id = &PHATTY_MIDI_ID
 };
@@ -42,16 +42,23 @@
 #define SDS_NO_SPEC_OPEN_LOOP_REST_TIME 200000
 #define SDS_SAMPLE_CHANNELS 1
 #define SDS_SAMPLE_NAME_MAX_LEN 127
+#define SDS_SCAN_KNOWN_SLOTS 2	//The handshake already got the name of the sample 1.
+#define SDS_SCAN_RANGE 128
+#define SDS_SAMPLE_NAME_REPLY_MIN_LEN 11
 
 struct sds_data
 {
-  gint rest_time;
   gboolean name_extension;
+  GMutex mutex;
+  guint slots;			//0 means not scanned yet.
+  gboolean slots_checked;	//FALSE if the scan ended on a timeout, so the slots must be checked before being used.
+  GHashTable *names;		//Sample names by id. Only used with the name extension.
 };
 
 struct sds_iterator_data
 {
   guint32 next;
+  guint32 slots;
   struct backend *backend;
 };
 
@@ -70,25 +77,114 @@ static const guint8 SDS_DUMP_HEADER[] =
 static const guint8 SDS_LOOP_POINT_REQUEST[] =
   { 0xf0, 0x7e, 0, 5, 2, 0, 0, 0, 0, 0xf7 };
 
-static gchar *
-sds_get_sample_name (struct backend *backend, gint index)
+//Returns -ETIMEDOUT if there is no answer and -EIO if the answer is not a sample name.
+
+static gint
+sds_request_sample_name_int (struct backend *backend, gint index,
+			     gint timeout, gboolean probe, gchar **name)
 {
+  size_t n;
   GByteArray *tx_msg, *rx_msg;
-  gchar *name = NULL;
 
   tx_msg = g_byte_array_sized_new (sizeof (SDS_SAMPLE_NAME_REQUEST));
   g_byte_array_append (tx_msg, SDS_SAMPLE_NAME_REQUEST,
 		       sizeof (SDS_SAMPLE_NAME_REQUEST));
   tx_msg->data[5] = index % 0x80;
   tx_msg->data[6] = index / 0x80;
-  rx_msg = backend_tx_and_rx_sysex (backend, tx_msg, SDS_NO_SPEC_TIMEOUT);
-  if (rx_msg)
+  if (probe)
+    {
+      rx_msg = backend_tx_and_probe_sysex (backend, tx_msg, timeout);
+    }
+  else
     {
-      size_t n = rx_msg->data[9];
-      name = g_malloc (sizeof (gchar) * (SDS_SAMPLE_NAME_MAX_LEN + 1));
-      memcpy (name, (gchar *) & rx_msg->data[10], n);
-      memset (name + n, 0, SDS_SAMPLE_NAME_MAX_LEN + 1 - n);
+      rx_msg = backend_tx_and_rx_sysex (backend, tx_msg, timeout);
+    }
+  if (!rx_msg)
+    {
+      return -ETIMEDOUT;
+    }
+
+  n = rx_msg->len >= SDS_SAMPLE_NAME_REPLY_MIN_LEN ? rx_msg->data[9] : 0;
+  if (rx_msg->len < SDS_SAMPLE_NAME_REPLY_MIN_LEN
+      || rx_msg->data[3] != SDS_SAMPLE_NAME_HEADER[3]
+      || rx_msg->data[4] != SDS_SAMPLE_NAME_HEADER[4]
+      || n > SDS_SAMPLE_NAME_MAX_LEN
+      || rx_msg->len < SDS_SAMPLE_NAME_REPLY_MIN_LEN + n)
+    {
+      debug_print (1, "Unexpected sample name reply");
       free_msg (rx_msg);
+      return -EIO;
+    }
+
+  *name = g_malloc (sizeof (gchar) * (SDS_SAMPLE_NAME_MAX_LEN + 1));
+  memcpy (*name, (gchar *) & rx_msg->data[10], n);
+  memset (*name + n, 0, SDS_SAMPLE_NAME_MAX_LEN + 1 - n);
+  free_msg (rx_msg);
+
+  return 0;
+}
+
+static gchar *
+sds_request_sample_name (struct backend *backend, gint index, gint timeout)
+{
+  gchar *name = NULL;
+  sds_request_sample_name_int (backend, index, timeout, FALSE, &name);
+  return name;
+}
+
+//Names are cached until the sample is uploaded or renamed.
+
+static gchar *
+sds_get_cached_sample_name (struct backend *backend, gint index)
+{
+  gchar *name;
+  struct sds_data *sds_data = backend->data;
+
+  g_mutex_lock (&sds_data->mutex);
+  name = g_strdup (g_hash_table_lookup (sds_data->names,
+					GINT_TO_POINTER (index)));
+  g_mutex_unlock (&sds_data->mutex);
+
+  return name;
+}
+
+static void
+sds_set_cached_sample_name (struct backend *backend, gint index,
+			    const gchar *name)
+{
+  struct sds_data *sds_data = backend->data;
+
+  g_mutex_lock (&sds_data->mutex);
+  g_hash_table_insert (sds_data->names, GINT_TO_POINTER (index),
+		       g_strdup (name));
+  g_mutex_unlock (&sds_data->mutex);
+}
+
+static void
+sds_clear_cached_sample_name (struct backend *backend, gint index)
+{
+  struct sds_data *sds_data = backend->data;
+
+  if (sds_data->name_extension)
+    {
+      g_mutex_lock (&sds_data->mutex);
+      g_hash_table_remove (sds_data->names, GINT_TO_POINTER (index));
+      g_mutex_unlock (&sds_data->mutex);
+    }
+}
+
+static gchar *
+sds_get_sample_name (struct backend *backend, gint index)
+{
+  gchar *name = sds_get_cached_sample_name (backend, index);
+
+  if (!name)
+    {
+      name = sds_request_sample_name (backend, index, SDS_NO_SPEC_TIMEOUT);
+      if (name)
+	{
+	  sds_set_cached_sample_name (backend, index, name);
+	}
     }
 
   return name;
@@ -321,26 +417,111 @@ sds_download_get_header (struct backend *backend, guint id)
   return NULL;
 }
 
+//A dump can not be requested from a given packet so a resumed download requests the whole dump again.
+//Packets already received are acknowledged as they arrive without being decoded nor verified again.
+
+struct sds_download_state
+{
+  GByteArray *output;		//Preallocated from the dump header. Packets are decoded in place.
+  struct sample_info *sample_info;
+  guint bits;
+  guint words;
+  guint word_size;
+  guint bytes_per_word;
+  guint packets;
+  guint rx_packets;		//Consecutive packets received from the first one.
+};
+
+static void
+sds_download_state_clear (struct sds_download_state *state)
+{
+  if (state->output)
+    {
+      g_byte_array_free (state->output, TRUE);
+      state->output = NULL;
+    }
+  if (state->sample_info)
+    {
+      sample_info_free (state->sample_info);
+      state->sample_info = NULL;
+    }
+  state->rx_packets = 0;
+}
+
+static gint
+sds_download_state_set_header (struct sds_download_state *state,
+			       GByteArray *header)
+{
+  guint bits, words, word_size, bytes_per_word;
+  struct sample_info *sample_info = sample_info_new (FALSE);
+
+  if (sds_get_download_info (header, sample_info, &bits, &words, &word_size,
+			     &bytes_per_word))
+    {
+      sample_info_free (sample_info);
+      return -EINVAL;
+    }
+
+  if (state->output)
+    {
+      if (state->bits == bits && state->words == words &&
+	  state->sample_info->rate == sample_info->rate)
+	{
+	  sample_info_free (sample_info);
+	  debug_print (1, "Resuming download after packet %d...",
+		       state->rx_packets);
+	  return 0;
+	}
+
+      debug_print (1, "Sample changed. Restarting download...");
+      sds_download_state_clear (state);
+    }
+
+  state->sample_info = sample_info;
+  state->bits = bits;
+  state->words = words;
+  state->word_size = word_size;
+  state->bytes_per_word = bytes_per_word;
+  state->packets = ceil (words / (double) (SDS_DATA_PACKET_PAYLOAD_LEN /
+					   bytes_per_word));
+  state->output = g_byte_array_sized_new (words * sizeof (gint16));
+  g_byte_array_set_size (state->output, words * sizeof (gint16));
+  memset (state->output->data, 0, state->output->len);
+  state->rx_packets = 0;
+
+  return 0;
+}
+
+static void
+sds_download_decode_packet (struct sds_download_state *state,
+			    GByteArray *rx_msg, guint packet)
+{
+  guint words_per_packet = SDS_DATA_PACKET_PAYLOAD_LEN /
+    state->bytes_per_word;
+  guint word = packet * words_per_packet;
+  gint16 *frame = &((gint16 *) state->output->data)[word];
+  guint8 *dataptr = &rx_msg->data[sizeof (SDS_DATA_PACKET_HEADER)];
+
+  for (guint i = 0; i < words_per_packet && word < state->words;
+       i++, word++, frame++)
+    {
+      *frame = sds_get_gint16_value_left_just (dataptr,
+					       state->bytes_per_word,
+					       state->bits);
+      dataptr += state->bytes_per_word;
+    }
+}
+
 static gint
-sds_download_try (struct backend *backend, const gchar *path,
-		  struct idata *sample, struct task_control *control)
+sds_download_try (struct backend *backend, guint id,
+		  struct sds_download_state *state,
+		  struct task_control *control)
 {
-  guint id, words, word_size, read_bytes, bytes_per_word, total_words, err,
-    retries, packets, packet, exp_packet, rx_packets, bits;
-  gint16 s;
+  guint total_words, err, retries, packet, exp_packet, words_per_packet;
   GByteArray *tx_msg, *rx_msg;
-  gchar *name, *basename;
-  guint8 *dataptr;
   gboolean active, first;
   gboolean last_packet_ack;
-  struct sample_info *sample_info;
   struct sysex_transfer transfer;
-  struct sds_data *sds_data = backend->data;
-  GByteArray *output = g_byte_array_new ();
-
-  basename = g_path_get_basename (path);
-  id = atoi (basename);
-  g_free (basename);
 
   debug_print (1, "Sending dump request...");
   packet = 0;
@@ -352,8 +533,7 @@ sds_download_try (struct backend *backend, const gchar *path,
 
       if (!active)
 	{
-	  err = -ECANCELED;
-	  goto end;
+	  return -ECANCELED;
 	}
 
       g_mutex_lock (&backend->mutex);
@@ -368,40 +548,36 @@ sds_download_try (struct backend *backend, const gchar *path,
       retries++;
       if (retries == SDS_MAX_RETRIES)
 	{
-	  err = -EIO;
-	  goto end;
+	  return -EIO;
 	}
     }
 
-  sample_info = sample_info_new (FALSE);
-  if (sds_get_download_info (rx_msg, sample_info, &bits, &words, &word_size,
-			     &bytes_per_word))
+  err = sds_download_state_set_header (state, rx_msg);
+  free_msg (rx_msg);
+  if (err)
     {
-      free_msg (rx_msg);
-      g_free (sample_info);
-      err = -EINVAL;
-      goto end;
+      return err;
     }
 
-  packets =
-    ceil (words / (double) (SDS_DATA_PACKET_PAYLOAD_LEN / bytes_per_word));
-  sds_debug_print_sample_data (bits, bytes_per_word, word_size,
-			       sample_info->rate, words, packets);
+  words_per_packet = SDS_DATA_PACKET_PAYLOAD_LEN / state->bytes_per_word;
+  sds_debug_print_sample_data (state->bits, state->bytes_per_word,
+			       state->word_size, state->sample_info->rate,
+			       state->words, state->packets);
 
   active = controllable_is_active (&control->controllable);
 
   task_control_reset (control, 1);
+  task_control_set_progress (control,
+			     state->rx_packets / (double) state->packets);
 
   debug_print (1, "Receiving dump data...");
 
-  total_words = 0;
   retries = 0;
   last_packet_ack = TRUE;
   err = 0;
   exp_packet = 0;
   first = TRUE;
-  rx_packets = 0;
-  while (active && rx_packets <= packets)
+  while (active && exp_packet <= state->packets)
     {
       if (retries == SDS_MAX_RETRIES)
 	{
@@ -421,7 +597,7 @@ sds_download_try (struct backend *backend, const gchar *path,
 	}
       tx_msg->data[4] = packet % 0x80;
 
-      if (rx_packets == packets)
+      if (exp_packet == state->packets)
 	{
 	  err = backend_tx (backend, tx_msg);
 	  goto end;
@@ -446,20 +622,24 @@ sds_download_try (struct backend *backend, const gchar *path,
 	}
       else if (err == -ETIMEDOUT)
 	{
+	  total_words = MIN (state->words, exp_packet * words_per_packet);
 	  debug_print (2,
 		       "Packet not received. Remaining packets: %d; remaining samples: %d",
-		       packets - rx_packets, words - total_words);
+		       state->packets - exp_packet,
+		       state->words - total_words);
 	  //This is a hack to fix a downloading error with an E-Mu ESI-2000 as it never sends the last packet when there is only 1 sample.
-	  if ((rx_packets == packets - 1) && (total_words == words - 1))
+	  if ((exp_packet == state->packets - 1)
+	      && (total_words == state->words - 1))
 	    {
 	      debug_print (2,
 			   "Skipping last packet as it has only one sample...");
-	      rx_packets++;
+	      exp_packet++;
+	      state->rx_packets = exp_packet;
 
 	      //We cancel the upload.
-	      usleep (sds_data->rest_time);
+	      backend_pacing_rest (backend);
 	      sds_tx_handshake (backend, SDS_CANCEL, packet % 0x80);
-	      usleep (sds_data->rest_time);
+	      backend_pacing_rest (backend);
 
 	      err = 0;
 	      goto end;
@@ -486,32 +666,28 @@ sds_download_try (struct backend *backend, const gchar *path,
 	  goto retry;
 	}
 
-      if (sds_checksum (rx_msg->data) !=
-	  rx_msg->data[SDS_DATA_PACKET_CKSUM_POS])
+      if (exp_packet >= state->rx_packets)
 	{
-	  debug_print (2, "Invalid cksum");
-	  goto retry;
+	  if (sds_checksum (rx_msg->data) !=
+	      rx_msg->data[SDS_DATA_PACKET_CKSUM_POS])
+	    {
+	      debug_print (2, "Invalid cksum");
+	      goto retry;
+	    }
+
+	  sds_download_decode_packet (state, rx_msg, exp_packet);
+	  state->rx_packets++;
+
+	  task_control_set_progress (control,
+				     state->rx_packets /
+				     (double) state->packets);
 	}
 
       exp_packet++;
-      rx_packets++;
 
       last_packet_ack = TRUE;
       retries = 0;
 
-      read_bytes = 0;
-      dataptr = &rx_msg->data[5];
-      while (read_bytes < SDS_DATA_PACKET_PAYLOAD_LEN && total_words < words)
-	{
-	  s = sds_get_gint16_value_left_just (dataptr, bytes_per_word, bits);
-	  g_byte_array_append (output, (guint8 *) & s, sizeof (gint16));
-	  dataptr += bytes_per_word;
-	  read_bytes += bytes_per_word;
-	  total_words++;
-	}
-
-      task_control_set_progress (control, rx_packets / (double) packets);
-
       active = controllable_is_active (&control->controllable);
 
       free_msg (rx_msg);
@@ -523,76 +699,109 @@ sds_download_try (struct backend *backend, const gchar *path,
       if (rx_msg)
 	{
 	  free_msg (rx_msg);
+	  backend_pacing_report (backend, -EBADMSG);
 	}
       last_packet_ack = FALSE;
-      usleep (sds_data->rest_time);
+      backend_pacing_rest (backend);
+      backend_stats_add_retry (backend);
       retries++;
       continue;
     }
 
 end:
-  if (active && !err && rx_packets == packets)
+  if (active && !err && state->rx_packets == state->packets)
     {
-      debug_print (1, "%d frames received", total_words);
+      debug_print (1, "%d frames received", state->words);
       task_control_set_progress (control, 1.0);
-
-      if (sds_data->name_extension)
-	{
-	  name = sds_get_sample_name (backend, id);
-	}
-      else
-	{
-	  name = g_malloc (LABEL_MAX);
-	  snprintf (name, LABEL_MAX, "%03d", id);
-	}
-      idata_init (sample, output, name, sample_info, sample_info_free);
     }
   else
     {
       debug_print (1, "Cancelling SDS download...");
       sds_tx_handshake (backend, SDS_CANCEL, packet % 0x80);
-      g_byte_array_free (output, TRUE);
+      if (!err)
+	{
+	  err = -ECANCELED;
+	}
     }
 
-  usleep (sds_data->rest_time);
+  backend_pacing_rest (backend);
 
   return err;
 }
 
+//Downloads interrupted by too many retries, timeouts or a device that stops answering are resumed keeping the packets already received.
+
 static gint
 sds_download (struct backend *backend, const gchar *path,
 	      struct idata *sample, struct task_control *control)
 {
   gint err;
+  guint id;
+  gchar *name, *basename;
+  struct sds_download_state state;
+  struct sds_data *sds_data = backend->data;
+
+  basename = g_path_get_basename (path);
+  id = atoi (basename);
+  g_free (basename);
+
+  state.output = NULL;
+  state.sample_info = NULL;
+  state.rx_packets = 0;
 
   for (gint i = 0; i < SDS_MAX_RETRIES; i++)
     {
-      err = sds_download_try (backend, path, sample, control);
-      if (err == -EBADMSG)
+      err = sds_download_try (backend, id, &state, control);
+      if (!err || err == -ECANCELED || err == -EINVAL || !state.output)
+	{
+	  break;
+	}
+
+      backend_stats_add_retry (backend);
+      debug_print (2, "Download interrupted after %d packets. Resuming...",
+		   state.rx_packets);
+    }
+
+  if (!err)
+    {
+      if (sds_data->name_extension)
 	{
-	  //We retry the whole download to fix a downloading error with an E-Mu ESI-2000 as it occasionally doesn't send the last packet.
-	  debug_print (2, "Bug detected. Retrying download...");
+	  name = sds_get_sample_name (backend, id);
 	}
       else
 	{
-	  break;
+	  name = g_malloc (LABEL_MAX);
+	  snprintf (name, LABEL_MAX, "%03d", id);
 	}
+      idata_init (sample, state.output, name, state.sample_info,
+		  sample_info_free);
+      state.output = NULL;
+      state.sample_info = NULL;
     }
 
+  sds_download_state_clear (&state);
+
   return err;
 }
 
 static gint
 sds_tx_and_wait_ack (struct backend *backend, GByteArray *tx_msg,
 		     guint packet, gint timeout, gint timeout2,
-		     struct controllable *controllable)
+		     struct controllable *controllable, gboolean probe)
 {
   gint err;
   gint t;
   guint rx_packet;
   GByteArray *rx_msg;
   gboolean waiting = FALSE;
-  rx_msg = backend_tx_and_rx_sysex (backend, tx_msg, timeout);
+  if (probe)
+    {
+      rx_msg = backend_tx_and_probe_sysex (backend, tx_msg, timeout);
+    }
+  else
+    {
+      rx_msg = backend_tx_and_rx_sysex (backend, tx_msg, timeout);
+    }
   if (!rx_msg)
     {
       return -ETIMEDOUT;	//Nothing was received
@@ -648,20 +857,17 @@ sds_tx_and_wait_ack (struct backend *backend, GByteArray *tx_msg,
   return err;
 }
 
-static inline GByteArray *
-sds_get_data_packet_msg (gint packet, guint words, guint *word,
-			 gint16 **frame, guint bits, guint bytes_per_word)
+static inline void
+sds_set_data_packet (guint8 *msg, gint packet, guint words, guint *word,
+		     gint16 **frame, guint bits, guint bytes_per_word)
 {
   guint8 *data;
-  GByteArray *tx_msg = g_byte_array_sized_new (SDS_DATA_PACKET_LEN);
-  g_byte_array_append (tx_msg, SDS_DATA_PACKET_HEADER,
-		       sizeof (SDS_DATA_PACKET_HEADER));
-  g_byte_array_set_size (tx_msg, SDS_DATA_PACKET_LEN);
-  tx_msg->data[4] = packet;
-  memset (&tx_msg->data[sizeof (SDS_DATA_PACKET_HEADER)], 0,
+  memcpy (msg, SDS_DATA_PACKET_HEADER, sizeof (SDS_DATA_PACKET_HEADER));
+  msg[4] = packet;
+  memset (&msg[sizeof (SDS_DATA_PACKET_HEADER)], 0,
 	  SDS_DATA_PACKET_PAYLOAD_LEN);
-  tx_msg->data[SDS_DATA_PACKET_LEN - 1] = 0xf7;
-  data = &tx_msg->data[sizeof (SDS_DATA_PACKET_HEADER)];
+  msg[SDS_DATA_PACKET_LEN - 1] = 0xf7;
+  data = &msg[sizeof (SDS_DATA_PACKET_HEADER)];
   for (guint i = 0; i < SDS_DATA_PACKET_PAYLOAD_LEN; i += bytes_per_word)
     {
       if (*word < words)
@@ -673,10 +879,65 @@ sds_get_data_packet_msg (gint packet, guint words, guint *word,
 	  (*word)++;
 	}
     }
-  tx_msg->data[SDS_DATA_PACKET_CKSUM_POS] = sds_checksum (tx_msg->data);
+  msg[SDS_DATA_PACKET_CKSUM_POS] = sds_checksum (msg);
+}
+
+//All the data packets are encoded before the transfer starts so that every packet can be sent as soon as the previous one is acknowledged.
+
+static GByteArray *
+sds_get_data_packets (GByteArray *input, guint words, guint packets,
+		      guint bits, guint bytes_per_word)
+{
+  guint word = 0;
+  gint16 *frame = (gint16 *) input->data;
+  GByteArray *msgs = g_byte_array_sized_new (packets * SDS_DATA_PACKET_LEN);
+
+  g_byte_array_set_size (msgs, packets * SDS_DATA_PACKET_LEN);
+  for (guint packet = 0; packet < packets; packet++)
+    {
+      sds_set_data_packet (&msgs->data[packet * SDS_DATA_PACKET_LEN],
+			   packet % 0x80, words, &word, &frame, bits,
+			   bytes_per_word);
+    }
+
+  return msgs;
+}
+
+static inline GByteArray *
+sds_get_data_packet_msg (GByteArray *msgs, guint packet)
+{
+  GByteArray *tx_msg = g_byte_array_sized_new (SDS_DATA_PACKET_LEN);
+  g_byte_array_append (tx_msg, &msgs->data[packet * SDS_DATA_PACKET_LEN],
+		       SDS_DATA_PACKET_LEN);
   return tx_msg;
 }
 
+//In open loop, the device is listened to instead of just waiting. If nothing arrives, the transfer continues.
+//No response is expected here, so the wait is fixed and the timeouts do not affect the pacing.
+
+static gint
+sds_tx_open_loop (struct backend *backend, GByteArray *tx_msg, guint packet,
+		  gboolean *open_loop, struct controllable *controllable)
+{
+  gint err;
+
+  err = sds_tx_and_wait_ack (backend, tx_msg, packet,
+			     SDS_NO_SPEC_OPEN_LOOP_REST_TIME / 1000,
+			     SDS_NO_SPEC_TIMEOUT, controllable, TRUE);
+  if (err == -ETIMEDOUT)
+    {
+      return 0;
+    }
+
+  if (!err)
+    {
+      debug_print (1, "ACK received. Leaving open loop...");
+      *open_loop = FALSE;
+    }
+
+  return err;
+}
+
 static inline GByteArray *
 sds_get_rename_sample_msg (guint id, const gchar *name)
 {
@@ -713,6 +974,8 @@ sds_rename (struct backend *backend, const gchar *src, const gchar *dst)
       return err;
     }
 
+  sds_clear_cached_sample_name (backend, id);
+
   g_mutex_lock (&backend->mutex);
   backend_rx_drain (backend);
   g_mutex_unlock (&backend->mutex);
@@ -733,11 +996,10 @@ static gint
 sds_upload (struct backend *backend, const gchar *path, struct idata *sample,
 	    struct task_control *control, guint bits)
 {
-  GByteArray *tx_msg;
-  gint16 *frame, *f;
+  GByteArray *tx_msg, *msgs;
   gboolean active, open_loop = FALSE;
-  guint word, words, words_per_packet, id, packet = 0, packets, retries =
-    0, w, bytes_per_word;
+  guint words, words_per_packet, id, packet = 0, packets, retries =
+    0, bytes_per_word;
   gint err = 0, word_size;
   struct sds_data *sds_data = backend->data;
   struct sample_info *sample_info = sample->info;
@@ -750,6 +1012,9 @@ sds_upload (struct backend *backend, const gchar *path, struct idata *sample,
       return -EINVAL;
     }
 
+  //Even a canceled upload erases the sample.
+  sds_clear_cached_sample_name (backend, id);
+
   g_mutex_lock (&backend->mutex);
   backend_rx_drain (backend);
   g_mutex_unlock (&backend->mutex);
@@ -764,10 +1029,13 @@ sds_upload (struct backend *backend, const gchar *path, struct idata *sample,
   words_per_packet = SDS_DATA_PACKET_PAYLOAD_LEN / bytes_per_word;
   packets = ceil (words / (double) words_per_packet);
 
+  msgs = sds_get_data_packets (input, words, packets, bits, bytes_per_word);
+
   tx_msg = sds_get_dump_msg (id, words, sample_info, bits);
   //The first timeout should be SDS_SPEC_TIMEOUT_HANDSHAKE (2 s) but it is not enough sometimes.
   err = sds_tx_and_wait_ack (backend, tx_msg, 0, SDS_NO_SPEC_TIMEOUT,
-			     SDS_NO_SPEC_TIMEOUT, &control->controllable);
+			     SDS_NO_SPEC_TIMEOUT, &control->controllable,
+			     TRUE);
   if (err == -ENOMSG)
     {
       debug_print (2, "No packet received after a WAIT. Continuing...");
@@ -780,20 +1048,20 @@ sds_upload (struct backend *backend, const gchar *path, struct idata *sample,
     }
   else if (err)
     {
+      free_msg (msgs);
       return err;
     }
 
   debug_print (1, "Sending dump data...");
 
-  word = 0;
   sds_debug_print_sample_data (bits, bytes_per_word,
 			       word_size, sample_info->rate, words, packets);
-  frame = (gint16 *) input->data;
   while (packet < packets && active)
     {
       if (retries)
 	{
-	  usleep (sds_data->rest_time);
+	  backend_pacing_rest (backend);
+	  backend_stats_add_retry (backend);
 	}
 
       if (retries == SDS_MAX_RETRIES)
@@ -802,14 +1070,11 @@ sds_upload (struct backend *backend, const gchar *path, struct idata *sample,
 	  break;
 	}
 
-      f = frame;
-      w = word;
-      tx_msg = sds_get_data_packet_msg (packet % 0x80, words, &w, &f, bits,
-					bytes_per_word);
+      tx_msg = sds_get_data_packet_msg (msgs, packet);
       if (open_loop)
 	{
-	  err = backend_tx (backend, tx_msg);
-	  usleep (SDS_NO_SPEC_OPEN_LOOP_REST_TIME);
+	  err = sds_tx_open_loop (backend, tx_msg, packet % 0x80, &open_loop,
+				  &control->controllable);
 	}
       else
 	{
@@ -817,12 +1082,13 @@ sds_upload (struct backend *backend, const gchar *path, struct idata *sample,
 	  err = sds_tx_and_wait_ack (backend, tx_msg, packet % 0x80,
 				     SDS_NO_SPEC_TIMEOUT,
 				     SDS_NO_SPEC_TIMEOUT,
-				     &control->controllable);
+				     &control->controllable, FALSE);
 	}
 
       if (err == -EBADMSG)
 	{
 	  debug_print (2, "NAK received. Retrying...");
+	  backend_pacing_report (backend, err);
 	  retries++;
 	  continue;
 	}
@@ -836,6 +1102,7 @@ sds_upload (struct backend *backend, const gchar *path, struct idata *sample,
       else if (err == -EINVAL)
 	{
 	  debug_print (2, "Unexpected packet number. Retrying...");
+	  backend_pacing_report (backend, err);
 	  retries++;
 	  continue;
 	}
@@ -860,13 +1127,12 @@ sds_upload (struct backend *backend, const gchar *path, struct idata *sample,
 
       active = controllable_is_active (&control->controllable);
 
-      word = w;
-      frame = f;
       packet++;
       retries = 0;
       err = 0;
 
-      usleep (sds_data->rest_time);
+      //Even after an ACK, some devices need this rest to not corrupt the next packet.
+      backend_pacing_rest (backend);
     }
 
   if (active && sds_data->name_extension)
@@ -886,6 +1152,8 @@ end:
       err = -ECANCELED;
     }
 
+  free_msg (msgs);
+
   return err;
 }
 
@@ -923,7 +1191,7 @@ sds_next_sample_dentry (struct item_iterator *iter)
   struct sds_iterator_data *iterator_data = iter->data;
   struct sds_data *data = iterator_data->backend->data;
 
-  if (iterator_data->next >= SDS_SAMPLE_LIMIT)
+  if (iterator_data->next >= iterator_data->slots)
     {
       return -ENOENT;
     }
@@ -933,10 +1201,11 @@ sds_next_sample_dentry (struct item_iterator *iter)
   iter->item.size = -1;
   (iterator_data->next)++;
 
+  //Names not in the cache are loaded later by get_item_info.
   if (data->name_extension)
     {
-      gchar *name = sds_get_sample_name (iterator_data->backend,
-					 iterator_data->next);
+      gchar *name = sds_get_cached_sample_name (iterator_data->backend,
+						iter->item.id);
       item_set_name (&iter->item, "%s", name ? name : "");
       g_free (name);
     }
@@ -948,6 +1217,140 @@ sds_next_sample_dentry (struct item_iterator *iter)
   return 0;
 }
 
+//Returns 0 if the slot exists, -ETIMEDOUT if there is no answer and -EIO if the device answers something else.
+
+static gint
+sds_probe_slot (struct backend *backend, guint id)
+{
+  gint err;
+  gchar *name = NULL;
+
+  debug_print (2, "Probing slot %d...", id);
+
+  //Slots that do not exist are not answered, so the timeouts must not affect the pacing.
+  err = sds_request_sample_name_int (backend, id, SDS_NO_SPEC_TIMEOUT_TRY,
+				     TRUE, &name);
+  if (!err)
+    {
+      sds_set_cached_sample_name (backend, id, name);
+      g_free (name);
+    }
+
+  return err;
+}
+
+//Devices implementing the name extension only answer the name requests for their slots.
+//The slots are probed at the end of increasing ranges and the last range is bisected.
+//If a slot after the first missing range end answers, the slots are not contiguous and every slot is listed.
+//Returns -ETIMEDOUT if the last slot is only known because the next one was not answered.
+
+static gint
+sds_scan_slots (struct backend *backend, guint *slots)
+{
+  gint err, last_err;
+  guint low, high, mid, next;
+
+  debug_print (1, "Scanning slots...");
+
+  //The slot low - 1 exists and the slot high - 1 does not.
+  low = SDS_SCAN_KNOWN_SLOTS;
+  high = SDS_SCAN_RANGE;
+  while (1)
+    {
+      high = MIN (high, SDS_SAMPLE_LIMIT);
+      last_err = sds_probe_slot (backend, high - 1);
+      if (last_err)
+	{
+	  break;
+	}
+      low = high;
+      if (high == SDS_SAMPLE_LIMIT)
+	{
+	  *slots = SDS_SAMPLE_LIMIT;
+	  return 0;
+	}
+      high *= 2;
+    }
+
+  for (next = high * 2; high < SDS_SAMPLE_LIMIT; next *= 2)
+    {
+      next = MIN (next, SDS_SAMPLE_LIMIT);
+      if (!sds_probe_slot (backend, next - 1))
+	{
+	  debug_print (1, "Slot %d found after a missing one", next - 1);
+	  *slots = SDS_SAMPLE_LIMIT;
+	  return 0;
+	}
+      if (next == SDS_SAMPLE_LIMIT)
+	{
+	  break;
+	}
+    }
+
+  while (high - low > 1)
+    {
+      mid = (low + high) / 2;
+      err = sds_probe_slot (backend, mid - 1);
+      if (err)
+	{
+	  high = mid;
+	  last_err = err;
+	}
+      else
+	{
+	  low = mid;
+	}
+    }
+
+  *slots = low;
+
+  return last_err == -ETIMEDOUT ? -ETIMEDOUT : 0;
+}
+
+//The number of slots found by a scan that ended on a timeout is only used again if its limit is still the same.
+
+static guint
+sds_get_slots (struct backend *backend)
+{
+  gint err;
+  guint slots;
+  gboolean checked;
+  struct sds_data *sds_data = backend->data;
+
+  if (!sds_data->name_extension)
+    {
+      return SDS_SAMPLE_LIMIT;
+    }
+
+  g_mutex_lock (&sds_data->mutex);
+  slots = sds_data->slots;
+  checked = sds_data->slots_checked;
+  g_mutex_unlock (&sds_data->mutex);
+
+  if (slots && checked)
+    {
+      return slots;
+    }
+
+  if (slots && !sds_probe_slot (backend, slots - 1)
+      && sds_probe_slot (backend, slots) == -ETIMEDOUT)
+    {
+      debug_print (1, "%d slots checked", slots);
+      return slots;
+    }
+
+  err = sds_scan_slots (backend, &slots);
+
+  debug_print (1, "%d slots found", slots);
+
+  g_mutex_lock (&sds_data->mutex);
+  sds_data->slots = slots;
+  sds_data->slots_checked = !err;
+  g_mutex_unlock (&sds_data->mutex);
+
+  return slots;
+}
+
 static gint
 sds_read_dir (struct backend *backend, struct item_iterator *iter,
 	      const gchar *dir, const gchar **extensions)
@@ -961,6 +1364,7 @@ sds_read_dir (struct backend *backend, struct item_iterator *iter,
 
   data = g_malloc (sizeof (struct sds_iterator_data));
   data->next = 0;
+  data->slots = sds_get_slots (backend);
   data->backend = backend;
 
   item_iterator_init (iter, dir, data, sds_next_sample_dentry, g_free);
@@ -968,6 +1372,30 @@ sds_read_dir (struct backend *backend, struct item_iterator *iter,
   return 0;
 }
 
+static gint
+sds_get_item_info (struct backend *backend, const gchar *dir,
+		   struct item *item)
+{
+  gchar *name;
+  struct sds_data *sds_data = backend->data;
+
+  if (!sds_data->name_extension)
+    {
+      return 0;
+    }
+
+  name = sds_get_sample_name (backend, item->id);
+  if (!name)
+    {
+      return -EIO;
+    }
+
+  item_set_name (item, "%s", name);
+  g_free (name);
+
+  return 0;
+}
+
 static gint
 sds_sample_load_common (const gchar *path, struct idata *sample,
 			struct task_control *control, gint32 rate)
@@ -1043,6 +1471,7 @@ static const struct fs_operations FS_SDS_SAMPLES_MONO_8B_OPERATIONS = {
   .readdir = sds_read_dir,
   .print_item = common_print_item,
   .rename = sds_rename,
+  .get_item_info = sds_get_item_info,
   .download = sds_download,
   .upload = sds_upload_8b,
   .load = sds_sample_load,
@@ -1064,6 +1493,7 @@ static const struct fs_operations FS_SDS_SAMPLES_MONO_12B_OPERATIONS = {
   .readdir = sds_read_dir,
   .print_item = common_print_item,
   .rename = sds_rename,
+  .get_item_info = sds_get_item_info,
   .download = sds_download,
   .upload = sds_upload_12b,
   .load = sds_sample_load,
@@ -1085,6 +1515,7 @@ static const struct fs_operations FS_SDS_SAMPLES_MONO_14B_OPERATIONS = {
   .readdir = sds_read_dir,
   .print_item = common_print_item,
   .rename = sds_rename,
+  .get_item_info = sds_get_item_info,
   .download = sds_download,
   .upload = sds_upload_14b,
   .load = sds_sample_load,
@@ -1106,6 +1537,7 @@ static const struct fs_operations FS_SDS_SAMPLES_MONO_16B_OPERATIONS = {
   .readdir = sds_read_dir,
   .print_item = common_print_item,
   .rename = sds_rename,
+  .get_item_info = sds_get_item_info,
   .download = sds_download,
   .upload = sds_upload_16b,
   .load = sds_sample_load,
@@ -1127,6 +1559,7 @@ static const struct fs_operations FS_SDS_SAMPLES_MONO_44K1_16B_OPERATIONS = {
   .readdir = sds_read_dir,
   .print_item = common_print_item,
   .rename = sds_rename,
+  .get_item_info = sds_get_item_info,
   .download = sds_download,
   .upload = sds_upload_16b,
   .load = sds_sample_load_44k1,
@@ -1148,6 +1581,7 @@ static const struct fs_operations FS_SDS_SAMPLES_MONO_32K_16B_OPERATIONS = {
   .readdir = sds_read_dir,
   .print_item = common_print_item,
   .rename = sds_rename,
+  .get_item_info = sds_get_item_info,
   .download = sds_download,
   .upload = sds_upload_16b,
   .load = sds_sample_load_32k_16b,
@@ -1169,6 +1603,7 @@ static const struct fs_operations FS_SDS_SAMPLES_MONO_16K_16B_OPERATIONS = {
   .readdir = sds_read_dir,
   .print_item = common_print_item,
   .rename = sds_rename,
+  .get_item_info = sds_get_item_info,
   .download = sds_download,
   .upload = sds_upload_16b,
   .load = sds_sample_load_16k_16b,
@@ -1190,6 +1625,7 @@ static const struct fs_operations FS_SDS_SAMPLES_MONO_8K_16B_OPERATIONS = {
   .readdir = sds_read_dir,
   .print_item = common_print_item,
   .rename = sds_rename,
+  .get_item_info = sds_get_item_info,
   .download = sds_download,
   .upload = sds_upload_16b,
   .load = sds_sample_load_8k_16b,
@@ -1270,7 +1706,7 @@ sds_handshake_esi_2000 (struct backend *backend)
   //In case we receive an ACK, NAK or CANCEL, there is a MIDI SDS device listening.
   gint err = sds_tx_and_wait_ack (backend, tx_msg, 0,
 				  SDS_SPEC_TIMEOUT_HANDSHAKE,
-				  SDS_NO_SPEC_TIMEOUT_TRY, NULL);
+				  SDS_NO_SPEC_TIMEOUT_TRY, NULL, TRUE);
   if (err && err != -EBADMSG && err != -ECANCELED)
     {
       return -ENODEV;
@@ -1284,11 +1720,20 @@ sds_handshake_esi_2000 (struct backend *backend)
   return 0;
 }
 
+static void
+sds_destroy_data (struct backend *backend)
+{
+  struct sds_data *sds_data = backend->data;
+  g_hash_table_destroy (sds_data->names);
+  g_mutex_clear (&sds_data->mutex);
+  backend_destroy_data (backend);
+}
+
 gint
 sds_handshake (struct backend *backend)
 {
   gint err;
-  gboolean name_extension;
+  gboolean name_extension, esi_2000 = FALSE;
   struct sds_data *sds_data;
 
   //We cancel anything that might be running.
@@ -1324,6 +1769,7 @@ sds_handshake (struct backend *backend)
     {
       return err;
     }
+  esi_2000 = TRUE;
 
 end:
   debug_print (1, "Name extension: %s", name_extension ? "yes" : "no");
@@ -1331,8 +1777,12 @@ end:
   //The remaining code is meant to set up different devices. These are the default values.
 
   sds_data = g_malloc (sizeof (struct sds_data));
-  sds_data->rest_time = SDS_REST_TIME_DEFAULT;
   sds_data->name_extension = name_extension;
+  g_mutex_init (&sds_data->mutex);
+  sds_data->slots = 0;
+  sds_data->slots_checked = FALSE;
+  sds_data->names = g_hash_table_new_full (g_direct_hash, g_direct_equal,
+					   NULL, g_free);
 
   gslist_fill (&backend->fs_ops, &FS_PROGRAM_DEFAULT_OPERATIONS,
 	       &FS_SDS_SAMPLES_MONO_8B_OPERATIONS,
@@ -1343,9 +1793,20 @@ end:
 	       &FS_SDS_SAMPLES_MONO_32K_16B_OPERATIONS,
 	       &FS_SDS_SAMPLES_MONO_16K_16B_OPERATIONS,
 	       &FS_SDS_SAMPLES_MONO_8K_16B_OPERATIONS, NULL);
-  backend->destroy_data = backend_destroy_data;
+  backend->destroy_data = sds_destroy_data;
   backend->data = sds_data;
 
+  //Shorter rests corrupt the packets sent by an E-Mu ESI-2000. As it is only found by the last probe, the floor is kept for every device found that way.
+  if (esi_2000)
+    {
+      backend_pacing_init_with_min (backend, SDS_REST_TIME_DEFAULT,
+				    SDS_REST_TIME_DEFAULT);
+    }
+  else
+    {
+      backend_pacing_init (backend, SDS_REST_TIME_DEFAULT);
+    }
+
   if (!strlen (backend->name))
     {
       snprintf (backend->name, LABEL_MAX, "%s", _("SDS sampler"));
@@ -195,7 +195,7 @@ summit_patch_next_dentry (struct item_iterator *iter)
     data->fs == FS_SUMMIT_SINGLE_PATCH ? SUMMIT_SINGLE_LEN : SUMMIT_MULTI_LEN;
   data->next++;
 
-  usleep (SUMMIT_REST_TIME_US);
+  backend_pacing_rest (data->backend);
 
   return 0;
 }
@@ -322,7 +322,7 @@ summit_patch_download (struct backend *backend, const gchar *path,
 cleanup:
   free_msg (rx_msg);
 end:
-  usleep (SUMMIT_REST_TIME_US);
+  backend_pacing_rest (backend);
   return err;
 }
 
@@ -370,7 +370,7 @@ summit_patch_upload (struct backend *backend, const gchar *path,
 cleanup:
   free_msg (msg);
 end:
-  usleep (SUMMIT_REST_TIME_US);
+  backend_pacing_rest (backend);
   return err;
 }
 
@@ -419,7 +419,7 @@ summit_patch_rename (struct backend *backend, const gchar *src,
       goto end;
     }
 
-  usleep (SUMMIT_REST_TIME_US);
+  backend_pacing_rest (backend);
 
   name = SUMMIT_GET_NAME_FROM_MSG (preset.content, fs);
   sanitized = common_get_sanitized_name (dst, SUMMIT_ALPHABET,
@@ -437,7 +437,7 @@ summit_patch_rename (struct backend *backend, const gchar *src,
       free_msg (rx_msg);
     }
 
-  usleep (SUMMIT_REST_TIME_US);
+  backend_pacing_rest (backend);
 
 end:
   controllable_clear (&control.controllable);
@@ -653,7 +653,7 @@ summit_tuning_download (struct backend *backend, const gchar *path,
 cleanup:
   free_msg (rx_msg);
 end:
-  usleep (SUMMIT_REST_TIME_US);
+  backend_pacing_rest (backend);
   return err;
 }
 
@@ -816,7 +816,7 @@ summit_wavetable_download (struct backend *backend, const gchar *path,
   g_byte_array_append (output, rx_msg->data, rx_msg->len);
   free_msg (rx_msg);
 
-  usleep (SUMMIT_REST_TIME_US);
+  backend_pacing_rest (backend);
 
   //Waves
   for (gint8 i = 0; i < SUMMIT_WAVETABLE_WAVES; i++)
@@ -836,7 +836,7 @@ summit_wavetable_download (struct backend *backend, const gchar *path,
       g_byte_array_append (output, rx_msg->data, rx_msg->len);
       free_msg (rx_msg);
 
-      usleep (SUMMIT_REST_TIME_US);
+      backend_pacing_rest (backend);
     }
 
   memcpy (name, &output->data[15], SUMMIT_WAVETABLE_NAME_LEN);
@@ -850,7 +850,7 @@ err:
   g_byte_array_free (output, TRUE);
   free_msg (rx_msg);
 end:
-  usleep (SUMMIT_REST_TIME_US);
+  backend_pacing_rest (backend);
   return err;
 }
 
@@ -959,12 +959,24 @@ summit_handshake (struct backend *backend)
 	       &FS_SUMMIT_BULK_TUNING_OPERATIONS, NULL);
   snprintf (backend->name, LABEL_MAX, "Novation Summit");
 
+  backend_pacing_init (backend, SUMMIT_REST_TIME_US);
+
   return 0;
 }
 
+static const struct connector_midi_id SUMMIT_MIDI_ID = {
+  .company = NOVATION_ID,
+  .company_len = sizeof (NOVATION_ID),
+  .family = SUMMIT_ID,
+  .family_len = BE_FAMILY_LEN,
+  .model = &SUMMIT_ID[BE_FAMILY_LEN],
+  .model_len = BE_MODEL_LEN
+};
+
 const struct connector CONNECTOR_SUMMIT = {
   .handshake = summit_handshake,
   .name = "summit",
   .options = 0,
-  .regex = ".*(Peak|Summit).*"
+  .regex = ".*(Peak|Summit).*",
+  .midi_id = &SUMMIT_MIDI_ID
 };
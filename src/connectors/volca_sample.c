@@ -22,6 +22,7 @@
 #include "sample.h"
 #include "common.h"
 #include "volca_sample_sdk/korg_syro_volcasample.h"
+#include <samplerate.h>
 
 #define VOLCA_SAMPLE_MAX_SAMPLES 100
 
@@ -37,6 +38,8 @@
 
 #define VOLCA_SAMPLE_UPLOAD_STAGES 4
 
+#define VOLCA_SAMPLE_SYRO_STREAM_FRAMES 1024
+
 enum volca_sample_fs
 {
   FS_VOLCA_SAMPLE,
@@ -67,46 +70,6 @@ volca_sample_read_dir (struct backend *backend, struct item_iterator *iter,
   return 0;
 }
 
-static gint
-volca_sample_send_syro (struct idata *syro, struct task_control *control)
-{
-  gint err;
-  struct idata sample;
-  struct sample_load_opts opts;
-
-  //Native samplerate and sample type conversion
-
-  sample_load_opts_init (&opts, VOLCA_SAMPLE_SYRO_CHANNELS, audio.rate,
-			 sample_get_internal_format (), FALSE);
-
-  err = sample_reload (syro, &sample, control, &opts,
-		       task_control_set_sample_progress);
-  if (err)
-    {
-      return err;
-    }
-
-  if (control)
-    {
-      control->part++;
-    }
-
-  //Playback
-
-  audio_set_play_and_wait (&sample, control);
-
-  usleep (VOLCA_SAMPLE_SLEEP_US);
-
-  if (control)
-    {
-      control->part++;
-    }
-
-  idata_clear (syro);
-
-  return 0;
-}
-
 gint
 volca_sample_get_syro_op (SyroData *data, struct idata *syro_op,
 			  struct task_control *control)
@@ -177,21 +140,174 @@ volca_sample_get_syro_op (SyroData *data, struct idata *syro_op,
   return 0;
 }
 
+struct volca_sample_syro_stream
+{
+  SyroHandle handle;
+  guint32 frames;
+  guint32 frame;
+  SRC_STATE *src_state;
+  gdouble ratio;
+  gfloat input[VOLCA_SAMPLE_SYRO_STREAM_FRAMES * VOLCA_SAMPLE_SYRO_CHANNELS];
+  gfloat *output;
+  guint output_frames;
+};
+
+//Called by the resampler every time it needs more SYRO frames.
+
+static long
+volca_sample_syro_stream_render (void *data, float **buffer)
+{
+  guint32 i;
+  gint16 left, right;
+  struct volca_sample_syro_stream *stream = data;
+
+  for (i = 0; i < VOLCA_SAMPLE_SYRO_STREAM_FRAMES &&
+       stream->frame < stream->frames; i++, stream->frame++)
+    {
+      // The returning value is ignored in korg_syro_volcasample_example.c so it's done here too.
+      SyroVolcaSample_GetSample (stream->handle, &left, &right);
+      stream->input[i * VOLCA_SAMPLE_SYRO_CHANNELS] = left / 32768.0f;
+      stream->input[i * VOLCA_SAMPLE_SYRO_CHANNELS + 1] = right / 32768.0f;
+    }
+
+  *buffer = stream->input;
+
+  return i;
+}
+
+static gint
+volca_sample_syro_stream_read (void *data, guint8 *buffer, guint frames)
+{
+  long n;
+  struct volca_sample_syro_stream *stream = data;
+
+  if (frames > stream->output_frames)
+    {
+      stream->output = g_realloc (stream->output, frames *
+				  VOLCA_SAMPLE_SYRO_CHANNELS *
+				  sizeof (gfloat));
+      stream->output_frames = frames;
+    }
+
+  n = src_callback_read (stream->src_state, stream->ratio, frames,
+			 stream->output);
+  if (!n && src_error (stream->src_state))
+    {
+      error_print ("Error while resampling: %s",
+		   src_strerror (src_error (stream->src_state)));
+      return -EIO;
+    }
+
+  if (sample_get_internal_format () == SF_FORMAT_FLOAT)
+    {
+      memcpy (buffer, stream->output,
+	      n * VOLCA_SAMPLE_SYRO_CHANNELS * sizeof (gfloat));
+    }
+  else
+    {
+      src_float_to_short_array (stream->output, (short *) buffer,
+				n * VOLCA_SAMPLE_SYRO_CHANNELS);
+    }
+
+  return n;
+}
+
+//The SYRO signal is rendered and resampled to the audio rate while it is being played.
+//Thus, the transmission starts at once and the memory used does not depend on the sample length.
+//Several entries are sent in the same stream so that the preamble and the gap are only paid once.
+
+static gint
+volca_sample_send_syro (SyroData *data, guint entries,
+			struct task_control *control)
+{
+  gint err;
+  SyroStatus status;
+  struct volca_sample_syro_stream *stream;
+
+  stream = g_malloc (sizeof (struct volca_sample_syro_stream));
+
+  status = SyroVolcaSample_Start (&stream->handle, data, entries, 0,
+				  &stream->frames);
+  if (status != Status_Success)
+    {
+      g_free (stream);
+      return -EIO;
+    }
+
+  debug_print (1, "Reported %d SYRO frames", stream->frames);
+
+  stream->frame = 0;
+  stream->ratio = audio.rate / (gdouble) VOLCA_SAMPLE_SYRO_RATE;
+  stream->output = NULL;
+  stream->output_frames = 0;
+  stream->src_state = src_callback_new (volca_sample_syro_stream_render,
+					SRC_SINC_BEST_QUALITY,
+					VOLCA_SAMPLE_SYRO_CHANNELS, &err,
+					stream);
+  if (!stream->src_state)
+    {
+      error_print ("Error while creating the resampler: %s",
+		   src_strerror (err));
+      SyroVolcaSample_End (stream->handle);
+      g_free (stream);
+      return -EIO;
+    }
+
+  //The SYRO conversion and the resampling stages happen during the playback.
+  if (control)
+    {
+      control->part += 2;
+    }
+
+  err = audio_set_play_stream_and_wait (volca_sample_syro_stream_read,
+					stream, stream->frames * stream->ratio,
+					control);
+
+  debug_print (1, "Read %d SYRO frames", stream->frame);
+
+  src_delete (stream->src_state);
+  SyroVolcaSample_End (stream->handle);
+  g_free (stream->output);
+  g_free (stream);
+
+  if (err)
+    {
+      return err;
+    }
+
+  usleep (VOLCA_SAMPLE_SLEEP_US);
+
+  if (control)
+    {
+      control->part++;
+    }
+
+  return 0;
+}
+
+static void
+volca_sample_set_upload_data (guint id, struct idata *input, guint32 quality,
+			      SyroData *data)
+{
+  struct sample_info *sample_info = input->info;
+
+  // DataType_Sample_Compress uses quality between 8 and 16. DataType_Sample_Liner uses 0.
+  data->DataType = quality ? DataType_Sample_Compress : DataType_Sample_Liner;
+  data->pData = input->content->data;
+  data->Number = id;
+  data->Size = input->content->len;
+  data->Quality = quality;
+  data->Fs = sample_info->rate;
+  data->SampleEndian = LittleEndian;
+}
+
 gint
 volca_sample_get_upload (guint id, struct idata *input, struct idata *syro_op,
 			 guint32 quality, struct task_control *control)
 {
   SyroData data;
-  struct sample_info *sample_info = input->info;
 
-  // DataType_Sample_Compress uses quality between 8 and 16. DataType_Sample_Liner uses 0.
-  data.DataType = quality ? DataType_Sample_Compress : DataType_Sample_Liner;
-  data.pData = input->content->data;
-  data.Number = id;
-  data.Size = input->content->len;
-  data.Quality = quality;
-  data.Fs = sample_info->rate;
-  data.SampleEndian = LittleEndian;
+  volca_sample_set_upload_data (id, input, quality, &data);
 
   return volca_sample_get_syro_op (&data, syro_op, control);
 }
@@ -222,6 +338,7 @@ volca_sample_upload_quality (const gchar *path, struct idata *sample,
 {
   guint id;
   gint err;
+  SyroData data;
   struct idata syro_op;
 
   err = common_slot_get_id_from_path (path, &id);
@@ -235,6 +352,12 @@ volca_sample_upload_quality (const gchar *path, struct idata *sample,
       return -EINVAL;
     }
 
+  if (upload)
+    {
+      volca_sample_set_upload_data (id, sample, quality, &data);
+      return volca_sample_send_syro (&data, 1, control);
+    }
+
   //Syro conversion
 
   err = volca_sample_get_upload (id, sample, &syro_op, quality, control);
@@ -243,14 +366,7 @@ volca_sample_upload_quality (const gchar *path, struct idata *sample,
       return err;
     }
 
-  if (upload)
-    {
-      return volca_sample_send_syro (&syro_op, control);
-    }
-  else
-    {
-      return volca_sample_dump_syro (&syro_op, id, control);
-    }
+  return volca_sample_dump_syro (&syro_op, id, control);
 }
 
 static gint
@@ -274,6 +390,99 @@ volca_sample_upload_8b (struct backend *backend, const gchar *path,
   return volca_sample_upload_quality (path, sample, 8, control, TRUE);
 }
 
+//Every valid item becomes an entry of a single SYRO stream. As the SDK limits the entries per stream, this is split when needed.
+//If a stream is interrupted, it is unknown which entries were received so all of them are reported as failed.
+
+static gint
+volca_sample_upload_batch_quality (GSList *items, guint32 quality,
+				   struct task_control *control)
+{
+  guint id, entries;
+  gint err = 0;
+  GArray *data;
+  GSList *sent = NULL, *e;
+  struct fs_upload_batch_item *item;
+
+  data = g_array_new (FALSE, FALSE, sizeof (SyroData));
+
+  for (e = items; e; e = e->next)
+    {
+      item = e->data;
+
+      item->err = common_slot_get_id_from_path (item->path, &id);
+      if (item->err)
+	{
+	  continue;
+	}
+
+      if (id >= VOLCA_SAMPLE_MAX_SAMPLES)
+	{
+	  item->err = -EINVAL;
+	  continue;
+	}
+
+      g_array_set_size (data, data->len + 1);
+      volca_sample_set_upload_data (id, &item->idata, quality,
+				    &g_array_index (data, SyroData,
+						    data->len - 1));
+      sent = g_slist_append (sent, item);
+    }
+
+  e = sent;
+  for (guint i = 0; i < data->len; i += entries)
+    {
+      entries = MIN (data->len - i, VOLCA_SAMPLE_MAX_SAMPLES);
+
+      if (!err)
+	{
+	  debug_print (1, "Sending %d samples in a single SYRO stream...",
+		       entries);
+
+	  task_control_reset (control, VOLCA_SAMPLE_UPLOAD_STAGES);
+	  control->part++;	//Loading was done before.
+
+	  err = volca_sample_send_syro (&g_array_index (data, SyroData, i),
+					entries, control);
+	  if (!err && !controllable_is_active (&control->controllable))
+	    {
+	      err = -ECANCELED;
+	    }
+	}
+
+      for (guint j = 0; j < entries; j++, e = e->next)
+	{
+	  item = e->data;
+	  item->err = err;
+	}
+    }
+
+  g_slist_free (sent);
+  g_array_free (data, TRUE);
+
+  return 0;
+}
+
+static gint
+volca_sample_upload_batch (struct backend *backend, GSList *items,
+			   struct task_control *control)
+{
+  return volca_sample_upload_batch_quality (items, 0, control);
+}
+
+static gint
+volca_sample_upload_batch_16b (struct backend *backend, GSList *items,
+			       struct task_control *control)
+{
+  return volca_sample_upload_batch_quality (items, 16, control);
+}
+
+static gint
+volca_sample_upload_batch_8b (struct backend *backend, GSList *items,
+			      struct task_control *control)
+{
+  return volca_sample_upload_batch_quality (items, 8, control);
+}
+
 static gint
 volca_sample_dump (struct backend *backend, const gchar *path,
 		   struct idata *sample, struct task_control *control)
@@ -317,15 +526,21 @@ volca_sample_load (struct backend *backend, const gchar *path,
   return 0;
 }
 
+static void
+volca_sample_set_delete_data (guint id, SyroData *data)
+{
+  data->DataType = DataType_Sample_Erase;
+  data->pData = NULL;
+  data->Number = id;
+  data->SampleEndian = LittleEndian;
+}
+
 gint
 volca_sample_get_delete (guint id, struct idata *syro_op)
 {
   SyroData data;
 
-  data.DataType = DataType_Sample_Erase;
-  data.pData = NULL;
-  data.Number = id;
-  data.SampleEndian = LittleEndian;
+  volca_sample_set_delete_data (id, &data);
 
   return volca_sample_get_syro_op (&data, syro_op, NULL);
 }
@@ -335,7 +550,7 @@ volca_sample_delete (struct backend *backend, const gchar *path)
 {
   guint id;
   gint err;
-  struct idata syro_op;
+  SyroData data;
 
   err = common_slot_get_id_from_path (path, &id);
   if (err)
@@ -348,13 +563,9 @@ volca_sample_delete (struct backend *backend, const gchar *path)
       return -EINVAL;
     }
 
-  err = volca_sample_get_delete (id, &syro_op);
-  if (err)
-    {
-      return err;
-    }
+  volca_sample_set_delete_data (id, &data);
 
-  return volca_sample_send_syro (&syro_op, NULL);
+  return volca_sample_send_syro (&data, 1, NULL);
 }
 
 static const struct fs_operations FS_VOLCA_SAMPLE_OPERATIONS = {
@@ -369,6 +580,7 @@ static const struct fs_operations FS_VOLCA_SAMPLE_OPERATIONS = {
   .delete = volca_sample_delete,
   .print_item = common_print_item,
   .upload = volca_sample_upload,
+  .upload_batch = volca_sample_upload_batch,
   .load = volca_sample_load,
   .get_exts = sample_get_sample_extensions,
   .get_upload_path = common_slot_get_upload_path
@@ -386,6 +598,7 @@ static const struct fs_operations FS_VOLCA_SAMPLE_COMP_16B_OPERATIONS = {
   .delete = volca_sample_delete,
   .print_item = common_print_item,
   .upload = volca_sample_upload_16b,
+  .upload_batch = volca_sample_upload_batch_16b,
   .load = volca_sample_load,
   .get_exts = sample_get_sample_extensions,
   .get_upload_path = common_slot_get_upload_path
@@ -403,6 +616,7 @@ static const struct fs_operations FS_VOLCA_SAMPLE_COMP_8B_OPERATIONS = {
   .delete = volca_sample_delete,
   .print_item = common_print_item,
   .upload = volca_sample_upload_8b,
+  .upload_batch = volca_sample_upload_batch_8b,
   .load = volca_sample_load,
   .get_exts = sample_get_sample_extensions,
   .get_upload_path = common_slot_get_upload_path
@@ -976,9 +976,19 @@ volca_sample_2_handshake (struct backend *backend)
   return 0;
 }
 
+static const struct connector_midi_id VOLCA_SAMPLE_2_MIDI_ID = {
+  .company = KORG_ID,
+  .company_len = sizeof (KORG_ID),
+  .family = FAMILY_ID,
+  .family_len = sizeof (FAMILY_ID),
+  .model = MODEL_ID,
+  .model_len = sizeof (MODEL_ID)
+};
+
 const struct connector CONNECTOR_VOLCA_SAMPLE_2 = {
   .name = "volca-sample-2",
   .handshake = volca_sample_2_handshake,
   .options = 0,
-  .regex = ".*volca sample.*"
+  .regex = ".*volca sample.*",
+  .midi_id = &VOLCA_SAMPLE_2_MIDI_ID
 };
@@ -22,6 +22,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>
+#include <getopt.h>
 #if defined(__linux__)
 #include <signal.h>
 #endif
@@ -39,6 +40,9 @@
 
 #define CLI_SLEEP_US 200000
 
+#define CLI_BENCH_NAME "elektroid-bench"
+#define CLI_BENCH_RATE 48000
+
 #define ERR_MSG_CMD_NOT_IN_SYSTEM_FS "Command not available in system backend"
 #define ERR_MSG_REMOTE_PATH_MISSING "Remote path missing"
 #define ERR_MSG_REMOTE_PATH_SRC_MISSING "Remote path source missing"
@@ -57,6 +61,16 @@ static const gchar *current_path_progress;
 static gboolean connected_to_tty;
 static gboolean same_line_progress;
 static gboolean use_audio;
+static gboolean print_stats;
+static gboolean dry_run;
+
+static const guint CLI_BENCH_SIZES[] = { 16 * KI, 64 * KI, 256 * KI, MI, 0 };
+
+static const struct option CLI_OPTIONS[] = {
+  {"stats", no_argument, NULL, 's'},
+  {"dry-run", no_argument, NULL, 'n'},
+  {NULL, 0, NULL, 0}
+};
 
 static void
 complete_progress (gint err)
@@ -123,6 +137,23 @@ cli_ld ()
   return EXIT_SUCCESS;
 }
 
+static void
+cli_print_stats ()
+{
+  gchar *summary;
+  struct backend_stats stats;
+
+  if (!print_stats || !backend_check (&backend))
+    {
+      return;
+    }
+
+  backend_stats_get (&backend, &stats);
+  summary = backend_stats_get_summary (&stats);
+  fprintf (stderr, "%s\n", summary);
+  g_free (summary);
+}
+
 static gint
 cli_connect (const gchar *device_path)
 {
@@ -156,6 +187,11 @@ cli_connect (const gchar *device_path)
 
   device = g_array_index (devices, struct backend_device, id);
   err = backend_init_connector (&backend, &device, connector, NULL);
+  if (!err)
+    {
+      //The handshake is not accounted.
+      backend_stats_reset (&backend);
+    }
 
   if (!err && fs)
     {
@@ -212,6 +248,10 @@ cli_list (int argc, gchar *argv[], int *optind)
   while (!item_iterator_next (&iter) &&
 	 controllable_is_active (&controllable))
     {
+      if (fs_ops->get_item_info)
+	{
+	  fs_ops->get_item_info (&backend, path, &iter.item);
+	}
       fs_ops->print_item (&iter, &backend, fs_ops);
     }
 
@@ -444,6 +484,302 @@ cli_info (int argc, gchar *argv[], int *optind)
   return EXIT_SUCCESS;
 }
 
+static gint
+cli_bench_create_file (const gchar *path, const gchar *name, guint size)
+{
+  gint err;
+  struct idata sample;
+  struct sample_info *sample_info;
+  GByteArray *content = g_byte_array_sized_new (size);
+  gint16 *frame;
+
+  g_byte_array_set_size (content, size);
+  frame = (gint16 *) content->data;
+  for (guint i = 0; i < size / sizeof (gint16); i++, frame++)
+    {
+      *frame = g_random_int ();
+    }
+
+  sample_info = sample_info_new (FALSE);
+  sample_info->frames = size / sizeof (gint16);
+  sample_info->rate = CLI_BENCH_RATE;
+  sample_info->format = SF_FORMAT_PCM_16;
+  sample_info->channels = 1;
+  sample_info->loop_start = 0;
+  sample_info->loop_end = sample_info->frames - 1;
+  sample_info->midi_note = 60;
+
+  idata_init (&sample, content, strdup (name), sample_info,
+	      sample_info_free);
+  err = sample_save_to_file (path, &sample, &task_control,
+			     SF_FORMAT_WAV | SF_FORMAT_PCM_16);
+  idata_clear (&sample);
+
+  return err;
+}
+
+//In slot mode, the last empty slot is used. Otherwise, a new file is created in the root directory.
+
+static gchar *
+cli_bench_get_dst_path (const struct fs_operations *ops)
+{
+  gint err;
+  gchar *dst_path = NULL;
+  struct item_iterator iter;
+
+  if (!(ops->options & FS_OPTION_SLOT_STORAGE))
+    {
+      return strdup ("/");
+    }
+
+  err = ops->readdir (&backend, &iter, "/", NULL);
+  if (err)
+    {
+      return NULL;
+    }
+
+  while (!item_iterator_next (&iter))
+    {
+      if (iter.item.type == ITEM_TYPE_FILE && iter.item.size == 0)
+	{
+	  gchar *filename = item_get_filename (&iter.item, ops->options);
+	  g_free (dst_path);
+	  dst_path = path_chain (PATH_INTERNAL, "/", filename);
+	  g_free (filename);
+	}
+    }
+
+  item_iterator_free (&iter);
+
+  return dst_path;
+}
+
+//Slots are only used if empty, so this is only needed outside slot mode.
+
+static gboolean
+cli_bench_path_exists (const struct fs_operations *ops, const gchar *path)
+{
+  gboolean exists = FALSE;
+  gchar *dir, *name, *filename;
+  struct item_iterator iter;
+
+  if (ops->file_exists)
+    {
+      return ops->file_exists (&backend, path);
+    }
+
+  dir = g_path_get_dirname (path);
+  name = g_path_get_basename (path);
+
+  if (!ops->readdir (&backend, &iter, dir, NULL))
+    {
+      while (!exists && !item_iterator_next (&iter))
+	{
+	  filename = item_get_filename (&iter.item, ops->options);
+	  exists = !strcmp (filename, name);
+	  g_free (filename);
+	}
+      item_iterator_free (&iter);
+    }
+
+  g_free (dir);
+  g_free (name);
+
+  return exists;
+}
+
+static void
+cli_bench_print_stats (const gchar *op, gint64 time,
+		       struct backend_stats *stats)
+{
+  gdouble secs = time / (gdouble) G_TIME_SPAN_SECOND;
+  guint64 bytes = stats->tx_bytes + stats->rx_bytes;
+  guint msgs = stats->tx_msgs + stats->rx_msgs;
+  gint p99 = backend_stats_get_latency_percentile (stats, 99);
+
+  printf ("  %s: %.3f MB/s; %.1f messages/s; round trip mean: %.3f ms",
+	  op, bytes / secs / MI, msgs / secs,
+	  backend_stats_get_latency_mean (stats) /
+	  (gdouble) G_TIME_SPAN_MILLISECOND);
+  if (p99 >= 0)
+    {
+      printf ("; round trip p99: < %d ms", p99);
+    }
+  printf ("\n");
+}
+
+static void
+cli_bench_fs (const struct fs_operations *ops, const gchar *local_path,
+	      const gchar *name)
+{
+  gint err = 0;
+  gint64 start;
+  struct idata idata;
+  struct backend_stats stats;
+  gchar *dst_path, *upload_path = NULL;
+
+  dst_path = cli_bench_get_dst_path (ops);
+  if (!dst_path)
+    {
+      printf ("%s: no scratch slot available\n", ops->name);
+      return;
+    }
+
+  printf ("%s:\n", ops->name);
+
+  for (const guint *size = CLI_BENCH_SIZES; *size && !err; size++)
+    {
+      err = cli_bench_create_file (local_path, name, *size);
+      if (err)
+	{
+	  break;
+	}
+
+      err = ops->load (&backend, local_path, &idata, &task_control);
+      if (err)
+	{
+	  break;
+	}
+
+      if (!upload_path)
+	{
+	  upload_path = ops->get_upload_path (&backend, ops, dst_path,
+					      local_path, &idata);
+	  //Nothing on the device must be overwritten or deleted.
+	  if (!(ops->options & FS_OPTION_SLOT_STORAGE) &&
+	      cli_bench_path_exists (ops, upload_path))
+	    {
+	      printf ("  Skipped: '%s' already exists\n", upload_path);
+	      idata_clear (&idata);
+	      g_free (upload_path);
+	      g_free (dst_path);
+	      return;
+	    }
+	}
+
+      printf (" %d KiB:\n", *size / KI);
+
+      backend_stats_reset (&backend);
+      start = g_get_monotonic_time ();
+      err = ops->upload (&backend, upload_path, &idata, &task_control);
+      idata_clear (&idata);
+      if (err)
+	{
+	  break;
+	}
+      backend_stats_get (&backend, &stats);
+      cli_bench_print_stats ("Upload", g_get_monotonic_time () - start,
+			     &stats);
+
+      backend_stats_reset (&backend);
+      start = g_get_monotonic_time ();
+      err = ops->download (&backend, upload_path, &idata, &task_control);
+      if (err)
+	{
+	  break;
+	}
+      idata_clear (&idata);
+      backend_stats_get (&backend, &stats);
+      cli_bench_print_stats ("Download", g_get_monotonic_time () - start,
+			     &stats);
+    }
+
+  if (err)
+    {
+      //Bigger payloads might not fit in the device but the previous results are still valid.
+      printf ("  Stopped: %s\n", g_strerror (-err));
+    }
+
+  if (upload_path && ops->delete (&backend, upload_path))
+    {
+      error_print ("Error while deleting '%s'", upload_path);
+    }
+
+  g_free (upload_path);
+  g_free (dst_path);
+}
+
+//Only sample filesystems are benchmarked as synthetic payloads can be created for them regardless of the device.
+
+static gint
+cli_bench (int argc, gchar *argv[], int *optind)
+{
+  gint err;
+  const gchar *device_path;
+  gchar *dir, *local_path, *name, *filename;
+  GSList *sorted;
+
+  if (*optind == argc)
+    {
+      error_print ("Device missing");
+      return EXIT_FAILURE;
+    }
+  else
+    {
+      device_path = argv[*optind];
+      (*optind)++;
+    }
+
+  err = cli_connect (device_path);
+  if (err)
+    {
+      return err;
+    }
+  if (backend.type != BE_TYPE_MIDI)
+    {
+      error_print ("Command only available in MIDI devices");
+      return EXIT_FAILURE;
+    }
+
+  dir = g_dir_make_tmp (PACKAGE "-XXXXXX", NULL);
+  if (!dir)
+    {
+      error_print ("Error while creating temporary directory");
+      return EXIT_FAILURE;
+    }
+  //A unique name makes it unlikely to match anything on the device.
+  name = g_strdup_printf ("%s-%08x", CLI_BENCH_NAME, g_random_int ());
+  filename = g_strconcat (name, ".wav", NULL);
+  local_path = g_build_filename (dir, filename, NULL);
+  g_free (filename);
+
+  controllable_set_active (&task_control.controllable, TRUE);
+  task_control.callback = NULL;
+
+  sorted = g_slist_copy (backend.fs_ops);
+  sorted = g_slist_sort (sorted, cli_fs_compare);
+
+  for (GSList *e = sorted; e && controllable_is_active (&controllable);
+       e = e->next)
+    {
+      const struct fs_operations *ops = e->data;
+      if ((ops->options & FS_OPTION_SAMPLE_EDITOR) && ops->load &&
+	  ops->upload && ops->download && ops->delete && ops->get_upload_path)
+	{
+	  cli_bench_fs (ops, local_path, name);
+	}
+    }
+
+  g_slist_free (sorted);
+
+  if (backend.pacing.default_rest_time)
+    {
+      printf ("Pacing: %d us\n", backend.pacing.rest_time);
+    }
+  else
+    {
+      printf ("Pacing: none\n");
+    }
+
+  g_unlink (local_path);
+  g_rmdir (dir);
+  g_free (local_path);
+  g_free (name);
+  g_free (dir);
+
+  return EXIT_SUCCESS;
+}
+
 static gint
 cli_df (int argc, gchar *argv[], int *optind)
 {
@@ -566,7 +902,13 @@ cli_upgrade_os (int argc, gchar *argv[], int *optind)
   else
     {
       sysex_transfer_init_tx (&sysex_transfer, idata_steal (&idata));
+      sysex_transfer.dry_run = dry_run;
       err = backend.upgrade_os (&backend, &sysex_transfer, &controllable);
+      if (!err && dry_run)
+	{
+	  printf ("Firmware '%s' is valid (%d B). Nothing was sent.\n",
+		  src_path, sysex_transfer.raw->len);
+	}
       sysex_transfer_clear (&sysex_transfer);
     }
 
@@ -778,6 +1120,139 @@ cli_upload_item (const gchar *src_path, const gchar *dst_path)
   return err;
 }
 
+static void
+cli_upload_batch_item_free (gpointer data)
+{
+  struct fs_upload_batch_item *item = data;
+  g_free (item->path);
+  idata_clear (&item->idata);
+  g_free (item);
+}
+
+//Every pair is made of a local path and a remote path. All the remote paths must refer to the same device and, as the filesystem is part of the command, to the same filesystem.
+//If the filesystem does not implement upload_batch, the files are uploaded one by one.
+//A file that can not be loaded is reported and the rest of the batch is uploaded anyway.
+
+static gint
+cli_upload_batch (int argc, gchar *argv[], int *optind)
+{
+  gint err = 0, device = -1;
+  const gchar *dst_path;
+  gchar *src_path, *device_dst_path;
+  GSList *items = NULL, *batch = NULL, *srcs = NULL, *s, *e;
+  struct fs_upload_batch_item *item;
+
+  controllable_set_active (&task_control.controllable, TRUE);
+  task_control.callback = print_progress;
+
+  while (*optind < argc)
+    {
+      src_path = argv[*optind];
+      (*optind)++;
+
+      if (*optind == argc)
+	{
+	  error_print (ERR_MSG_REMOTE_PATH_MISSING);
+	  err = EXIT_FAILURE;
+	  goto end;
+	}
+
+      device_dst_path = argv[*optind];
+      (*optind)++;
+
+      if (device == -1)
+	{
+	  err = cli_connect (device_dst_path);
+	  if (err)
+	    {
+	      goto end;
+	    }
+
+	  if (!fs_ops->load || !fs_ops->get_upload_path || !fs_ops->upload)
+	    {
+	      error_print ("Function not implemented");
+	      err = EXIT_FAILURE;
+	      goto end;
+	    }
+
+	  device = atoi (device_dst_path);
+	}
+      else if (atoi (device_dst_path) != device)
+	{
+	  error_print ("All the remote paths must be in the same device");
+	  err = EXIT_FAILURE;
+	  goto end;
+	}
+
+      dst_path = cli_get_path (device_dst_path);
+
+      item = g_malloc0 (sizeof (struct fs_upload_batch_item));
+      current_path_progress = src_path;
+      item->err = fs_ops->load (&backend, src_path, &item->idata,
+				&task_control);
+      if (item->err)
+	{
+	  item->path = g_strdup (dst_path);
+	}
+      else
+	{
+	  item->path = fs_ops->get_upload_path (&backend, fs_ops, dst_path,
+						src_path, &item->idata);
+	  batch = g_slist_append (batch, item);
+	}
+
+      items = g_slist_append (items, item);
+      srcs = g_slist_append (srcs, src_path);
+    }
+
+  current_path_progress = "Batch";
+
+  if (fs_ops->upload_batch)
+    {
+      err = batch ? fs_ops->upload_batch (&backend, batch, &task_control) : 0;
+    }
+  else
+    {
+      for (e = batch; e; e = e->next)
+	{
+	  item = e->data;
+	  item->err = fs_ops->upload (&backend, item->path, &item->idata,
+				      &task_control);
+	}
+    }
+
+  complete_progress (err);
+
+  //An error affecting the whole batch applies to every file not reported otherwise.
+  for (e = batch; e && err; e = e->next)
+    {
+      item = e->data;
+      if (!item->err)
+	{
+	  item->err = err;
+	}
+    }
+
+  //Every pair gets its status, so the errors are already reported.
+  err = 0;
+  for (e = items, s = srcs; e; e = e->next, s = s->next)
+    {
+      item = e->data;
+      printf ("%s -> %s: %s\n", (gchar *) s->data, item->path,
+	      item->err ? g_strerror (-item->err) : "OK");
+      if (item->err)
+	{
+	  err = EXIT_FAILURE;
+	}
+    }
+
+end:
+  g_slist_free (batch);
+  g_slist_free_full (items, cli_upload_batch_item_free);
+  g_slist_free (srcs);
+  return err;
+}
+
 static gint
 cli_upload (int argc, gchar *argv[], int *optind)
 {
@@ -807,6 +1282,13 @@ cli_upload (int argc, gchar *argv[], int *optind)
       (*optind)++;
     }
 
+  //More than one pair means a batch.
+  if (*optind < argc)
+    {
+      *optind -= 2;
+      return cli_upload_batch (argc, argv, optind);
+    }
+
   err = cli_connect (device_dst_path);
   if (err)
     {
@@ -1049,7 +1531,9 @@ cli_print_help (const gchar *argv0)
 {
   gchar *exec_name = g_path_get_basename (argv0);
   fprintf (stderr, "%s\n", PACKAGE_STRING);
-  fprintf (stderr, "Usage: %s [ -v ] command\n", exec_name);
+  fprintf (stderr,
+	   "Usage: %s [ -v ] [ -s | --stats ] [ -n | --dry-run ] command\n",
+	   exec_name);
   fprintf (stderr, "\n");
   fprintf (stderr, "Device commands:\n");
   cli_print_help_cmd ("ld", NULL, "List devices");
@@ -1061,7 +1545,9 @@ cli_print_help (const gchar *argv0)
   cli_print_help_cmd ("receive", "device_number file",
 		      "Receive MIDI data file from device");
   cli_print_help_cmd ("upgrade", "firmware device_number",
-		      "Upgrade the device");
+		      "Upgrade the device. With --dry-run, the firmware is only validated");
+  cli_print_help_cmd ("bench", "device_number",
+		      "Measure the transfer speed of the sample filesystems");
   cli_print_help_cmd ("play", "file", "Play audio file");
   cli_print_help_cmd ("record", "file", "Record into file");
   fprintf (stderr, "\n");
@@ -1076,6 +1562,9 @@ cli_print_help (const gchar *argv0)
 		      "Delete directory recursively");
   cli_print_help_cmd ("ul", "file device_number:path_to_file_or_directory",
 		      "Upload file");
+  cli_print_help_cmd ("ul",
+		      "file device_number:path_to_file [ file device_number:path_to_file ... ]",
+		      "Upload files in a batch and show the status of every upload");
   cli_print_help_cmd ("dl",
 		      "device_number:path_to_file_or_directory [ destination ]",
 		      "Download file");
@@ -1121,13 +1610,19 @@ main (int argc, gchar *argv[])
   sigaction (SIGHUP, &action, NULL);
 #endif
 
-  while ((c = getopt (argc, argv, "v")) != -1)
+  while ((c = getopt_long (argc, argv, "vsn", CLI_OPTIONS, NULL)) != -1)
     {
       switch (c)
 	{
 	case 'v':
 	  vflg++;
 	  break;
+	case 's':
+	  print_stats = TRUE;
+	  break;
+	case 'n':
+	  dry_run = TRUE;
+	  break;
 	case '?':
 	  errflg++;
 	}
@@ -1183,6 +1678,10 @@ main (int argc, gchar *argv[])
     {
       err = cli_upgrade_os (argc, argv, &optind);
     }
+  else if (!strcmp (command, "bench"))
+    {
+      err = cli_bench (argc, argv, &optind);
+    }
   else if (!strcmp (command, "play"))
     {
       err = cli_play (argc, argv, &optind);
@@ -1256,11 +1755,6 @@ main (int argc, gchar *argv[])
 	  err = EXIT_FAILURE;
 	}
 
-      if (backend_check (&backend))
-	{
-	  backend_destroy (&backend);
-	}
-
       g_free (connector);
       g_free (fs);
       g_free (op);
@@ -1272,6 +1766,13 @@ end:
       error_print ("Error: %s", g_strerror (-err));
     }
 
+  cli_print_stats ();
+
+  if (backend_check (&backend))
+    {
+      backend_destroy (&backend);
+    }
+
   controllable_clear (&controllable);
 
   regconn_unregister ();
@@ -66,6 +66,7 @@ struct elektroid_set_device_data
 };
 
 static gpointer elektroid_upload_task_runner (gpointer);
+static gpointer elektroid_upload_batch_task_runner (gpointer);
 static gpointer elektroid_download_task_runner (gpointer);
 static void elektroid_update_progress (struct task_control *);
 
@@ -361,6 +362,7 @@ elektroid_refresh_devices_int (gboolean startup)
   if (backend_check (BACKEND))
     {
       elektroid_cancel_all_tasks_and_wait ();
+      browser_wait_item_info (&remote_browser);
       backend_destroy (BACKEND);
       maction_menu_clear (&maction_context);
       browser_reset (&remote_browser);
@@ -557,6 +559,8 @@ elektroid_run_next (gpointer data)
 
       if (ops->options & FS_OPTION_SINGLE_OP)
 	{
+	  //Item info requests can not be interleaved with the operation.
+	  browser_wait_item_info (&remote_browser);
 	  gtk_widget_set_sensitive (remote_box, FALSE);
 	  gtk_widget_set_sensitive (fs_combo, FALSE);
 	}
@@ -596,13 +600,31 @@ elektroid_run_next (gpointer data)
       tasks.transfer.fs_ops = ops;
       tasks.transfer.batch_id = batch_id;
       tasks.transfer.mode = mode;
+      tasks.transfer.batch = NULL;
       debug_print (1, "Running task type %d from %s to %s (filesystem %s)...",
 		   type, tasks.transfer.src, tasks.transfer.dst,
 		   tasks.transfer.fs_ops->name);
 
+      backend_stats_reset (BACKEND);
       tasks_update_current_progress (NULL);
 
-      if (type == TASK_TYPE_UPLOAD)
+      //Batches are not possible if a replacement might need to be confirmed.
+      if (type == TASK_TYPE_UPLOAD && ops->upload_batch && !ops->file_exists)
+	{
+	  tasks.transfer.batch = tasks_start_upload_batch (&iter, batch_id,
+							   fs);
+	}
+
+      if (type == TASK_TYPE_UPLOAD && tasks.transfer.batch)
+	{
+	  debug_print (1, "Running %d more tasks in the same batch...",
+		       g_slist_length (tasks.transfer.batch));
+	  tasks.thread = g_thread_new ("upload_task",
+				       elektroid_upload_batch_task_runner,
+				       NULL);
+	  remote_browser.dirty = TRUE;
+	}
+      else if (type == TASK_TYPE_UPLOAD)
 	{
 	  tasks.thread = g_thread_new ("upload_task",
 				       elektroid_upload_task_runner, NULL);
@@ -623,15 +645,20 @@ elektroid_run_next (gpointer data)
 	{
 	  gtk_widget_set_sensitive (remote_box, TRUE);
 	  gtk_widget_set_sensitive (fs_combo, TRUE);
+	}
 
-	  if (remote_browser.dirty)
+      //Uploaded items are added to the browser as they finish so the directory is only listed once all the tasks are done.
+      if (remote_browser.dirty)
+	{
+	  remote_browser.dirty = FALSE;
+	  if (remote_browser.fs_ops)
 	    {
-	      remote_browser.dirty = FALSE;
 	      g_idle_add (browser_load_dir_if_needed, &remote_browser);
 	    }
 	}
 
-      if (remote_browser.fs_ops->options & FS_OPTION_AUDIO_LINK)
+      if (remote_browser.fs_ops &&
+	  remote_browser.fs_ops->options & FS_OPTION_AUDIO_LINK)
 	{
 	  g_mutex_lock (&audio.control.controllable.mutex);
 	  audio.mono_mix = mono_mix;
@@ -752,13 +779,86 @@ elektroid_check_file_and_wait (gchar *path, struct browser *browser)
     }
 }
 
+struct elektroid_uploaded_item
+{
+  const struct fs_operations *fs_ops;
+  gchar *dir;
+  struct item item;
+};
+
+//The remote browser is only accessed from the main thread.
+//Items in subdirectories are only shown after the final listing.
+
+static gboolean
+elektroid_update_uploaded_item (gpointer data)
+{
+  struct elektroid_uploaded_item *uploaded = data;
+
+  if (uploaded->fs_ops == remote_browser.fs_ops && remote_browser.dir &&
+      !strcmp (uploaded->dir, remote_browser.dir))
+    {
+      browser_update_item (&remote_browser, uploaded->dir, &uploaded->item);
+    }
+
+  sample_info_clear (&uploaded->item.sample_info);
+  g_free (uploaded->dir);
+  g_free (uploaded);
+
+  return G_SOURCE_REMOVE;
+}
+
+//The item is built from the uploaded data. The listing done when all the tasks finish will set the values reported by the device.
+//Items in slots are only shown after the final listing.
+
+static void
+elektroid_update_uploaded_item_if_visible (const gchar *upload_path,
+					   struct idata *idata)
+{
+  gchar *name;
+  struct elektroid_uploaded_item *uploaded;
+  const struct fs_operations *fs_ops = tasks.transfer.fs_ops;
+
+  if (fs_ops->options & (FS_OPTION_SINGLE_OP | FS_OPTION_SLOT_STORAGE))
+    {
+      return;
+    }
+
+  uploaded = g_malloc (sizeof (struct elektroid_uploaded_item));
+  uploaded->fs_ops = fs_ops;
+  uploaded->dir = g_path_get_dirname (upload_path);
+
+  name = g_path_get_basename (upload_path);
+  uploaded->item.type = ITEM_TYPE_FILE;
+  snprintf (uploaded->item.name, ITEM_NAME_MAX, "%s", name);
+  uploaded->item.id = -1;
+  uploaded->item.size = idata->content->len;
+  uploaded->item.object_info[0] = 0;
+  if (fs_ops->options & FS_OPTION_SHOW_SAMPLE_COLUMNS && idata->info)
+    {
+      //The tags are referenced as the data is freed before the item is used.
+      memcpy (&uploaded->item.sample_info, idata->info,
+	      sizeof (struct sample_info));
+      if (uploaded->item.sample_info.tags)
+	{
+	  g_hash_table_ref (uploaded->item.sample_info.tags);
+	}
+    }
+  else
+    {
+      memset (&uploaded->item.sample_info, 0, sizeof (struct sample_info));
+    }
+  g_free (name);
+
+  g_idle_add (elektroid_update_uploaded_item, uploaded);
+}
+
 static gpointer
 elektroid_upload_task_runner (gpointer data)
 {
   gint res;
   gboolean active;
   struct idata idata;
-  gchar *dst_dir, *upload_path;
+  gchar *upload_path;
 
   debug_print (1, "Local path: %s", tasks.transfer.src);
   debug_print (1, "Remote path: %s", tasks.transfer.dst);
@@ -812,17 +912,12 @@ elektroid_upload_task_runner (gpointer data)
 	TASK_STATUS_COMPLETED_OK : TASK_STATUS_CANCELED;
     }
 
-  dst_dir = g_path_get_dirname (upload_path);
-  if (!res && tasks.transfer.fs_ops == remote_browser.fs_ops &&
-      !strncmp (dst_dir, remote_browser.dir,
-		strlen (remote_browser.dir))
-      && !(tasks.transfer.fs_ops->options & FS_OPTION_SINGLE_OP))
+  if (!res)
     {
-      g_idle_add (browser_load_dir_if_needed, &remote_browser);
+      elektroid_update_uploaded_item_if_visible (upload_path, &idata);
     }
 
   g_free (upload_path);
-  g_free (dst_dir);
 
 cleanup:
   idata_clear (&idata);
@@ -832,6 +927,118 @@ end:
   return NULL;
 }
 
+static void
+elektroid_upload_batch_item_free (gpointer data)
+{
+  struct fs_upload_batch_item *item = data;
+  g_free (item->path);
+  idata_clear (&item->idata);
+  g_free (item);
+}
+
+//The current task and the ones in tasks.transfer.batch are loaded first and then uploaded with a single upload_batch call.
+//Items that can not be loaded are reported as errors and left out of the batch.
+
+static gpointer
+elektroid_upload_batch_task_runner (gpointer data)
+{
+  gint res;
+  gboolean active;
+  GSList *task_items, *loaded = NULL, *items = NULL, *e, *t;
+  struct task_batch_item current, *task_item;
+  struct fs_upload_batch_item *item;
+  const struct fs_operations *fs_ops = tasks.transfer.fs_ops;
+
+  current.src = tasks.transfer.src;
+  current.dst = tasks.transfer.dst;
+  task_items = g_slist_prepend (g_slist_copy (tasks.transfer.batch),
+				&current);
+
+  for (e = task_items; e; e = e->next)
+    {
+      task_item = e->data;
+
+      if (!controllable_is_active (&tasks.transfer.control.controllable))
+	{
+	  task_item->status = TASK_STATUS_CANCELED;
+	  continue;
+	}
+
+      task_item->status = TASK_STATUS_COMPLETED_ERROR;
+
+      debug_print (1, "Local path: %s", task_item->src);
+      debug_print (1, "Remote path: %s", task_item->dst);
+
+      if (remote_browser.fs_ops->mkdir
+	  && remote_browser.fs_ops->mkdir (BACKEND, task_item->dst))
+	{
+	  error_print ("Error while creating remote %s dir", task_item->dst);
+	  continue;
+	}
+
+      item = g_malloc (sizeof (struct fs_upload_batch_item));
+      res = fs_ops->load (BACKEND, task_item->src, &item->idata,
+			  &tasks.transfer.control);
+      if (res)
+	{
+	  error_print ("Error while loading file");
+	  g_free (item);
+	  continue;
+	}
+
+      item->path = remote_browser.fs_ops->get_upload_path (BACKEND,
+							   remote_browser.fs_ops,
+							   task_item->dst,
+							   task_item->src,
+							   &item->idata);
+      item->err = 0;
+      items = g_slist_append (items, item);
+      loaded = g_slist_append (loaded, task_item);
+    }
+
+  if (items)
+    {
+      debug_print (1, "Writing %d files (filesystem %s)...",
+		   g_slist_length (items), fs_ops->name);
+
+      res = fs_ops->upload_batch (BACKEND, items, &tasks.transfer.control);
+      active = controllable_is_active (&tasks.transfer.control.controllable);
+
+      for (e = items, t = loaded; e; e = e->next, t = t->next)
+	{
+	  item = e->data;
+	  task_item = t->data;
+
+	  if ((res || item->err) && active)
+	    {
+	      error_print ("Error while uploading");
+	      task_item->status = TASK_STATUS_COMPLETED_ERROR;
+	    }
+	  else
+	    {
+	      task_item->status = active ?
+		TASK_STATUS_COMPLETED_OK : TASK_STATUS_CANCELED;
+	    }
+
+	  if (!res && !item->err)
+	    {
+	      elektroid_update_uploaded_item_if_visible (item->path,
+							 &item->idata);
+	    }
+	}
+    }
+
+  tasks.transfer.status = current.status;
+
+  g_slist_free_full (items, elektroid_upload_batch_item_free);
+  g_slist_free (loaded);
+  g_slist_free (task_items);
+
+  g_idle_add (tasks_complete_current, &tasks);
+  g_idle_add (elektroid_run_next, NULL);
+  return NULL;
+}
+
 static void
 elektroid_add_upload_task_path (const gchar *rel_path,
 				const gchar *src_dir, const gchar *dst_dir,
@@ -1291,6 +1498,7 @@ elektroid_set_device (GtkWidget *object, gpointer data)
 
   if (backend_check (BACKEND))
     {
+      browser_wait_item_info (&remote_browser);
       backend_destroy (BACKEND);
     }
 
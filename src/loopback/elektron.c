@@ -0,0 +1,989 @@
+/*
+ *   elektron.c
+ *   Copyright (C) 2026 David García Goñi <dagargo@gmail.com>
+ *
+ *   This file is part of Elektroid.
+ *
+ *   Elektroid is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   Elektroid is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with Elektroid. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <glib/gstdio.h>
+#include <zlib.h>
+#include "loopback.h"
+
+// Reference model of an Elektron Digitakt.
+// The sample filesystem is stored in the "samples" directory and the data filesystem in the "data" directory.
+// In the data filesystem, slots are files named after their id.
+
+#define LOOPBACK_ELEKTRON_DEVICE_ID 12
+#define LOOPBACK_ELEKTRON_NAME "Digitakt (loopback)"
+#define LOOPBACK_ELEKTRON_VERSION "1.50"
+#define LOOPBACK_ELEKTRON_UID 0x10ade7
+#define LOOPBACK_ELEKTRON_DRIVE_SIZE (960 * MI)
+#define LOOPBACK_ELEKTRON_RAM_SIZE (64 * MI)
+#define LOOPBACK_ELEKTRON_DATA_CHUNK_SIZE 0x2000
+#define LOOPBACK_ELEKTRON_SAMPLES_PAD_RES 22
+
+#define LOOPBACK_ELEKTRON_SAMPLES_DIR "samples"
+#define LOOPBACK_ELEKTRON_DATA_DIR "data"
+
+static const guint8 LOOPBACK_ELEKTRON_MSG_HEADER[] =
+  { 0xf0, 0, 0x20, 0x3c, 0x10, 0 };
+
+static const gchar *LOOPBACK_ELEKTRON_DATA_DIRS[] = {
+  "projects", "soundbanks/A", "soundbanks/B", "soundbanks/C",
+  "soundbanks/D", "soundbanks/E", "soundbanks/F", "soundbanks/G",
+  "soundbanks/H", NULL
+};
+
+struct loopback_elektron_job
+{
+  guint32 id;
+  gchar *path;
+  GByteArray *content;
+  gboolean write;
+};
+
+struct loopback_elektron_state
+{
+  gchar *samples;
+  gchar *data;
+  guint16 seq;
+  guint32 next_job_id;
+  GSList *jobs;
+};
+
+static GByteArray *
+loopback_elektron_decode_payload (const guint8 *src, guint len)
+{
+  GByteArray *dst;
+  guint i, j, k;
+  guint8 shift;
+  guint dst_len = len - (len + 7) / 8;
+
+  dst = g_byte_array_sized_new (dst_len);
+  dst->len = dst_len;
+
+  for (i = 0, j = 0; i < len; i += 8, j += 7)
+    {
+      shift = 0x40;
+      for (k = 0; k < 7 && i + k + 1 < len; k++)
+	{
+	  dst->data[j + k] = src[i + k + 1] | (src[i] & shift ? 0x80 : 0);
+	  shift = shift >> 1;
+	}
+    }
+
+  return dst;
+}
+
+static GByteArray *
+loopback_elektron_encode_payload (const GByteArray *src)
+{
+  GByteArray *dst;
+  guint i, j, k;
+  guint8 accum;
+  guint dst_len = src->len + (src->len + 6) / 7;
+
+  dst = g_byte_array_sized_new (dst_len);
+  dst->len = dst_len;
+
+  for (i = 0, j = 0; j < src->len; i += 8, j += 7)
+    {
+      accum = 0;
+      for (k = 0; k < 7; k++)
+	{
+	  accum = accum << 1;
+	  if (j + k < src->len)
+	    {
+	      if (src->data[j + k] & 0x80)
+		{
+		  accum |= 1;
+		}
+	      dst->data[i + k + 1] = src->data[j + k] & 0x7f;
+	    }
+	}
+      dst->data[i] = accum;
+    }
+
+  return dst;
+}
+
+static guint32
+loopback_elektron_get_u32 (const GByteArray *msg, guint pos)
+{
+  guint32 v;
+
+  if (pos + sizeof (guint32) > msg->len)
+    {
+      return 0;
+    }
+
+  memcpy (&v, &msg->data[pos], sizeof (guint32));
+  return g_ntohl (v);
+}
+
+static void
+loopback_elektron_append_u32 (GByteArray *msg, guint32 v)
+{
+  guint32 aux = g_htonl (v);
+  g_byte_array_append (msg, (guint8 *) & aux, sizeof (guint32));
+}
+
+static void
+loopback_elektron_append_u64 (GByteArray *msg, guint64 v)
+{
+  guint64 aux = GUINT64_TO_BE (v);
+  g_byte_array_append (msg, (guint8 *) & aux, sizeof (guint64));
+}
+
+static void
+loopback_elektron_append_u8 (GByteArray *msg, guint8 v)
+{
+  g_byte_array_append (msg, &v, 1);
+}
+
+static void
+loopback_elektron_append_string (GByteArray *msg, const gchar *s)
+{
+  g_byte_array_append (msg, (guint8 *) s, strlen (s) + 1);
+}
+
+//Returns NULL if the string is not terminated inside the message.
+
+static const gchar *
+loopback_elektron_get_string (const GByteArray *msg, guint pos)
+{
+  if (pos >= msg->len || !memchr (&msg->data[pos], 0, msg->len - pos))
+    {
+      return NULL;
+    }
+  return (const gchar *) &msg->data[pos];
+}
+
+//Device paths are absolute and can not go up the tree.
+
+static gchar *
+loopback_elektron_get_host_path (const gchar *root, const gchar *path)
+{
+  if (!path || path[0] != '/' || strstr (path, ".."))
+    {
+      return NULL;
+    }
+  return g_build_filename (root, path, NULL);
+}
+
+static GByteArray *
+loopback_elektron_new_reply (struct loopback_elektron_state *state,
+			     const GByteArray *request)
+{
+  guint16 aux;
+  GByteArray *reply = g_byte_array_new ();
+
+  aux = g_htons (state->seq);
+  g_byte_array_append (reply, (guint8 *) & aux, sizeof (guint16));
+  state->seq++;
+  g_byte_array_append (reply, request->data, sizeof (guint16));
+  loopback_elektron_append_u8 (reply, request->data[4] | 0x80);
+
+  return reply;
+}
+
+static void
+loopback_elektron_send (struct loopback_device *device, GByteArray *reply)
+{
+  GByteArray *encoded = loopback_elektron_encode_payload (reply);
+  GByteArray *raw = g_byte_array_sized_new (sizeof
+					    (LOOPBACK_ELEKTRON_MSG_HEADER) +
+					    encoded->len + 1);
+
+  g_byte_array_append (raw, LOOPBACK_ELEKTRON_MSG_HEADER,
+		       sizeof (LOOPBACK_ELEKTRON_MSG_HEADER));
+  g_byte_array_append (raw, encoded->data, encoded->len);
+  g_byte_array_append (raw, (guint8 *) "\xf7", 1);
+  free_msg (encoded);
+  free_msg (reply);
+
+  loopback_device_reply (device, raw);
+}
+
+static void
+loopback_elektron_append_status (GByteArray *reply, gint err)
+{
+  loopback_elektron_append_u8 (reply, err ? 0 : 1);
+  if (err)
+    {
+      loopback_elektron_append_string (reply, g_strerror (-err));
+    }
+}
+
+static struct loopback_elektron_job *
+loopback_elektron_job_new (struct loopback_elektron_state *state,
+			   const gchar *path, GByteArray *content,
+			   gboolean write)
+{
+  struct loopback_elektron_job *job =
+    g_malloc (sizeof (struct loopback_elektron_job));
+
+  job->id = state->next_job_id;
+  state->next_job_id++;
+  job->path = g_strdup (path);
+  job->content = content;
+  job->write = write;
+  state->jobs = g_slist_append (state->jobs, job);
+
+  return job;
+}
+
+static void
+loopback_elektron_job_free (gpointer data)
+{
+  struct loopback_elektron_job *job = data;
+
+  g_free (job->path);
+  free_msg (job->content);
+  g_free (job);
+}
+
+static struct loopback_elektron_job *
+loopback_elektron_job_get (struct loopback_elektron_state *state, guint32 id)
+{
+  for (GSList *e = state->jobs; e; e = e->next)
+    {
+      struct loopback_elektron_job *job = e->data;
+      if (job->id == id)
+	{
+	  return job;
+	}
+    }
+  return NULL;
+}
+
+static void
+loopback_elektron_job_remove (struct loopback_elektron_state *state,
+			      struct loopback_elektron_job *job)
+{
+  state->jobs = g_slist_remove (state->jobs, job);
+  loopback_elektron_job_free (job);
+}
+
+static gint
+loopback_elektron_copy_file (const gchar *src, const gchar *dst)
+{
+  gint err;
+  GByteArray *content = loopback_file_load (src);
+
+  if (!content)
+    {
+      return -ENOENT;
+    }
+
+  err = loopback_file_save (dst, content);
+  free_msg (content);
+
+  return err;
+}
+
+static guint64
+loopback_elektron_get_dir_size (const gchar *dir)
+{
+  GStatBuf buf;
+  guint64 size = 0;
+  GSList *names = loopback_dir_list (dir);
+
+  for (GSList *e = names; e; e = e->next)
+    {
+      gchar *path = g_build_filename (dir, e->data, NULL);
+      if (!g_stat (path, &buf))
+	{
+	  size += S_ISDIR (buf.st_mode) ?
+	    loopback_elektron_get_dir_size (path) : buf.st_size;
+	}
+      g_free (path);
+    }
+  g_slist_free_full (names, g_free);
+
+  return size;
+}
+
+static void
+loopback_elektron_storage_info (struct loopback_elektron_state *state,
+				const GByteArray *msg, GByteArray *reply)
+{
+  guint64 size, used;
+  guint8 fsid = msg->len > 5 ? msg->data[5] : 0;
+
+  switch (fsid)
+    {
+    case 1:
+      size = LOOPBACK_ELEKTRON_DRIVE_SIZE;
+      used = loopback_elektron_get_dir_size (state->samples);
+      break;
+    case 2:
+      size = LOOPBACK_ELEKTRON_RAM_SIZE;
+      used = 0;
+      break;
+    default:
+      loopback_elektron_append_status (reply, -EINVAL);
+      return;
+    }
+
+  loopback_elektron_append_u8 (reply, 1);
+  loopback_elektron_append_u64 (reply, used > size ? 0 : size - used);
+  loopback_elektron_append_u64 (reply, size);
+}
+
+static void
+loopback_elektron_sample_read_dir (struct loopback_elektron_state *state,
+				   const GByteArray *msg, GByteArray *reply)
+{
+  GSList *names;
+  GStatBuf buf;
+  gchar *path = loopback_elektron_get_host_path (state->samples,
+						 loopback_elektron_get_string
+						 (msg, 5));
+
+  //A missing directory is just empty.
+  if (!path)
+    {
+      return;
+    }
+
+  names = loopback_dir_list (path);
+  for (GSList *e = names; e; e = e->next)
+    {
+      guint32 hash = 0;
+      gchar *child = g_build_filename (path, e->data, NULL);
+
+      if (!g_stat (child, &buf))
+	{
+	  gboolean dir = S_ISDIR (buf.st_mode);
+	  if (!dir)
+	    {
+	      GByteArray *content = loopback_file_load (child);
+	      if (content)
+		{
+		  hash = crc32 (0, content->data, content->len);
+		  free_msg (content);
+		}
+	    }
+	  loopback_elektron_append_u32 (reply, hash);
+	  loopback_elektron_append_u32 (reply, dir ? 0 : buf.st_size);
+	  loopback_elektron_append_u8 (reply, 0);
+	  loopback_elektron_append_u8 (reply, dir ? 'D' : 'F');
+	  loopback_elektron_append_string (reply, e->data);
+	}
+      g_free (child);
+    }
+  g_slist_free_full (names, g_free);
+  g_free (path);
+}
+
+static void
+loopback_elektron_path_op (const gchar *root, guint8 type,
+			   const GByteArray *msg, GByteArray *reply)
+{
+  gint err = 0;
+  GStatBuf buf;
+  gchar *path = loopback_elektron_get_host_path (root,
+						 loopback_elektron_get_string
+						 (msg, 5));
+
+  if (!path)
+    {
+      loopback_elektron_append_status (reply, -EINVAL);
+      return;
+    }
+
+  switch (type)
+    {
+    case 0x11:
+      err = g_mkdir (path, 0755) ? -errno : 0;
+      break;
+    case 0x12:
+      err = g_rmdir (path) ? -errno : 0;
+      break;
+    case 0x20:
+    case 0x5c:
+      err = g_unlink (path) ? -errno : 0;
+      break;
+    case 0x22:
+      err = g_stat (path, &buf) ? -errno : 0;
+      if (!err && S_ISDIR (buf.st_mode))
+	{
+	  err = -EISDIR;
+	}
+      break;
+    }
+
+  loopback_elektron_append_status (reply, err);
+  if (type == 0x22 && !err)
+    {
+      loopback_elektron_append_u32 (reply, buf.st_size);
+      loopback_elektron_append_u32 (reply, 0);
+    }
+  g_free (path);
+}
+
+static void
+loopback_elektron_src_dst_op (const gchar *root, guint8 type,
+			      const GByteArray *msg, GByteArray *reply)
+{
+  gint err = 0;
+  gchar *aux;
+  const gchar *src_name = loopback_elektron_get_string (msg, 5);
+  const gchar *dst_name = src_name ?
+    loopback_elektron_get_string (msg, 5 + strlen (src_name) + 1) : NULL;
+  gchar *src = loopback_elektron_get_host_path (root, src_name);
+  gchar *dst = loopback_elektron_get_host_path (root, dst_name);
+
+  if (!src || !dst)
+    {
+      err = -EINVAL;
+      goto end;
+    }
+
+  switch (type)
+    {
+    case 0x21:
+    case 0x5a:
+      err = g_rename (src, dst) ? -errno : 0;
+      break;
+    case 0x5b:
+      err = loopback_elektron_copy_file (src, dst);
+      break;
+    case 0x5d:
+      aux = g_strconcat (dst, ".swap", NULL);
+      err = g_rename (dst, aux) || g_rename (src, dst) ||
+	g_rename (aux, src) ? -errno : 0;
+      g_free (aux);
+      break;
+    }
+
+end:
+  loopback_elektron_append_status (reply, err);
+  g_free (src);
+  g_free (dst);
+}
+
+static void
+loopback_elektron_sample_open_reader (struct loopback_elektron_state *state,
+				      const GByteArray *msg,
+				      GByteArray *reply)
+{
+  struct loopback_elektron_job *job;
+  GByteArray *content = NULL;
+  gchar *path = loopback_elektron_get_host_path (state->samples,
+						 loopback_elektron_get_string
+						 (msg, 5));
+
+  if (path)
+    {
+      content = loopback_file_load (path);
+    }
+
+  if (!content)
+    {
+      loopback_elektron_append_status (reply, -ENOENT);
+      g_free (path);
+      return;
+    }
+
+  job = loopback_elektron_job_new (state, path, content, FALSE);
+  loopback_elektron_append_u8 (reply, 1);
+  loopback_elektron_append_u32 (reply, job->id);
+  loopback_elektron_append_u32 (reply, content->len);
+  g_free (path);
+}
+
+static void
+loopback_elektron_sample_read (struct loopback_elektron_state *state,
+			       const GByteArray *msg, GByteArray *reply)
+{
+  guint32 id = loopback_elektron_get_u32 (msg, 5);
+  guint32 size = loopback_elektron_get_u32 (msg, 9);
+  guint32 start = loopback_elektron_get_u32 (msg, 13);
+  struct loopback_elektron_job *job = loopback_elektron_job_get (state, id);
+
+  if (!job || job->write || start > job->content->len)
+    {
+      loopback_elektron_append_status (reply, -EBADF);
+      return;
+    }
+
+  if (start + size > job->content->len)
+    {
+      size = job->content->len - start;
+    }
+
+  loopback_elektron_append_u8 (reply, 1);
+  loopback_elektron_append_u32 (reply, id);
+  loopback_elektron_append_u32 (reply, start);
+  loopback_elektron_append_u32 (reply, size);
+  while (reply->len < LOOPBACK_ELEKTRON_SAMPLES_PAD_RES)
+    {
+      loopback_elektron_append_u8 (reply, 0);
+    }
+  g_byte_array_append (reply, &job->content->data[start], size);
+}
+
+static void
+loopback_elektron_sample_open_writer (struct loopback_elektron_state *state,
+				      const GByteArray *msg,
+				      GByteArray *reply)
+{
+  struct loopback_elektron_job *job;
+  GByteArray *content;
+  guint32 size = loopback_elektron_get_u32 (msg, 5);
+  gchar *path = loopback_elektron_get_host_path (state->samples,
+						 loopback_elektron_get_string
+						 (msg, 9));
+
+  if (!path)
+    {
+      loopback_elektron_append_status (reply, -EINVAL);
+      return;
+    }
+
+  content = g_byte_array_sized_new (size);
+  g_byte_array_set_size (content, size);
+  memset (content->data, 0, size);
+
+  job = loopback_elektron_job_new (state, path, content, TRUE);
+  loopback_elektron_append_u8 (reply, 1);
+  loopback_elektron_append_u32 (reply, job->id);
+  g_free (path);
+}
+
+static void
+loopback_elektron_sample_write (struct loopback_elektron_state *state,
+				const GByteArray *msg, GByteArray *reply)
+{
+  guint32 id = loopback_elektron_get_u32 (msg, 5);
+  guint32 len = loopback_elektron_get_u32 (msg, 9);
+  guint32 offset = loopback_elektron_get_u32 (msg, 13);
+  struct loopback_elektron_job *job = loopback_elektron_job_get (state, id);
+
+  if (!job || !job->write || msg->len < 17 + len ||
+      offset + len > job->content->len)
+    {
+      loopback_elektron_append_status (reply, -EBADF);
+      return;
+    }
+
+  memcpy (&job->content->data[offset], &msg->data[17], len);
+  loopback_elektron_append_u8 (reply, 1);
+}
+
+static void
+loopback_elektron_close (struct loopback_elektron_state *state,
+			 const GByteArray *msg, GByteArray *reply)
+{
+  gint err = 0;
+  guint32 id = loopback_elektron_get_u32 (msg, 5);
+  struct loopback_elektron_job *job = loopback_elektron_job_get (state, id);
+
+  if (!job)
+    {
+      loopback_elektron_append_status (reply, -EBADF);
+      return;
+    }
+
+  if (job->write)
+    {
+      err = loopback_file_save (job->path, job->content);
+    }
+
+  loopback_elektron_append_status (reply, err);
+  if (!err)
+    {
+      loopback_elektron_append_u32 (reply, id);
+      loopback_elektron_append_u32 (reply, job->content->len);
+    }
+  loopback_elektron_job_remove (state, job);
+}
+
+static gint
+loopback_elektron_compare_slots (gconstpointer a, gconstpointer b)
+{
+  return atoi (a) - atoi (b);
+}
+
+static gboolean
+loopback_elektron_is_slot (const gchar *name)
+{
+  for (const gchar *c = name; *c; c++)
+    {
+      if (!g_ascii_isdigit (*c))
+	{
+	  return FALSE;
+	}
+    }
+  return *name != 0;
+}
+
+static void
+loopback_elektron_data_list (struct loopback_elektron_state *state,
+			     const GByteArray *msg, GByteArray *reply)
+{
+  GSList *names, *slots = NULL;
+  GStatBuf buf;
+  guint count = 0;
+  gchar *path = loopback_elektron_get_host_path (state->data,
+						 loopback_elektron_get_string
+						 (msg, 5));
+
+  if (!path || g_stat (path, &buf) || !S_ISDIR (buf.st_mode))
+    {
+      loopback_elektron_append_status (reply, -ENOTDIR);
+      g_free (path);
+      return;
+    }
+
+  names = loopback_dir_list (path);
+  for (GSList *e = names; e; e = e->next)
+    {
+      if (loopback_elektron_is_slot (e->data))
+	{
+	  slots = g_slist_insert_sorted (slots, e->data,
+					 loopback_elektron_compare_slots);
+	}
+      count++;
+    }
+
+  loopback_elektron_append_u8 (reply, 1);
+  loopback_elektron_append_u32 (reply, 0);
+  loopback_elektron_append_u32 (reply, count);
+  loopback_elektron_append_u32 (reply, count);
+
+  for (GSList *e = names; e; e = e->next)
+    {
+      gchar *child = g_build_filename (path, e->data, NULL);
+      if (!g_stat (child, &buf) && S_ISDIR (buf.st_mode))
+	{
+	  GSList *children = loopback_dir_list (child);
+	  loopback_elektron_append_string (reply, e->data);
+	  loopback_elektron_append_u8 (reply, 1);
+	  loopback_elektron_append_u8 (reply, 1);
+	  loopback_elektron_append_u32 (reply, g_slist_length (children));
+	  g_slist_free_full (children, g_free);
+	}
+      g_free (child);
+    }
+
+  for (GSList *e = slots; e; e = e->next)
+    {
+      gchar *child = g_build_filename (path, e->data, NULL);
+      if (!g_stat (child, &buf) && S_ISREG (buf.st_mode))
+	{
+	  loopback_elektron_append_string (reply, e->data);
+	  loopback_elektron_append_u8 (reply, 0);
+	  loopback_elektron_append_u8 (reply, 2);
+	  loopback_elektron_append_u32 (reply, atoi (e->data));
+	  loopback_elektron_append_u32 (reply, buf.st_size);
+	  //All the operations are allowed.
+	  loopback_elektron_append_u8 (reply, 0xff);
+	  loopback_elektron_append_u8 (reply, 0xff);
+	  loopback_elektron_append_u8 (reply, 1);
+	  loopback_elektron_append_u8 (reply, 0);
+	}
+      g_free (child);
+    }
+
+  g_slist_free (slots);
+  g_slist_free_full (names, g_free);
+  g_free (path);
+}
+
+static void
+loopback_elektron_data_read_open (struct loopback_elektron_state *state,
+				  const GByteArray *msg, GByteArray *reply)
+{
+  struct loopback_elektron_job *job;
+  GByteArray *content = NULL;
+  gchar *path = loopback_elektron_get_host_path (state->data,
+						 loopback_elektron_get_string
+						 (msg, 5));
+
+  if (path)
+    {
+      content = loopback_file_load (path);
+    }
+
+  if (!content)
+    {
+      loopback_elektron_append_status (reply, -ENOENT);
+      g_free (path);
+      return;
+    }
+
+  job = loopback_elektron_job_new (state, path, content, FALSE);
+  loopback_elektron_append_u8 (reply, 1);
+  loopback_elektron_append_u32 (reply, job->id);
+  loopback_elektron_append_u32 (reply, LOOPBACK_ELEKTRON_DATA_CHUNK_SIZE);
+  loopback_elektron_append_u8 (reply, 0);
+  g_free (path);
+}
+
+static void
+loopback_elektron_data_read_partial (struct loopback_elektron_state *state,
+				     const GByteArray *msg,
+				     GByteArray *reply)
+{
+  guint32 start, len;
+  guint32 id = loopback_elektron_get_u32 (msg, 5);
+  guint32 seq = loopback_elektron_get_u32 (msg, 9);
+  struct loopback_elektron_job *job = loopback_elektron_job_get (state, id);
+
+  start = seq * LOOPBACK_ELEKTRON_DATA_CHUNK_SIZE;
+  if (!job || job->write || start > job->content->len)
+    {
+      loopback_elektron_append_status (reply, -EBADF);
+      return;
+    }
+
+  len = job->content->len - start;
+  len = len > LOOPBACK_ELEKTRON_DATA_CHUNK_SIZE ?
+    LOOPBACK_ELEKTRON_DATA_CHUNK_SIZE : len;
+
+  loopback_elektron_append_u8 (reply, 1);
+  loopback_elektron_append_u32 (reply, id);
+  loopback_elektron_append_u32 (reply, seq);
+  loopback_elektron_append_u32 (reply, job->content->len ?
+				(guint64) (start + len) * 1000 /
+				job->content->len : 1000);
+  loopback_elektron_append_u8 (reply, start + len == job->content->len);
+  loopback_elektron_append_u32 (reply,
+				crc32 (0, &job->content->data[start], len));
+  loopback_elektron_append_u32 (reply, len);
+  g_byte_array_append (reply, &job->content->data[start], len);
+}
+
+static void
+loopback_elektron_data_write_open (struct loopback_elektron_state *state,
+				   const GByteArray *msg, GByteArray *reply)
+{
+  struct loopback_elektron_job *job;
+  gchar *dir;
+  gchar *path = loopback_elektron_get_host_path (state->data,
+						 loopback_elektron_get_string
+						 (msg, 9));
+
+  if (!path)
+    {
+      loopback_elektron_append_status (reply, -EINVAL);
+      return;
+    }
+
+  dir = g_path_get_dirname (path);
+  if (!g_file_test (dir, G_FILE_TEST_IS_DIR))
+    {
+      loopback_elektron_append_status (reply, -ENOENT);
+    }
+  else
+    {
+      job = loopback_elektron_job_new (state, path,
+				       g_byte_array_sized_new
+				       (loopback_elektron_get_u32 (msg, 5)),
+				       TRUE);
+      loopback_elektron_append_u8 (reply, 1);
+      loopback_elektron_append_u32 (reply, job->id);
+    }
+
+  g_free (dir);
+  g_free (path);
+}
+
+static void
+loopback_elektron_data_write_partial (struct loopback_elektron_state *state,
+				      const GByteArray *msg,
+				      GByteArray *reply)
+{
+  guint32 id = loopback_elektron_get_u32 (msg, 5);
+  guint32 seq = loopback_elektron_get_u32 (msg, 9);
+  guint32 crc = loopback_elektron_get_u32 (msg, 13);
+  guint32 len = loopback_elektron_get_u32 (msg, 17);
+  struct loopback_elektron_job *job = loopback_elektron_job_get (state, id);
+
+  if (!job || !job->write || msg->len < 21 + len)
+    {
+      loopback_elektron_append_status (reply, -EBADF);
+      return;
+    }
+
+  if (crc32 (0xffffffff, &msg->data[21], len) != crc)
+    {
+      loopback_elektron_append_status (reply, -EBADMSG);
+      return;
+    }
+
+  g_byte_array_append (job->content, &msg->data[21], len);
+
+  loopback_elektron_append_u8 (reply, 1);
+  loopback_elektron_append_u32 (reply, id);
+  loopback_elektron_append_u32 (reply, seq);
+  loopback_elektron_append_u32 (reply, job->content->len);
+}
+
+static void
+loopback_elektron_handle (struct loopback_device *device, gpointer data,
+			  const GByteArray *raw)
+{
+  guint8 type;
+  GByteArray *msg, *reply;
+  struct loopback_elektron_state *state = data;
+  guint header_len = sizeof (LOOPBACK_ELEKTRON_MSG_HEADER);
+
+  if (raw->len < 12 || memcmp (raw->data, LOOPBACK_ELEKTRON_MSG_HEADER,
+			       header_len))
+    {
+      return;
+    }
+
+  msg = loopback_elektron_decode_payload (&raw->data[header_len],
+					  raw->len - header_len - 1);
+  if (msg->len < 5)
+    {
+      free_msg (msg);
+      return;
+    }
+
+  type = msg->data[4];
+  reply = loopback_elektron_new_reply (state, msg);
+
+  switch (type)
+    {
+    case 0x01:
+      loopback_elektron_append_u8 (reply, LOOPBACK_ELEKTRON_DEVICE_ID);
+      loopback_elektron_append_u8 (reply, 0);
+      loopback_elektron_append_string (reply, LOOPBACK_ELEKTRON_NAME);
+      break;
+    case 0x02:
+      loopback_elektron_append_u8 (reply, 1);
+      loopback_elektron_append_u32 (reply, 0);
+      loopback_elektron_append_string (reply, LOOPBACK_ELEKTRON_VERSION);
+      break;
+    case 0x03:
+      loopback_elektron_append_u32 (reply, LOOPBACK_ELEKTRON_UID);
+      break;
+    case 0x05:
+      loopback_elektron_storage_info (state, msg, reply);
+      break;
+    case 0x10:
+      loopback_elektron_sample_read_dir (state, msg, reply);
+      break;
+    case 0x11:
+    case 0x12:
+    case 0x20:
+    case 0x22:
+      loopback_elektron_path_op (state->samples, type, msg, reply);
+      break;
+    case 0x21:
+      loopback_elektron_src_dst_op (state->samples, type, msg, reply);
+      break;
+    case 0x30:
+      loopback_elektron_sample_open_reader (state, msg, reply);
+      break;
+    case 0x31:
+    case 0x41:
+    case 0x56:
+    case 0x59:
+      loopback_elektron_close (state, msg, reply);
+      break;
+    case 0x32:
+      loopback_elektron_sample_read (state, msg, reply);
+      break;
+    case 0x40:
+      loopback_elektron_sample_open_writer (state, msg, reply);
+      break;
+    case 0x42:
+      loopback_elektron_sample_write (state, msg, reply);
+      break;
+    case 0x53:
+      loopback_elektron_data_list (state, msg, reply);
+      break;
+    case 0x54:
+      loopback_elektron_data_read_open (state, msg, reply);
+      break;
+    case 0x55:
+      loopback_elektron_data_read_partial (state, msg, reply);
+      break;
+    case 0x57:
+      loopback_elektron_data_write_open (state, msg, reply);
+      break;
+    case 0x58:
+      loopback_elektron_data_write_partial (state, msg, reply);
+      break;
+    case 0x5a:
+    case 0x5b:
+    case 0x5d:
+      loopback_elektron_src_dst_op (state->data, type, msg, reply);
+      break;
+    case 0x5c:
+      loopback_elektron_path_op (state->data, type, msg, reply);
+      break;
+    default:
+      debug_print (1, "Unsupported loopback Elektron request 0x%02x", type);
+      loopback_elektron_append_status (reply, -ENOSYS);
+      break;
+    }
+
+  free_msg (msg);
+  loopback_elektron_send (device, reply);
+}
+
+static gpointer
+loopback_elektron_init (const gchar *dir)
+{
+  struct loopback_elektron_state *state =
+    g_malloc (sizeof (struct loopback_elektron_state));
+
+  state->samples = g_build_filename (dir, LOOPBACK_ELEKTRON_SAMPLES_DIR,
+				     NULL);
+  state->data = g_build_filename (dir, LOOPBACK_ELEKTRON_DATA_DIR, NULL);
+  state->seq = 0;
+  state->next_job_id = 1;
+  state->jobs = NULL;
+
+  g_mkdir_with_parents (state->samples, 0755);
+  for (const gchar **d = LOOPBACK_ELEKTRON_DATA_DIRS; *d; d++)
+    {
+      gchar *path = g_build_filename (state->data, *d, NULL);
+      g_mkdir_with_parents (path, 0755);
+      g_free (path);
+    }
+
+  return state;
+}
+
+static void
+loopback_elektron_free (gpointer data)
+{
+  struct loopback_elektron_state *state = data;
+
+  g_slist_free_full (state->jobs, loopback_elektron_job_free);
+  g_free (state->samples);
+  g_free (state->data);
+  g_free (state);
+}
+
+const struct loopback_model LOOPBACK_MODEL_ELEKTRON = {
+  .name = "elektron",
+  .device_name = "Elektron Digitakt (loopback)",
+  .identity = NULL,
+  .identity_len = 0,
+  .init = loopback_elektron_init,
+  .free = loopback_elektron_free,
+  .handle = loopback_elektron_handle
+};
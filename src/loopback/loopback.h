@@ -0,0 +1,80 @@
+/*
+ *   loopback.h
+ *   Copyright (C) 2026 David García Goñi <dagargo@gmail.com>
+ *
+ *   This file is part of Elektroid.
+ *
+ *   Elektroid is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   Elektroid is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with Elektroid. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LOOPBACK_H
+#define LOOPBACK_H
+
+#include "backend.h"
+
+#define LOOPBACK_DIR "/loopback"
+
+#define LOOPBACK_ENV_DIR "ELEKTROID_LOOPBACK_DIR"
+#define LOOPBACK_ENV_LATENCY "ELEKTROID_LOOPBACK_LATENCY_US"
+#define LOOPBACK_ENV_BANDWIDTH "ELEKTROID_LOOPBACK_BANDWIDTH"	//Bytes per second. 0 or unset means unlimited.
+#define LOOPBACK_ENV_REPLAY "ELEKTROID_LOOPBACK_REPLAY"	//Capture file served by the replay model.
+#define LOOPBACK_ENV_REPLAY_COPY "ELEKTROID_LOOPBACK_REPLAY_COPY"	//Comma separated request byte positions that are ignored when matching and copied into the replies.
+#define LOOPBACK_ENV_SCRIPT "ELEKTROID_LOOPBACK_SCRIPT"	//Script checked before the model handler.
+
+#define LOOPBACK_SCRIPT_FILE "script.txt"	//Used when there is no script in the environment.
+
+struct loopback_device;
+
+//The model state is persisted in the given directory so that it survives between connections.
+typedef gpointer (*t_loopback_init) (const gchar * dir);
+
+typedef void (*t_loopback_free) (gpointer state);
+
+//Called from the device thread for every received SysEx message. Replies must be sent with loopback_device_reply.
+typedef void (*t_loopback_handle) (struct loopback_device * device,
+				   gpointer state, const GByteArray * msg);
+
+struct loopback_model
+{
+  const gchar *name;		//Used as the device id and as the state directory name.
+  const gchar *device_name;	//This should match the connector regex.
+  const guint8 *identity;	//MIDI identity reply. If NULL, the identity request is passed to the handler.
+  guint identity_len;
+  t_loopback_init init;
+  t_loopback_free free;
+  t_loopback_handle handle;
+};
+
+void loopback_device_reply (struct loopback_device *device, GByteArray * msg);
+
+GByteArray *loopback_file_load (const gchar * path);
+
+gint loopback_file_save (const gchar * path, GByteArray * content);
+
+GSList *loopback_dir_list (const gchar * path);
+
+GSList *loopback_script_load (const gchar * path);
+
+gboolean loopback_script_handle (struct loopback_device *device,
+				 GSList * rules, const GByteArray * msg);
+
+void loopback_script_free (GSList * rules);
+
+extern const struct loopback_model LOOPBACK_MODEL_ELEKTRON;
+extern const struct loopback_model LOOPBACK_MODEL_SDS;
+extern const struct loopback_model LOOPBACK_MODEL_MICROFREAK;
+extern const struct loopback_model LOOPBACK_MODEL_REPLAY;
+extern const struct loopback_model LOOPBACK_MODEL_SCRIPT;
+
+#endif
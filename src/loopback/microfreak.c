@@ -0,0 +1,713 @@
+/*
+ *   microfreak.c
+ *   Copyright (C) 2026 David García Goñi <dagargo@gmail.com>
+ *
+ *   This file is part of Elektroid.
+ *
+ *   Elektroid is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   Elektroid is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with Elektroid. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <glib/gstdio.h>
+#include "loopback.h"
+
+// Reference model of an Arturia MicroFreak with firmware 5 covering presets and samples.
+// Presets are stored as the header followed by the data parts. Samples are stored as the 28 bytes header followed by the little endian data.
+// Wavetables are not modelled.
+
+#define LOOPBACK_MICROFREAK_PRESETS_DIR "presets"
+#define LOOPBACK_MICROFREAK_SAMPLES_DIR "samples"
+
+#define LOOPBACK_MICROFREAK_PRESET_HEADER_LEN 0x23
+#define LOOPBACK_MICROFREAK_PRESET_PARTS 146
+#define LOOPBACK_MICROFREAK_PRESET_PART_LEN 0x20
+#define LOOPBACK_MICROFREAK_PRESET_DATA_LEN (LOOPBACK_MICROFREAK_PRESET_PARTS * LOOPBACK_MICROFREAK_PRESET_PART_LEN)
+#define LOOPBACK_MICROFREAK_PRESET_NAME_POS 12
+#define LOOPBACK_MICROFREAK_PRESET_INIT 0x08
+
+#define LOOPBACK_MICROFREAK_SAMPLE_HEADER_LEN 28
+#define LOOPBACK_MICROFREAK_SAMPLE_SIZE_POS 4
+#define LOOPBACK_MICROFREAK_WAVE_MSG_SIZE 32
+#define LOOPBACK_MICROFREAK_WAVE_BLK_SIZE 28
+#define LOOPBACK_MICROFREAK_WAVE_BLK_LAST_SIZE 8
+#define LOOPBACK_MICROFREAK_BATCH_PACKETS 147
+#define LOOPBACK_MICROFREAK_SAMPLE_MEM_SIZE 0x00cd0000
+#define LOOPBACK_MICROFREAK_BYTES_PER_MS 64
+
+#define LOOPBACK_MICROFREAK_HEADER_LEN 9
+#define LOOPBACK_MICROFREAK_GET_PAYLOAD_LEN(msg) ((msg)->data[7])
+#define LOOPBACK_MICROFREAK_GET_OP(msg) ((msg)->data[8])
+#define LOOPBACK_MICROFREAK_GET_PAYLOAD(msg) (&(msg)->data[9])
+
+static const guint8 LOOPBACK_MICROFREAK_IDENTITY[] = {
+  0xf0, 0x7e, 0x7f, 0x06, 0x02, 0x00, 0x20, 0x6b, 0x06, 0x00, 0x06, 0x01,
+  0x05, 0x00, 0x00, 0x00, 0xf7
+};
+
+static const guint8 LOOPBACK_MICROFREAK_MSG_HEADER[] =
+  { 0xf0, 0, 0x20, 0x6b, 7, 1 };
+
+enum loopback_microfreak_mode
+{
+  LOOPBACK_MICROFREAK_MODE_NONE,
+  LOOPBACK_MICROFREAK_MODE_PRESET_READ,
+  LOOPBACK_MICROFREAK_MODE_PRESET_WRITE,
+  LOOPBACK_MICROFREAK_MODE_SAMPLE_HEADER,
+  LOOPBACK_MICROFREAK_MODE_SAMPLE_READ,
+  LOOPBACK_MICROFREAK_MODE_SAMPLE_ALLOC,
+  LOOPBACK_MICROFREAK_MODE_SAMPLE_RESET,
+  LOOPBACK_MICROFREAK_MODE_SAMPLE_WRITE
+};
+
+struct loopback_microfreak_state
+{
+  gchar *presets;
+  gchar *samples;
+  enum loopback_microfreak_mode mode;
+  guint id;
+  guint part;
+  GByteArray *object;		//Preset or sample being transferred.
+};
+
+static void
+loopback_microfreak_midi_msg_to_8bit_msg (const guint8 *msg_midi,
+					  guint8 *msg_8bit, guint input_size)
+{
+  guint8 *dst = msg_8bit;
+  const guint8 *src = msg_midi;
+
+  for (guint i = 0; i < input_size; i++)
+    {
+      guint8 bits = *src;
+      src++;
+      for (guint j = 0; j < 7 && i < input_size; j++, i++, src++, dst++)
+	{
+	  *dst = *src | (bits & 0x1 ? 0x80 : 0);
+	  bits >>= 1;
+	}
+    }
+}
+
+static void
+loopback_microfreak_8bit_msg_to_midi_msg (const guint8 *msg_8bit,
+					  guint8 *msg_midi, guint input_size)
+{
+  guint8 *dst = msg_midi;
+  const guint8 *src = msg_8bit;
+  guint8 *bits = NULL;
+  guint rem;
+
+  for (guint i = 0; i < input_size;)
+    {
+      bits = dst;
+      *bits = 0;
+      dst++;
+      for (guint j = 0; j < 7 && i < input_size; j++, i++, src++, dst++)
+	{
+	  *dst = *src & 0x7f;
+	  *bits |= *src & 0x80;
+	  *bits >>= 1;
+	}
+    }
+  rem = input_size % 7;
+  if (rem)
+    {
+      *bits >>= 7 - rem;
+    }
+}
+
+static gchar *
+loopback_microfreak_get_path (const gchar *dir, guint id)
+{
+  gchar name[LABEL_MAX];
+
+  snprintf (name, LABEL_MAX, "%03d", id);
+  return g_build_filename (dir, name, NULL);
+}
+
+static void
+loopback_microfreak_reply (struct loopback_device *device,
+			   const GByteArray *request, guint8 op,
+			   const guint8 *payload, guint8 len)
+{
+  GByteArray *reply = g_byte_array_sized_new (LOOPBACK_MICROFREAK_HEADER_LEN +
+					       len + 1);
+
+  g_byte_array_append (reply, LOOPBACK_MICROFREAK_MSG_HEADER,
+		       sizeof (LOOPBACK_MICROFREAK_MSG_HEADER));
+  g_byte_array_append (reply,
+		       &request->data[sizeof
+				      (LOOPBACK_MICROFREAK_MSG_HEADER)], 1);
+  g_byte_array_append (reply, &len, 1);
+  g_byte_array_append (reply, &op, 1);
+  if (len)
+    {
+      g_byte_array_append (reply, payload, len);
+    }
+  g_byte_array_append (reply, (guint8 *) "\xf7", 1);
+
+  loopback_device_reply (device, reply);
+}
+
+static void
+loopback_microfreak_reply_8bit (struct loopback_device *device,
+				const GByteArray *request, guint8 op,
+				const guint8 *msg_8bit)
+{
+  guint8 midi_msg[LOOPBACK_MICROFREAK_WAVE_MSG_SIZE];
+
+  loopback_microfreak_8bit_msg_to_midi_msg (msg_8bit, midi_msg,
+					    LOOPBACK_MICROFREAK_WAVE_BLK_SIZE);
+  loopback_microfreak_reply (device, request, op, midi_msg,
+			     LOOPBACK_MICROFREAK_WAVE_MSG_SIZE);
+}
+
+static void
+loopback_microfreak_set_object (struct loopback_microfreak_state *state,
+				GByteArray *object)
+{
+  if (state->object)
+    {
+      free_msg (state->object);
+    }
+  state->object = object;
+}
+
+//Empty presets are reported as init presets.
+
+static GByteArray *
+loopback_microfreak_preset_load (struct loopback_microfreak_state *state,
+				 guint id)
+{
+  gchar *path = loopback_microfreak_get_path (state->presets, id);
+  GByteArray *preset = loopback_file_load (path);
+
+  g_free (path);
+
+  if (!preset || preset->len < LOOPBACK_MICROFREAK_PRESET_HEADER_LEN)
+    {
+      if (preset)
+	{
+	  free_msg (preset);
+	}
+      preset = g_byte_array_sized_new (LOOPBACK_MICROFREAK_PRESET_HEADER_LEN);
+      g_byte_array_set_size (preset, LOOPBACK_MICROFREAK_PRESET_HEADER_LEN);
+      memset (preset->data, 0, LOOPBACK_MICROFREAK_PRESET_HEADER_LEN);
+      preset->data[0] = id >> 7;
+      preset->data[1] = id & 0x7f;
+      preset->data[3] = LOOPBACK_MICROFREAK_PRESET_INIT;
+      preset->data[8] = preset->data[1];
+      memcpy (&preset->data[LOOPBACK_MICROFREAK_PRESET_NAME_POS], "Init", 4);
+    }
+
+  return preset;
+}
+
+static void
+loopback_microfreak_preset_save (struct loopback_microfreak_state *state,
+				 guint id, GByteArray *preset)
+{
+  gchar *path = loopback_microfreak_get_path (state->presets, id);
+
+  loopback_file_save (path, preset);
+  g_free (path);
+}
+
+static GByteArray *
+loopback_microfreak_sample_load (struct loopback_microfreak_state *state,
+				 guint id)
+{
+  gchar *path = loopback_microfreak_get_path (state->samples, id);
+  GByteArray *sample = loopback_file_load (path);
+
+  g_free (path);
+
+  if (!sample || sample->len < LOOPBACK_MICROFREAK_SAMPLE_HEADER_LEN)
+    {
+      if (sample)
+	{
+	  free_msg (sample);
+	}
+      sample = g_byte_array_sized_new (LOOPBACK_MICROFREAK_SAMPLE_HEADER_LEN);
+      g_byte_array_set_size (sample, LOOPBACK_MICROFREAK_SAMPLE_HEADER_LEN);
+      memset (sample->data, 0, LOOPBACK_MICROFREAK_SAMPLE_HEADER_LEN);
+      sample->data[LOOPBACK_MICROFREAK_SAMPLE_HEADER_LEN - 5] = id;
+    }
+
+  return sample;
+}
+
+static guint32
+loopback_microfreak_sample_get_size (const guint8 *header)
+{
+  guint32 size;
+
+  memcpy (&size, &header[LOOPBACK_MICROFREAK_SAMPLE_SIZE_POS],
+	  sizeof (guint32));
+  return GUINT32_FROM_LE (size);
+}
+
+static guint64
+loopback_microfreak_get_used_memory (struct loopback_microfreak_state *state)
+{
+  guint64 used = 0;
+  GSList *names = loopback_dir_list (state->samples);
+
+  for (GSList *e = names; e; e = e->next)
+    {
+      GByteArray *sample = loopback_microfreak_sample_load (state,
+							    atoi (e->data));
+      used += loopback_microfreak_sample_get_size (sample->data);
+      free_msg (sample);
+    }
+  g_slist_free_full (names, g_free);
+
+  return used;
+}
+
+static void
+loopback_microfreak_storage (struct loopback_device *device,
+			     struct loopback_microfreak_state *state,
+			     const GByteArray *msg)
+{
+  guint8 payload[9];
+  guint units = loopback_microfreak_get_used_memory (state) /
+    LOOPBACK_MICROFREAK_BYTES_PER_MS / 4;
+  guint8 lsb = units & 0xff;
+  guint8 msb = (units >> 8) & 0xff;
+
+  memset (payload, 0, sizeof (payload));
+  payload[2] = (lsb & 0x80 ? 0x08 : 0) | (msb & 0x80 ? 0x04 : 0);
+  payload[6] = lsb & 0x7f;
+  payload[7] = msb & 0x7f;
+
+  loopback_microfreak_reply (device, msg, 0x48, payload, sizeof (payload));
+}
+
+static void
+loopback_microfreak_preset_read (struct loopback_device *device,
+				 struct loopback_microfreak_state *state,
+				 const GByteArray *msg)
+{
+  GByteArray *preset;
+  guint8 *payload = LOOPBACK_MICROFREAK_GET_PAYLOAD (msg);
+  guint id = (payload[0] << 7) | payload[1];
+
+  preset = loopback_microfreak_preset_load (state, id);
+
+  if (payload[2])
+    {
+      if (preset->len < LOOPBACK_MICROFREAK_PRESET_HEADER_LEN +
+	  LOOPBACK_MICROFREAK_PRESET_DATA_LEN)
+	{
+	  g_byte_array_set_size (preset,
+				 LOOPBACK_MICROFREAK_PRESET_HEADER_LEN +
+				 LOOPBACK_MICROFREAK_PRESET_DATA_LEN);
+	}
+      loopback_microfreak_set_object (state, preset);
+      state->mode = LOOPBACK_MICROFREAK_MODE_PRESET_READ;
+      state->part = 0;
+      loopback_microfreak_reply (device, msg, 0x15, NULL, 0);
+    }
+  else
+    {
+      loopback_microfreak_reply (device, msg, 0x52, preset->data,
+				 LOOPBACK_MICROFREAK_PRESET_HEADER_LEN);
+      free_msg (preset);
+    }
+}
+
+//A header is stored as soon as it is received as renaming a preset does not send any data part.
+
+static void
+loopback_microfreak_preset_write (struct loopback_device *device,
+				  struct loopback_microfreak_state *state,
+				  const GByteArray *msg)
+{
+  GByteArray *preset;
+  guint8 *payload = LOOPBACK_MICROFREAK_GET_PAYLOAD (msg);
+  guint id = (payload[0] << 7) | payload[1];
+
+  if (LOOPBACK_MICROFREAK_GET_PAYLOAD_LEN (msg) ==
+      LOOPBACK_MICROFREAK_PRESET_HEADER_LEN)
+    {
+      preset = loopback_microfreak_preset_load (state, id);
+      memcpy (preset->data, payload, LOOPBACK_MICROFREAK_PRESET_HEADER_LEN);
+      loopback_microfreak_preset_save (state, id, preset);
+      free_msg (preset);
+    }
+  else
+    {
+      preset = g_byte_array_sized_new (LOOPBACK_MICROFREAK_PRESET_HEADER_LEN +
+				       LOOPBACK_MICROFREAK_PRESET_DATA_LEN);
+      loopback_microfreak_set_object (state, preset);
+      state->mode = LOOPBACK_MICROFREAK_MODE_PRESET_WRITE;
+      state->id = id;
+      state->part = 0;
+    }
+
+  loopback_microfreak_reply (device, msg, 0x18, NULL, 0);
+}
+
+static void
+loopback_microfreak_preset_write_part (struct loopback_device *device,
+				       struct loopback_microfreak_state
+				       *state, const GByteArray *msg)
+{
+  GByteArray *preset;
+  guint8 op = LOOPBACK_MICROFREAK_GET_OP (msg);
+
+  if (state->part == 0)
+    {
+      GByteArray *stored = loopback_microfreak_preset_load (state, state->id);
+      g_byte_array_append (state->object, stored->data,
+			   LOOPBACK_MICROFREAK_PRESET_HEADER_LEN);
+      state->object->data[3] &= ~LOOPBACK_MICROFREAK_PRESET_INIT;
+      free_msg (stored);
+    }
+
+  g_byte_array_append (state->object, LOOPBACK_MICROFREAK_GET_PAYLOAD (msg),
+		       LOOPBACK_MICROFREAK_PRESET_PART_LEN);
+  state->part++;
+
+  if (op == 0x17)
+    {
+      preset = state->object;
+      state->object = NULL;
+      loopback_microfreak_preset_save (state, state->id, preset);
+      free_msg (preset);
+      state->mode = LOOPBACK_MICROFREAK_MODE_NONE;
+    }
+
+  loopback_microfreak_reply (device, msg, 0x18, NULL, 0);
+}
+
+static void
+loopback_microfreak_sample_read (struct loopback_device *device,
+				 struct loopback_microfreak_state *state,
+				 const GByteArray *msg)
+{
+  guint8 *payload = LOOPBACK_MICROFREAK_GET_PAYLOAD (msg);
+
+  state->id = payload[0];
+  state->part = 0;
+  state->mode = payload[2] ? LOOPBACK_MICROFREAK_MODE_SAMPLE_READ :
+    LOOPBACK_MICROFREAK_MODE_SAMPLE_HEADER;
+  loopback_microfreak_set_object (state,
+				  loopback_microfreak_sample_load (state,
+								   state->id));
+
+  loopback_microfreak_reply (device, msg, 0x15, NULL, 0);
+}
+
+static void
+loopback_microfreak_sample_read_packet (struct loopback_device *device,
+					struct loopback_microfreak_state
+					*state, const GByteArray *msg)
+{
+  guint8 blk[LOOPBACK_MICROFREAK_WAVE_BLK_SIZE];
+  guint len, offset;
+  gboolean last;
+
+  if (state->mode == LOOPBACK_MICROFREAK_MODE_SAMPLE_HEADER)
+    {
+      loopback_microfreak_reply_8bit (device, msg, 0x16,
+				      state->object->data);
+      state->mode = LOOPBACK_MICROFREAK_MODE_NONE;
+      return;
+    }
+
+  last = state->part == LOOPBACK_MICROFREAK_BATCH_PACKETS - 1;
+  len = last ? LOOPBACK_MICROFREAK_WAVE_BLK_LAST_SIZE :
+    LOOPBACK_MICROFREAK_WAVE_BLK_SIZE;
+  offset = LOOPBACK_MICROFREAK_SAMPLE_HEADER_LEN +
+    state->part * LOOPBACK_MICROFREAK_WAVE_BLK_SIZE;
+
+  memset (blk, 0, sizeof (blk));
+  if (offset < state->object->len)
+    {
+      guint available = state->object->len - offset;
+      memcpy (blk, &state->object->data[offset],
+	      available < len ? available : len);
+    }
+
+  loopback_microfreak_reply_8bit (device, msg, last ? 0x17 : 0x16, blk);
+
+  state->part++;
+  if (last)
+    {
+      state->mode = LOOPBACK_MICROFREAK_MODE_NONE;
+    }
+}
+
+static void
+loopback_microfreak_sample_set_header (struct loopback_device *device,
+				       struct loopback_microfreak_state
+				       *state, const GByteArray *msg)
+{
+  gchar *path;
+  guint8 result;
+  GByteArray *sample;
+  guint8 header[LOOPBACK_MICROFREAK_WAVE_BLK_SIZE];
+  guint32 size;
+
+  loopback_microfreak_midi_msg_to_8bit_msg (LOOPBACK_MICROFREAK_GET_PAYLOAD
+					    (msg), header,
+					    LOOPBACK_MICROFREAK_WAVE_MSG_SIZE);
+  size = loopback_microfreak_sample_get_size (header);
+  path = loopback_microfreak_get_path (state->samples, state->id);
+
+  if (state->mode == LOOPBACK_MICROFREAK_MODE_SAMPLE_ALLOC)
+    {
+      sample = loopback_microfreak_sample_load (state, state->id);
+      result = loopback_microfreak_get_used_memory (state) -
+	loopback_microfreak_sample_get_size (sample->data) + size <=
+	LOOPBACK_MICROFREAK_SAMPLE_MEM_SIZE;
+      free_msg (sample);
+      loopback_microfreak_reply (device, msg, 0x16, &result, 1);
+    }
+  else if (!size)
+    {
+      g_unlink (path);
+    }
+  else
+    {
+      //The data is sent later in batches.
+      sample = g_byte_array_sized_new (LOOPBACK_MICROFREAK_SAMPLE_HEADER_LEN +
+				       size);
+      g_byte_array_append (sample, header,
+			   LOOPBACK_MICROFREAK_SAMPLE_HEADER_LEN);
+      loopback_file_save (path, sample);
+      free_msg (sample);
+    }
+
+  g_free (path);
+  state->mode = LOOPBACK_MICROFREAK_MODE_NONE;
+  loopback_microfreak_reply (device, msg, 0x18, NULL, 0);
+}
+
+static void
+loopback_microfreak_sample_write_packet (struct loopback_device *device,
+					 struct loopback_microfreak_state
+					 *state, const GByteArray *msg)
+{
+  guint8 blk[LOOPBACK_MICROFREAK_WAVE_BLK_SIZE];
+  guint8 op = LOOPBACK_MICROFREAK_GET_OP (msg);
+  guint32 size = loopback_microfreak_sample_get_size (state->object->data);
+  guint32 len = op == 0x17 ? LOOPBACK_MICROFREAK_WAVE_BLK_LAST_SIZE :
+    LOOPBACK_MICROFREAK_WAVE_BLK_SIZE;
+  guint32 written = state->object->len - LOOPBACK_MICROFREAK_SAMPLE_HEADER_LEN;
+
+  loopback_microfreak_midi_msg_to_8bit_msg (LOOPBACK_MICROFREAK_GET_PAYLOAD
+					    (msg), blk,
+					    LOOPBACK_MICROFREAK_WAVE_MSG_SIZE);
+
+  //The last batch is padded with zeros.
+  if (written + len > size)
+    {
+      len = written < size ? size - written : 0;
+    }
+  g_byte_array_append (state->object, blk, len);
+
+  if (op == 0x17)
+    {
+      gchar *path = loopback_microfreak_get_path (state->samples, state->id);
+      loopback_file_save (path, state->object);
+      g_free (path);
+      state->mode = LOOPBACK_MICROFREAK_MODE_NONE;
+    }
+
+  loopback_microfreak_reply (device, msg, 0x18, NULL, 0);
+}
+
+static void
+loopback_microfreak_sample_op (struct loopback_device *device,
+			       struct loopback_microfreak_state *state,
+			       const GByteArray *msg)
+{
+  guint8 op = LOOPBACK_MICROFREAK_GET_OP (msg);
+
+  state->id = LOOPBACK_MICROFREAK_GET_PAYLOAD (msg)[0];
+
+  switch (op)
+    {
+    case 0x58:
+      state->mode = LOOPBACK_MICROFREAK_MODE_SAMPLE_WRITE;
+      loopback_microfreak_set_object (state,
+				      loopback_microfreak_sample_load (state,
+								       state->id));
+      break;
+    case 0x5a:
+      state->mode = LOOPBACK_MICROFREAK_MODE_SAMPLE_RESET;
+      break;
+    case 0x5d:
+      state->mode = LOOPBACK_MICROFREAK_MODE_SAMPLE_ALLOC;
+      break;
+    }
+
+  loopback_microfreak_reply (device, msg, 0x18, NULL, 0);
+}
+
+static void
+loopback_microfreak_handle (struct loopback_device *device, gpointer data,
+			    const GByteArray *msg)
+{
+  guint8 op;
+  struct loopback_microfreak_state *state = data;
+
+  if (msg->len < LOOPBACK_MICROFREAK_HEADER_LEN + 1 ||
+      memcmp (msg->data, LOOPBACK_MICROFREAK_MSG_HEADER,
+	      sizeof (LOOPBACK_MICROFREAK_MSG_HEADER)) ||
+      msg->len < LOOPBACK_MICROFREAK_HEADER_LEN +
+      LOOPBACK_MICROFREAK_GET_PAYLOAD_LEN (msg) + 1)
+    {
+      return;
+    }
+
+  op = LOOPBACK_MICROFREAK_GET_OP (msg);
+
+  switch (op)
+    {
+    case 0x15:
+      loopback_microfreak_reply (device, msg, 0x18, NULL, 0);
+      return;
+    case 0x16:
+    case 0x17:
+      if (state->mode == LOOPBACK_MICROFREAK_MODE_PRESET_WRITE &&
+	  LOOPBACK_MICROFREAK_GET_PAYLOAD_LEN (msg) ==
+	  LOOPBACK_MICROFREAK_PRESET_PART_LEN)
+	{
+	  loopback_microfreak_preset_write_part (device, state, msg);
+	  return;
+	}
+      if (state->mode == LOOPBACK_MICROFREAK_MODE_SAMPLE_WRITE &&
+	  LOOPBACK_MICROFREAK_GET_PAYLOAD_LEN (msg) ==
+	  LOOPBACK_MICROFREAK_WAVE_MSG_SIZE)
+	{
+	  loopback_microfreak_sample_write_packet (device, state, msg);
+	  return;
+	}
+      if (op == 0x17 && LOOPBACK_MICROFREAK_GET_PAYLOAD_LEN (msg) ==
+	  LOOPBACK_MICROFREAK_WAVE_MSG_SIZE &&
+	  (state->mode == LOOPBACK_MICROFREAK_MODE_SAMPLE_ALLOC ||
+	   state->mode == LOOPBACK_MICROFREAK_MODE_SAMPLE_RESET))
+	{
+	  loopback_microfreak_sample_set_header (device, state, msg);
+	  return;
+	}
+      break;
+    case 0x18:
+      if (state->mode == LOOPBACK_MICROFREAK_MODE_PRESET_READ)
+	{
+	  gboolean last = state->part == LOOPBACK_MICROFREAK_PRESET_PARTS - 1;
+	  loopback_microfreak_reply (device, msg, last ? 0x17 : 0x16,
+				     &state->object->data
+				     [LOOPBACK_MICROFREAK_PRESET_HEADER_LEN +
+				      state->part *
+				      LOOPBACK_MICROFREAK_PRESET_PART_LEN],
+				     LOOPBACK_MICROFREAK_PRESET_PART_LEN);
+	  state->part++;
+	  if (last)
+	    {
+	      state->mode = LOOPBACK_MICROFREAK_MODE_NONE;
+	    }
+	  return;
+	}
+      if (state->mode == LOOPBACK_MICROFREAK_MODE_SAMPLE_HEADER ||
+	  state->mode == LOOPBACK_MICROFREAK_MODE_SAMPLE_READ)
+	{
+	  loopback_microfreak_sample_read_packet (device, state, msg);
+	  return;
+	}
+      break;
+    case 0x19:
+      if (LOOPBACK_MICROFREAK_GET_PAYLOAD_LEN (msg) == 3)
+	{
+	  loopback_microfreak_preset_read (device, state, msg);
+	  return;
+	}
+      break;
+    case 0x47:
+      loopback_microfreak_storage (device, state, msg);
+      return;
+    case 0x49:
+      loopback_microfreak_reply (device, msg, 0x18, NULL, 0);
+      return;
+    case 0x52:
+      if (LOOPBACK_MICROFREAK_GET_PAYLOAD_LEN (msg) == 3 ||
+	  LOOPBACK_MICROFREAK_GET_PAYLOAD_LEN (msg) ==
+	  LOOPBACK_MICROFREAK_PRESET_HEADER_LEN)
+	{
+	  loopback_microfreak_preset_write (device, state, msg);
+	  return;
+	}
+      break;
+    case 0x5b:
+      if (LOOPBACK_MICROFREAK_GET_PAYLOAD_LEN (msg) == 3)
+	{
+	  loopback_microfreak_sample_read (device, state, msg);
+	  return;
+	}
+      break;
+    case 0x58:
+    case 0x5a:
+    case 0x5d:
+      if (LOOPBACK_MICROFREAK_GET_PAYLOAD_LEN (msg) == 3)
+	{
+	  loopback_microfreak_sample_op (device, state, msg);
+	  return;
+	}
+      break;
+    }
+
+  debug_print (1, "Unsupported loopback MicroFreak operation 0x%02x", op);
+}
+
+static gpointer
+loopback_microfreak_init (const gchar *dir)
+{
+  struct loopback_microfreak_state *state =
+    g_malloc0 (sizeof (struct loopback_microfreak_state));
+
+  state->presets = g_build_filename (dir, LOOPBACK_MICROFREAK_PRESETS_DIR,
+				     NULL);
+  state->samples = g_build_filename (dir, LOOPBACK_MICROFREAK_SAMPLES_DIR,
+				     NULL);
+  state->mode = LOOPBACK_MICROFREAK_MODE_NONE;
+
+  g_mkdir_with_parents (state->presets, 0755);
+  g_mkdir_with_parents (state->samples, 0755);
+
+  return state;
+}
+
+static void
+loopback_microfreak_free (gpointer data)
+{
+  struct loopback_microfreak_state *state = data;
+
+  loopback_microfreak_set_object (state, NULL);
+  g_free (state->presets);
+  g_free (state->samples);
+  g_free (state);
+}
+
+const struct loopback_model LOOPBACK_MODEL_MICROFREAK = {
+  .name = "microfreak",
+  .device_name = "Arturia MicroFreak (loopback)",
+  .identity = LOOPBACK_MICROFREAK_IDENTITY,
+  .identity_len = sizeof (LOOPBACK_MICROFREAK_IDENTITY),
+  .init = loopback_microfreak_init,
+  .free = loopback_microfreak_free,
+  .handle = loopback_microfreak_handle
+};
@@ -0,0 +1,210 @@
+/*
+ *   replay.c
+ *   Copyright (C) 2026 David García Goñi <dagargo@gmail.com>
+ *
+ *   This file is part of Elektroid.
+ *
+ *   Elektroid is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   Elektroid is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with Elektroid. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "loopback.h"
+
+// Model that serves the replies recorded in a capture file.
+// Every received message is looked up among the recorded requests starting after the last matched one and the replies that followed it are sent with the recorded timing.
+// As the lookup wraps around, retries and repeated requests are served too. Unknown requests are not answered, just as a real device would do.
+// Bytes that change between sessions, like sequence numbers, can be ignored when matching. These are copied from the request into the replies.
+
+#define LOOPBACK_REPLAY_FILE "session.cap"
+
+struct loopback_replay_state
+{
+  GPtrArray *records;
+  guint next;
+  GArray *copy;			//Request byte positions.
+};
+
+static gboolean
+loopback_replay_is_copied (struct loopback_replay_state *state, guint pos)
+{
+  for (guint i = 0; i < state->copy->len; i++)
+    {
+      if (g_array_index (state->copy, guint, i) == pos)
+	{
+	  return TRUE;
+	}
+    }
+  return FALSE;
+}
+
+static gboolean
+loopback_replay_match (struct loopback_replay_state *state,
+		       GByteArray *recorded, const GByteArray *msg)
+{
+  if (recorded->len != msg->len)
+    {
+      return FALSE;
+    }
+
+  for (guint i = 0; i < msg->len; i++)
+    {
+      if (recorded->data[i] != msg->data[i] &&
+	  !loopback_replay_is_copied (state, i))
+	{
+	  return FALSE;
+	}
+    }
+
+  return TRUE;
+}
+
+static gint
+loopback_replay_find (struct loopback_replay_state *state,
+		      const GByteArray *msg)
+{
+  struct backend_capture_record *record;
+  guint len = state->records->len;
+
+  for (guint i = 0; i < len; i++)
+    {
+      guint index = (state->next + i) % len;
+      record = g_ptr_array_index (state->records, index);
+      if (record->dir == BE_CAPTURE_TX &&
+	  loopback_replay_match (state, record->data, msg))
+	{
+	  return index;
+	}
+    }
+
+  return -1;
+}
+
+static void
+loopback_replay_handle (struct loopback_device *device, gpointer data,
+			const GByteArray *msg)
+{
+  gint index;
+  gint64 start, diff;
+  GByteArray *reply;
+  struct backend_capture_record *request, *record;
+  struct loopback_replay_state *state = data;
+
+  index = loopback_replay_find (state, msg);
+  if (index < 0)
+    {
+      debug_print (1, "Request not found in the capture");
+      return;
+    }
+
+  start = g_get_monotonic_time ();
+  request = g_ptr_array_index (state->records, index);
+
+  for (index++; index < state->records->len; index++)
+    {
+      record = g_ptr_array_index (state->records, index);
+      if (record->dir == BE_CAPTURE_TX)
+	{
+	  break;
+	}
+
+      diff = start + record->time - request->time - g_get_monotonic_time ();
+      if (diff > 0)
+	{
+	  g_usleep (diff);
+	}
+
+      reply = g_byte_array_sized_new (record->data->len);
+      g_byte_array_append (reply, record->data->data, record->data->len);
+      for (guint i = 0; i < state->copy->len; i++)
+	{
+	  guint pos = g_array_index (state->copy, guint, i);
+	  if (pos < reply->len)
+	    {
+	      reply->data[pos] = msg->data[pos];
+	    }
+	}
+      loopback_device_reply (device, reply);
+    }
+
+  state->next = index % state->records->len;
+}
+
+static gpointer
+loopback_replay_init (const gchar *dir)
+{
+  guint pos;
+  gchar *path, **positions;
+  GSList *records;
+  const gchar *env_file = g_getenv (LOOPBACK_ENV_REPLAY);
+  const gchar *env_copy = g_getenv (LOOPBACK_ENV_REPLAY_COPY);
+  struct loopback_replay_state *state =
+    g_malloc (sizeof (struct loopback_replay_state));
+
+  if (env_file)
+    {
+      path = g_strdup (env_file);
+    }
+  else
+    {
+      path = g_build_filename (dir, LOOPBACK_REPLAY_FILE, NULL);
+    }
+
+  //A truncated capture is still useful up to the last complete record.
+  backend_capture_load (path, &records);
+  g_free (path);
+
+  state->records = g_ptr_array_new_with_free_func
+    (backend_capture_record_free);
+  for (GSList *e = records; e; e = e->next)
+    {
+      g_ptr_array_add (state->records, e->data);
+    }
+  g_slist_free (records);
+  state->next = 0;
+
+  state->copy = g_array_new (FALSE, FALSE, sizeof (guint));
+  if (env_copy)
+    {
+      positions = g_strsplit (env_copy, ",", -1);
+      for (gchar ** p = positions; *p; p++)
+	{
+	  pos = g_ascii_strtoull (*p, NULL, 10);
+	  g_array_append_val (state->copy, pos);
+	}
+      g_strfreev (positions);
+    }
+
+  return state;
+}
+
+static void
+loopback_replay_free (gpointer data)
+{
+  struct loopback_replay_state *state = data;
+
+  g_ptr_array_free (state->records, TRUE);
+  g_array_free (state->copy, TRUE);
+  g_free (state);
+}
+
+//The identity reply is served from the capture too.
+
+const struct loopback_model LOOPBACK_MODEL_REPLAY = {
+  .name = "replay",
+  .device_name = "Session replay (loopback)",
+  .identity = NULL,
+  .identity_len = 0,
+  .init = loopback_replay_init,
+  .free = loopback_replay_free,
+  .handle = loopback_replay_handle
+};
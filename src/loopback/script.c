@@ -0,0 +1,345 @@
+/*
+ *   script.c
+ *   Copyright (C) 2026 David García Goñi <dagargo@gmail.com>
+ *
+ *   This file is part of Elektroid.
+ *
+ *   Elektroid is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   Elektroid is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with Elektroid. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "loopback.h"
+
+// Scripted replies. Every line of a script is a rule with a request pattern and the replies to it separated by '->'.
+// Request pattern tokens are hexadecimal bytes, '??' for any byte and '*' for any number of bytes.
+// Replies are separated by '|'. Their tokens are hexadecimal bytes, '$N' to copy the byte N of the request and '+N' to wait N ms before sending the reply.
+// A rule without replies swallows the request. The first matching rule is used and empty lines and lines starting with '#' are ignored.
+// Example: "f0 7e ?? 06 01 f7 -> f0 7e $2 06 02 00 20 3c 0c 00 00 00 00 00 00 f7"
+
+enum loopback_script_token_type
+{
+  LOOPBACK_SCRIPT_BYTE,
+  LOOPBACK_SCRIPT_ANY,
+  LOOPBACK_SCRIPT_REST,
+  LOOPBACK_SCRIPT_COPY,
+  LOOPBACK_SCRIPT_WAIT
+};
+
+struct loopback_script_token
+{
+  enum loopback_script_token_type type;
+  guint value;
+};
+
+struct loopback_script_rule
+{
+  GArray *pattern;
+  GSList *replies;		//GArray of tokens.
+};
+
+static void
+loopback_script_free_tokens (gpointer data)
+{
+  g_array_free (data, TRUE);
+}
+
+static void
+loopback_script_free_rule (gpointer data)
+{
+  struct loopback_script_rule *rule = data;
+  g_array_free (rule->pattern, TRUE);
+  g_slist_free_full (rule->replies, loopback_script_free_tokens);
+  g_free (rule);
+}
+
+void
+loopback_script_free (GSList *rules)
+{
+  g_slist_free_full (rules, loopback_script_free_rule);
+}
+
+static GArray *
+loopback_script_parse_tokens (const gchar *text, gboolean reply)
+{
+  gchar *end;
+  gchar **tokens, **t;
+  GArray *array;
+  struct loopback_script_token token;
+
+  array = g_array_new (FALSE, FALSE, sizeof (struct loopback_script_token));
+  tokens = g_strsplit_set (g_strstrip ((gchar *) text), " \t", -1);
+
+  for (t = tokens; *t; t++)
+    {
+      if (!**t)
+	{
+	  continue;
+	}
+
+      if (!reply && !strcmp (*t, "??"))
+	{
+	  token.type = LOOPBACK_SCRIPT_ANY;
+	  token.value = 0;
+	}
+      else if (!reply && !strcmp (*t, "*"))
+	{
+	  token.type = LOOPBACK_SCRIPT_REST;
+	  token.value = 0;
+	}
+      else if (reply && (**t == '$' || **t == '+'))
+	{
+	  token.type = **t == '$' ? LOOPBACK_SCRIPT_COPY :
+	    LOOPBACK_SCRIPT_WAIT;
+	  token.value = g_ascii_strtoull (*t + 1, &end, 10);
+	  if (*end)
+	    {
+	      goto error;
+	    }
+	}
+      else
+	{
+	  token.type = LOOPBACK_SCRIPT_BYTE;
+	  token.value = g_ascii_strtoull (*t, &end, 16);
+	  if (*end || token.value > 0xff)
+	    {
+	      goto error;
+	    }
+	}
+
+      g_array_append_val (array, token);
+    }
+
+  g_strfreev (tokens);
+  return array;
+
+error:
+  error_print ("Invalid script token '%s'", *t);
+  g_strfreev (tokens);
+  g_array_free (array, TRUE);
+  return NULL;
+}
+
+static struct loopback_script_rule *
+loopback_script_parse_rule (const gchar *line)
+{
+  gchar **parts, **replies;
+  GArray *reply;
+  struct loopback_script_rule *rule;
+
+  parts = g_strsplit (line, "->", 2);
+  if (!parts[0] || !parts[1])
+    {
+      error_print ("Invalid script rule '%s'", line);
+      g_strfreev (parts);
+      return NULL;
+    }
+
+  rule = g_malloc (sizeof (struct loopback_script_rule));
+  rule->replies = NULL;
+  rule->pattern = loopback_script_parse_tokens (parts[0], FALSE);
+  if (!rule->pattern)
+    {
+      g_free (rule);
+      g_strfreev (parts);
+      return NULL;
+    }
+
+  replies = g_strsplit (parts[1], "|", -1);
+  for (gchar ** r = replies; *r; r++)
+    {
+      reply = loopback_script_parse_tokens (*r, TRUE);
+      if (!reply)
+	{
+	  loopback_script_free_rule (rule);
+	  rule = NULL;
+	  break;
+	}
+
+      if (reply->len)
+	{
+	  rule->replies = g_slist_append (rule->replies, reply);
+	}
+      else
+	{
+	  g_array_free (reply, TRUE);
+	}
+    }
+
+  g_strfreev (replies);
+  g_strfreev (parts);
+
+  return rule;
+}
+
+//Returns the rules in the file or NULL if there are none or the file is not valid.
+
+GSList *
+loopback_script_load (const gchar *path)
+{
+  gchar *text, **lines;
+  GSList *rules = NULL;
+  struct loopback_script_rule *rule;
+
+  if (!g_file_get_contents (path, &text, NULL, NULL))
+    {
+      return NULL;
+    }
+
+  lines = g_strsplit (text, "\n", -1);
+  g_free (text);
+
+  for (gchar ** l = lines; *l; l++)
+    {
+      gchar *line = g_strstrip (*l);
+
+      if (!*line || *line == '#')
+	{
+	  continue;
+	}
+
+      rule = loopback_script_parse_rule (line);
+      if (!rule)
+	{
+	  loopback_script_free (rules);
+	  rules = NULL;
+	  break;
+	}
+
+      rules = g_slist_append (rules, rule);
+    }
+
+  g_strfreev (lines);
+
+  debug_print (1, "%d script rules loaded from %s", g_slist_length (rules),
+	       path);
+
+  return rules;
+}
+
+static gboolean
+loopback_script_match (GArray *pattern, const GByteArray *msg)
+{
+  guint i;
+  struct loopback_script_token *token;
+
+  for (i = 0; i < pattern->len; i++)
+    {
+      token = &g_array_index (pattern, struct loopback_script_token, i);
+
+      if (token->type == LOOPBACK_SCRIPT_REST)
+	{
+	  return TRUE;
+	}
+
+      if (i >= msg->len)
+	{
+	  return FALSE;
+	}
+
+      if (token->type == LOOPBACK_SCRIPT_BYTE && token->value != msg->data[i])
+	{
+	  return FALSE;
+	}
+    }
+
+  return i == msg->len;
+}
+
+static void
+loopback_script_reply (struct loopback_device *device, GArray *tokens,
+		       const GByteArray *msg)
+{
+  guint8 byte;
+  GByteArray *reply = g_byte_array_new ();
+  struct loopback_script_token *token;
+
+  for (guint i = 0; i < tokens->len; i++)
+    {
+      token = &g_array_index (tokens, struct loopback_script_token, i);
+      switch (token->type)
+	{
+	case LOOPBACK_SCRIPT_WAIT:
+	  g_usleep (token->value * G_TIME_SPAN_MILLISECOND);
+	  continue;
+	case LOOPBACK_SCRIPT_COPY:
+	  byte = token->value < msg->len ? msg->data[token->value] : 0;
+	  break;
+	default:
+	  byte = token->value;
+	}
+      g_byte_array_append (reply, &byte, 1);
+    }
+
+  if (reply->len)
+    {
+      loopback_device_reply (device, reply);
+    }
+  else
+    {
+      free_msg (reply);
+    }
+}
+
+//Returns TRUE if a rule handled the message.
+
+gboolean
+loopback_script_handle (struct loopback_device *device, GSList *rules,
+			const GByteArray *msg)
+{
+  struct loopback_script_rule *rule;
+
+  for (GSList * e = rules; e; e = e->next)
+    {
+      rule = e->data;
+      if (loopback_script_match (rule->pattern, msg))
+	{
+	  for (GSList * r = rule->replies; r; r = r->next)
+	    {
+	      loopback_script_reply (device, r->data, msg);
+	    }
+	  return TRUE;
+	}
+    }
+
+  return FALSE;
+}
+
+//This model only answers through the script.
+
+static gpointer
+loopback_script_init (const gchar *dir)
+{
+  return NULL;
+}
+
+static void
+loopback_script_model_free (gpointer data)
+{
+}
+
+static void
+loopback_script_model_handle (struct loopback_device *device, gpointer data,
+			      const GByteArray *msg)
+{
+  debug_print (1, "Request not found in the script");
+}
+
+const struct loopback_model LOOPBACK_MODEL_SCRIPT = {
+  .name = "script",
+  .device_name = "Scripted device (loopback)",
+  .identity = NULL,
+  .identity_len = 0,
+  .init = loopback_script_init,
+  .free = loopback_script_model_free,
+  .handle = loopback_script_model_handle
+};
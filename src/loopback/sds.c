@@ -0,0 +1,434 @@
+/*
+ *   sds.c
+ *   Copyright (C) 2026 David García Goñi <dagargo@gmail.com>
+ *
+ *   This file is part of Elektroid.
+ *
+ *   Elektroid is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   Elektroid is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with Elektroid. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "loopback.h"
+
+// Reference model of a MIDI SDS sampler with the sample name and loop point extensions.
+// Every sample is stored as received, i.e., the dump header followed by the data packets, and its name is stored in a separate file.
+
+#define LOOPBACK_SDS_SAMPLE_LIMIT 1000
+#define LOOPBACK_SDS_HEADER_LEN 21
+#define LOOPBACK_SDS_PACKET_LEN 127
+#define LOOPBACK_SDS_PACKET_PAYLOAD_LEN 120
+#define LOOPBACK_SDS_PACKET_CKSUM_POS 125
+
+#define LOOPBACK_SDS_DUMP_HEADER 0x01
+#define LOOPBACK_SDS_DATA_PACKET 0x02
+#define LOOPBACK_SDS_DUMP_REQUEST 0x03
+#define LOOPBACK_SDS_EXTENSION 0x05
+#define LOOPBACK_SDS_WAIT 0x7c
+#define LOOPBACK_SDS_CANCEL 0x7d
+#define LOOPBACK_SDS_NAK 0x7e
+#define LOOPBACK_SDS_ACK 0x7f
+
+#define LOOPBACK_SDS_EXT_LOOP_POINT 0x02
+#define LOOPBACK_SDS_EXT_NAME 0x03
+#define LOOPBACK_SDS_EXT_NAME_REQUEST 0x04
+
+struct loopback_sds_state
+{
+  gchar *dir;
+  //Upload
+  GByteArray *upload;
+  guint upload_id;
+  guint upload_packets;
+  guint upload_packet;
+  //Download
+  GByteArray *download;
+  guint download_packets;
+  guint download_packet;
+};
+
+static gchar *
+loopback_sds_get_path (struct loopback_sds_state *state, guint id,
+		       const gchar *ext)
+{
+  gchar name[LABEL_MAX];
+
+  snprintf (name, LABEL_MAX, "%03d.%s", id, ext);
+  return g_build_filename (state->dir, name, NULL);
+}
+
+static guint
+loopback_sds_get_id (const GByteArray *msg)
+{
+  return msg->data[4] | (msg->data[5] << 7);
+}
+
+static guint
+loopback_sds_get_packets (const guint8 *header)
+{
+  guint bits = header[6];
+  guint words = header[10] | (header[11] << 7) | (header[12] << 14);
+  guint words_per_packet = LOOPBACK_SDS_PACKET_PAYLOAD_LEN / ((bits + 6) / 7);
+
+  return (words + words_per_packet - 1) / words_per_packet;
+}
+
+static guint8
+loopback_sds_checksum (const guint8 *data)
+{
+  guint8 checksum = 0;
+
+  for (guint i = 1; i < LOOPBACK_SDS_PACKET_CKSUM_POS; i++)
+    {
+      checksum ^= data[i];
+    }
+
+  return checksum & 0x7f;
+}
+
+static void
+loopback_sds_tx_handshake (struct loopback_device *device, guint8 type,
+			   guint8 packet)
+{
+  GByteArray *msg = g_byte_array_sized_new (6);
+
+  g_byte_array_append (msg, (guint8 *) "\xf0\x7e\x00", 3);
+  g_byte_array_append (msg, &type, 1);
+  g_byte_array_append (msg, &packet, 1);
+  g_byte_array_append (msg, (guint8 *) "\xf7", 1);
+
+  loopback_device_reply (device, msg);
+}
+
+static void
+loopback_sds_tx_download_packet (struct loopback_device *device,
+				 struct loopback_sds_state *state,
+				 guint packet)
+{
+  GByteArray *msg = g_byte_array_sized_new (LOOPBACK_SDS_PACKET_LEN);
+
+  g_byte_array_append (msg, &state->download->data[LOOPBACK_SDS_HEADER_LEN +
+						    packet *
+						    LOOPBACK_SDS_PACKET_LEN],
+		       LOOPBACK_SDS_PACKET_LEN);
+  loopback_device_reply (device, msg);
+}
+
+static void
+loopback_sds_clear_upload (struct loopback_sds_state *state)
+{
+  if (state->upload)
+    {
+      free_msg (state->upload);
+      state->upload = NULL;
+    }
+}
+
+static void
+loopback_sds_clear_download (struct loopback_sds_state *state)
+{
+  if (state->download)
+    {
+      free_msg (state->download);
+      state->download = NULL;
+    }
+}
+
+static void
+loopback_sds_commit_upload (struct loopback_sds_state *state)
+{
+  gchar *path = loopback_sds_get_path (state, state->upload_id, "syx");
+
+  debug_print (1, "Storing SDS sample %d...", state->upload_id);
+  loopback_file_save (path, state->upload);
+  g_free (path);
+  loopback_sds_clear_upload (state);
+}
+
+static void
+loopback_sds_dump_header (struct loopback_device *device,
+			  struct loopback_sds_state *state,
+			  const GByteArray *msg)
+{
+  guint id;
+
+  if (msg->len != LOOPBACK_SDS_HEADER_LEN)
+    {
+      return;
+    }
+
+  id = loopback_sds_get_id (msg);
+  if (id >= LOOPBACK_SDS_SAMPLE_LIMIT || !msg->data[6] || msg->data[6] > 16)
+    {
+      loopback_sds_tx_handshake (device, LOOPBACK_SDS_CANCEL, 0);
+      return;
+    }
+
+  loopback_sds_clear_upload (state);
+  state->upload = g_byte_array_sized_new (LOOPBACK_SDS_HEADER_LEN);
+  g_byte_array_append (state->upload, msg->data, msg->len);
+  state->upload_id = id;
+  state->upload_packets = loopback_sds_get_packets (msg->data);
+  state->upload_packet = 0;
+
+  loopback_sds_tx_handshake (device, LOOPBACK_SDS_ACK, 0);
+
+  if (!state->upload_packets)
+    {
+      loopback_sds_commit_upload (state);
+    }
+}
+
+static void
+loopback_sds_data_packet (struct loopback_device *device,
+			  struct loopback_sds_state *state,
+			  const GByteArray *msg)
+{
+  guint8 packet;
+
+  if (!state->upload || msg->len != LOOPBACK_SDS_PACKET_LEN)
+    {
+      return;
+    }
+
+  packet = msg->data[4];
+  if (packet != state->upload_packet % 0x80 ||
+      loopback_sds_checksum (msg->data) !=
+      msg->data[LOOPBACK_SDS_PACKET_CKSUM_POS])
+    {
+      loopback_sds_tx_handshake (device, LOOPBACK_SDS_NAK, packet);
+      return;
+    }
+
+  g_byte_array_append (state->upload, msg->data, msg->len);
+  state->upload_packet++;
+  loopback_sds_tx_handshake (device, LOOPBACK_SDS_ACK, packet);
+
+  if (state->upload_packet == state->upload_packets)
+    {
+      loopback_sds_commit_upload (state);
+    }
+}
+
+static void
+loopback_sds_dump_request (struct loopback_device *device,
+			   struct loopback_sds_state *state,
+			   const GByteArray *msg)
+{
+  gchar *path;
+  GByteArray *header;
+  guint id = loopback_sds_get_id (msg);
+
+  loopback_sds_clear_download (state);
+
+  path = loopback_sds_get_path (state, id, "syx");
+  state->download = loopback_file_load (path);
+  g_free (path);
+
+  if (!state->download || state->download->len < LOOPBACK_SDS_HEADER_LEN)
+    {
+      loopback_sds_clear_download (state);
+      loopback_sds_tx_handshake (device, LOOPBACK_SDS_CANCEL, 0);
+      return;
+    }
+
+  state->download_packets = (state->download->len - LOOPBACK_SDS_HEADER_LEN)
+    / LOOPBACK_SDS_PACKET_LEN;
+  state->download_packet = 0;
+
+  header = g_byte_array_sized_new (LOOPBACK_SDS_HEADER_LEN);
+  g_byte_array_append (header, state->download->data,
+		       LOOPBACK_SDS_HEADER_LEN);
+  loopback_device_reply (device, header);
+}
+
+static void
+loopback_sds_name_request (struct loopback_device *device,
+			   struct loopback_sds_state *state,
+			   const GByteArray *msg)
+{
+  guint8 len;
+  gchar *path, *name = NULL;
+  GByteArray *reply = g_byte_array_new ();
+  guint id = msg->data[5] | (msg->data[6] << 7);
+
+  path = loopback_sds_get_path (state, id, "name");
+  g_file_get_contents (path, &name, NULL, NULL);
+  g_free (path);
+
+  len = name ? strlen (name) : 0;
+  g_byte_array_append (reply, (guint8 *) "\xf0\x7e\x00\x05\x03", 5);
+  g_byte_array_append (reply, &msg->data[5], 2);
+  g_byte_array_append (reply, (guint8 *) "\x00\x00", 2);
+  g_byte_array_append (reply, &len, 1);
+  if (name)
+    {
+      g_byte_array_append (reply, (guint8 *) name, len);
+    }
+  g_byte_array_append (reply, (guint8 *) "\xf7", 1);
+  g_free (name);
+
+  loopback_device_reply (device, reply);
+}
+
+static void
+loopback_sds_name (struct loopback_device *device,
+		   struct loopback_sds_state *state, const GByteArray *msg)
+{
+  gchar *path, *name;
+  guint id = msg->data[5] | (msg->data[6] << 7);
+  guint len = msg->data[8];
+
+  if (msg->len < 10 + len)
+    {
+      loopback_sds_tx_handshake (device, LOOPBACK_SDS_NAK, 0);
+      return;
+    }
+
+  name = g_strndup ((gchar *) & msg->data[9], len);
+  path = loopback_sds_get_path (state, id, "name");
+  file_save_data (path, (guint8 *) name, len);
+  g_free (path);
+  g_free (name);
+
+  loopback_sds_tx_handshake (device, LOOPBACK_SDS_ACK, 0);
+}
+
+static void
+loopback_sds_extension (struct loopback_device *device,
+			struct loopback_sds_state *state,
+			const GByteArray *msg)
+{
+  if (msg->len < 8)
+    {
+      return;
+    }
+
+  switch (msg->data[4])
+    {
+    case LOOPBACK_SDS_EXT_LOOP_POINT:
+      loopback_sds_tx_handshake (device, LOOPBACK_SDS_ACK, 0);
+      break;
+    case LOOPBACK_SDS_EXT_NAME:
+      loopback_sds_name (device, state, msg);
+      break;
+    case LOOPBACK_SDS_EXT_NAME_REQUEST:
+      loopback_sds_name_request (device, state, msg);
+      break;
+    default:
+      debug_print (1, "Unsupported loopback SDS extension 0x%02x",
+		   msg->data[4]);
+    }
+}
+
+//A download is driven by the receiver. Every ACK requests the next packet and every NAK requests the last one again.
+
+static void
+loopback_sds_download_handshake (struct loopback_device *device,
+				 struct loopback_sds_state *state,
+				 guint8 type)
+{
+  if (!state->download)
+    {
+      return;
+    }
+
+  if (type == LOOPBACK_SDS_ACK)
+    {
+      if (state->download_packet == state->download_packets)
+	{
+	  loopback_sds_clear_download (state);
+	  return;
+	}
+      loopback_sds_tx_download_packet (device, state,
+				       state->download_packet);
+      state->download_packet++;
+    }
+  else if (type == LOOPBACK_SDS_NAK && state->download_packet)
+    {
+      loopback_sds_tx_download_packet (device, state,
+				       state->download_packet - 1);
+    }
+}
+
+static void
+loopback_sds_handle (struct loopback_device *device, gpointer data,
+		     const GByteArray *msg)
+{
+  struct loopback_sds_state *state = data;
+
+  if (msg->len < 6 || msg->data[1] != 0x7e)
+    {
+      return;
+    }
+
+  switch (msg->data[3])
+    {
+    case LOOPBACK_SDS_DUMP_HEADER:
+      loopback_sds_dump_header (device, state, msg);
+      break;
+    case LOOPBACK_SDS_DATA_PACKET:
+      loopback_sds_data_packet (device, state, msg);
+      break;
+    case LOOPBACK_SDS_DUMP_REQUEST:
+      loopback_sds_dump_request (device, state, msg);
+      break;
+    case LOOPBACK_SDS_EXTENSION:
+      loopback_sds_extension (device, state, msg);
+      break;
+    case LOOPBACK_SDS_ACK:
+    case LOOPBACK_SDS_NAK:
+      loopback_sds_download_handshake (device, state, msg->data[3]);
+      break;
+    case LOOPBACK_SDS_CANCEL:
+      loopback_sds_clear_upload (state);
+      loopback_sds_clear_download (state);
+      break;
+    case LOOPBACK_SDS_WAIT:
+      break;
+    default:
+      debug_print (1, "Unsupported loopback SDS message 0x%02x",
+		   msg->data[3]);
+    }
+}
+
+static gpointer
+loopback_sds_init (const gchar *dir)
+{
+  struct loopback_sds_state *state =
+    g_malloc0 (sizeof (struct loopback_sds_state));
+
+  state->dir = g_strdup (dir);
+
+  return state;
+}
+
+static void
+loopback_sds_free (gpointer data)
+{
+  struct loopback_sds_state *state = data;
+
+  loopback_sds_clear_upload (state);
+  loopback_sds_clear_download (state);
+  g_free (state->dir);
+  g_free (state);
+}
+
+const struct loopback_model LOOPBACK_MODEL_SDS = {
+  .name = "sds",
+  .device_name = "MIDI SDS Sampler (loopback)",
+  .identity = NULL,
+  .identity_len = 0,
+  .init = loopback_sds_init,
+  .free = loopback_sds_free,
+  .handle = loopback_sds_handle
+};
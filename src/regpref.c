@@ -24,6 +24,14 @@
 #define PREF_MAX_SUBDIVISIONS 8
 #define PREF_MIN_SUBDIVISIONS 1
 
+#define PREF_DEFAULT_ELEKTRON_TRANSFER_WINDOW 1	//Pipelining has not been confirmed on every device.
+#define PREF_MAX_ELEKTRON_TRANSFER_WINDOW 16
+#define PREF_MIN_ELEKTRON_TRANSFER_WINDOW 1
+
+#define PREF_DEFAULT_ELEKTRON_CACHE_SIZE 256	//MiB
+#define PREF_MAX_ELEKTRON_CACHE_SIZE 65536
+#define PREF_MIN_ELEKTRON_CACHE_SIZE 0
+
 #define PREF_DEFAULT_AUDIO_BUF_LENGTH 1024
 #define PREF_MAX_AUDIO_BUF_LENGTH 4096
 #define PREF_MIN_AUDIO_BUF_LENGTH 256
@@ -44,6 +52,23 @@ regpref_get_subdivisions (const gpointer grid)
 				    PREF_DEFAULT_SUBDIVISIONS);
 }
 
+static gpointer
+regpref_get_elektron_transfer_window (const gpointer window)
+{
+  return preferences_get_int_value (window,
+				    PREF_MAX_ELEKTRON_TRANSFER_WINDOW,
+				    PREF_MIN_ELEKTRON_TRANSFER_WINDOW,
+				    PREF_DEFAULT_ELEKTRON_TRANSFER_WINDOW);
+}
+
+static gpointer
+regpref_get_elektron_cache_size (const gpointer size)
+{
+  return preferences_get_int_value (size, PREF_MAX_ELEKTRON_CACHE_SIZE,
+				    PREF_MIN_ELEKTRON_CACHE_SIZE,
+				    PREF_DEFAULT_ELEKTRON_CACHE_SIZE);
+}
+
 static gpointer
 regpref_get_audio_buffer_length (const gpointer len)
 {
@@ -79,6 +104,12 @@ regpref_get_home (const gpointer home)
   return home ? g_strdup (home) : get_user_dir (NULL);
 }
 
+static gpointer
+regpref_get_elektron_sample_store (const gpointer dir)
+{
+  return preferences_get_string_value_default (dir, "");
+}
+
 static gpointer
 regpref_get_tags_structures (const gpointer tags)
 {
@@ -186,6 +217,42 @@ const struct preference PREF_ELEKTRON_LOAD_SOUND_TAGS = {
   .get_value = preferences_get_boolean_value_true
 };
 
+static const struct preference PREF_ELEKTRON_TRANSFER_WINDOW = {
+  .key = PREF_KEY_ELEKTRON_TRANSFER_WINDOW,
+  .type = PREFERENCE_TYPE_INT,
+  .get_value = regpref_get_elektron_transfer_window
+};
+
+static const struct preference PREF_ELEKTRON_CACHE_SIZE = {
+  .key = PREF_KEY_ELEKTRON_CACHE_SIZE,
+  .type = PREFERENCE_TYPE_INT,
+  .get_value = regpref_get_elektron_cache_size
+};
+
+static const struct preference PREF_ELEKTRON_SAMPLE_STORE = {
+  .key = PREF_KEY_ELEKTRON_SAMPLE_STORE,
+  .type = PREFERENCE_TYPE_STRING,
+  .get_value = regpref_get_elektron_sample_store
+};
+
+static const struct preference PREF_ELEKTRON_SAMPLE_LOOKUP = {
+  .key = PREF_KEY_ELEKTRON_SAMPLE_LOOKUP,
+  .type = PREFERENCE_TYPE_BOOLEAN,
+  .get_value = preferences_get_boolean_value_false
+};
+
+static const struct preference PREF_ELEKTRON_LIST_PAGES = {
+  .key = PREF_KEY_ELEKTRON_LIST_PAGES,
+  .type = PREFERENCE_TYPE_BOOLEAN,
+  .get_value = preferences_get_boolean_value_false
+};
+
+static const struct preference PREF_ELEKTRON_OS_BIG_BLOCKS = {
+  .key = PREF_KEY_ELEKTRON_OS_BIG_BLOCKS,
+  .type = PREFERENCE_TYPE_BOOLEAN,
+  .get_value = preferences_get_boolean_value_false
+};
+
 static const struct preference PREF_TAGS_STRUCTURES = {
   .key = PREF_KEY_TAGS_STRUCTURES,
   .type = PREFERENCE_TYPE_STRING,
@@ -236,7 +303,10 @@ regpref_register ()
 	       &PREF_SUBDIVISIONS, &PREF_PLAY_WHILE_LOADING,
 	       &PREF_AUDIO_BUFFER_LEN, &PREF_AUDIO_USE_FLOAT,
 	       &PREF_SHOW_PLAYBACK_CURSOR, &PREF_STOP_DEVICE_WHEN_CONNECTING,
-	       &PREF_ELEKTRON_LOAD_SOUND_TAGS, &PREF_TAGS_STRUCTURES,
+	       &PREF_ELEKTRON_LOAD_SOUND_TAGS, &PREF_ELEKTRON_TRANSFER_WINDOW,
+	       &PREF_ELEKTRON_CACHE_SIZE, &PREF_ELEKTRON_SAMPLE_STORE,
+	       &PREF_ELEKTRON_SAMPLE_LOOKUP, &PREF_ELEKTRON_LIST_PAGES,
+	       &PREF_ELEKTRON_OS_BIG_BLOCKS, &PREF_TAGS_STRUCTURES,
 	       &PREF_TAGS_INSTRUMENTS, &PREF_TAGS_GENRES,
 	       &PREF_TAGS_OBJECTIVE_CHARS, &PREF_TAGS_SUBJECTIVE_CHARS,
 	       &PREF_SHOW_FOLDER_SIZES, &PREF_USE_SAFETY_QUESTIONS, NULL);
@@ -113,10 +113,77 @@ tasks_get_current (GtkTreeIter *iter)
   return found;
 }
 
+static void
+tasks_update_stats ()
+{
+  gchar *summary;
+  struct backend_stats stats;
+
+  backend_stats_get (remote_browser.backend, &stats);
+  summary = backend_stats_get_summary (&stats);
+  gtk_label_set_text (GTK_LABEL (tasks.stats_label), summary);
+  g_free (summary);
+}
+
+static void
+tasks_batch_item_free (gpointer data)
+{
+  struct task_batch_item *item = data;
+  g_free (item->src);
+  g_free (item->dst);
+  g_free (item);
+}
+
+//The queued uploads right after the given task that belong to the same batch and filesystem are set as running.
+//The returned list contains a struct task_batch_item for each of them.
+
+GSList *
+tasks_start_upload_batch (GtkTreeIter *iter, guint batch_id, gint fs)
+{
+  enum task_type type;
+  enum task_status status;
+  guint task_batch_id;
+  gint task_fs;
+  GtkTreeIter next = *iter;
+  GSList *batch = NULL;
+  struct task_batch_item *item;
+  const gchar *status_human = tasks_get_human_status (TASK_STATUS_RUNNING);
+
+  while (gtk_tree_model_iter_next (GTK_TREE_MODEL (tasks.list_store), &next))
+    {
+      gtk_tree_model_get (GTK_TREE_MODEL (tasks.list_store), &next,
+			  TASK_LIST_STORE_STATUS_FIELD, &status,
+			  TASK_LIST_STORE_TYPE_FIELD, &type,
+			  TASK_LIST_STORE_REMOTE_FS_ID_FIELD, &task_fs,
+			  TASK_LIST_STORE_BATCH_ID_FIELD, &task_batch_id, -1);
+
+      if (status != TASK_STATUS_QUEUED || type != TASK_TYPE_UPLOAD ||
+	  task_fs != fs || task_batch_id != batch_id)
+	{
+	  break;
+	}
+
+      item = g_malloc (sizeof (struct task_batch_item));
+      gtk_tree_model_get (GTK_TREE_MODEL (tasks.list_store), &next,
+			  TASK_LIST_STORE_SRC_FIELD, &item->src,
+			  TASK_LIST_STORE_DST_FIELD, &item->dst, -1);
+      item->status = TASK_STATUS_RUNNING;
+      batch = g_slist_append (batch, item);
+
+      gtk_list_store_set (tasks.list_store, &next,
+			  TASK_LIST_STORE_STATUS_FIELD, TASK_STATUS_RUNNING,
+			  TASK_LIST_STORE_STATUS_HUMAN_FIELD, status_human,
+			  -1);
+    }
+
+  return batch;
+}
+
 gboolean
 tasks_complete_current (gpointer data)
 {
   GtkTreeIter iter;
+  struct task_batch_item *item;
   const gchar *status = tasks_get_human_status (tasks.transfer.status);
 
   if (tasks_get_current (&iter))
@@ -125,11 +192,30 @@ tasks_complete_current (gpointer data)
 			  TASK_LIST_STORE_STATUS_FIELD,
 			  tasks.transfer.status,
 			  TASK_LIST_STORE_STATUS_HUMAN_FIELD, status, -1);
+
+      //The tasks in the batch are the next running ones.
+      for (GSList * e = tasks.transfer.batch; e; e = e->next)
+	{
+	  item = e->data;
+	  if (!tasks_get_current (&iter))
+	    {
+	      break;
+	    }
+	  status = tasks_get_human_status (item->status);
+	  gtk_list_store_set (tasks.list_store, &iter,
+			      TASK_LIST_STORE_STATUS_FIELD, item->status,
+			      TASK_LIST_STORE_STATUS_HUMAN_FIELD, status, -1);
+	}
+      g_slist_free_full (tasks.transfer.batch, tasks_batch_item_free);
+      tasks.transfer.batch = NULL;
+
       tasks_stop_current (NULL, NULL);
       g_free (tasks.transfer.src);
       g_free (tasks.transfer.dst);
 
       gtk_widget_set_sensitive (tasks.cancel_task_button, FALSE);
+
+      tasks_update_stats ();
     }
   else
     {
@@ -387,6 +473,8 @@ tasks_update_current_progress (gpointer data)
   GtkTreeIter iter;
   gdouble progress;
   gint percent;
+  enum task_status status;
+  gboolean valid;
 
   if (tasks_get_current (&iter))
     {
@@ -396,8 +484,22 @@ tasks_update_current_progress (gpointer data)
 
       percent = (gint) (100.0 * progress);
 
-      gtk_list_store_set (tasks.list_store, &iter,
-			  TASK_LIST_STORE_PROGRESS_FIELD, percent, -1);
+      //Running tasks are contiguous and all of them share the progress when they are run as a batch.
+      do
+	{
+	  gtk_list_store_set (tasks.list_store, &iter,
+			      TASK_LIST_STORE_PROGRESS_FIELD, percent, -1);
+	  valid = gtk_tree_model_iter_next (GTK_TREE_MODEL (tasks.list_store),
+					    &iter);
+	  if (valid)
+	    {
+	      gtk_tree_model_get (GTK_TREE_MODEL (tasks.list_store), &iter,
+				  TASK_LIST_STORE_STATUS_FIELD, &status, -1);
+	    }
+	}
+      while (valid && status == TASK_STATUS_RUNNING);
+
+      tasks_update_stats ();
     }
 
   return FALSE;
@@ -407,6 +509,7 @@ void
 tasks_init (GtkBuilder *builder)
 {
   tasks.thread = NULL;
+  tasks.transfer.batch = NULL;
 
   tasks.list_store =
     GTK_LIST_STORE (gtk_builder_get_object (builder, "task_list_store"));
@@ -419,6 +522,8 @@ tasks_init (GtkBuilder *builder)
     GTK_WIDGET (gtk_builder_get_object (builder, "remove_tasks_button"));
   tasks.clear_tasks_button =
     GTK_WIDGET (gtk_builder_get_object (builder, "clear_tasks_button"));
+  tasks.stats_label =
+    GTK_WIDGET (gtk_builder_get_object (builder, "task_stats_label"));
   g_signal_connect (tasks.cancel_task_button, "clicked",
 		    G_CALLBACK (tasks_cancel_all), NULL);
   g_signal_connect (tasks.remove_tasks_button, "clicked",
@@ -61,6 +61,14 @@ enum task_type
   TASK_TYPE_DOWNLOAD
 };
 
+//A queued task that runs along with the current one.
+struct task_batch_item
+{
+  gchar *src;
+  gchar *dst;
+  enum task_status status;	//Contains the final status
+};
+
 struct task_transfer
 {
   struct task_control control;
@@ -70,6 +78,7 @@ struct task_transfer
   const struct fs_operations *fs_ops;	//Contains the fs_operations to use in this transfer
   guint mode;
   guint batch_id;
+  GSList *batch;		//Contains the struct task_batch_item of the tasks run along with this one.
 };
 
 struct tasks
@@ -82,6 +91,7 @@ struct tasks
   GtkWidget *cancel_task_button;
   GtkWidget *remove_tasks_button;
   GtkWidget *clear_tasks_button;
+  GtkWidget *stats_label;
 };
 
 extern struct tasks tasks;
@@ -93,6 +103,9 @@ gboolean tasks_get_next_queued (GtkTreeIter * iter,
 				gchar ** dst, gint * fs, guint * batch_id,
 				guint * mode);
 
+GSList *tasks_start_upload_batch (GtkTreeIter * iter, guint batch_id,
+				  gint fs);
+
 gboolean tasks_complete_current (gpointer data);
 
 void tasks_cancel_all (GtkWidget * object, gpointer data);
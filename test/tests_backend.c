@@ -0,0 +1,603 @@
+#include <CUnit/CUnit.h>
+#include <CUnit/Basic.h>
+#include <glib/gstdio.h>
+#include "../config.h"
+#include "../src/backend.h"
+#if defined(ELEKTROID_LOOPBACK)
+#include "../src/loopback/loopback.h"
+#endif
+
+static struct backend backend;
+
+static void
+test_backend_rx_sysex ()
+{
+  gint err;
+  struct sysex_transfer transfer;
+
+  printf ("\n");
+
+  backend_rx_ring_init (&backend);
+
+  //Non SysEx data before the message and realtime bytes inside are filtered out.
+  backend_rx_ring_push (&backend, (guint8 *) "\xf8\x01\xf0\x01\xf8\x02\xf7\xf0\x03",
+			9);
+  CU_ASSERT_TRUE (backend.rx_ready);
+
+  sysex_transfer_init_rx (&transfer, 100, FALSE);
+  err = backend_rx_sysex (&backend, &transfer, NULL);
+  CU_ASSERT_EQUAL (err, 0);
+  CU_ASSERT_EQUAL (transfer.raw->len, 4);
+  CU_ASSERT_EQUAL (memcmp (transfer.raw->data, "\xf0\x01\x02\xf7", 4), 0);
+  sysex_transfer_clear (&transfer);
+
+  //The incomplete message is kept until its end arrives.
+  sysex_transfer_init_rx (&transfer, 100, FALSE);
+  err = backend_rx_sysex (&backend, &transfer, NULL);
+  CU_ASSERT_EQUAL (err, -ETIMEDOUT);
+  CU_ASSERT_PTR_NULL (transfer.raw);
+
+  //Empty messages are skipped.
+  backend_rx_ring_push (&backend, (guint8 *) "\x04\xf7\xf0\xf7", 4);
+  sysex_transfer_init_rx (&transfer, 100, FALSE);
+  err = backend_rx_sysex (&backend, &transfer, NULL);
+  CU_ASSERT_EQUAL (err, 0);
+  CU_ASSERT_EQUAL (transfer.raw->len, 4);
+  CU_ASSERT_EQUAL (memcmp (transfer.raw->data, "\xf0\x03\x04\xf7", 4), 0);
+  sysex_transfer_clear (&transfer);
+  CU_ASSERT_EQUAL (backend.rx_ring_len, 0);
+
+  //Batch mode concatenates the messages.
+  backend_rx_ring_push (&backend, (guint8 *) "\xf0\x05\xf7\xf0\x06\xf7", 6);
+  sysex_transfer_init_rx (&transfer, 100, TRUE);
+  err = backend_rx_sysex (&backend, &transfer, NULL);
+  CU_ASSERT_EQUAL (err, 0);
+  CU_ASSERT_EQUAL (transfer.raw->len, 6);
+  CU_ASSERT_EQUAL (memcmp (transfer.raw->data, "\xf0\x05\xf7\xf0\x06\xf7",
+			   6), 0);
+  sysex_transfer_clear (&transfer);
+
+  backend_rx_ring_set_error (&backend, -ENODATA);
+  sysex_transfer_init_rx (&transfer, 100, FALSE);
+  err = backend_rx_sysex (&backend, &transfer, NULL);
+  CU_ASSERT_EQUAL (err, -ENODATA);
+
+  backend_rx_ring_stop (&backend);
+  backend_rx_ring_free (&backend);
+}
+
+static void
+test_backend_rx_ring_next_msg_bigger_than_ring ()
+{
+  guint8 *data;
+  GByteArray *msg;
+  guint len = BE_DEV_RING_BUF_LEN * 3 / 2;
+
+  printf ("\n");
+
+  backend_rx_ring_init (&backend);
+
+  data = g_malloc (len);
+  data[0] = 0xf0;
+  for (guint i = 1; i < len - 1; i++)
+    {
+      data[i] = i % 1000 ? i & 0x7f : 0xf8;
+    }
+  data[len - 1] = 0xf7;
+
+  backend_rx_ring_push (&backend, data, BE_DEV_RING_BUF_LEN);
+  CU_ASSERT_TRUE (backend.rx_ready);
+  msg = backend_rx_ring_next_msg (&backend);
+  CU_ASSERT_PTR_NULL (msg);
+  CU_ASSERT_FALSE (backend.rx_ready);
+  CU_ASSERT_EQUAL (backend.rx_ring_len, 0);
+
+  backend_rx_ring_push (&backend, &data[BE_DEV_RING_BUF_LEN],
+			len - BE_DEV_RING_BUF_LEN);
+  msg = backend_rx_ring_next_msg (&backend);
+  CU_ASSERT_PTR_NOT_NULL (msg);
+  CU_ASSERT_EQUAL (msg->len, len - (len - 2) / 1000);
+  for (guint i = 0, j = 0; i < len; i++)
+    {
+      if (data[i] != 0xf8)
+	{
+	  CU_ASSERT_EQUAL (msg->data[j], data[i]);
+	  j++;
+	}
+    }
+  free_msg (msg);
+  g_free (data);
+
+  backend_rx_ring_stop (&backend);
+  backend_rx_ring_free (&backend);
+}
+
+static void
+test_backend_pacing ()
+{
+  printf ("\n");
+
+  backend_pacing_init (&backend, 32000);
+  CU_ASSERT_EQUAL (backend.pacing.rest_time, 32000);
+  CU_ASSERT_EQUAL (backend.pacing.min_rest_time, 3200);
+  CU_ASSERT_EQUAL (backend.pacing.max_rest_time, 256000);
+
+  backend_pacing_report (&backend, 0);
+  CU_ASSERT_EQUAL (backend.pacing.rest_time, 32000);
+
+  backend_pacing_report (&backend, -EBADMSG);
+  CU_ASSERT_EQUAL (backend.pacing.rest_time, 64000);
+
+  for (gint i = 0; i < 4; i++)
+    {
+      backend_pacing_report (&backend, -EBADMSG);
+    }
+  CU_ASSERT_EQUAL (backend.pacing.rest_time, 256000);
+
+  backend_pacing_init_with_min (&backend, 32000, 32000);
+  CU_ASSERT_EQUAL (backend.pacing.min_rest_time, 32000);
+  CU_ASSERT_EQUAL (backend.pacing.max_rest_time, 256000);
+
+  //No pacing before a connector sets it up.
+  backend_pacing_init (&backend, 0);
+  backend_pacing_report (&backend, -EBADMSG);
+  CU_ASSERT_EQUAL (backend.pacing.rest_time, 0);
+}
+
+static void
+test_backend_stats ()
+{
+  gchar *summary;
+  struct sysex_transfer transfer;
+  struct backend_stats stats;
+
+  printf ("\n");
+
+  backend_rx_ring_init (&backend);
+  backend_stats_reset (&backend);
+
+  backend_rx_ring_push (&backend, (guint8 *) "\xf0\x01\xf7\xf0\x02\xf7", 6);
+  sysex_transfer_init_rx (&transfer, 100, TRUE);
+  backend_rx_sysex (&backend, &transfer, NULL);
+  sysex_transfer_clear (&transfer);
+  backend_stats_add_retry (&backend);
+  backend_pacing_report (&backend, -EBADMSG);
+
+  backend_stats_get (&backend, &stats);
+  CU_ASSERT_EQUAL (stats.rx_msgs, 2);
+  CU_ASSERT_EQUAL (stats.rx_bytes, 6);
+  CU_ASSERT_EQUAL (stats.tx_msgs, 0);
+  CU_ASSERT_EQUAL (stats.retries, 1);
+  CU_ASSERT_EQUAL (stats.naks, 1);
+  CU_ASSERT_TRUE (stats.wait_time > 0);
+
+  summary = backend_stats_get_summary (&stats);
+  CU_ASSERT_PTR_NOT_NULL (strstr (summary, "Received: 2 messages, 6 B"));
+  g_free (summary);
+
+  backend_stats_reset (&backend);
+  backend_stats_get (&backend, &stats);
+  CU_ASSERT_EQUAL (stats.rx_msgs, 0);
+
+  backend_rx_ring_stop (&backend);
+  backend_rx_ring_free (&backend);
+}
+
+static void
+test_backend_stats_latency ()
+{
+  struct backend_stats stats;
+
+  printf ("\n");
+
+  memset (&stats, 0, sizeof (struct backend_stats));
+  CU_ASSERT_EQUAL (backend_stats_get_latency_mean (&stats), 0);
+  CU_ASSERT_EQUAL (backend_stats_get_latency_percentile (&stats, 99), -1);
+
+  stats.latency[2] = 98;
+  stats.latency[5] = 2;
+  stats.latency_sum = 100 * 3000;
+  CU_ASSERT_EQUAL (backend_stats_get_latency_mean (&stats), 3000);
+  CU_ASSERT_EQUAL (backend_stats_get_latency_percentile (&stats, 50), 4);
+  CU_ASSERT_EQUAL (backend_stats_get_latency_percentile (&stats, 99), 32);
+
+  stats.latency[BE_STATS_LATENCY_BUCKETS - 1] = 100;
+  CU_ASSERT_EQUAL (backend_stats_get_latency_percentile (&stats, 99),
+		   1 << (BE_STATS_LATENCY_BUCKETS - 2));
+}
+
+static void
+test_backend_capture ()
+{
+  gint err, fd;
+  gchar *path;
+  GSList *records;
+  struct sysex_transfer transfer;
+  struct backend_capture_record *record;
+
+  printf ("\n");
+
+  fd = g_file_open_tmp ("elektroid-XXXXXX.cap", &path, NULL);
+  CU_ASSERT_TRUE (fd >= 0);
+  close (fd);
+
+  backend_rx_ring_init (&backend);
+
+  err = backend_capture_start (&backend, path);
+  CU_ASSERT_EQUAL (err, 0);
+
+  backend_rx_ring_push (&backend, (guint8 *) "\xf0\x01\xf7\xf0\x02\x03\xf7",
+			7);
+  sysex_transfer_init_rx (&transfer, 100, TRUE);
+  backend_rx_sysex (&backend, &transfer, NULL);
+  sysex_transfer_clear (&transfer);
+
+  backend_capture_stop (&backend);
+  CU_ASSERT_PTR_NULL (backend.capture);
+
+  err = backend_capture_load (path, &records);
+  CU_ASSERT_EQUAL (err, 0);
+  CU_ASSERT_EQUAL (g_slist_length (records), 2);
+
+  record = records->data;
+  CU_ASSERT_EQUAL (record->dir, BE_CAPTURE_RX);
+  CU_ASSERT_EQUAL (record->data->len, 3);
+  CU_ASSERT_EQUAL (record->data->data[1], 1);
+
+  record = records->next->data;
+  CU_ASSERT_EQUAL (record->dir, BE_CAPTURE_RX);
+  CU_ASSERT_EQUAL (record->data->len, 4);
+  CU_ASSERT_EQUAL (record->data->data[2], 3);
+  CU_ASSERT_TRUE (record->time >= ((struct backend_capture_record *)
+				   records->data)->time);
+
+  g_slist_free_full (records, backend_capture_record_free);
+
+  backend_rx_ring_stop (&backend);
+  backend_rx_ring_free (&backend);
+
+  g_unlink (path);
+  g_free (path);
+}
+
+#if defined(ELEKTROID_LOOPBACK)
+
+gint backend_init_int (struct backend *, const gchar *);
+void backend_destroy_int (struct backend *);
+
+//Requests are answered by the scripted loopback device. 0x02 is never answered on its own, 0x03 is answered after 0x02 and 0x04 is answered after a delay.
+static const gchar *PIPELINE_SCRIPT = "f0 01 f7 -> f0 01 f7\n"
+  "f0 02 f7 ->\n"
+  "f0 03 f7 -> f0 03 f7 | f0 02 f7\n"
+  "f0 04 f7 -> +300 f0 04 f7\n" "f0 05 f7 -> f0 09 f7 | f0 05 f7\n";
+
+static gchar *pipeline_dir;
+static gchar *pipeline_script;
+
+static gboolean
+pipeline_matcher (GByteArray *request, GByteArray *reply, void *data)
+{
+  return request->data[1] == reply->data[1];
+}
+
+static GByteArray *
+pipeline_msg (guint8 id)
+{
+  GByteArray *msg = g_byte_array_new ();
+  guint8 data[] = { 0xf0, id, 0xf7 };
+  g_byte_array_append (msg, data, sizeof (data));
+  return msg;
+}
+
+static gint
+pipeline_init ()
+{
+  pipeline_dir = g_dir_make_tmp ("elektroid-XXXXXX", NULL);
+  if (!pipeline_dir)
+    {
+      return 1;
+    }
+
+  pipeline_script = g_build_filename (pipeline_dir, LOOPBACK_SCRIPT_FILE,
+				      NULL);
+  if (!g_file_set_contents (pipeline_script, PIPELINE_SCRIPT, -1, NULL))
+    {
+      return 1;
+    }
+
+  g_setenv (LOOPBACK_ENV_DIR, pipeline_dir, TRUE);
+  g_setenv (LOOPBACK_ENV_SCRIPT, pipeline_script, TRUE);
+
+  return backend_init_int (&backend, "script");
+}
+
+static gint
+pipeline_cleanup ()
+{
+  gchar *dir;
+
+  backend_destroy_int (&backend);
+
+  g_unlink (pipeline_script);
+  g_free (pipeline_script);
+  dir = g_build_filename (pipeline_dir, "script", NULL);
+  g_rmdir (dir);
+  g_free (dir);
+  g_rmdir (pipeline_dir);
+  g_free (pipeline_dir);
+
+  return 0;
+}
+
+static void
+test_backend_pipeline_ordering ()
+{
+  gint err;
+  struct backend_pipeline pipeline;
+  struct backend_request *r1, *r2, *r3, *r5;
+
+  printf ("\n");
+
+  backend_pipeline_init (&pipeline, &backend, 4, 1000, pipeline_matcher,
+			 NULL);
+
+  r1 = backend_pipeline_tx (&pipeline, pipeline_msg (1), NULL);
+  r2 = backend_pipeline_tx (&pipeline, pipeline_msg (2), NULL);
+  r3 = backend_pipeline_tx (&pipeline, pipeline_msg (3), NULL);
+  r5 = backend_pipeline_tx (&pipeline, pipeline_msg (5), NULL);
+  CU_ASSERT_FALSE (r2->done);
+
+  //The reply to 0x02 arrives after the one to 0x03 and each one goes to its own request.
+  err = backend_pipeline_wait (&pipeline, r2, NULL);
+  CU_ASSERT_EQUAL (err, 0);
+  CU_ASSERT_TRUE (r1->done);
+  CU_ASSERT_TRUE (r3->done);
+  CU_ASSERT_EQUAL (r1->rx_msg->data[1], 1);
+  CU_ASSERT_EQUAL (r2->rx_msg->data[1], 2);
+  CU_ASSERT_EQUAL (r3->rx_msg->data[1], 3);
+
+  //Replies that match no request are discarded.
+  err = backend_pipeline_wait (&pipeline, r5, NULL);
+  CU_ASSERT_EQUAL (err, 0);
+  CU_ASSERT_EQUAL (r5->rx_msg->data[1], 5);
+  CU_ASSERT_PTR_NULL (pipeline.outstanding);
+
+  backend_pipeline_clear (&pipeline);
+
+  backend_request_free (r1);
+  backend_request_free (r2);
+  backend_request_free (r3);
+  backend_request_free (r5);
+}
+
+static void
+test_backend_pipeline_window ()
+{
+  gint err;
+  struct backend_pipeline pipeline;
+  struct backend_request *r4, *r1;
+
+  printf ("\n");
+
+  backend_pipeline_init (&pipeline, &backend, 1, 1000, pipeline_matcher,
+			 NULL);
+
+  //With a window of 1, the second request is only sent after the first one is answered.
+  r4 = backend_pipeline_tx (&pipeline, pipeline_msg (4), NULL);
+  CU_ASSERT_FALSE (r4->done);
+  r1 = backend_pipeline_tx (&pipeline, pipeline_msg (1), NULL);
+  CU_ASSERT_TRUE (r4->done);
+  CU_ASSERT_EQUAL (r4->err, 0);
+  CU_ASSERT_EQUAL (g_slist_length (pipeline.outstanding), 1);
+
+  err = backend_pipeline_wait (&pipeline, r1, NULL);
+  CU_ASSERT_EQUAL (err, 0);
+
+  backend_pipeline_clear (&pipeline);
+
+  backend_request_free (r4);
+  backend_request_free (r1);
+}
+
+static void
+test_backend_pipeline_timeout ()
+{
+  gint err;
+  gint64 start;
+  struct backend_stats stats;
+  struct backend_pipeline pipeline;
+  struct backend_request *r2, *r1;
+
+  printf ("\n");
+
+  backend_stats_reset (&backend);
+  backend_pipeline_init (&pipeline, &backend, 4, 200, pipeline_matcher,
+			 NULL);
+
+  start = g_get_monotonic_time ();
+  r2 = backend_pipeline_tx (&pipeline, pipeline_msg (2), NULL);
+  r1 = backend_pipeline_tx (&pipeline, pipeline_msg (1), NULL);
+
+  //Requests after a timed out one are still answered.
+  err = backend_pipeline_wait (&pipeline, r2, NULL);
+  CU_ASSERT_EQUAL (err, -ETIMEDOUT);
+  CU_ASSERT_TRUE (g_get_monotonic_time () - start >=
+		  200 * G_TIME_SPAN_MILLISECOND);
+  CU_ASSERT_TRUE (r1->done);
+  CU_ASSERT_EQUAL (r1->err, 0);
+
+  backend_pipeline_clear (&pipeline);
+
+  backend_stats_get (&backend, &stats);
+  CU_ASSERT_EQUAL (stats.timeouts, 1);
+
+  backend_request_free (r2);
+  backend_request_free (r1);
+}
+
+static void
+test_backend_pipeline_cancel ()
+{
+  gint err;
+  struct controllable controllable;
+  struct backend_pipeline pipeline;
+  struct backend_request *r2, *r4;
+
+  printf ("\n");
+
+  controllable_init (&controllable);
+
+  backend_pipeline_init (&pipeline, &backend, 4, 1000, pipeline_matcher,
+			 NULL);
+
+  //Waiting with an inactive controllable cancels every outstanding request.
+  r2 = backend_pipeline_tx (&pipeline, pipeline_msg (2), &controllable);
+  r4 = backend_pipeline_tx (&pipeline, pipeline_msg (4), &controllable);
+  err = backend_pipeline_wait (&pipeline, r2, &controllable);
+  CU_ASSERT_EQUAL (err, -ECANCELED);
+  CU_ASSERT_TRUE (r4->done);
+  CU_ASSERT_EQUAL (r4->err, -ECANCELED);
+  CU_ASSERT_PTR_NULL (pipeline.outstanding);
+
+  backend_request_free (r2);
+  backend_request_free (r4);
+
+  //Clearing the pipeline cancels the requests not waited for.
+  r2 = backend_pipeline_tx (&pipeline, pipeline_msg (2), NULL);
+  backend_pipeline_clear (&pipeline);
+  CU_ASSERT_TRUE (r2->done);
+  CU_ASSERT_EQUAL (r2->err, -ECANCELED);
+  backend_request_free (r2);
+
+  //The reply to 0x04 arriving late must not be taken as the reply to a new request.
+  usleep (400000);
+  backend_rx_drain (&backend);
+
+  controllable_clear (&controllable);
+}
+
+static void
+test_backend_probe ()
+{
+  GByteArray *rx_msg;
+  struct backend_stats stats;
+
+  printf ("\n");
+
+  backend_stats_reset (&backend);
+  backend_pacing_init (&backend, 32000);
+
+  //An unanswered probe is neither a timeout nor a reason to slow down.
+  rx_msg = backend_tx_and_probe_sysex (&backend, pipeline_msg (2), 100);
+  CU_ASSERT_PTR_NULL (rx_msg);
+  CU_ASSERT_EQUAL (backend.pacing.rest_time, 32000);
+  backend_stats_get (&backend, &stats);
+  CU_ASSERT_EQUAL (stats.timeouts, 0);
+
+  rx_msg = backend_tx_and_rx_sysex (&backend, pipeline_msg (2), 100);
+  CU_ASSERT_PTR_NULL (rx_msg);
+  CU_ASSERT_EQUAL (backend.pacing.rest_time, 64000);
+  backend_stats_get (&backend, &stats);
+  CU_ASSERT_EQUAL (stats.timeouts, 1);
+
+  backend_pacing_init (&backend, 0);
+}
+
+#endif
+
+gint
+main (gint argc, gchar *argv[])
+{
+  gint err = 0;
+
+  debug_level = 5;
+
+  if (CU_initialize_registry () != CUE_SUCCESS)
+    {
+      goto cleanup;
+    }
+  CU_pSuite suite = CU_add_suite ("Elektroid backend tests", 0, 0);
+  if (!suite)
+    {
+      goto cleanup;
+    }
+
+  if (!CU_add_test (suite, "backend_rx_sysex", test_backend_rx_sysex))
+    {
+      goto cleanup;
+    }
+
+  if (!CU_add_test (suite, "backend_rx_ring_next_msg_bigger_than_ring",
+		    test_backend_rx_ring_next_msg_bigger_than_ring))
+    {
+      goto cleanup;
+    }
+
+  if (!CU_add_test (suite, "backend_pacing", test_backend_pacing))
+    {
+      goto cleanup;
+    }
+
+  if (!CU_add_test (suite, "backend_stats", test_backend_stats))
+    {
+      goto cleanup;
+    }
+
+  if (!CU_add_test (suite, "backend_stats_latency",
+		    test_backend_stats_latency))
+    {
+      goto cleanup;
+    }
+
+  if (!CU_add_test (suite, "backend_capture", test_backend_capture))
+    {
+      goto cleanup;
+    }
+
+#if defined(ELEKTROID_LOOPBACK)
+  CU_pSuite pipeline_suite = CU_add_suite ("Elektroid backend pipeline tests",
+					   pipeline_init, pipeline_cleanup);
+  if (!pipeline_suite)
+    {
+      goto cleanup;
+    }
+
+  if (!CU_add_test (pipeline_suite, "backend_pipeline_ordering",
+		    test_backend_pipeline_ordering))
+    {
+      goto cleanup;
+    }
+
+  if (!CU_add_test (pipeline_suite, "backend_pipeline_window",
+		    test_backend_pipeline_window))
+    {
+      goto cleanup;
+    }
+
+  if (!CU_add_test (pipeline_suite, "backend_pipeline_timeout",
+		    test_backend_pipeline_timeout))
+    {
+      goto cleanup;
+    }
+
+  if (!CU_add_test (pipeline_suite, "backend_pipeline_cancel",
+		    test_backend_pipeline_cancel))
+    {
+      goto cleanup;
+    }
+
+  if (!CU_add_test (pipeline_suite, "backend_probe", test_backend_probe))
+    {
+      goto cleanup;
+    }
+#endif
+
+  CU_basic_set_mode (CU_BRM_VERBOSE);
+
+  CU_basic_run_tests ();
+  err = CU_get_number_of_tests_failed ();
+
+cleanup:
+  CU_cleanup_registry ();
+  return err || CU_get_error ();
+}
@@ -24,6 +24,49 @@ test_item_iterator_is_dir_or_matches_exts ()
 		   FALSE);
 }
 
+void
+test_connector_get_midi_id_score ()
+{
+  static const guint8 company[] = { 0x42 };
+  static const guint8 family[] = { 0x2d, 0x01 };
+  static const guint8 model[] = { 0x8, 0x0 };
+  struct connector_midi_id company_id = {
+    .company = company,
+    .company_len = sizeof (company)
+  };
+  struct connector_midi_id full_id = {
+    .company = company,
+    .company_len = sizeof (company),
+    .family = family,
+    .family_len = sizeof (family),
+    .model = model,
+    .model_len = sizeof (model)
+  };
+  struct connector connector = {
+    .name = "test",
+    .midi_id = NULL
+  };
+  struct backend_midi_info midi_info = {
+    .company = { 0x42, 0, 0 },
+    .family = { 0x2d, 0x01 },
+    .model = { 0x8, 0x0 },
+    .version = { 0, 0, 0, 0 }
+  };
+
+  printf ("\n");
+
+  CU_ASSERT_EQUAL (connector_get_midi_id_score (&connector, &midi_info), 0);
+
+  connector.midi_id = &company_id;
+  CU_ASSERT_EQUAL (connector_get_midi_id_score (&connector, &midi_info), 1);
+
+  connector.midi_id = &full_id;
+  CU_ASSERT_EQUAL (connector_get_midi_id_score (&connector, &midi_info), 5);
+
+  midi_info.model[0] = 0x9;
+  CU_ASSERT_EQUAL (connector_get_midi_id_score (&connector, &midi_info), -1);
+}
+
 gint
 main (gint argc, gchar *argv[])
 {
@@ -47,6 +90,11 @@ main (gint argc, gchar *argv[])
       goto cleanup;
     }
 
+  if (!CU_add_test (suite, "connector_get_midi_id_score",
+		    test_connector_get_midi_id_score))
+    {
+      goto cleanup;
+    }
 
   CU_basic_set_mode (CU_BRM_VERBOSE);
 
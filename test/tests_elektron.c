@@ -1,5 +1,8 @@
 #include <string.h>
 #include <math.h>
+#include <zlib.h>
+#include <utime.h>
+#include <glib/gstdio.h>
 #include <CUnit/CUnit.h>
 #include <CUnit/Basic.h>
 #include "../config.h"
@@ -7,6 +10,10 @@
 #include "../src/utils.h"
 #include "../src/connectors/elektron_pkg.h"
 #include "../src/connectors/elektron.h"
+#include "../src/connectors/elektron_cache.h"
+#if defined(ELEKTROID_LOOPBACK)
+#include "../src/loopback/loopback.h"
+#endif
 
 gchar *elektron_get_dev_ext (struct backend *backend,
 			     const struct fs_operations *ops);
@@ -24,6 +31,231 @@ gint elektron_set_sample_from_data_sample (struct idata *sample,
 gint elektron_set_data_sample_from_sample (struct idata *data_sample,
 					   struct idata *data_footer,
 					   struct idata *sample, guint slot);
+void elektron_get_sample_hash_size (struct idata *sample, guint32 * hash,
+				    guint32 * size);
+guint32 elektron_get_list_msg_next_start (const GByteArray * msg);
+
+#if defined(ELEKTROID_LOOPBACK)
+
+gint backend_init_int (struct backend *, const gchar *);
+void backend_destroy_int (struct backend *);
+
+gint elektron_tx_and_rx_blks (struct backend *backend,
+			      GByteArray * (*new_msg_blk) (guint, void *),
+			      gint (*process_reply) (guint, GByteArray *,
+						     void *), void *data,
+			      struct controllable *controllable);
+
+#define TEST_BLKS 8
+#define TEST_BLK_FAILING 3
+
+//Block requests are answered with the status in the request. Block 5 gets a reply with another sequence first.
+static const gchar *BLKS_SCRIPT =
+  "f0 00 20 3c 10 00 ?? ?? ?? 00 00 42 05 ?? f7 -> "
+  "f0 00 20 3c 10 00 04 00 00 7f 7f 42 01 00 f7 | "
+  "f0 00 20 3c 10 00 04 00 00 $7 $8 42 $13 00 f7\n"
+  "f0 00 20 3c 10 00 ?? ?? ?? 00 00 42 ?? ?? f7 -> "
+  "f0 00 20 3c 10 00 04 00 00 $7 $8 42 $13 00 f7\n";
+
+struct test_blks_data
+{
+  guint sent[TEST_BLKS];
+  guint replies[TEST_BLKS];
+  guint next_reply;
+  gboolean in_order;
+  gint fail;			//Number of times TEST_BLK_FAILING fails.
+};
+
+static GByteArray *
+test_blks_new_msg (guint blk, void *data)
+{
+  GByteArray *msg;
+  struct test_blks_data *blks_data = data;
+  guint8 payload[] = { 0, 0, 0, 0, 0x42, blk, 1 };
+
+  if (blk == TEST_BLKS)
+    {
+      return NULL;
+    }
+
+  blks_data->sent[blk]++;
+  msg = g_byte_array_new ();
+  g_byte_array_append (msg, payload, sizeof (payload));
+  return msg;
+}
+
+static gint
+test_blks_reply (guint blk, GByteArray *rx_msg, void *data)
+{
+  struct test_blks_data *blks_data = data;
+
+  if (rx_msg->data[5] != 1)
+    {
+      return -EIO;
+    }
+
+  if (blk == TEST_BLK_FAILING && blks_data->fail)
+    {
+      blks_data->fail--;
+      return -EIO;
+    }
+
+  if (blk != blks_data->next_reply)
+    {
+      blks_data->in_order = FALSE;
+    }
+  blks_data->next_reply++;
+  blks_data->replies[blk]++;
+
+  return 0;
+}
+
+static struct backend blks_backend;
+static struct elektron_data blks_elektron_data;
+static gchar *blks_dir;
+static gchar *blks_script;
+
+static gint
+init_blks_suite ()
+{
+  blks_dir = g_dir_make_tmp ("elektroid-XXXXXX", NULL);
+  if (!blks_dir)
+    {
+      return 1;
+    }
+
+  blks_script = g_build_filename (blks_dir, LOOPBACK_SCRIPT_FILE, NULL);
+  if (!g_file_set_contents (blks_script, BLKS_SCRIPT, -1, NULL))
+    {
+      return 1;
+    }
+
+  g_setenv (LOOPBACK_ENV_DIR, blks_dir, TRUE);
+  g_setenv (LOOPBACK_ENV_SCRIPT, blks_script, TRUE);
+
+  blks_backend.data = &blks_elektron_data;
+  return backend_init_int (&blks_backend, "script");
+}
+
+static gint
+clean_blks_suite ()
+{
+  gchar *dir;
+
+  backend_destroy_int (&blks_backend);
+
+  g_unlink (blks_script);
+  g_free (blks_script);
+  dir = g_build_filename (blks_dir, "script", NULL);
+  g_rmdir (dir);
+  g_free (dir);
+  g_rmdir (blks_dir);
+  g_free (blks_dir);
+
+  return 0;
+}
+
+static void
+test_blks_run (guint window, gint fail, struct test_blks_data *data)
+{
+  gint err;
+  struct controllable controllable;
+
+  controllable_init (&controllable);
+  controllable_set_active (&controllable, TRUE);
+
+  memset (data, 0, sizeof (struct test_blks_data));
+  data->in_order = TRUE;
+  data->fail = fail;
+
+  blks_elektron_data.seq = 0;
+  blks_elektron_data.window = window;
+
+  err = elektron_tx_and_rx_blks (&blks_backend, test_blks_new_msg,
+				 test_blks_reply, data, &controllable);
+  CU_ASSERT_EQUAL (err, 0);
+  CU_ASSERT_TRUE (data->in_order);
+  for (guint i = 0; i < TEST_BLKS; i++)
+    {
+      CU_ASSERT_EQUAL (data->replies[i], 1);
+    }
+
+  controllable_clear (&controllable);
+}
+
+static void
+test_elektron_tx_and_rx_blks ()
+{
+  struct test_blks_data data;
+
+  printf ("\n");
+
+  //Every block is sent once and the reply with an unknown sequence is discarded.
+  test_blks_run (4, 0, &data);
+  for (guint i = 0; i < TEST_BLKS; i++)
+    {
+      CU_ASSERT_EQUAL (data.sent[i], 1);
+    }
+  CU_ASSERT_EQUAL (blks_elektron_data.window, 4);
+}
+
+static void
+test_elektron_tx_and_rx_blks_retry ()
+{
+  struct test_blks_data data;
+
+  printf ("\n");
+
+  //The failing block and the ones in flight after it are sent again and the window falls back to 1 until the transfer succeeds.
+  test_blks_run (4, 1, &data);
+  for (guint i = 0; i < TEST_BLK_FAILING; i++)
+    {
+      CU_ASSERT_EQUAL (data.sent[i], 1);
+    }
+  CU_ASSERT_EQUAL (data.sent[TEST_BLK_FAILING], 2);
+  for (guint i = TEST_BLK_FAILING + 4; i < TEST_BLKS; i++)
+    {
+      CU_ASSERT_EQUAL (data.sent[i], 1);
+    }
+  CU_ASSERT_EQUAL (blks_elektron_data.window, 4);
+
+  //Without pipelining, only the failing block is sent again.
+  test_blks_run (1, 2, &data);
+  for (guint i = 0; i < TEST_BLKS; i++)
+    {
+      CU_ASSERT_EQUAL (data.sent[i], i == TEST_BLK_FAILING ? 3 : 1);
+    }
+  CU_ASSERT_EQUAL (blks_elektron_data.window, 1);
+}
+
+static void
+test_elektron_tx_and_rx_blks_too_many_retries ()
+{
+  gint err;
+  struct test_blks_data data;
+  struct controllable controllable;
+
+  printf ("\n");
+
+  controllable_init (&controllable);
+  controllable_set_active (&controllable, TRUE);
+
+  memset (&data, 0, sizeof (struct test_blks_data));
+  data.fail = G_MAXINT;
+
+  blks_elektron_data.seq = 0;
+  blks_elektron_data.window = 1;
+
+  err = elektron_tx_and_rx_blks (&blks_backend, test_blks_new_msg,
+				 test_blks_reply, &data, &controllable);
+  CU_ASSERT_EQUAL (err, -EIO);
+  CU_ASSERT_EQUAL (data.sent[TEST_BLK_FAILING], 4);
+  CU_ASSERT_EQUAL (data.sent[TEST_BLK_FAILING + 1], 0);
+
+  controllable_clear (&controllable);
+}
+
+#endif
 
 static void
 test_elektron_get_dev_exts ()
@@ -253,6 +485,246 @@ test_elektron_data_sample ()
   g_byte_array_free (content_after, TRUE);
 }
 
+static void
+test_elektron_get_sample_hash_size ()
+{
+  guint32 hash, size, expected;
+  struct idata sample;
+  struct sample_info *sample_info;
+  GByteArray *content = g_byte_array_new ();
+  guint16 frames[] = { 0x0102, 0x0304 };
+  //Header of a mono sample with 4 bytes, 48 kHz, loop from 0 to 1 and forward loop followed by the big endian frames.
+  //No hash and size pairs computed by a device are available yet, so this only pins the layout and the CRC used.
+  guint8 stored[68] = {
+    0, 0, 0, 0, 0, 0, 0, 4, 0, 0, 0xbb, 0x80, 0, 0, 0, 0, 0, 0, 0, 1, 0
+  };
+
+  printf ("\n");
+
+  stored[64] = 1;
+  stored[65] = 2;
+  stored[66] = 3;
+  stored[67] = 4;
+  expected = crc32 (0xffffffff, stored, sizeof (stored));
+
+  g_byte_array_append (content, (guint8 *) frames, sizeof (frames));
+  sample_info = sample_info_new (FALSE);
+  sample_info->channels = 1;
+  sample_info->frames = 2;
+  sample_info->loop_start = 0;
+  sample_info->loop_end = 1;
+  sample_info->loop_type = 0;
+  idata_init (&sample, content, NULL, sample_info, sample_info_free);
+
+  elektron_get_sample_hash_size (&sample, &hash, &size);
+
+  CU_ASSERT_EQUAL (size, sizeof (stored));
+  CU_ASSERT_EQUAL (hash, expected);
+
+  idata_clear (&sample);
+}
+
+static guint32
+test_list_next_start (guint32 start, guint32 end, guint32 total)
+{
+  guint32 next;
+  guint32 fields[] = { g_htonl (start), g_htonl (end), g_htonl (total) };
+  guint8 header[] = { 0, 0, 0, 0, 0xb0, 1 };
+  GByteArray *msg = g_byte_array_new ();
+
+  g_byte_array_append (msg, header, sizeof (header));
+  g_byte_array_append (msg, (guint8 *) fields, sizeof (fields));
+  next = elektron_get_list_msg_next_start (msg);
+  free_msg (msg);
+
+  return next;
+}
+
+static void
+test_elektron_get_list_msg_next_start ()
+{
+  GByteArray *msg;
+
+  printf ("\n");
+
+  //Whole listing.
+  CU_ASSERT_EQUAL (test_list_next_start (0, 300, 300), 0);
+
+  CU_ASSERT_EQUAL (test_list_next_start (0, 128, 300), 128);
+  CU_ASSERT_EQUAL (test_list_next_start (128, 256, 300), 256);
+  CU_ASSERT_EQUAL (test_list_next_start (256, 300, 300), 0);
+
+  //An empty page moves to the next one until the total is reached.
+  CU_ASSERT_EQUAL (test_list_next_start (128, 128, 400), 256);
+  CU_ASSERT_EQUAL (test_list_next_start (256, 256, 300), 0);
+
+  msg = g_byte_array_new ();
+  CU_ASSERT_EQUAL (elektron_get_list_msg_next_start (msg), 0);
+  free_msg (msg);
+}
+
+#define TEST_CACHE_FILE_SIZE 100
+
+static gchar *cache_home;
+
+//The cache lives in the user directory so the home is replaced by a temporary one.
+
+static gint
+init_cache_suite ()
+{
+  gchar *home;
+  gint err;
+
+  cache_home = g_dir_make_tmp ("elektroid-tests-XXXXXX", NULL);
+  if (!cache_home)
+    {
+      return 1;
+    }
+
+  g_setenv ("HOME", cache_home, TRUE);
+
+  //GLib caches the home so the real one might already be in use.
+  home = get_user_dir (NULL);
+  err = strcmp (home, cache_home) != 0;
+  g_free (home);
+
+  return err;
+}
+
+static gint
+clean_cache_suite ()
+{
+  GDir *dir;
+  const gchar *name;
+  gchar *path, *cache_dir = get_user_dir (CONF_DIR ELEKTRON_CACHE_DIR);
+
+  dir = g_dir_open (cache_dir, 0, NULL);
+  if (dir)
+    {
+      while ((name = g_dir_read_name (dir)))
+	{
+	  path = path_chain (PATH_SYSTEM, cache_dir, name);
+	  g_unlink (path);
+	  g_free (path);
+	}
+      g_dir_close (dir);
+    }
+
+  //Every directory up to the temporary home is removed.
+  while (strcmp (cache_dir, cache_home))
+    {
+      g_rmdir (cache_dir);
+      path = g_path_get_dirname (cache_dir);
+      g_free (cache_dir);
+      cache_dir = path;
+    }
+  g_rmdir (cache_home);
+
+  g_free (cache_dir);
+  g_free (cache_home);
+  return 0;
+}
+
+static GByteArray *
+test_cache_new_content (guint8 value)
+{
+  GByteArray *content = g_byte_array_sized_new (TEST_CACHE_FILE_SIZE);
+  g_byte_array_set_size (content, TEST_CACHE_FILE_SIZE);
+  memset (content->data, value, TEST_CACHE_FILE_SIZE);
+  return content;
+}
+
+static void
+test_cache_set_mtime (guint32 hash, time_t mtime)
+{
+  gchar name[LABEL_MAX];
+  gchar *dir = get_user_dir (CONF_DIR ELEKTRON_CACHE_DIR);
+  gchar *path;
+  struct utimbuf times;
+
+  snprintf (name, LABEL_MAX, "%08x-%u", hash, TEST_CACHE_FILE_SIZE);
+  path = path_chain (PATH_SYSTEM, dir, name);
+
+  times.actime = mtime;
+  times.modtime = mtime;
+  CU_ASSERT_EQUAL (g_utime (path, &times), 0);
+
+  g_free (path);
+  g_free (dir);
+}
+
+static void
+test_elektron_cache_get_put ()
+{
+  GByteArray *content, *cached;
+
+  printf ("\n");
+
+  content = test_cache_new_content (1);
+
+  CU_ASSERT_PTR_NULL (elektron_cache_get (1, TEST_CACHE_FILE_SIZE));
+
+  elektron_cache_put (1, TEST_CACHE_FILE_SIZE, content, MI);
+  cached = elektron_cache_get (1, TEST_CACHE_FILE_SIZE);
+  CU_ASSERT_PTR_NOT_NULL_FATAL (cached);
+  CU_ASSERT_EQUAL (cached->len, TEST_CACHE_FILE_SIZE);
+  CU_ASSERT_EQUAL (memcmp (cached->data, content->data, content->len), 0);
+  free_msg (cached);
+
+  //The same hash with another size is another file.
+  CU_ASSERT_PTR_NULL (elektron_cache_get (1, TEST_CACHE_FILE_SIZE + 1));
+
+  //Content that does not match the size or does not fit in the cache is not stored.
+  elektron_cache_put (2, TEST_CACHE_FILE_SIZE + 1, content, MI);
+  CU_ASSERT_PTR_NULL (elektron_cache_get (2, TEST_CACHE_FILE_SIZE + 1));
+  elektron_cache_put (3, TEST_CACHE_FILE_SIZE, content,
+		      TEST_CACHE_FILE_SIZE - 1);
+  CU_ASSERT_PTR_NULL (elektron_cache_get (3, TEST_CACHE_FILE_SIZE));
+
+  free_msg (content);
+}
+
+static void
+test_elektron_cache_eviction ()
+{
+  GByteArray *a, *b, *c, *cached;
+  guint64 limit = TEST_CACHE_FILE_SIZE * 2.5;
+
+  printf ("\n");
+
+  a = test_cache_new_content (0xa);
+  b = test_cache_new_content (0xb);
+  c = test_cache_new_content (0xc);
+
+  elektron_cache_put (0xa, TEST_CACHE_FILE_SIZE, a, limit);
+  test_cache_set_mtime (0xa, 1000);
+  elektron_cache_put (0xb, TEST_CACHE_FILE_SIZE, b, limit);
+  test_cache_set_mtime (0xb, 2000);
+
+  //A hit makes a the most recently used file so b is the one removed.
+  cached = elektron_cache_get (0xa, TEST_CACHE_FILE_SIZE);
+  CU_ASSERT_PTR_NOT_NULL (cached);
+  free_msg (cached);
+
+  elektron_cache_put (0xc, TEST_CACHE_FILE_SIZE, c, limit);
+
+  cached = elektron_cache_get (0xb, TEST_CACHE_FILE_SIZE);
+  CU_ASSERT_PTR_NULL (cached);
+
+  cached = elektron_cache_get (0xa, TEST_CACHE_FILE_SIZE);
+  CU_ASSERT_PTR_NOT_NULL (cached);
+  free_msg (cached);
+
+  cached = elektron_cache_get (0xc, TEST_CACHE_FILE_SIZE);
+  CU_ASSERT_PTR_NOT_NULL_FATAL (cached);
+  CU_ASSERT_EQUAL (memcmp (cached->data, c->data, c->len), 0);
+  free_msg (cached);
+
+  free_msg (a);
+  free_msg (b);
+  free_msg (c);
+}
+
 gint
 main (gint argc, gchar *argv[])
 {
@@ -264,6 +736,28 @@ main (gint argc, gchar *argv[])
     {
       goto cleanup;
     }
+
+  //This suite goes first as it needs to set the home before GLib caches it.
+  CU_pSuite cache_suite = CU_add_suite ("Elektroid elektron cache tests",
+					init_cache_suite,
+					clean_cache_suite);
+  if (!cache_suite)
+    {
+      goto cleanup;
+    }
+
+  if (!CU_add_test (cache_suite, "elektron_cache_get_put",
+		    test_elektron_cache_get_put))
+    {
+      goto cleanup;
+    }
+
+  if (!CU_add_test (cache_suite, "elektron_cache_eviction",
+		    test_elektron_cache_eviction))
+    {
+      goto cleanup;
+    }
+
   CU_pSuite suite = CU_add_suite ("Elektroid elektron tests", 0, 0);
   if (!suite)
     {
@@ -293,6 +787,45 @@ main (gint argc, gchar *argv[])
       goto cleanup;
     }
 
+  if (!CU_add_test (suite, "elektron_get_sample_hash_size",
+		    test_elektron_get_sample_hash_size))
+    {
+      goto cleanup;
+    }
+
+  if (!CU_add_test (suite, "elektron_get_list_msg_next_start",
+		    test_elektron_get_list_msg_next_start))
+    {
+      goto cleanup;
+    }
+
+#if defined(ELEKTROID_LOOPBACK)
+  CU_pSuite blks_suite = CU_add_suite ("Elektroid elektron block tests",
+				       init_blks_suite, clean_blks_suite);
+  if (!blks_suite)
+    {
+      goto cleanup;
+    }
+
+  if (!CU_add_test (blks_suite, "elektron_tx_and_rx_blks",
+		    test_elektron_tx_and_rx_blks))
+    {
+      goto cleanup;
+    }
+
+  if (!CU_add_test (blks_suite, "elektron_tx_and_rx_blks_retry",
+		    test_elektron_tx_and_rx_blks_retry))
+    {
+      goto cleanup;
+    }
+
+  if (!CU_add_test (blks_suite, "elektron_tx_and_rx_blks_too_many_retries",
+		    test_elektron_tx_and_rx_blks_too_many_retries))
+    {
+      goto cleanup;
+    }
+#endif
+
   CU_basic_set_mode (CU_BRM_VERBOSE);
 
   CU_basic_run_tests ();